@@ -9,6 +9,7 @@
 #include "buffers.h"
 #include "config.h"
 #include "rsp-recorder.h"
+#include "sdrplay-rsp.h"
 
 #include <stdbool.h>
 #include <stdio.h>
@@ -16,25 +17,31 @@
 
 
 /* global variables */
-ResourceDescriptor blocks_resource;
-ResourceDescriptor samples_resource;
-short *insamples = NULL;
+ResourceDescriptor blocks_resource_A;
+ResourceDescriptor blocks_resource_B;
+ResourceDescriptor samples_resource_A;
+ResourceDescriptor samples_resource_B;
 TimeInfo timeinfo;
 ResourceDescriptor gain_changes_resource;
+EventRecords event_records;
 
 
-static BlockDescriptor *blocks;
-static TimeMarker *markers = NULL;
+static BlockDescriptor *blocks[2] = {NULL, NULL};
+static short *insamples[2] = {NULL, NULL};
 static GainChange *gain_changes = NULL;
-static bool is_blocks_buffer_allocated = false;
-static bool is_insamples_buffer_allocated = false;
-static bool is_time_markers_buffer_allocated = false;
+static bool is_blocks_buffer_allocated[2] = {false, false};
+static bool is_insamples_buffer_allocated[2] = {false, false};
 static bool is_gain_changes_buffer_allocated = false;
 
 static pthread_mutex_t blocks_lock;
 static pthread_cond_t is_ready;
-static pthread_mutex_t samples_lock;
+static pthread_mutex_t samples_lock[2];
 static pthread_mutex_t gain_changes_lock;
+static pthread_mutex_t time_markers_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t event_records_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* internal functions */
+static int create_tuner_buffers(int tuner, ResourceDescriptor *blocks_resource, ResourceDescriptor *samples_resource);
 
 
 int buffers_create() {
@@ -50,67 +57,57 @@ int buffers_create() {
         fprintf(stderr, "pthread_cond_init(is_ready) failed - errcode=%d\n", errcode);
         return -1;
     }
-    blocks = (BlockDescriptor *)malloc(blocks_buffer_capacity * sizeof(BlockDescriptor));
-    if (blocks == NULL) {
-        fprintf(stderr, "malloc(blocks) failed\n");
-        return -1;
-    }
-    is_blocks_buffer_allocated = true;
-    blocks_resource = (ResourceDescriptor) {
-        .lock = &blocks_lock,
-        .resource = blocks,
-        .read_index = 0,
-        .write_index = 0,
-        .size = blocks_buffer_capacity,
-        .nused = 0,
-        .nused_max = 0,
-        .nready = 0,
-        .is_ready = &is_ready,
-    };
 
-    errcode = pthread_mutex_init(&samples_lock, NULL);
-    if (errcode != 0) {
-        fprintf(stderr, "pthread_mutex_init(samples_lock) failed - errcode=%d\n", errcode);
+    if (create_tuner_buffers(0, &blocks_resource_A, &samples_resource_A) == -1) {
         return -1;
     }
-    insamples = (short *)malloc(samples_buffer_capacity * sizeof(short));
-    if (insamples == NULL) {
-        fprintf(stderr, "malloc(insamples) failed\n");
-        return -1;
+    if (is_dual_tuner) {
+        if (create_tuner_buffers(1, &blocks_resource_B, &samples_resource_B) == -1) {
+            return -1;
+        }
     }
-    is_insamples_buffer_allocated = true;
-    samples_resource = (ResourceDescriptor) {
-        .lock = &samples_lock,
-        .resource = insamples,
-        .read_index = 0,
-        .write_index = 0,
-        .size = samples_buffer_capacity,
-        .nused = 0,
-        .nused_max = 0,
-        .nready = 0,
-        .is_ready = NULL,
-    };
 
-    int markers_max_idx = 0;
-    if (marker_interval > 0) {
-        /* add two extra slots to also store the start time marker and
-         * because integer division truncates
-        */
-        markers_max_idx = streaming_time / marker_interval + 2;
-        markers = (TimeMarker *)malloc(markers_max_idx * sizeof(TimeMarker));
-        if (markers == NULL) {
-            markers_max_idx = 0;
+    /* the markers are added by the writer, which allocates a new chunk
+     * every TIME_MARKERS_CHUNK_SIZE markers
+     */
+    TimeMarkersChunk *markers_chunk = NULL;
+    if (marker_interval > 0 || marker_interval_samples > 0) {
+        markers_chunk = (TimeMarkersChunk *)malloc(sizeof(TimeMarkersChunk));
+        if (markers_chunk == NULL) {
+            fprintf(stderr, "malloc(time markers) failed\n");
+            return -1;
         }
-        is_time_markers_buffer_allocated = true;
+        markers_chunk->next = NULL;
+        markers_chunk->num_markers = 0;
     }
     timeinfo = (TimeInfo) {
         .start_ts = {0L, 0L},
         .stop_ts = {0L, 0L},
-        .markers = markers,
+        .markers_first = markers_chunk,
+        .markers_last = markers_chunk,
+        .num_markers = 0,
+        .markers_lost = 0,
         .timetick_curr = 0L,
         .marker_interval = marker_interval,
-        .markers_curr_idx = 0,
-        .markers_max_idx = markers_max_idx,
+        .marker_interval_samples = marker_interval_samples,
+        .next_marker_sample_num = 0,
+    };
+
+    EventRecordsChunk *records_chunk = NULL;
+    if (events_chunk_enable) {
+        records_chunk = (EventRecordsChunk *)malloc(sizeof(EventRecordsChunk));
+        if (records_chunk == NULL) {
+            fprintf(stderr, "malloc(event records) failed\n");
+            return -1;
+        }
+        records_chunk->next = NULL;
+        records_chunk->num_records = 0;
+    }
+    event_records = (EventRecords) {
+        .first = records_chunk,
+        .last = records_chunk,
+        .num_records = 0,
+        .records_lost = 0,
     };
 
     unsigned int gain_changes_size = 0;
@@ -149,19 +146,166 @@ void buffers_free() {
         gain_changes = NULL;
         is_gain_changes_buffer_allocated = false;
     }
-    if (is_time_markers_buffer_allocated) {
-        free(markers);
-        markers = NULL;
-        is_time_markers_buffer_allocated = false;
+    TimeMarkersChunk *markers_chunk = timeinfo.markers_first;
+    while (markers_chunk != NULL) {
+        TimeMarkersChunk *next = markers_chunk->next;
+        free(markers_chunk);
+        markers_chunk = next;
+    }
+    timeinfo.markers_first = NULL;
+    timeinfo.markers_last = NULL;
+    EventRecordsChunk *records_chunk = event_records.first;
+    while (records_chunk != NULL) {
+        EventRecordsChunk *next = records_chunk->next;
+        free(records_chunk);
+        records_chunk = next;
+    }
+    event_records.first = NULL;
+    event_records.last = NULL;
+    for (int tuner = 0; tuner < 2; tuner++) {
+        if (is_insamples_buffer_allocated[tuner]) {
+            free(insamples[tuner]);
+            insamples[tuner] = NULL;
+            is_insamples_buffer_allocated[tuner] = false;
+        }
+        if (is_blocks_buffer_allocated[tuner]) {
+            free(blocks[tuner]);
+            blocks[tuner] = NULL;
+            is_blocks_buffer_allocated[tuner] = false;
+        }
+    }
+}
+
+/* called by the writer for each block of tuner A; 'ts' is the time the
+ * block was received, and 'sample_num' the position of its first sample
+ * in the output file
+ */
+void time_markers_update(TimeInfo *timeinfo, const struct timespec *ts, unsigned long long sample_num) {
+    if (timeinfo->markers_last == NULL) {
+        return;
+    }
+    bool is_marker_due = false;
+    if (timeinfo->marker_interval > 0) {
+        time_t timetick_curr = ts->tv_sec / timeinfo->marker_interval;
+        if (timetick_curr > timeinfo->timetick_curr) {
+            is_marker_due = true;
+            timeinfo->timetick_curr = timetick_curr;
+        }
+    }
+    if (timeinfo->marker_interval_samples > 0 && sample_num >= timeinfo->next_marker_sample_num) {
+        is_marker_due = true;
+        timeinfo->next_marker_sample_num = (sample_num / timeinfo->marker_interval_samples + 1) * timeinfo->marker_interval_samples;
+    }
+    if (is_marker_due) {
+        time_markers_add(timeinfo, ts, sample_num);
+    }
+}
+
+int time_markers_add(TimeInfo *timeinfo, const struct timespec *ts, unsigned long long sample_num) {
+    pthread_mutex_lock(&time_markers_lock);
+    TimeMarkersChunk *markers_chunk = timeinfo->markers_last;
+    if (markers_chunk->num_markers == TIME_MARKERS_CHUNK_SIZE) {
+        TimeMarkersChunk *new_chunk = (TimeMarkersChunk *)malloc(sizeof(TimeMarkersChunk));
+        if (new_chunk == NULL) {
+            timeinfo->markers_lost++;
+            pthread_mutex_unlock(&time_markers_lock);
+            return -1;
+        }
+        new_chunk->next = NULL;
+        new_chunk->num_markers = 0;
+        markers_chunk->next = new_chunk;
+        timeinfo->markers_last = new_chunk;
+        markers_chunk = new_chunk;
     }
-    if (is_insamples_buffer_allocated) {
-        free(insamples);
-        insamples = NULL;
-        is_insamples_buffer_allocated = false;
+    TimeMarker *tm = &markers_chunk->markers[markers_chunk->num_markers];
+    tm->ts.tv_sec = ts->tv_sec;
+    tm->ts.tv_nsec = ts->tv_nsec;
+    tm->sample_num = sample_num;
+    markers_chunk->num_markers++;
+    timeinfo->num_markers++;
+    pthread_mutex_unlock(&time_markers_lock);
+    return 0;
+}
+
+/* number of time markers completely written; the markers never move in
+ * memory, so these can be read while the writer adds new ones
+ */
+unsigned long long time_markers_count(TimeInfo *timeinfo) {
+    pthread_mutex_lock(&time_markers_lock);
+    unsigned long long num_markers = timeinfo->num_markers;
+    pthread_mutex_unlock(&time_markers_lock);
+    return num_markers;
+}
+
+/* with one file per tuner the two writers add events */
+int event_records_add(EventRecords *event_records, const EventRecord *record) {
+    pthread_mutex_lock(&event_records_lock);
+    EventRecordsChunk *records_chunk = event_records->last;
+    if (records_chunk->num_records == EVENT_RECORDS_CHUNK_SIZE) {
+        EventRecordsChunk *new_chunk = (EventRecordsChunk *)malloc(sizeof(EventRecordsChunk));
+        if (new_chunk == NULL) {
+            event_records->records_lost++;
+            pthread_mutex_unlock(&event_records_lock);
+            return -1;
+        }
+        new_chunk->next = NULL;
+        new_chunk->num_records = 0;
+        records_chunk->next = new_chunk;
+        event_records->last = new_chunk;
+        records_chunk = new_chunk;
     }
-    if (is_blocks_buffer_allocated) {
-        free(blocks);
-        blocks = NULL;
-        is_blocks_buffer_allocated = false;
+    records_chunk->records[records_chunk->num_records] = *record;
+    records_chunk->num_records++;
+    event_records->num_records++;
+    pthread_mutex_unlock(&event_records_lock);
+    return 0;
+}
+
+/* internal functions */
+static int create_tuner_buffers(int tuner, ResourceDescriptor *blocks_resource, ResourceDescriptor *samples_resource) {
+    int errcode;
+    char tuner_id = 'A' + tuner;
+
+    blocks[tuner] = (BlockDescriptor *)malloc(blocks_buffer_capacity * sizeof(BlockDescriptor));
+    if (blocks[tuner] == NULL) {
+        fprintf(stderr, "malloc(blocks %c) failed\n", tuner_id);
+        return -1;
     }
+    is_blocks_buffer_allocated[tuner] = true;
+    *blocks_resource = (ResourceDescriptor) {
+        .lock = &blocks_lock,
+        .resource = blocks[tuner],
+        .read_index = 0,
+        .write_index = 0,
+        .size = blocks_buffer_capacity,
+        .nused = 0,
+        .nused_max = 0,
+        .nready = 0,
+        .is_ready = &is_ready,
+    };
+
+    errcode = pthread_mutex_init(&samples_lock[tuner], NULL);
+    if (errcode != 0) {
+        fprintf(stderr, "pthread_mutex_init(samples_lock %c) failed - errcode=%d\n", tuner_id, errcode);
+        return -1;
+    }
+    insamples[tuner] = (short *)malloc(samples_buffer_capacity * sizeof(short));
+    if (insamples[tuner] == NULL) {
+        fprintf(stderr, "malloc(insamples %c) failed\n", tuner_id);
+        return -1;
+    }
+    is_insamples_buffer_allocated[tuner] = true;
+    *samples_resource = (ResourceDescriptor) {
+        .lock = &samples_lock[tuner],
+        .resource = insamples[tuner],
+        .read_index = 0,
+        .write_index = 0,
+        .size = samples_buffer_capacity,
+        .nused = 0,
+        .nused_max = 0,
+        .nready = 0,
+        .is_ready = NULL,
+    };
+
+    return 0;
 }
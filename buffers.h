@@ -11,12 +11,24 @@
 
 #include <pthread.h>
 #include <stdint.h>
+#include <time.h>
 
 /* typedefs */
 typedef struct {
     unsigned int first_sample_num;
     unsigned int num_samples;
     unsigned int samples_index;
+    unsigned int clipped_values;            /* I and Q values at full scale */
+    unsigned int near_full_scale_values;    /* I and Q values at or above the overload threshold */
+    unsigned short peak;                    /* largest absolute I or Q value */
+    /* tuner state when the block was received */
+    unsigned int gain_changes;              /* gain change events so far */
+    unsigned int overload_detected;         /* power overload detected events so far */
+    unsigned int overload_corrected;        /* power overload corrected events so far */
+    float currGain;
+    uint8_t gRdB;
+    uint8_t lnaGRdB;
+    struct timespec ts;                     /* time of the RX callback */
     char rx_id;
 } BlockDescriptor;
 
@@ -37,14 +49,28 @@ typedef struct {
    unsigned long long sample_num;
 } TimeMarker;
 
+/* time markers are stored in a list of fixed size chunks, so the number
+ * of markers is not limited and the markers never move in memory
+ */
+#define TIME_MARKERS_CHUNK_SIZE 1024
+
+typedef struct TimeMarkersChunk {
+    struct TimeMarkersChunk *next;
+    unsigned int num_markers;
+    TimeMarker markers[TIME_MARKERS_CHUNK_SIZE];
+} TimeMarkersChunk;
+
 typedef struct {
     struct timespec start_ts;
     struct timespec stop_ts;
-    TimeMarker *markers;
+    TimeMarkersChunk *markers_first;    /* NULL if time markers are disabled */
+    TimeMarkersChunk *markers_last;
+    unsigned long long num_markers;
+    unsigned long long markers_lost;
     time_t timetick_curr;
     int marker_interval;
-    int markers_curr_idx;
-    int markers_max_idx;
+    unsigned long long marker_interval_samples;
+    unsigned long long next_marker_sample_num;
 } TimeInfo;
 
 typedef struct {
@@ -56,15 +82,60 @@ typedef struct {
     uint8_t unused;
 } GainChange;
 
+/* gain and power overload events, stored in the same 16 byte format as
+ * the gains file (the last byte is the event type), and embedded in the
+ * WAV file when it is finalized
+ */
+#define EVENT_TYPE_GAIN_CHANGE          0
+#define EVENT_TYPE_OVERLOAD_DETECTED    1
+#define EVENT_TYPE_OVERLOAD_CORRECTED   2
+
+typedef struct {
+    uint64_t sample_num;
+    float currGain;
+    uint8_t tuner;
+    uint8_t gRdB;
+    uint8_t lnaGRdB;
+    uint8_t type;
+} EventRecord;
+
+/* like the time markers, the events are stored in a list of fixed size
+ * chunks, so the writers never have to move them
+ */
+#define EVENT_RECORDS_CHUNK_SIZE 1024
+
+typedef struct EventRecordsChunk {
+    struct EventRecordsChunk *next;
+    unsigned int num_records;
+    EventRecord records[EVENT_RECORDS_CHUNK_SIZE];
+} EventRecordsChunk;
+
+typedef struct {
+    EventRecordsChunk *first;   /* NULL if the events chunk is disabled */
+    EventRecordsChunk *last;
+    unsigned long long num_records;
+    unsigned long long records_lost;
+} EventRecords;
+
 /* global variables */
-extern ResourceDescriptor blocks_resource;
-extern ResourceDescriptor samples_resource;
-extern short *insamples;
+/* one blocks ring and one samples ring per tuner; the two blocks rings
+ * share the same lock and condition variable, so the writer can wait
+ * for data from either tuner
+ */
+extern ResourceDescriptor blocks_resource_A;
+extern ResourceDescriptor blocks_resource_B;
+extern ResourceDescriptor samples_resource_A;
+extern ResourceDescriptor samples_resource_B;
 extern TimeInfo timeinfo; 
 extern ResourceDescriptor gain_changes_resource;
+extern EventRecords event_records;
 
 /* public functions */
 int buffers_create();
 void buffers_free();
+void time_markers_update(TimeInfo *timeinfo, const struct timespec *ts, unsigned long long sample_num);
+int time_markers_add(TimeInfo *timeinfo, const struct timespec *ts, unsigned long long sample_num);
+unsigned long long time_markers_count(TimeInfo *timeinfo);
+int event_records_add(EventRecords *event_records, const EventRecord *record);
 
 #endif /* _BUFFERS_H */
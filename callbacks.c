@@ -7,10 +7,12 @@
  */
 
 #include <limits.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <string.h>
 
 #include "callbacks.h"
+#include "sample-scale.h"
 #include "sdrplay-rsp.h"
 #include "streaming.h"
 
@@ -20,13 +22,17 @@
 unsigned long long num_gain_changes[2] = {0L, 0L};
 unsigned long long num_power_overload_detected[2] = {0L, 0L};
 unsigned long long num_power_overload_corrected[2] = {0L, 0L};
+/* latest gain reduction values (0xff until the first gain change event) */
+uint8_t current_gRdB[2] = {0xff, 0xff};
+uint8_t current_lnaGRdB[2] = {0xff, 0xff};
+float current_gain[2] = {0.0, 0.0};
 
 static unsigned int firstSampleNum = 0;
 
 /* internal functions */
 static void rx_callback(short *xi, short *xq, sdrplay_api_StreamCbParamsT *params, unsigned int numSamples, unsigned int reset, RXContext *rxContext, char rx_id, StreamingStatus streaming_status_rx_callback);
-static void update_timeinfo(TimeInfo *timeinfo, unsigned long long sample_num, StreamingStatus streaming_status_rx_callback);
-static int write_samples_to_circular_buffer(unsigned int num_samples, unsigned int first_sample_num, const short *xi, const short *xq, RXContext *rx_context, char rx_id);
+static void update_timeinfo(TimeInfo *timeinfo, StreamingStatus streaming_status_rx_callback);
+static int write_samples_to_circular_buffer(unsigned int num_samples, unsigned int first_sample_num, const short *xi, const short *xq, const BlockDescriptor *block_stats, RXContext *rx_context, char rx_id);
 
 
 void rxA_callback(short *xi, short *xq, sdrplay_api_StreamCbParamsT *params, unsigned int numSamples, unsigned int reset, void *cbContext)
@@ -34,7 +40,7 @@ void rxA_callback(short *xi, short *xq, sdrplay_api_StreamCbParamsT *params, uns
     StreamingStatus streaming_status_rx_callback = streaming_status;
     firstSampleNum = params->firstSampleNum;
     RXContext *rx_context = ((CallbackContext *)cbContext)->rx_contexts[0];
-    update_timeinfo(rx_context->timeinfo, rx_context->rx_stats->total_samples, streaming_status_rx_callback);
+    update_timeinfo(rx_context->timeinfo, streaming_status_rx_callback);
     rx_callback(xi, xq, params, numSamples, reset, rx_context, 'A', streaming_status_rx_callback);
 }
 
@@ -61,6 +67,9 @@ void event_callback(sdrplay_api_EventT eventId, sdrplay_api_TunerSelectT tuner,
         }
         uint64_t sample_num = streaming_status == STREAMING_STATUS_STARTING ? 0 : *eventContext->total_samples[tuner_index];
         num_gain_changes[tuner_index]++;
+        current_gRdB[tuner_index] = params->gainParams.gRdB;
+        current_lnaGRdB[tuner_index] = params->gainParams.lnaGRdB;
+        current_gain[tuner_index] = params->gainParams.currGain;
         ResourceDescriptor *gain_changes_resource = eventContext->gain_changes_resource;
         if (gain_changes_resource != NULL) {
             pthread_mutex_lock(gain_changes_resource->lock);
@@ -119,7 +128,7 @@ static void rx_callback(short *xi, short *xq, sdrplay_api_StreamCbParamsT *param
         /* just return a block with num_samples set to 0
          * to signal the end of streaming
          */
-        if (write_samples_to_circular_buffer(0, params->firstSampleNum, NULL, NULL, rxContext, rx_id) == -1) {
+        if (write_samples_to_circular_buffer(0, params->firstSampleNum, NULL, NULL, NULL, rxContext, rx_id) == -1) {
             streaming_status_rx_callback = streaming_status;
             return;
         }
@@ -160,49 +169,66 @@ static void rx_callback(short *xi, short *xq, sdrplay_api_StreamCbParamsT *param
     rxStats->num_samples_min = rxStats->num_samples_min < numSamples ? rxStats->num_samples_min : numSamples;
     rxStats->num_samples_max = rxStats->num_samples_max > numSamples ? rxStats->num_samples_max : numSamples;
 
+    /* the values at (or near) full scale are counted in the same pass;
+     * the samples are 14 bit, so clipping is at -8192 and 8191
+     */
     short imin = SHRT_MAX;
     short imax = SHRT_MIN;
     short qmin = SHRT_MAX;
     short qmax = SHRT_MIN;
+    short level = rxContext->near_full_scale_level;
+    unsigned int clipped_values = 0;
+    unsigned int near_full_scale_values = 0;
     for (unsigned int i = 0; i < numSamples; i++) {
         imin = imin < xi[i] ? imin : xi[i];
         imax = imax > xi[i] ? imax : xi[i];
+        clipped_values += (xi[i] >= SAMPLE_MAX_14BIT) | (xi[i] <= SAMPLE_MIN_14BIT);
+        near_full_scale_values += (xi[i] >= level) | (xi[i] <= -level);
     }
     for (unsigned int i = 0; i < numSamples; i++) {
         qmin = qmin < xq[i] ? qmin : xq[i];
         qmax = qmax > xq[i] ? qmax : xq[i];
+        clipped_values += (xq[i] >= SAMPLE_MAX_14BIT) | (xq[i] <= SAMPLE_MIN_14BIT);
+        near_full_scale_values += (xq[i] >= level) | (xq[i] <= -level);
     }
     rxStats->imin = rxStats->imin < imin ? rxStats->imin : imin;
     rxStats->imax = rxStats->imax > imax ? rxStats->imax : imax;
     rxStats->qmin = rxStats->qmin < qmin ? rxStats->qmin : qmin;
     rxStats->qmax = rxStats->qmax > qmax ? rxStats->qmax : qmax;
+    rxStats->clipped_values += clipped_values;
+    rxStats->near_full_scale_values += near_full_scale_values;
 
-    if (write_samples_to_circular_buffer(numSamples, params->firstSampleNum, xi, xq, rxContext, rx_id) == -1) {
+    int peak = -imin > imax ? -imin : imax;
+    peak = -qmin > peak ? -qmin : peak;
+    peak = qmax > peak ? qmax : peak;
+    int tuner_index = rx_id - 'A';
+    BlockDescriptor block_stats = {
+        .clipped_values = clipped_values,
+        .near_full_scale_values = near_full_scale_values,
+        .peak = (unsigned short)peak,
+        .gain_changes = num_gain_changes[tuner_index],
+        .overload_detected = num_power_overload_detected[tuner_index],
+        .overload_corrected = num_power_overload_corrected[tuner_index],
+        .currGain = current_gain[tuner_index],
+        .gRdB = current_gRdB[tuner_index],
+        .lnaGRdB = current_lnaGRdB[tuner_index],
+        .ts = rxStats->latest_callback,
+    };
+
+    if (write_samples_to_circular_buffer(numSamples, params->firstSampleNum, xi, xq, &block_stats, rxContext, rx_id) == -1) {
         streaming_status_rx_callback = streaming_status;
         return;
     }
 }
 
-static void update_timeinfo(TimeInfo *timeinfo, unsigned long long sample_num, StreamingStatus streaming_status_rx_callback) {
+/* the time markers are added by the writer, from the time stamped on
+ * each block
+ */
+static void update_timeinfo(TimeInfo *timeinfo, StreamingStatus streaming_status_rx_callback) {
     if (streaming_status_rx_callback == STREAMING_STATUS_RUNNING) {
         if (timeinfo->start_ts.tv_sec == 0) {
             clock_gettime(CLOCK_REALTIME, &timeinfo->start_ts);
         }
-        if (timeinfo->markers != NULL) {
-            struct timespec ts;
-            clock_gettime(CLOCK_REALTIME, &ts);
-            time_t timetick_curr = ts.tv_sec / timeinfo->marker_interval;
-            if (timetick_curr > timeinfo->timetick_curr) {
-                if (timeinfo->markers_curr_idx < timeinfo->markers_max_idx) {
-                    TimeMarker *tm = &timeinfo->markers[timeinfo->markers_curr_idx];
-                    tm->ts.tv_sec = ts.tv_sec;
-                    tm->ts.tv_nsec = ts.tv_nsec;
-                    tm->sample_num = sample_num;
-                    timeinfo->markers_curr_idx++;
-                }
-                timeinfo->timetick_curr = timetick_curr;
-            }
-        }
     } else if (streaming_status_rx_callback == STREAMING_STATUS_TERMINATE || streaming_status_rx_callback == STREAMING_STATUS_DONE) {
         if (timeinfo->stop_ts.tv_sec == 0) {
             clock_gettime(CLOCK_REALTIME, &timeinfo->stop_ts);
@@ -212,7 +238,7 @@ static void update_timeinfo(TimeInfo *timeinfo, unsigned long long sample_num, S
 
 static int write_samples_to_circular_buffer(unsigned int num_samples,
     unsigned int first_sample_num, const short *xi, const short *xq,
-    RXContext *rx_context, char rx_id) {
+    const BlockDescriptor *block_stats, RXContext *rx_context, char rx_id) {
 
     ResourceDescriptor *samples_resource = NULL;
     unsigned int samples_write_index = 0;
@@ -275,12 +301,22 @@ static int write_samples_to_circular_buffer(unsigned int num_samples,
     block->first_sample_num = first_sample_num;
     block->num_samples = num_samples;
     block->samples_index = samples_write_index;
+    block->clipped_values = block_stats != NULL ? block_stats->clipped_values : 0;
+    block->near_full_scale_values = block_stats != NULL ? block_stats->near_full_scale_values : 0;
+    block->peak = block_stats != NULL ? block_stats->peak : 0;
+    block->gain_changes = block_stats != NULL ? block_stats->gain_changes : 0;
+    block->overload_detected = block_stats != NULL ? block_stats->overload_detected : 0;
+    block->overload_corrected = block_stats != NULL ? block_stats->overload_corrected : 0;
+    block->currGain = block_stats != NULL ? block_stats->currGain : 0.0;
+    block->gRdB = block_stats != NULL ? block_stats->gRdB : 0xff;
+    block->lnaGRdB = block_stats != NULL ? block_stats->lnaGRdB : 0xff;
+    block->ts = block_stats != NULL ? block_stats->ts : (struct timespec) {0, 0};
     block->rx_id = rx_id;
 
     /* all done; let the writer thread know there's data ready */
     pthread_mutex_lock(blocks_resource->lock);
     blocks_resource->nready++;
-    pthread_cond_signal(blocks_resource->is_ready);
+    pthread_cond_broadcast(blocks_resource->is_ready);
     pthread_mutex_unlock(blocks_resource->lock);
 
     return 0;
@@ -23,6 +23,7 @@
 typedef struct {
     unsigned int next_sample_num;
     int internal_decimation;
+    short near_full_scale_level;    /* overload threshold */
     ResourceDescriptor *blocks_resource;
     ResourceDescriptor *samples_resource;
     TimeInfo *timeinfo;
@@ -43,6 +44,9 @@ typedef struct {
 extern unsigned long long num_gain_changes[2];
 extern unsigned long long num_power_overload_detected[2];
 extern unsigned long long num_power_overload_corrected[2];
+extern uint8_t current_gRdB[2];
+extern uint8_t current_lnaGRdB[2];
+extern float current_gain[2];
 
 /* public functions */
 void rxA_callback(short *xi, short *xq, sdrplay_api_StreamCbParamsT *params, unsigned int numSamples, unsigned int reset, void *cbContext);
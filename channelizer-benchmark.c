@@ -0,0 +1,158 @@
+/* record to file the I/Q stream(s) from a SDRplay RSP
+ * benchmark for the FFT channelizer
+ * (runs one polyphase filter bank per tuner on synthetic samples and
+ * compares the throughput with the 2 Msps x 2 tuners target)
+ *
+ * Copyright 2025 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "polyphase.h"
+
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCHMARK_SAMPLE_RATE 2000000.0
+#define BENCHMARK_NUM_TUNERS 2
+#define BENCHMARK_CHUNK_SAMPLES 65536
+
+typedef struct {
+    pthread_t thread;
+    unsigned int num_channels;
+    unsigned int oversampling;
+    unsigned int taps_per_channel;
+    double seconds;
+    unsigned long long samples;
+    double elapsed;
+    int status;
+} BenchmarkWorker;
+
+static double elapsed_since(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) * 1e-9;
+}
+
+static void *benchmark_loop(void *arg) {
+    BenchmarkWorker *worker = (BenchmarkWorker *)arg;
+    worker->status = -1;
+    Polyphase pp;
+    if (polyphase_init(&pp, worker->num_channels, worker->oversampling, worker->taps_per_channel) == -1) {
+        return NULL;
+    }
+    size_t max_frames = BENCHMARK_CHUNK_SAMPLES / pp.decimation + 1;
+    short *samples = (short *)malloc(BENCHMARK_CHUNK_SAMPLES * 2 * sizeof(short));
+    float *frames_re = (float *)malloc(max_frames * worker->num_channels * sizeof(float));
+    float *frames_im = (float *)malloc(max_frames * worker->num_channels * sizeof(float));
+    short *outsamples = (short *)malloc(max_frames * 2 * worker->num_channels * sizeof(short));
+    if (samples == NULL || frames_re == NULL || frames_im == NULL || outsamples == NULL) {
+        fprintf(stderr, "malloc(benchmark buffers) failed\n");
+        polyphase_free(&pp);
+        free(samples);
+        free(frames_re);
+        free(frames_im);
+        free(outsamples);
+        return NULL;
+    }
+    /* a few tones and some noise at the 14 bit scale of the recorder */
+    unsigned int seed = 12345;
+    for (size_t i = 0; i < BENCHMARK_CHUNK_SAMPLES; i++) {
+        double vi = 0.0;
+        double vq = 0.0;
+        for (int tone = 1; tone <= 3; tone++) {
+            double phase = 2.0 * M_PI * (tone * 0.0731) * i;
+            vi += 1000.0 * cos(phase);
+            vq += 1000.0 * sin(phase);
+        }
+        vi += (rand_r(&seed) % 201) - 100;
+        vq += (rand_r(&seed) % 201) - 100;
+        samples[2 * i] = (short)lrint(vi);
+        samples[2 * i + 1] = (short)lrint(vq);
+    }
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    unsigned long long total_samples = 0;
+    double elapsed = 0.0;
+    do {
+        size_t num_frames = polyphase_process(&pp, samples, 2, BENCHMARK_CHUNK_SAMPLES, frames_re, frames_im);
+        /* same conversion to 16 bit as the multichannel file */
+        size_t num_values = num_frames * worker->num_channels;
+        for (size_t i = 0; i < num_values; i++) {
+            outsamples[2 * i] = (short)lrintf(frames_re[i]);
+            outsamples[2 * i + 1] = (short)lrintf(frames_im[i]);
+        }
+        total_samples += BENCHMARK_CHUNK_SAMPLES;
+        elapsed = elapsed_since(&start);
+    } while (elapsed < worker->seconds);
+    worker->samples = total_samples;
+    worker->elapsed = elapsed;
+    worker->status = 0;
+
+    polyphase_free(&pp);
+    free(samples);
+    free(frames_re);
+    free(frames_im);
+    free(outsamples);
+    return NULL;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc > 1 && (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0)) {
+        fprintf(stderr, "usage: %s [<channel spacing in Hz> [<oversampling> [<taps per channel> [<seconds>]]]] (default: 10000 2 16 5)\n", argv[0]);
+        return EXIT_SUCCESS;
+    }
+    double spacing = argc > 1 ? atof(argv[1]) : 10000.0;
+    unsigned int oversampling = argc > 2 ? (unsigned int)atoi(argv[2]) : 2;
+    unsigned int taps_per_channel = argc > 3 ? (unsigned int)atoi(argv[3]) : 16;
+    double seconds = argc > 4 ? atof(argv[4]) : 5.0;
+    if (spacing <= 0.0 || seconds <= 0.0) {
+        fprintf(stderr, "invalid channel spacing or seconds: %lf %lf\n", spacing, seconds);
+        return EXIT_FAILURE;
+    }
+    unsigned int num_channels = (unsigned int)(BENCHMARK_SAMPLE_RATE / spacing + 0.5);
+    fprintf(stderr, "channelizer benchmark: %u channels of %.0lfHz, oversampling=%u, taps per channel=%u, %d tuners, %.0lf seconds\n", num_channels, spacing, oversampling, taps_per_channel, BENCHMARK_NUM_TUNERS, seconds);
+
+    BenchmarkWorker workers[BENCHMARK_NUM_TUNERS];
+    for (int i = 0; i < BENCHMARK_NUM_TUNERS; i++) {
+        workers[i] = (BenchmarkWorker) {
+            .num_channels = num_channels,
+            .oversampling = oversampling,
+            .taps_per_channel = taps_per_channel,
+            .seconds = seconds,
+            .samples = 0,
+            .elapsed = 0.0,
+            .status = -1,
+        };
+        int errcode = pthread_create(&workers[i].thread, NULL, benchmark_loop, &workers[i]);
+        if (errcode != 0) {
+            fprintf(stderr, "pthread_create(benchmark worker) failed: %s\n", strerror(errcode));
+            return EXIT_FAILURE;
+        }
+    }
+    double min_rate = 0.0;
+    int status = EXIT_SUCCESS;
+    for (int i = 0; i < BENCHMARK_NUM_TUNERS; i++) {
+        pthread_join(workers[i].thread, NULL);
+        if (workers[i].status == -1) {
+            status = EXIT_FAILURE;
+            continue;
+        }
+        double rate = workers[i].samples / workers[i].elapsed;
+        printf("tuner %c: %.2lf Msps (%.0lf%% of one core at %.0lf Msps)\n", 'A' + i, rate * 1e-6, 100.0 * BENCHMARK_SAMPLE_RATE / rate, BENCHMARK_SAMPLE_RATE * 1e-6);
+        if (i == 0 || rate < min_rate) {
+            min_rate = rate;
+        }
+    }
+    if (status == EXIT_FAILURE) {
+        return status;
+    }
+    int is_ok = min_rate >= BENCHMARK_SAMPLE_RATE;
+    printf("target %.0lf Msps x %d tuners: %s\n", BENCHMARK_SAMPLE_RATE * 1e-6, BENCHMARK_NUM_TUNERS, is_ok ? "OK" : "NOT MET");
+    return is_ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
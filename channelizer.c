@@ -0,0 +1,438 @@
+/* record to file the I/Q stream(s) from a SDRplay RSP
+ * FFT channelizer
+ *
+ * Copyright 2025 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "channelizer.h"
+#include "config.h"
+#include "output.h"
+#include "polyphase.h"
+#include "sdrplay-rsp.h"
+#include "stats.h"
+#include "wav.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+/* samples copied out of the ring (and processed) at a time by each worker */
+#define CHANNELIZER_CHUNK_SAMPLES 65536
+
+/* the band of each tuner is split into a grid of channels 'channelizer
+ * spacing' Hz apart (one of them at the center frequency) by a polyphase
+ * filter bank; the channels are either critically sampled (sample rate
+ * equal to the spacing) or 2x oversampled, so that the transition band
+ * of the filter does not alias into the channel.
+ * Like the DDC channels, the writer copies the samples into a ring, and
+ * one worker thread per tuner runs its filter bank and writes the
+ * channels; the writer never waits for the workers, and if a worker
+ * falls behind by more than the ring, the samples it missed are counted
+ * as dropped and replaced with zeros.
+ */
+static pthread_mutex_t channelizer_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t channelizer_data_ready = PTHREAD_COND_INITIALIZER;
+static short *ring = NULL;
+static unsigned long long ring_samples = 0;
+static unsigned long long write_sample = 0;     /* next sample to write to the ring */
+static unsigned int ring_channels = 0;
+static bool is_channelizer_stopping = false;
+static int num_workers = 0;
+
+/* global variables */
+ChannelizerTuner channelizer_tuners[2];
+int num_channelizer_tuners = 0;
+ChannelizerStats channelizer_stats = {
+    .dropped_samples = 0,
+    .overruns = 0,
+};
+
+/* internal functions */
+static int channelizer_tuner_init(ChannelizerTuner *ct, int tuner, unsigned int num_bins);
+static int channelizer_output_open(OutputFile *output, Stats *stats, const char *filename, int tuner, int num_channels, double frequency, double sample_rate);
+static void channelizer_output_close(OutputFile *output);
+static void *channelizer_worker_loop(void *arg);
+static void channelizer_tuner_process(ChannelizerTuner *ct, const short *samples, size_t num_samples);
+static void channelizer_tuner_write(ChannelizerTuner *ct, size_t num_frames);
+static short clip_value(float value, unsigned long long *clipped_values);
+
+
+int channelizer_open() {
+    if (channelizer_spacing <= 0.0) {
+        return 0;
+    }
+    double ratio = output_sample_rate / channelizer_spacing;
+    unsigned int num_bins = (unsigned int)(ratio + 0.5);
+    if (num_bins < 2 || fabs(ratio - num_bins) > 1e-6 * ratio) {
+        fprintf(stderr, "channelizer spacing %.0lf does not divide the output sample rate %.0lf\n", channelizer_spacing, output_sample_rate);
+        return -1;
+    }
+    ring_channels = is_dual_tuner ? 4 : 2;
+    int nrx = is_dual_tuner ? 2 : 1;
+    for (int tuner = 0; tuner < nrx; tuner++) {
+        if (channelizer_tuner_init(&channelizer_tuners[tuner], tuner, num_bins) == -1) {
+            num_channelizer_tuners = tuner + 1;
+            return -1;
+        }
+        num_channelizer_tuners = tuner + 1;
+        if (verbose) {
+            const ChannelizerTuner *ct = &channelizer_tuners[tuner];
+            fprintf(stderr, "channelizer tuner %c: %d channels of %.0lfHz (%u points FFT, %u taps) - sample rate=%.1lf\n", 'A' + tuner, ct->num_channels, channelizer_spacing, num_bins, ct->polyphase.num_taps, ct->sample_rate);
+            if (channelizer_multichannel_file) {
+                fprintf(stderr, "channelizer tuner %c: %s\n", 'A' + tuner, ct->multichannel_output.filename);
+            }
+        }
+    }
+
+    ring_samples = channelizer_buffer_capacity;
+    ring = (short *)malloc(ring_samples * ring_channels * sizeof(short));
+    if (ring == NULL) {
+        fprintf(stderr, "malloc(channelizer buffer) failed\n");
+        return -1;
+    }
+    write_sample = 0;
+    is_channelizer_stopping = false;
+
+    for (int i = 0; i < num_channelizer_tuners; i++) {
+        int errcode = pthread_create(&channelizer_tuners[i].thread, NULL, channelizer_worker_loop, &channelizer_tuners[i]);
+        if (errcode != 0) {
+            fprintf(stderr, "pthread_create(channelizer worker) failed: %s\n", strerror(errcode));
+            return -1;
+        }
+        num_workers = i + 1;
+    }
+    return 0;
+}
+
+/* called by the writer for each segment; a NULL tuner is filled with zeros */
+void channelizer_write(const short *const *xi, const short *const *xq, unsigned int nrx, size_t num_samples) {
+    if (num_workers == 0) {
+        return;
+    }
+    pthread_mutex_lock(&channelizer_lock);
+    for (size_t offset = 0; offset < num_samples; ) {
+        unsigned long long ring_index = (write_sample + offset) % ring_samples;
+        size_t n = num_samples - offset;
+        if (n > ring_samples - ring_index) {
+            n = ring_samples - ring_index;
+        }
+        for (unsigned int tuner = 0; tuner < nrx; tuner++) {
+            short *out = ring + ring_index * ring_channels + 2 * tuner;
+            if (xi[tuner] != NULL) {
+                const short *txi = xi[tuner] + offset;
+                const short *txq = xq[tuner] + offset;
+                for (size_t i = 0; i < n; i++, out += ring_channels) {
+                    out[0] = txi[i];
+                    out[1] = txq[i];
+                }
+            } else {
+                for (size_t i = 0; i < n; i++, out += ring_channels) {
+                    out[0] = 0;
+                    out[1] = 0;
+                }
+            }
+        }
+        offset += n;
+    }
+    write_sample += num_samples;
+
+    for (int i = 0; i < num_workers; i++) {
+        ChannelizerTuner *ct = &channelizer_tuners[i];
+        if (write_sample - ct->read_sample > ring_samples) {
+            unsigned long long first_sample = write_sample - ring_samples;
+            unsigned long long dropped = first_sample - ct->read_sample;
+            if (ct->skipped_samples == 0) {
+                channelizer_stats.overruns++;
+            }
+            channelizer_stats.dropped_samples += dropped;
+            ct->skipped_samples += dropped;
+            ct->read_sample = first_sample;
+        }
+    }
+    pthread_cond_broadcast(&channelizer_data_ready);
+    pthread_mutex_unlock(&channelizer_lock);
+}
+
+/* end of streaming: the workers process what is left in the ring */
+void channelizer_finish() {
+    if (num_workers == 0) {
+        return;
+    }
+    pthread_mutex_lock(&channelizer_lock);
+    is_channelizer_stopping = true;
+    pthread_cond_broadcast(&channelizer_data_ready);
+    pthread_mutex_unlock(&channelizer_lock);
+    for (int i = 0; i < num_workers; i++) {
+        pthread_join(channelizer_tuners[i].thread, NULL);
+    }
+    num_workers = 0;
+}
+
+void channelizer_close() {
+    channelizer_finish();
+    for (int i = 0; i < num_channelizer_tuners; i++) {
+        ChannelizerTuner *ct = &channelizer_tuners[i];
+        channelizer_output_close(&ct->multichannel_output);
+        for (int k = 0; k < ct->num_channels; k++) {
+            channelizer_output_close(&ct->channels[k].output);
+        }
+        polyphase_free(&ct->polyphase);
+        free(ct->channels);
+        ct->channels = NULL;
+        free(ct->samples);
+        ct->samples = NULL;
+        free(ct->frames_re);
+        ct->frames_re = NULL;
+        free(ct->frames_im);
+        ct->frames_im = NULL;
+        free(ct->outsamples);
+        ct->outsamples = NULL;
+    }
+    num_channelizer_tuners = 0;
+    free(ring);
+    ring = NULL;
+}
+
+/* internal functions */
+static int channelizer_tuner_init(ChannelizerTuner *ct, int tuner, unsigned int num_bins) {
+    *ct = (ChannelizerTuner) {
+        .tuner = tuner,
+        .polyphase = { .taps = NULL },
+        .channels = NULL,
+        .num_channels = 0,
+        .multichannel_output = { .fd = -1, .is_open = false },
+        .is_multichannel_failed = false,
+        .read_sample = 0,
+        .skipped_samples = 0,
+        .samples = NULL,
+        .frames_re = NULL,
+        .frames_im = NULL,
+        .outsamples = NULL,
+        .output_samples = 0,
+        .clipped_values = 0,
+    };
+    if (polyphase_init(&ct->polyphase, num_bins, channelizer_oversampling, channelizer_taps_per_channel) == -1) {
+        return -1;
+    }
+    ct->sample_rate = output_sample_rate / ct->polyphase.decimation;
+
+    /* the channels entirely inside the band (or inside the range) */
+    double center_frequency = tuner == 1 ? frequency_B : frequency_A;
+    int max_index = (int)((num_bins - 1) / 2);
+    ct->channels = (ChannelizerChannel *)calloc(num_bins, sizeof(ChannelizerChannel));
+    if (ct->channels == NULL) {
+        fprintf(stderr, "calloc(channelizer channels) failed\n");
+        return -1;
+    }
+    for (int k = -max_index; k <= max_index; k++) {
+        double frequency = center_frequency + k * channelizer_spacing;
+        if (channelizer_range_low != channelizer_range_high && (frequency < channelizer_range_low || frequency > channelizer_range_high)) {
+            continue;
+        }
+        ChannelizerChannel *channel = &ct->channels[ct->num_channels++];
+        channel->frequency = frequency;
+        channel->bin = (unsigned int)((k + (int)num_bins) % (int)num_bins);
+        channel->output = (OutputFile) { .fd = -1, .is_open = false };
+        channel->is_failed = false;
+    }
+    if (ct->num_channels == 0) {
+        fprintf(stderr, "no channelizer channels in the range %.0lf,%.0lf for tuner %c\n", channelizer_range_low, channelizer_range_high, 'A' + tuner);
+        return -1;
+    }
+
+    size_t max_frames = CHANNELIZER_CHUNK_SAMPLES / ct->polyphase.decimation + 1;
+    size_t outsamples_values = channelizer_multichannel_file ? max_frames * 2 * ct->num_channels : max_frames * 2;
+    ct->samples = (short *)malloc(CHANNELIZER_CHUNK_SAMPLES * ring_channels * sizeof(short));
+    ct->frames_re = (float *)malloc(max_frames * num_bins * sizeof(float));
+    ct->frames_im = (float *)malloc(max_frames * num_bins * sizeof(float));
+    ct->outsamples = (short *)malloc(outsamples_values * sizeof(short));
+    if (ct->samples == NULL || ct->frames_re == NULL || ct->frames_im == NULL || ct->outsamples == NULL) {
+        fprintf(stderr, "malloc(channelizer buffers) failed\n");
+        return -1;
+    }
+
+    char filename[PATH_MAX];
+    if (channelizer_multichannel_file) {
+        if (output_channelizer_filename(filename, PATH_MAX, tuner, ct->sample_rate) != 0) {
+            fprintf(stderr, "output_channelizer_filename(%s) failed\n", outfile_template);
+            return -1;
+        }
+        return channelizer_output_open(&ct->multichannel_output, &ct->multichannel_stats, filename, tuner, 2 * ct->num_channels, center_frequency, ct->sample_rate);
+    }
+    for (int k = 0; k < ct->num_channels; k++) {
+        ChannelizerChannel *channel = &ct->channels[k];
+        if (output_channel_filename(filename, PATH_MAX, tuner, channel->frequency, ct->sample_rate) != 0) {
+            fprintf(stderr, "output_channel_filename(%s) failed\n", outfile_template);
+            return -1;
+        }
+        if (channelizer_output_open(&channel->output, &channel->stats, filename, tuner, 2, channel->frequency, ct->sample_rate) == -1) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int channelizer_output_open(OutputFile *output, Stats *stats, const char *filename, int tuner, int num_channels, double frequency, double sample_rate) {
+    if (strcmp(filename, "-") == 0 || filename[0] == '|') {
+        fprintf(stderr, "stdout and named pipes are not supported for the channelizer\n");
+        return -1;
+    }
+    *stats = (Stats) {
+        .data_size = 0,
+        .output_samples = 0,
+    };
+    *output = (OutputFile) {
+        .fd = -1,
+        .tuner = tuner,
+        .num_channels = num_channels,
+        .frequency = frequency,
+        .sample_rate = sample_rate,
+        .wav_type = WAV_TYPE_UNKNOWN,
+        .stats = stats,
+        .is_open = false,
+        .index_fd = -1,
+    };
+    snprintf(output->filename, sizeof(output->filename), "%s", filename);
+    output->fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, 0644);
+    if (output->fd == -1) {
+        fprintf(stderr, "open(%s) for writing failed: %s\n", filename, strerror(errno));
+        return -1;
+    }
+    output->is_open = true;
+    if (output_type != OUTPUT_TYPE_WAVVIEWDX_RAW) {
+        if (write_auxi_wav_header(output) == -1) {
+            fprintf(stderr, "write() WAV header to %s failed: %s\n", filename, strerror(errno));
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void channelizer_output_close(OutputFile *output) {
+    if (!output->is_open) {
+        return;
+    }
+    if (output_type != OUTPUT_TYPE_WAVVIEWDX_RAW) {
+        if (finalize_auxi_wav_file(output) == -1) {
+            fprintf(stderr, "finalize() WAV file %s failed: %s\n", output->filename, strerror(errno));
+        }
+    }
+    close(output->fd);
+    output->fd = -1;
+    output->is_open = false;
+}
+
+static void *channelizer_worker_loop(void *arg) {
+    ChannelizerTuner *ct = (ChannelizerTuner *)arg;
+    pthread_mutex_lock(&channelizer_lock);
+    for (;;) {
+        while (ct->read_sample == write_sample && !is_channelizer_stopping) {
+            pthread_cond_wait(&channelizer_data_ready, &channelizer_lock);
+        }
+        if (ct->read_sample == write_sample) {
+            break;
+        }
+        unsigned long long skipped_samples = ct->skipped_samples;
+        ct->skipped_samples = 0;
+        unsigned long long ring_index = ct->read_sample % ring_samples;
+        size_t n = write_sample - ct->read_sample;
+        if (n > CHANNELIZER_CHUNK_SAMPLES) {
+            n = CHANNELIZER_CHUNK_SAMPLES;
+        }
+        if (n > ring_samples - ring_index) {
+            n = ring_samples - ring_index;
+        }
+        memcpy(ct->samples, ring + ring_index * ring_channels, n * ring_channels * sizeof(short));
+        ct->read_sample += n;
+        pthread_mutex_unlock(&channelizer_lock);
+
+        /* the samples dropped by the worker go through the filter bank as
+         * zeros, so that the timing of the channels is kept
+         */
+        while (skipped_samples > 0) {
+            size_t nz = skipped_samples < CHANNELIZER_CHUNK_SAMPLES ? skipped_samples : CHANNELIZER_CHUNK_SAMPLES;
+            channelizer_tuner_process(ct, NULL, nz);
+            skipped_samples -= nz;
+        }
+        channelizer_tuner_process(ct, ct->samples + 2 * ct->tuner, n);
+
+        pthread_mutex_lock(&channelizer_lock);
+    }
+    pthread_mutex_unlock(&channelizer_lock);
+    return NULL;
+}
+
+static void channelizer_tuner_process(ChannelizerTuner *ct, const short *samples, size_t num_samples) {
+    size_t num_frames = polyphase_process(&ct->polyphase, samples, ring_channels, num_samples, ct->frames_re, ct->frames_im);
+    if (num_frames > 0) {
+        channelizer_tuner_write(ct, num_frames);
+    }
+}
+
+static void channelizer_tuner_write(ChannelizerTuner *ct, size_t num_frames) {
+    unsigned int num_bins = ct->polyphase.num_channels;
+    if (channelizer_multichannel_file) {
+        if (ct->is_multichannel_failed) {
+            return;
+        }
+        short *out = ct->outsamples;
+        for (size_t f = 0; f < num_frames; f++) {
+            const float *frame_re = ct->frames_re + f * num_bins;
+            const float *frame_im = ct->frames_im + f * num_bins;
+            for (int k = 0; k < ct->num_channels; k++) {
+                unsigned int bin = ct->channels[k].bin;
+                *out++ = clip_value(frame_re[bin], &ct->clipped_values);
+                *out++ = clip_value(frame_im[bin], &ct->clipped_values);
+            }
+        }
+        if (output_write(&ct->multichannel_output, (const uint8_t *)ct->outsamples, num_frames * 2 * ct->num_channels * sizeof(short)) == -1) {
+            fprintf(stderr, "channelizer output %s failed - no more samples will be written to it\n", ct->multichannel_output.filename);
+            ct->is_multichannel_failed = true;
+            return;
+        }
+        ct->multichannel_stats.output_samples += num_frames;
+        ct->output_samples += num_frames;
+        return;
+    }
+    for (int k = 0; k < ct->num_channels; k++) {
+        ChannelizerChannel *channel = &ct->channels[k];
+        if (channel->is_failed) {
+            continue;
+        }
+        unsigned int bin = channel->bin;
+        short *out = ct->outsamples;
+        for (size_t f = 0; f < num_frames; f++) {
+            *out++ = clip_value(ct->frames_re[f * num_bins + bin], &ct->clipped_values);
+            *out++ = clip_value(ct->frames_im[f * num_bins + bin], &ct->clipped_values);
+        }
+        if (output_write(&channel->output, (const uint8_t *)ct->outsamples, num_frames * 2 * sizeof(short)) == -1) {
+            fprintf(stderr, "channelizer channel %s failed - no more samples will be written to it\n", channel->output.filename);
+            channel->is_failed = true;
+            continue;
+        }
+        channel->stats.output_samples += num_frames;
+    }
+    ct->output_samples += num_frames;
+}
+
+static short clip_value(float value, unsigned long long *clipped_values) {
+    long v = lrintf(value);
+    if (v > SHRT_MAX || v < SHRT_MIN) {
+        (*clipped_values)++;
+        return v > SHRT_MAX ? SHRT_MAX : SHRT_MIN;
+    }
+    return (short)v;
+}
@@ -0,0 +1,65 @@
+/* record to file the I/Q stream(s) from a SDRplay RSP
+ * FFT channelizer
+ *
+ * Copyright 2025 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef _CHANNELIZER_H
+#define _CHANNELIZER_H
+
+#include "output.h"
+#include "polyphase.h"
+#include "stats.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/* typedefs */
+typedef struct {
+    OutputFile output;          /* one file per channel only */
+    Stats stats;
+    double frequency;           /* center frequency of the channel */
+    unsigned int bin;           /* FFT bin of the channel */
+    bool is_failed;
+} ChannelizerChannel;
+
+typedef struct {
+    pthread_t thread;
+    int tuner;
+    Polyphase polyphase;
+    double sample_rate;                 /* of each channel */
+    ChannelizerChannel *channels;
+    int num_channels;
+    OutputFile multichannel_output;     /* all the channels in one file */
+    Stats multichannel_stats;
+    bool is_multichannel_failed;
+    unsigned long long read_sample;     /* next sample to read from the ring */
+    unsigned long long skipped_samples; /* dropped, not yet seen by the filter bank */
+    short *samples;                     /* samples copied out of the ring */
+    float *frames_re;
+    float *frames_im;
+    short *outsamples;
+    unsigned long long output_samples;  /* per channel */
+    unsigned long long clipped_values;
+} ChannelizerTuner;
+
+typedef struct {
+    unsigned long long dropped_samples;
+    unsigned long long overruns;
+} ChannelizerStats;
+
+/* global variables */
+extern ChannelizerTuner channelizer_tuners[2];
+extern int num_channelizer_tuners;
+extern ChannelizerStats channelizer_stats;
+
+/* public functions */
+int channelizer_open();
+void channelizer_write(const short *const *xi, const short *const *xq, unsigned int nrx, size_t num_samples);
+void channelizer_finish();
+void channelizer_close();
+
+#endif /* _CHANNELIZER_H */
@@ -0,0 +1,84 @@
+#!/usr/bin/env python3
+# check the TCP server output with the rtl_tcp client handshake
+#
+# Copyright 2025 Franco Venturi
+#
+# SPDX-License-Identifier: GPL-3.0-or-later
+
+import socket
+import struct
+import sys
+import time
+
+# rtl_tcp commands: 1 byte command, 4 bytes parameter (big endian)
+CMD_SET_FREQUENCY = 0x01
+CMD_SET_SAMPLE_RATE = 0x02
+CMD_SET_GAIN_MODE = 0x03
+
+BYTES_PER_SAMPLE = {'u8': 2, 'cs8': 2, 'cs16': 4}
+
+def main():
+    if len(sys.argv) < 2:
+        print(f'usage: {sys.argv[0]} [<address>:]<port> [<format> [<seconds>]]', file=sys.stderr)
+        sys.exit(1)
+    address = sys.argv[1]
+    host, port = address.rsplit(':', 1) if ':' in address else ('127.0.0.1', address)
+    sample_format = sys.argv[2].lower() if len(sys.argv) > 2 else 'u8'
+    seconds = float(sys.argv[3]) if len(sys.argv) > 3 else 5.0
+    if sample_format not in BYTES_PER_SAMPLE:
+        print(f'unsupported format: {sample_format}', file=sys.stderr)
+        sys.exit(1)
+
+    with socket.create_connection((host, int(port)), timeout=10) as s:
+        # like rtl_tcp: 'RTL0', tuner type, number of gains
+        header = b''
+        while len(header) < 12:
+            data = s.recv(12 - len(header))
+            if not data:
+                print('connection closed before the header', file=sys.stderr)
+                sys.exit(1)
+            header += data
+        magic, tuner_type, num_gains = struct.unpack('>4sII', header)
+        if magic != b'RTL0':
+            print(f'invalid header: {header!r}', file=sys.stderr)
+            sys.exit(1)
+        print(f'header: magic={magic.decode()} tuner_type={tuner_type} gains={num_gains}')
+
+        # the commands are counted by the server, but otherwise ignored
+        for command, param in ((CMD_SET_GAIN_MODE, 0), (CMD_SET_SAMPLE_RATE, 2000000), (CMD_SET_FREQUENCY, 100000000)):
+            s.sendall(struct.pack('>BI', command, param))
+
+        bytes_per_sample = BYTES_PER_SAMPLE[sample_format]
+        num_bytes = 0
+        tail = b''
+        sum_i = 0
+        sum_q = 0
+        num_samples = 0
+        start = time.monotonic()
+        while time.monotonic() - start < seconds:
+            data = s.recv(65536)
+            if not data:
+                break
+            num_bytes += len(data)
+            data = tail + data
+            n = len(data) // bytes_per_sample * bytes_per_sample
+            tail = data[n:]
+            if sample_format == 'cs16':
+                values = struct.unpack(f'<{n // 2}h', data[:n])
+            elif sample_format == 'cs8':
+                values = struct.unpack(f'{n}b', data[:n])
+            else:
+                values = data[:n]
+            sum_i += sum(values[0::2])
+            sum_q += sum(values[1::2])
+            num_samples += n // bytes_per_sample
+        elapsed = time.monotonic() - start
+
+    if num_samples == 0:
+        print('no samples received', file=sys.stderr)
+        sys.exit(1)
+    print(f'received {num_bytes} bytes in {elapsed:.1f}s - {num_samples / elapsed:.0f} samples/s')
+    print(f'mean I={sum_i / num_samples:.2f} mean Q={sum_q / num_samples:.2f}')
+
+if __name__ == '__main__':
+    main()
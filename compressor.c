@@ -0,0 +1,419 @@
+/* record to file the I/Q stream(s) from a SDRplay RSP
+ * parallel block compressor for the compressed output types
+ *
+ * Copyright 2025 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "compressor.h"
+#include "config.h"
+#include "iqz.h"
+#include "stats.h"
+#include "zstd-seekable.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define IQZ_DEFAULT_BLOCK_FRAMES 16384
+#define ZSTD_DEFAULT_BLOCK_FRAMES 131072
+
+/* typedefs */
+typedef enum {
+    COMPRESSOR_BLOCK_FREE,
+    COMPRESSOR_BLOCK_QUEUED,
+    COMPRESSOR_BLOCK_ENCODING,
+    COMPRESSOR_BLOCK_DONE,
+} CompressorBlockState;
+
+typedef struct {
+    CompressorBlockState state;
+    unsigned int num_frames;
+    unsigned long long first_frame;
+    short *samples;             /* interleaved input samples */
+    uint8_t *encoded;
+    size_t encoded_size;        /* 0 if the compression failed */
+} CompressorBlock;
+
+typedef struct Compressor {
+    OutputType output_type;
+    int num_channels;
+    unsigned int block_frames;
+    size_t max_encoded_size;
+    unsigned int num_blocks;
+    CompressorBlock *blocks;
+    /* block sequence numbers; block 'seq' uses the slot 'seq % num_blocks' */
+    unsigned long long fill_seq;        /* block being filled by the writer */
+    unsigned long long encode_seq;      /* next block for the workers */
+    unsigned long long write_seq;       /* next block to be written out */
+    size_t fill_bytes;
+    unsigned long long total_frames;
+    unsigned long long file_offset;
+    CompressedBlockInfo *index;
+    size_t index_size;
+    size_t index_capacity;
+    Stats *stats;
+    int num_threads;
+    pthread_t *threads;
+    pthread_mutex_t lock;
+    pthread_cond_t work_ready;
+    pthread_cond_t block_done;
+    bool is_stopping;
+    bool is_finished;
+    int finish_status;
+} Compressor;
+
+/* internal functions */
+static void *compressor_worker(void *arg);
+static size_t encode_block(Compressor *comp, CompressorBlock *block, int32_t *x, uint32_t *u, void *zstd_cctx, bool *is_verbatim);
+static void queue_block(Compressor *comp);
+static int write_encoded_blocks(OutputFile *output, unsigned long long until_seq);
+static void compressor_free(Compressor *comp);
+
+
+int compressor_open(OutputFile *output) {
+    if (compression_threads < 1) {
+        fprintf(stderr, "invalid number of compression threads: %d\n", compression_threads);
+        return -1;
+    }
+
+    Compressor *comp = (Compressor *)calloc(1, sizeof(Compressor));
+    if (comp == NULL) {
+        fprintf(stderr, "calloc(Compressor) failed\n");
+        return -1;
+    }
+    output->compressor = comp;
+    comp->output_type = output_type;
+    comp->num_channels = output->num_channels;
+    if (compression_block_size > 0) {
+        comp->block_frames = compression_block_size;
+    } else {
+        comp->block_frames = output_type == OUTPUT_TYPE_ZSTD ? ZSTD_DEFAULT_BLOCK_FRAMES : IQZ_DEFAULT_BLOCK_FRAMES;
+    }
+    comp->num_blocks = 2 * compression_threads + 2;
+    comp->stats = output->stats;
+    pthread_mutex_init(&comp->lock, NULL);
+    pthread_cond_init(&comp->work_ready, NULL);
+    pthread_cond_init(&comp->block_done, NULL);
+
+    size_t block_samples = (size_t)comp->block_frames * comp->num_channels;
+    if (comp->output_type == OUTPUT_TYPE_COMPRESSED) {
+        if (iqz_write_header(output, comp->block_frames) == -1) {
+            return -1;
+        }
+        comp->file_offset = sizeof(IQZFileHeader);
+        comp->max_encoded_size = iqz_max_block_size(comp->block_frames, comp->num_channels);
+    } else if (comp->output_type == OUTPUT_TYPE_ZSTD) {
+#ifdef HAVE_ZSTD
+        if (block_samples * sizeof(short) > ZSTD_SEEKABLE_MAX_FRAME_SIZE) {
+            fprintf(stderr, "compression block size too large for the zstd seekable format\n");
+            return -1;
+        }
+        comp->file_offset = 0;
+        comp->max_encoded_size = zstd_max_frame_size(block_samples * sizeof(short));
+#else
+        fprintf(stderr, "zstd output not supported (built without zstd)\n");
+        return -1;
+#endif /* HAVE_ZSTD */
+    }
+
+    comp->blocks = (CompressorBlock *)calloc(comp->num_blocks, sizeof(CompressorBlock));
+    if (comp->blocks == NULL) {
+        fprintf(stderr, "calloc(compressor blocks) failed\n");
+        return -1;
+    }
+    for (unsigned int i = 0; i < comp->num_blocks; i++) {
+        CompressorBlock *block = &comp->blocks[i];
+        block->state = COMPRESSOR_BLOCK_FREE;
+        block->samples = (short *)malloc(block_samples * sizeof(short));
+        block->encoded = (uint8_t *)malloc(comp->max_encoded_size);
+        if (block->samples == NULL || block->encoded == NULL) {
+            fprintf(stderr, "malloc(compressor block) failed\n");
+            return -1;
+        }
+    }
+
+    comp->threads = (pthread_t *)calloc(compression_threads, sizeof(pthread_t));
+    if (comp->threads == NULL) {
+        fprintf(stderr, "calloc(compressor threads) failed\n");
+        return -1;
+    }
+    for (int i = 0; i < compression_threads; i++) {
+        int ret = pthread_create(&comp->threads[i], NULL, compressor_worker, comp);
+        if (ret != 0) {
+            fprintf(stderr, "pthread_create(compressor worker) failed: %s\n", strerror(ret));
+            return -1;
+        }
+        comp->num_threads++;
+    }
+    return 0;
+}
+
+/* the input is whole frames of interleaved 16 bit samples; when all the
+ * blocks in the ring are busy the writer waits for the oldest one to be
+ * compressed and written out, so the samples ring buffers absorb the backlog
+ */
+int compressor_write(OutputFile *output, const uint8_t *buf, size_t count) {
+    Compressor *comp = output->compressor;
+    size_t block_bytes = (size_t)comp->block_frames * comp->num_channels * sizeof(short);
+    while (count > 0) {
+        if (comp->fill_bytes == 0 && comp->fill_seq >= comp->write_seq + comp->num_blocks) {
+            if (write_encoded_blocks(output, comp->fill_seq - comp->num_blocks + 1) == -1) {
+                return -1;
+            }
+        }
+        CompressorBlock *block = &comp->blocks[comp->fill_seq % comp->num_blocks];
+        size_t n = block_bytes - comp->fill_bytes;
+        if (n > count)
+            n = count;
+        memcpy((uint8_t *)block->samples + comp->fill_bytes, buf, n);
+        comp->fill_bytes += n;
+        buf += n;
+        count -= n;
+        if (comp->fill_bytes == block_bytes) {
+            queue_block(comp);
+        }
+    }
+    /* write out any block that is already done */
+    return write_encoded_blocks(output, comp->write_seq);
+}
+
+/* write out the last blocks and the block index at the end of streaming */
+int compressor_finish(OutputFile *output) {
+    Compressor *comp = output->compressor;
+    if (comp->is_finished) {
+        return comp->finish_status;
+    }
+    int status = -1;
+    if (comp->num_threads > 0) {
+        if (comp->fill_bytes > 0) {
+            queue_block(comp);
+        }
+        status = write_encoded_blocks(output, comp->fill_seq);
+    }
+
+    if (status == 0) {
+        if (comp->output_type == OUTPUT_TYPE_COMPRESSED) {
+            status = iqz_write_index(output, comp->index, comp->index_size, comp->file_offset, comp->total_frames);
+#ifdef HAVE_ZSTD
+        } else if (comp->output_type == OUTPUT_TYPE_ZSTD) {
+            status = zstd_write_seek_table(output, comp->index, comp->index_size, comp->num_channels);
+#endif /* HAVE_ZSTD */
+        }
+    }
+    comp->is_finished = true;
+    comp->finish_status = status;
+    return status;
+}
+
+int compressor_close(OutputFile *output) {
+    Compressor *comp = output->compressor;
+    if (comp == NULL) {
+        return 0;
+    }
+    int status = compressor_finish(output);
+    compressor_free(comp);
+    output->compressor = NULL;
+    return status;
+}
+
+
+/* internal functions */
+static void *compressor_worker(void *arg) {
+    Compressor *comp = (Compressor *)arg;
+    size_t block_samples = (size_t)comp->block_frames * comp->num_channels;
+    int32_t *x = NULL;
+    uint32_t *u = NULL;
+    void *zstd_cctx = NULL;
+    short *verify_samples = NULL;
+    bool is_ready = true;
+    if (comp->output_type == OUTPUT_TYPE_COMPRESSED) {
+        x = (int32_t *)malloc(comp->block_frames * sizeof(int32_t));
+        u = (uint32_t *)malloc(comp->block_frames * sizeof(uint32_t));
+        is_ready = x != NULL && u != NULL;
+#ifdef HAVE_ZSTD
+    } else if (comp->output_type == OUTPUT_TYPE_ZSTD) {
+        zstd_cctx = zstd_context_new(compression_level);
+        is_ready = zstd_cctx != NULL;
+#endif /* HAVE_ZSTD */
+    }
+    if (compression_verify) {
+        verify_samples = (short *)malloc(block_samples * sizeof(short));
+        is_ready = is_ready && verify_samples != NULL;
+    }
+    if (!is_ready) {
+        /* the blocks still go through, but they are marked as failed */
+        fprintf(stderr, "compressor worker initialization failed\n");
+    }
+
+    pthread_mutex_lock(&comp->lock);
+    while (true) {
+        while (!comp->is_stopping && comp->encode_seq == comp->fill_seq) {
+            pthread_cond_wait(&comp->work_ready, &comp->lock);
+        }
+        if (comp->encode_seq == comp->fill_seq) {
+            break;
+        }
+        CompressorBlock *block = &comp->blocks[comp->encode_seq % comp->num_blocks];
+        comp->encode_seq++;
+        block->state = COMPRESSOR_BLOCK_ENCODING;
+        pthread_mutex_unlock(&comp->lock);
+
+        struct timespec before_encode_ts;
+        struct timespec after_encode_ts;
+        bool is_verbatim = false;
+        clock_gettime(CLOCK_MONOTONIC, &before_encode_ts);
+        block->encoded_size = is_ready ? encode_block(comp, block, x, u, zstd_cctx, &is_verbatim) : 0;
+        clock_gettime(CLOCK_MONOTONIC, &after_encode_ts);
+        unsigned long long encode_elapsed = (after_encode_ts.tv_sec - before_encode_ts.tv_sec) * 1000000000ULL + after_encode_ts.tv_nsec - before_encode_ts.tv_nsec;
+
+        bool is_verified = true;
+        if (verify_samples != NULL && block->encoded_size > 0) {
+            size_t raw_size = block->num_frames * comp->num_channels * sizeof(short);
+            if (comp->output_type == OUTPUT_TYPE_COMPRESSED) {
+                int nframes = iqz_decode_block(block->encoded, block->encoded_size, comp->num_channels, verify_samples, comp->block_frames);
+                is_verified = nframes == (int)block->num_frames && memcmp(verify_samples, block->samples, raw_size) == 0;
+#ifdef HAVE_ZSTD
+            } else if (comp->output_type == OUTPUT_TYPE_ZSTD) {
+                is_verified = zstd_verify_frame(block->encoded, block->encoded_size, block->samples, raw_size, verify_samples) == 0;
+#endif /* HAVE_ZSTD */
+            }
+        }
+
+        pthread_mutex_lock(&comp->lock);
+        comp->stats->compression_input_bytes += block->num_frames * comp->num_channels * sizeof(short);
+        comp->stats->compression_encode_elapsed += encode_elapsed;
+        comp->stats->compression_blocks++;
+        if (is_verbatim) {
+            comp->stats->compression_verbatim_blocks++;
+        }
+        if (!is_verified) {
+            comp->stats->compression_verify_errors++;
+        }
+        block->state = COMPRESSOR_BLOCK_DONE;
+        pthread_cond_broadcast(&comp->block_done);
+    }
+    pthread_mutex_unlock(&comp->lock);
+
+    free(x);
+    free(u);
+#ifdef HAVE_ZSTD
+    if (zstd_cctx != NULL) {
+        zstd_context_free(zstd_cctx);
+    }
+#endif /* HAVE_ZSTD */
+    free(verify_samples);
+    return NULL;
+}
+
+static size_t encode_block(Compressor *comp, CompressorBlock *block, int32_t *x, uint32_t *u, void *zstd_cctx, bool *is_verbatim) {
+    if (comp->output_type == OUTPUT_TYPE_COMPRESSED) {
+        return iqz_encode_block(block->samples, block->num_frames, comp->num_channels, block->encoded, x, u, is_verbatim);
+#ifdef HAVE_ZSTD
+    } else if (comp->output_type == OUTPUT_TYPE_ZSTD) {
+        size_t raw_size = block->num_frames * comp->num_channels * sizeof(short);
+        return zstd_encode_frame(zstd_cctx, block->samples, raw_size, block->encoded, comp->max_encoded_size);
+#endif /* HAVE_ZSTD */
+    }
+    (void)zstd_cctx;
+    return 0;
+}
+
+/* hand the block being filled to the worker pool */
+static void queue_block(Compressor *comp) {
+    CompressorBlock *block = &comp->blocks[comp->fill_seq % comp->num_blocks];
+    block->num_frames = comp->fill_bytes / (comp->num_channels * sizeof(short));
+    block->first_frame = comp->total_frames;
+    comp->total_frames += block->num_frames;
+    pthread_mutex_lock(&comp->lock);
+    block->state = COMPRESSOR_BLOCK_QUEUED;
+    comp->fill_seq++;
+    comp->fill_bytes = 0;
+    pthread_cond_signal(&comp->work_ready);
+    pthread_mutex_unlock(&comp->lock);
+}
+
+/* write out the encoded blocks in order; wait for all the blocks before
+ * 'until_seq', then continue with the ones that are already done
+ */
+static int write_encoded_blocks(OutputFile *output, unsigned long long until_seq) {
+    Compressor *comp = output->compressor;
+    while (comp->write_seq < comp->fill_seq) {
+        CompressorBlock *block = &comp->blocks[comp->write_seq % comp->num_blocks];
+        pthread_mutex_lock(&comp->lock);
+        if (comp->write_seq < until_seq) {
+            while (block->state != COMPRESSOR_BLOCK_DONE) {
+                pthread_cond_wait(&comp->block_done, &comp->lock);
+            }
+        }
+        bool is_done = block->state == COMPRESSOR_BLOCK_DONE;
+        pthread_mutex_unlock(&comp->lock);
+        if (!is_done) {
+            break;
+        }
+        if (block->encoded_size == 0) {
+            fprintf(stderr, "compression of block %llu failed\n", comp->write_seq);
+            return -1;
+        }
+
+        if (comp->index_size == comp->index_capacity) {
+            size_t index_capacity = comp->index_capacity > 0 ? 2 * comp->index_capacity : 1024;
+            CompressedBlockInfo *index = (CompressedBlockInfo *)realloc(comp->index, index_capacity * sizeof(CompressedBlockInfo));
+            if (index == NULL) {
+                fprintf(stderr, "realloc(compressed blocks index) failed\n");
+                return -1;
+            }
+            comp->index = index;
+            comp->index_capacity = index_capacity;
+        }
+        comp->index[comp->index_size++] = (CompressedBlockInfo) {
+            .offset = comp->file_offset,
+            .first_frame = block->first_frame,
+            .compressed_size = block->encoded_size,
+            .num_frames = block->num_frames
+        };
+
+        if (output_write(output, block->encoded, block->encoded_size) == -1) {
+            return -1;
+        }
+        comp->file_offset += block->encoded_size;
+        /* the IQZ block headers are container overhead, like the file
+         * header and the index; a zstd frame is all payload */
+        comp->stats->compression_output_bytes += block->encoded_size;
+        if (comp->output_type == OUTPUT_TYPE_COMPRESSED) {
+            comp->stats->compression_output_bytes -= sizeof(IQZBlockHeader);
+        }
+        pthread_mutex_lock(&comp->lock);
+        block->state = COMPRESSOR_BLOCK_FREE;
+        pthread_mutex_unlock(&comp->lock);
+        comp->write_seq++;
+    }
+    return 0;
+}
+
+static void compressor_free(Compressor *comp) {
+    pthread_mutex_lock(&comp->lock);
+    comp->is_stopping = true;
+    pthread_cond_broadcast(&comp->work_ready);
+    pthread_mutex_unlock(&comp->lock);
+    for (int i = 0; i < comp->num_threads; i++) {
+        pthread_join(comp->threads[i], NULL);
+    }
+    free(comp->threads);
+    if (comp->blocks != NULL) {
+        for (unsigned int i = 0; i < comp->num_blocks; i++) {
+            free(comp->blocks[i].samples);
+            free(comp->blocks[i].encoded);
+        }
+        free(comp->blocks);
+    }
+    free(comp->index);
+    pthread_cond_destroy(&comp->work_ready);
+    pthread_cond_destroy(&comp->block_done);
+    pthread_mutex_destroy(&comp->lock);
+    free(comp);
+}
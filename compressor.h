@@ -0,0 +1,31 @@
+/* record to file the I/Q stream(s) from a SDRplay RSP
+ * parallel block compressor for the compressed output types
+ *
+ * Copyright 2025 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef _COMPRESSOR_H
+#define _COMPRESSOR_H
+
+#include "output.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* typedefs */
+typedef struct {
+    uint64_t offset;            /* file offset of the compressed block */
+    uint64_t first_frame;
+    uint32_t compressed_size;
+    uint32_t num_frames;
+} CompressedBlockInfo;
+
+/* public functions */
+int compressor_open(OutputFile *output);
+int compressor_write(OutputFile *output, const uint8_t *buf, size_t count);
+int compressor_finish(OutputFile *output);
+int compressor_close(OutputFile *output);
+
+#endif /* _COMPRESSOR_H */
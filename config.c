@@ -22,6 +22,9 @@ static char default_output_filename_wavviewdx_raw[] = "{WAVVIEWDX-RAW}.raw";
 static char default_output_filename_linrad[] = "RSP_recording_{TIMESTAMP}_{FREQKHZ}.raw";
 static char default_output_filename_sdruno[] = "{SDRUNO}.wav";
 static char default_output_filename_sdrconnect[] = "{SDRCONNECT}.wav";
+static char default_output_filename_compressed[] = "RSP_recording_{TIMESTAMP}_{FREQKHZ}.iqz";
+static char default_output_filename_zstd[] = "RSP_recording_{TIMESTAMP}_{FREQKHZ}.zst";
+static char default_output_filename_sigmf[] = "RSP_recording_{TIMESTAMP}_{FREQKHZ}.sigmf-data";
 static char default_output_filename_experimental[] = "RSP_recording_{TIMESTAMP}_{FREQKHZ}.wav";
 
 
@@ -32,6 +35,7 @@ sdrplay_api_RspDuoModeT rspduo_mode = sdrplay_api_RspDuoMode_Unknown;
 const char *antenna = NULL;
 double sample_rate = 0.0;
 int decimation = 1;
+double software_sample_rate = 0.0;    /* Hz (0: disabled) */
 double ppm = 0.0;
 sdrplay_api_If_kHzT if_frequency = sdrplay_api_IF_Zero;
 sdrplay_api_Bw_MHzT if_bandwidth = sdrplay_api_BW_0_200;
@@ -58,7 +62,12 @@ double frequency_B = 100e6;
 /* streaming and output settings */
 int streaming_time = 10;  /* streaming time in seconds */
 int marker_interval = 0;  /* store a marker tick every N seconds */
+unsigned int marker_interval_samples = 0;  /* store a marker tick every N samples */
 OutputType output_type = OUTPUT_TYPE_WAVVIEWDX_RAW;
+SampleFormat sample_format = SAMPLE_FORMAT_S16;
+unsigned int bfp_block_size = 128;      /* frames in a block floating point block */
+SampleScale sample_scale = SAMPLE_SCALE_FULLSCALE;  /* cf32 only */
+double calibration_offset = 0.0;        /* dB, calibrated scale only */
 char *outfile_template = NULL;
 unsigned int zero_sample_gaps_max_size = 100000;
 #ifndef WIN32
@@ -69,9 +78,83 @@ unsigned int samples_buffer_capacity = 1048576;
 unsigned int blocks_buffer_capacity = 16000;
 unsigned int samples_buffer_capacity = 8388608;
 #endif
+int split_tuner_files = 0;
+int header_checkpoint_interval = 10;    /* rewrite WAV header sizes every N seconds */
+int header_checkpoint_size = 0;         /* rewrite WAV header sizes every N MB */
+int header_checkpoint_sync = 0;         /* flush the file to disk after each checkpoint */
+int pipe_size = 1048576;                /* stdout/named pipe buffer size (0: system default) */
+int pipe_zero_copy = 1;
+/* tee outputs */
+const char *tee_outputs[MAX_TEE_OUTPUTS];       /* [<sample format>:]<filename> */
+int num_tee_outputs = 0;
+unsigned int tee_buffer_capacity = 4194304;     /* in number of samples */
+/* shared memory output */
+const char *shm_output_name = NULL;
+SampleFormat shm_output_format = SAMPLE_FORMAT_S16;
+unsigned int shm_output_capacity = 4194304;     /* in number of samples */
+/* triggered recordings */
+int trigger_mode = 0;
+double trigger_pre_time = 10.0;                 /* seconds before the trigger */
+double trigger_post_time = 10.0;                /* seconds after the trigger */
+const char *trigger_control_socket = NULL;
+int power_detector_enable = 0;
+double power_detector_threshold = 10.0;         /* dB above the baseline */
+double power_detector_hysteresis = 3.0;         /* dB */
+unsigned int power_detector_block_size = 16384; /* in number of samples */
+double power_detector_baseline_time = 10.0;     /* seconds */
+double power_detector_band_low = 0.0;           /* Hz from the center frequency */
+double power_detector_band_high = 0.0;          /* Hz from the center frequency */
+unsigned int power_detector_fft_size = 256;
+/* TCP server output */
+const char *tcp_server_address = NULL;          /* [<address>:]<port> */
+TcpServerFormat tcp_server_format = TCP_SERVER_FORMAT_U8;
+unsigned int tcp_server_queue_capacity = 1048576;   /* in number of samples */
+int tcp_server_max_clients = 4;
+/* digital downconverter (DDC) channels */
+double ddc_channel_frequencies[MAX_DDC_CHANNELS];       /* Hz */
+double ddc_channel_sample_rates[MAX_DDC_CHANNELS];      /* 0: ddc sample rate */
+int num_ddc_channels = 0;
+double ddc_sample_rate = 20000.0;
+int ddc_threads = 2;
+unsigned int ddc_buffer_capacity = 4194304;     /* in number of samples */
+int ddc_only = 0;                               /* no full band output file */
+/* FFT channelizer */
+double channelizer_spacing = 0.0;               /* Hz (0: disabled) */
+int channelizer_oversampling = 2;               /* 1: critically sampled, 2: 2x oversampled */
+int channelizer_taps_per_channel = 16;
+double channelizer_range_low = 0.0;             /* Hz */
+double channelizer_range_high = 0.0;            /* Hz */
+int channelizer_multichannel_file = 0;
+unsigned int channelizer_buffer_capacity = 4194304; /* in number of samples */
+/* spectrum (PSD/waterfall) file */
+int spectrum_file_enable = 0;
+unsigned int spectrum_fft_size = 1024;
+double spectrum_interval = 1.0;                 /* seconds */
+SpectrumFormat spectrum_format = SPECTRUM_FORMAT_UINT8;
+double spectrum_range_low = -130.0;             /* dBFS */
+double spectrum_range_high = -10.0;             /* dBFS */
+int spectrum_image = 0;                         /* PGM image */
+unsigned int spectrum_buffer_capacity = 4194304;    /* in number of samples */
+/* index file */
+int index_file_enable = 0;
+int index_interval = 100;   /* one index entry every N milliseconds */
+/* envelope file */
+int envelope_file_enable = 0;
+/* overload map */
+int overload_map_enable = 0;
+double overload_threshold = -1.0;               /* dBFS */
+/* diversity combining */
+DiversityCombining diversity_combining = DIVERSITY_COMBINING_NONE;
+unsigned int diversity_block_size = 8192;       /* in number of samples */
+/* compressed output */
+int compression_threads = 2;
+unsigned int compression_block_size = 0;        /* frames in a compressed block (0: default) */
+int compression_level = 3;                      /* zstd only */
+int compression_verify = 0;
 /* gain file */
 int gains_file_enable = 0;
 int gain_changes_buffer_capacity = 100;
+int events_chunk_enable = 0;
 /* misc settings */
 int debug_enable = 0;
 int verbose = 0;
@@ -79,6 +162,13 @@ int verbose = 0;
 /* internal functions */
 static int read_config_file(const char *config_file);
 static OutputType output_type_from_string(const char *output_type_string);
+static SampleFormat sample_format_from_string(const char *sample_format_string);
+static SampleScale sample_scale_from_string(const char *sample_scale_string);
+static TcpServerFormat tcp_server_format_from_string(const char *tcp_server_format_string);
+static SpectrumFormat spectrum_format_from_string(const char *spectrum_format_string);
+static DiversityCombining diversity_combining_from_string(const char *diversity_combining_string);
+static int add_tee_output(const char *tee_output);
+static int add_ddc_channel(const char *ddc_channel);
 
 /* internal constants */
 #define LINE_BUFFER_SIZE 1024
@@ -110,11 +200,14 @@ static void usage(const char* progname)
     fprintf(stderr, "    -f <center frequency>\n");
     fprintf(stderr, "    -x <streaming time (s)> (default: 10s)\n");
     fprintf(stderr, "    -m <time marker interval (s)> (default: 0 -> no time markers)\n");
-    fprintf(stderr, "    -t <output file format> (one of: WavViewDX-raw, Linrad, SDRuno, SDRconnect, experimental)\n");
+    fprintf(stderr, "    -t <output file format> (one of: WavViewDX-raw, Linrad, SDRuno, SDRconnect, compressed, zstd, SigMF, experimental)\n");
+    fprintf(stderr, "    -F <output sample format> (one of: s16, bfp8, packed12, packed14, cf32, cs8; default: s16)\n");
     fprintf(stderr, "    -o <output filename template>\n");
+    fprintf(stderr, "    -T <tee output> ([<sample format>:]<filename>, '-' for stdout, '|<pipe>' for named pipe; can be repeated)\n");
     fprintf(stderr, "    -z <zero sample gaps if smaller than size> (default: 100000)\n");
     fprintf(stderr, "    -j <blocks buffer capacity> (in number of blocks)\n");
     fprintf(stderr, "    -k <samples buffer capacity> (in number of samples)\n");
+    fprintf(stderr, "    -S write one output file per tuner in dual tuner mode (default: disabled)\n");
     fprintf(stderr, "    -L output file in Linrad format\n");
     fprintf(stderr, "    -R output file in raw format (i.e. just the samples)\n");
     fprintf(stderr, "    -W output file in RIFF/RF64 format\n");
@@ -128,7 +221,7 @@ static void usage(const char* progname)
 int get_config_from_cli(int argc, char *argv[])
 {
     int c;
-    while ((c = getopt(argc, argv, "c:s:w:a:r:p:d:i:b:g:l:n:DIy:BHu:f:x:m:t:o:z:j:k:GXvh")) != -1) {
+    while ((c = getopt(argc, argv, "c:s:w:a:r:p:d:i:b:g:l:n:DIy:BHu:f:x:m:t:F:o:T:z:j:k:SGXvh")) != -1) {
         int n;
         switch (c) {
             case 'c':
@@ -276,9 +369,21 @@ int get_config_from_cli(int argc, char *argv[])
                     return -1;
                 }
                 break;
+            case 'F':
+                sample_format = sample_format_from_string(optarg);
+                if (sample_format == SAMPLE_FORMAT_UNKNOWN) {
+                    fprintf(stderr, "invalid sample format: %s\n", optarg);
+                    return -1;
+                }
+                break;
             case 'o':
                 outfile_template = optarg;
                 break;
+            case 'T':
+                if (add_tee_output(optarg) == -1) {
+                    return -1;
+                }
+                break;
             case 'z':
                 if (sscanf(optarg, "%u", &zero_sample_gaps_max_size) != 1) {
                     fprintf(stderr, "invalid zero sample gaps max size: %s\n", optarg);
@@ -297,6 +402,9 @@ int get_config_from_cli(int argc, char *argv[])
                     return -1;
                 }
                 break;
+            case 'S':
+                split_tuner_files = 1;
+                break;
             case 'G':
                 gains_file_enable = 1;
                 break;
@@ -319,9 +427,270 @@ int get_config_from_cli(int argc, char *argv[])
         }
     }
 
-    if (marker_interval > 0) {
-        if (output_type != OUTPUT_TYPE_EXPERIMENTAL) {
-            fprintf(stderr, "time markers require experimental output type");
+    if (marker_interval > 0 || marker_interval_samples > 0) {
+        if (output_type != OUTPUT_TYPE_EXPERIMENTAL && output_type != OUTPUT_TYPE_SIGMF) {
+            fprintf(stderr, "time markers require experimental or SigMF output type");
+            return -1;
+        }
+    }
+    if (events_chunk_enable) {
+        if (!(output_type == OUTPUT_TYPE_SDRUNO || output_type == OUTPUT_TYPE_SDRCONNECT || output_type == OUTPUT_TYPE_EXPERIMENTAL)) {
+            fprintf(stderr, "events chunk requires SDRuno, SDRconnect, or experimental output type\n");
+            return -1;
+        }
+    }
+    if (output_type == OUTPUT_TYPE_COMPRESSED || output_type == OUTPUT_TYPE_ZSTD) {
+        if (compression_threads < 1) {
+            fprintf(stderr, "invalid number of compression threads: %d\n", compression_threads);
+            return -1;
+        }
+    }
+#ifndef HAVE_ZSTD
+    if (output_type == OUTPUT_TYPE_ZSTD) {
+        fprintf(stderr, "zstd output type not available (built without zstd)\n");
+        return -1;
+    }
+#endif /* HAVE_ZSTD */
+    if (sample_format != SAMPLE_FORMAT_S16) {
+        if (output_type == OUTPUT_TYPE_SIGMF) {
+            if (!(sample_format == SAMPLE_FORMAT_CF32 || sample_format == SAMPLE_FORMAT_CS8)) {
+                fprintf(stderr, "SigMF output type supports only s16, cf32, and cs8 sample formats\n");
+                return -1;
+            }
+        } else if (output_type != OUTPUT_TYPE_WAVVIEWDX_RAW) {
+            fprintf(stderr, "sample formats other than s16 require WavViewDX-raw output type\n");
+            return -1;
+        }
+        if (index_file_enable) {
+            fprintf(stderr, "index file requires s16 sample format\n");
+            return -1;
+        }
+        if (sample_format == SAMPLE_FORMAT_BFP8 && bfp_block_size < 1) {
+            fprintf(stderr, "invalid block floating point block size: %u\n", bfp_block_size);
+            return -1;
+        }
+    }
+    if (sample_scale != SAMPLE_SCALE_FULLSCALE && sample_format != SAMPLE_FORMAT_CF32) {
+        fprintf(stderr, "sample scale requires cf32 sample format\n");
+        return -1;
+    }
+    if (num_tee_outputs > 0) {
+        if (split_tuner_files) {
+            fprintf(stderr, "tee outputs are not supported with one file per tuner\n");
+            return -1;
+        }
+        if (tee_buffer_capacity < 65536) {
+            fprintf(stderr, "tee buffer capacity must be at least 65536 samples\n");
+            return -1;
+        }
+    }
+    if (shm_output_name != NULL) {
+#ifdef WIN32
+        fprintf(stderr, "shared memory output is not supported on Windows\n");
+        return -1;
+#endif /* WIN32 */
+        if (shm_output_name[0] != '/') {
+            fprintf(stderr, "shared memory output name must begin with '/': %s\n", shm_output_name);
+            return -1;
+        }
+        if (!(shm_output_format == SAMPLE_FORMAT_S16 || shm_output_format == SAMPLE_FORMAT_CF32 || shm_output_format == SAMPLE_FORMAT_CS8)) {
+            fprintf(stderr, "shared memory output supports only s16, cf32, and cs8 sample formats\n");
+            return -1;
+        }
+        if (split_tuner_files) {
+            fprintf(stderr, "shared memory output is not supported with one file per tuner\n");
+            return -1;
+        }
+        if (shm_output_capacity < 65536) {
+            fprintf(stderr, "shared memory capacity must be at least 65536 samples\n");
+            return -1;
+        }
+    }
+    if (pipe_size < 0) {
+        fprintf(stderr, "invalid pipe size: %d\n", pipe_size);
+        return -1;
+    }
+    if (trigger_mode) {
+        if (!(output_type == OUTPUT_TYPE_WAVVIEWDX_RAW || output_type == OUTPUT_TYPE_SDRUNO || output_type == OUTPUT_TYPE_SDRCONNECT || output_type == OUTPUT_TYPE_EXPERIMENTAL)) {
+            fprintf(stderr, "trigger mode is only supported for WavViewDX-raw, SDRuno, SDRconnect, and experimental formats\n");
+            return -1;
+        }
+        if (sample_format != SAMPLE_FORMAT_S16) {
+            fprintf(stderr, "trigger mode requires s16 sample format\n");
+            return -1;
+        }
+        if (split_tuner_files) {
+            fprintf(stderr, "trigger mode is not supported with one file per tuner\n");
+            return -1;
+        }
+        if (index_file_enable) {
+            fprintf(stderr, "trigger mode is not supported with the index file\n");
+            return -1;
+        }
+        if (envelope_file_enable) {
+            fprintf(stderr, "trigger mode is not supported with the envelope file\n");
+            return -1;
+        }
+        if (trigger_pre_time < 0.0 || trigger_post_time <= 0.0) {
+            fprintf(stderr, "invalid trigger pre time or post time: %lf %lf\n", trigger_pre_time, trigger_post_time);
+            return -1;
+        }
+#ifdef WIN32
+        if (trigger_control_socket != NULL) {
+            fprintf(stderr, "trigger control socket is not supported on Windows\n");
+            return -1;
+        }
+#endif /* WIN32 */
+    }
+    if (power_detector_enable) {
+        if (!trigger_mode) {
+            fprintf(stderr, "power detector requires trigger mode\n");
+            return -1;
+        }
+        if (power_detector_threshold <= 0.0 || power_detector_hysteresis < 0.0 || power_detector_hysteresis >= power_detector_threshold) {
+            fprintf(stderr, "invalid power detector threshold or hysteresis: %lf %lf\n", power_detector_threshold, power_detector_hysteresis);
+            return -1;
+        }
+        if (power_detector_block_size < 256 || power_detector_baseline_time <= 0.0) {
+            fprintf(stderr, "invalid power detector block size or baseline time: %u %lf\n", power_detector_block_size, power_detector_baseline_time);
+            return -1;
+        }
+        if (power_detector_band_low > power_detector_band_high) {
+            fprintf(stderr, "invalid power detector band: %lf,%lf\n", power_detector_band_low, power_detector_band_high);
+            return -1;
+        }
+        if (power_detector_band_low != power_detector_band_high) {
+            if (power_detector_fft_size < 16 || power_detector_fft_size > 4096 || (power_detector_fft_size & (power_detector_fft_size - 1)) != 0) {
+                fprintf(stderr, "power detector fft size must be a power of 2 between 16 and 4096\n");
+                return -1;
+            }
+            if (power_detector_block_size % power_detector_fft_size != 0) {
+                fprintf(stderr, "power detector block size must be a multiple of the fft size\n");
+                return -1;
+            }
+        }
+    }
+    if (tcp_server_address != NULL) {
+#ifndef __linux__
+        fprintf(stderr, "TCP server output is only supported on Linux\n");
+        return -1;
+#endif /* __linux__ */
+        if (split_tuner_files) {
+            fprintf(stderr, "TCP server output is not supported with one file per tuner\n");
+            return -1;
+        }
+        if (tcp_server_queue_capacity < 65536) {
+            fprintf(stderr, "TCP server queue capacity must be at least 65536 samples\n");
+            return -1;
+        }
+        if (tcp_server_max_clients < 1) {
+            fprintf(stderr, "invalid TCP server max clients: %d\n", tcp_server_max_clients);
+            return -1;
+        }
+    }
+    if (num_ddc_channels > 0) {
+        if (!(output_type == OUTPUT_TYPE_WAVVIEWDX_RAW || output_type == OUTPUT_TYPE_SDRUNO || output_type == OUTPUT_TYPE_SDRCONNECT || output_type == OUTPUT_TYPE_EXPERIMENTAL)) {
+            fprintf(stderr, "DDC channels are only supported for WavViewDX-raw, SDRuno, SDRconnect, and experimental formats\n");
+            return -1;
+        }
+        if (split_tuner_files) {
+            fprintf(stderr, "DDC channels are not supported with one file per tuner\n");
+            return -1;
+        }
+        if (ddc_sample_rate <= 0.0 || ddc_threads < 1) {
+            fprintf(stderr, "invalid DDC sample rate or threads: %lf %d\n", ddc_sample_rate, ddc_threads);
+            return -1;
+        }
+        if (ddc_buffer_capacity < 65536) {
+            fprintf(stderr, "DDC buffer capacity must be at least 65536 samples\n");
+            return -1;
+        }
+    }
+    if (channelizer_spacing > 0.0) {
+        if (!(output_type == OUTPUT_TYPE_WAVVIEWDX_RAW || output_type == OUTPUT_TYPE_SDRUNO || output_type == OUTPUT_TYPE_SDRCONNECT || output_type == OUTPUT_TYPE_EXPERIMENTAL)) {
+            fprintf(stderr, "channelizer is only supported for WavViewDX-raw, SDRuno, SDRconnect, and experimental formats\n");
+            return -1;
+        }
+        if (split_tuner_files) {
+            fprintf(stderr, "channelizer is not supported with one file per tuner\n");
+            return -1;
+        }
+        if (!(channelizer_oversampling == 1 || channelizer_oversampling == 2) || channelizer_taps_per_channel < 2 || channelizer_taps_per_channel > 64) {
+            fprintf(stderr, "invalid channelizer oversampling or taps per channel: %d %d\n", channelizer_oversampling, channelizer_taps_per_channel);
+            return -1;
+        }
+        if (channelizer_range_low > channelizer_range_high) {
+            fprintf(stderr, "invalid channelizer range: %lf,%lf\n", channelizer_range_low, channelizer_range_high);
+            return -1;
+        }
+        if (channelizer_buffer_capacity < 65536) {
+            fprintf(stderr, "channelizer buffer capacity must be at least 65536 samples\n");
+            return -1;
+        }
+    }
+    if (spectrum_file_enable) {
+        if (split_tuner_files) {
+            fprintf(stderr, "spectrum file is not supported with one file per tuner\n");
+            return -1;
+        }
+        if (spectrum_fft_size < 16 || spectrum_fft_size > 65536 || spectrum_interval <= 0.0) {
+            fprintf(stderr, "invalid spectrum fft size or interval: %u %lf\n", spectrum_fft_size, spectrum_interval);
+            return -1;
+        }
+        if (spectrum_range_low >= spectrum_range_high) {
+            fprintf(stderr, "invalid spectrum range: %lf,%lf\n", spectrum_range_low, spectrum_range_high);
+            return -1;
+        }
+        if (spectrum_buffer_capacity < 65536 || spectrum_buffer_capacity < 4 * spectrum_fft_size) {
+            fprintf(stderr, "spectrum buffer capacity must be at least 65536 samples and 4 times the fft size\n");
+            return -1;
+        }
+    }
+    if (overload_threshold < -40.0 || overload_threshold > 0.0) {
+        fprintf(stderr, "invalid overload threshold: %lf (must be between -40 and 0 dBFS)\n", overload_threshold);
+        return -1;
+    }
+    if (diversity_combining != DIVERSITY_COMBINING_NONE) {
+        if (rspduo_mode != sdrplay_api_RspDuoMode_Dual_Tuner) {
+            fprintf(stderr, "diversity combining requires RSPduo dual tuner mode\n");
+            return -1;
+        }
+        if (frequency_A != frequency_B) {
+            fprintf(stderr, "diversity combining requires both tuners on the same frequency\n");
+            return -1;
+        }
+        if (split_tuner_files) {
+            fprintf(stderr, "diversity combining is not supported with one file per tuner\n");
+            return -1;
+        }
+        if (trigger_mode) {
+            fprintf(stderr, "diversity combining is not supported in trigger mode\n");
+            return -1;
+        }
+        if (ddc_only) {
+            fprintf(stderr, "diversity combining is not supported with DDC only\n");
+            return -1;
+        }
+        if (diversity_block_size < 256 || diversity_block_size > 1048576) {
+            fprintf(stderr, "invalid diversity block size: %u (must be between 256 and 1048576 samples)\n", diversity_block_size);
+            return -1;
+        }
+    }
+    if (ddc_only) {
+        if (num_ddc_channels == 0 && channelizer_spacing <= 0.0) {
+            fprintf(stderr, "DDC only requires at least one DDC channel or the channelizer\n");
+            return -1;
+        }
+        if (trigger_mode) {
+            fprintf(stderr, "DDC only is not supported in trigger mode\n");
+            return -1;
+        }
+        if (index_file_enable) {
+            fprintf(stderr, "DDC only is not supported with the index file\n");
+            return -1;
+        }
+        if (envelope_file_enable) {
+            fprintf(stderr, "DDC only is not supported with the envelope file\n");
             return -1;
         }
     }
@@ -345,6 +714,15 @@ int get_config_from_cli(int argc, char *argv[])
             case OUTPUT_TYPE_SDRCONNECT:
                 outfile_template = default_output_filename_sdrconnect;
                 break;
+            case OUTPUT_TYPE_COMPRESSED:
+                outfile_template = default_output_filename_compressed;
+                break;
+            case OUTPUT_TYPE_ZSTD:
+                outfile_template = default_output_filename_zstd;
+                break;
+            case OUTPUT_TYPE_SIGMF:
+                outfile_template = default_output_filename_sigmf;
+                break;
             case OUTPUT_TYPE_EXPERIMENTAL:
                 outfile_template = default_output_filename_experimental;
                 break;
@@ -611,6 +989,56 @@ static int read_config_output_type(const char *valuestr, OutputType *value) {
     return 0;
 }
 
+static int read_config_sample_format(const char *valuestr, SampleFormat *value) {
+    SampleFormat sf = sample_format_from_string(valuestr);
+    if (sf == SAMPLE_FORMAT_UNKNOWN) {
+        return -1;
+    }
+    *value = sf;
+
+    return 0;
+}
+
+static int read_config_sample_scale(const char *valuestr, SampleScale *value) {
+    SampleScale ss = sample_scale_from_string(valuestr);
+    if (ss == SAMPLE_SCALE_UNKNOWN) {
+        return -1;
+    }
+    *value = ss;
+
+    return 0;
+}
+
+static int read_config_tcp_server_format(const char *valuestr, TcpServerFormat *value) {
+    TcpServerFormat tf = tcp_server_format_from_string(valuestr);
+    if (tf == TCP_SERVER_FORMAT_UNKNOWN) {
+        return -1;
+    }
+    *value = tf;
+
+    return 0;
+}
+
+static int read_config_spectrum_format(const char *valuestr, SpectrumFormat *value) {
+    SpectrumFormat sf = spectrum_format_from_string(valuestr);
+    if (sf == SPECTRUM_FORMAT_UNKNOWN) {
+        return -1;
+    }
+    *value = sf;
+
+    return 0;
+}
+
+static int read_config_diversity_combining(const char *valuestr, DiversityCombining *value) {
+    DiversityCombining dc = diversity_combining_from_string(valuestr);
+    if (dc == DIVERSITY_COMBINING_UNKNOWN) {
+        return -1;
+    }
+    *value = dc;
+
+    return 0;
+}
+
 static int read_config_file(const char *config_file) {
     if (read_config_file_begin(config_file) == -1)
         return -1;
@@ -629,6 +1057,8 @@ static int read_config_file(const char *config_file) {
             read_config_status = read_config_double(value, &sample_rate);
         } else if (strcasecmp(key, "decimation") == 0) {
             read_config_status = read_config_int(value, &decimation);
+        } else if (strcasecmp(key, "software sample rate") == 0) {
+            read_config_status = read_config_double(value, &software_sample_rate);
         } else if (strcasecmp(key, "frequency correction") == 0 || strcasecmp(key, "ppm") == 0) {
             read_config_status = read_config_double(value, &ppm);
         } else if (strcasecmp(key, "IF frequency") == 0) {
@@ -669,18 +1099,140 @@ static int read_config_file(const char *config_file) {
             read_config_status = read_config_int(value, &streaming_time);
         } else if (strcasecmp(key, "marker interval") == 0) {
             read_config_status = read_config_int(value, &marker_interval);
+        } else if (strcasecmp(key, "marker interval samples") == 0) {
+            read_config_status = read_config_unsigned_int(value, &marker_interval_samples);
         } else if (strcasecmp(key, "output type") == 0) {
             read_config_status = read_config_output_type(value, &output_type);
+        } else if (strcasecmp(key, "sample format") == 0) {
+            read_config_status = read_config_sample_format(value, &sample_format);
+        } else if (strcasecmp(key, "bfp block size") == 0) {
+            read_config_status = read_config_unsigned_int(value, &bfp_block_size);
+        } else if (strcasecmp(key, "sample scale") == 0) {
+            read_config_status = read_config_sample_scale(value, &sample_scale);
+        } else if (strcasecmp(key, "calibration offset") == 0) {
+            read_config_status = read_config_double(value, &calibration_offset);
         } else if (strcasecmp(key, "output file") == 0) {
             read_config_status = read_config_string(value, (const char **)(&outfile_template));
+        } else if (strcasecmp(key, "tee output") == 0) {
+            read_config_status = add_tee_output(value);
+        } else if (strcasecmp(key, "tee buffer capacity") == 0) {
+            read_config_status = read_config_unsigned_int(value, &tee_buffer_capacity);
+        } else if (strcasecmp(key, "shared memory output") == 0) {
+            read_config_status = read_config_string(value, &shm_output_name);
+        } else if (strcasecmp(key, "shared memory format") == 0) {
+            read_config_status = read_config_sample_format(value, &shm_output_format);
+        } else if (strcasecmp(key, "shared memory capacity") == 0) {
+            read_config_status = read_config_unsigned_int(value, &shm_output_capacity);
+        } else if (strcasecmp(key, "trigger mode") == 0) {
+            read_config_status = read_config_bool(value, &trigger_mode);
+        } else if (strcasecmp(key, "trigger pre time") == 0) {
+            read_config_status = read_config_double(value, &trigger_pre_time);
+        } else if (strcasecmp(key, "trigger post time") == 0) {
+            read_config_status = read_config_double(value, &trigger_post_time);
+        } else if (strcasecmp(key, "trigger control socket") == 0) {
+            read_config_status = read_config_string(value, &trigger_control_socket);
+        } else if (strcasecmp(key, "power detector") == 0) {
+            read_config_status = read_config_bool(value, &power_detector_enable);
+        } else if (strcasecmp(key, "power detector threshold") == 0) {
+            read_config_status = read_config_double(value, &power_detector_threshold);
+        } else if (strcasecmp(key, "power detector hysteresis") == 0) {
+            read_config_status = read_config_double(value, &power_detector_hysteresis);
+        } else if (strcasecmp(key, "power detector block size") == 0) {
+            read_config_status = read_config_unsigned_int(value, &power_detector_block_size);
+        } else if (strcasecmp(key, "power detector baseline time") == 0) {
+            read_config_status = read_config_double(value, &power_detector_baseline_time);
+        } else if (strcasecmp(key, "power detector band") == 0) {
+            read_config_status = read_config_two_doubles(value, &power_detector_band_low, &power_detector_band_high);
+        } else if (strcasecmp(key, "power detector fft size") == 0) {
+            read_config_status = read_config_unsigned_int(value, &power_detector_fft_size);
+        } else if (strcasecmp(key, "tcp server") == 0) {
+            read_config_status = read_config_string(value, &tcp_server_address);
+        } else if (strcasecmp(key, "tcp server format") == 0) {
+            read_config_status = read_config_tcp_server_format(value, &tcp_server_format);
+        } else if (strcasecmp(key, "tcp server queue capacity") == 0) {
+            read_config_status = read_config_unsigned_int(value, &tcp_server_queue_capacity);
+        } else if (strcasecmp(key, "tcp server max clients") == 0) {
+            read_config_status = read_config_int(value, &tcp_server_max_clients);
+        } else if (strcasecmp(key, "ddc channel") == 0) {
+            read_config_status = add_ddc_channel(value);
+        } else if (strcasecmp(key, "ddc sample rate") == 0) {
+            read_config_status = read_config_double(value, &ddc_sample_rate);
+        } else if (strcasecmp(key, "ddc threads") == 0) {
+            read_config_status = read_config_int(value, &ddc_threads);
+        } else if (strcasecmp(key, "ddc buffer capacity") == 0) {
+            read_config_status = read_config_unsigned_int(value, &ddc_buffer_capacity);
+        } else if (strcasecmp(key, "ddc only") == 0) {
+            read_config_status = read_config_bool(value, &ddc_only);
+        } else if (strcasecmp(key, "channelizer spacing") == 0) {
+            read_config_status = read_config_double(value, &channelizer_spacing);
+        } else if (strcasecmp(key, "channelizer oversampling") == 0) {
+            read_config_status = read_config_int(value, &channelizer_oversampling);
+        } else if (strcasecmp(key, "channelizer taps per channel") == 0) {
+            read_config_status = read_config_int(value, &channelizer_taps_per_channel);
+        } else if (strcasecmp(key, "channelizer range") == 0) {
+            read_config_status = read_config_two_doubles(value, &channelizer_range_low, &channelizer_range_high);
+        } else if (strcasecmp(key, "channelizer multichannel file") == 0) {
+            read_config_status = read_config_bool(value, &channelizer_multichannel_file);
+        } else if (strcasecmp(key, "channelizer buffer capacity") == 0) {
+            read_config_status = read_config_unsigned_int(value, &channelizer_buffer_capacity);
+        } else if (strcasecmp(key, "spectrum file") == 0) {
+            read_config_status = read_config_bool(value, &spectrum_file_enable);
+        } else if (strcasecmp(key, "spectrum fft size") == 0) {
+            read_config_status = read_config_unsigned_int(value, &spectrum_fft_size);
+        } else if (strcasecmp(key, "spectrum interval") == 0) {
+            read_config_status = read_config_double(value, &spectrum_interval);
+        } else if (strcasecmp(key, "spectrum format") == 0) {
+            read_config_status = read_config_spectrum_format(value, &spectrum_format);
+        } else if (strcasecmp(key, "spectrum range") == 0) {
+            read_config_status = read_config_two_doubles(value, &spectrum_range_low, &spectrum_range_high);
+        } else if (strcasecmp(key, "spectrum image") == 0) {
+            read_config_status = read_config_bool(value, &spectrum_image);
+        } else if (strcasecmp(key, "spectrum buffer capacity") == 0) {
+            read_config_status = read_config_unsigned_int(value, &spectrum_buffer_capacity);
+        } else if (strcasecmp(key, "index file") == 0) {
+            read_config_status = read_config_bool(value, &index_file_enable);
+        } else if (strcasecmp(key, "index interval") == 0) {
+            read_config_status = read_config_int(value, &index_interval);
+        } else if (strcasecmp(key, "envelope file") == 0) {
+            read_config_status = read_config_bool(value, &envelope_file_enable);
+        } else if (strcasecmp(key, "overload map") == 0) {
+            read_config_status = read_config_bool(value, &overload_map_enable);
+        } else if (strcasecmp(key, "overload threshold") == 0) {
+            read_config_status = read_config_double(value, &overload_threshold);
+        } else if (strcasecmp(key, "diversity combining") == 0) {
+            read_config_status = read_config_diversity_combining(value, &diversity_combining);
+        } else if (strcasecmp(key, "diversity block size") == 0) {
+            read_config_status = read_config_unsigned_int(value, &diversity_block_size);
         } else if (strcasecmp(key, "gains file") == 0) {
             read_config_status = read_config_bool(value, &gains_file_enable);
+        } else if (strcasecmp(key, "events chunk") == 0) {
+            read_config_status = read_config_bool(value, &events_chunk_enable);
         } else if (strcasecmp(key, "zero sample gaps max size") == 0) {
             read_config_status = read_config_unsigned_int(value, &zero_sample_gaps_max_size);
         } else if (strcasecmp(key, "blocks buffer capacity") == 0) {
             read_config_status = read_config_unsigned_int(value, &blocks_buffer_capacity);
         } else if (strcasecmp(key, "samples buffer capacity") == 0) {
             read_config_status = read_config_unsigned_int(value, &samples_buffer_capacity);
+        } else if (strcasecmp(key, "split tuner files") == 0) {
+            read_config_status = read_config_bool(value, &split_tuner_files);
+        } else if (strcasecmp(key, "header checkpoint interval") == 0) {
+            read_config_status = read_config_int(value, &header_checkpoint_interval);
+        } else if (strcasecmp(key, "header checkpoint size") == 0) {
+            read_config_status = read_config_int(value, &header_checkpoint_size);
+        } else if (strcasecmp(key, "header checkpoint sync") == 0) {
+            read_config_status = read_config_bool(value, &header_checkpoint_sync);
+        } else if (strcasecmp(key, "pipe size") == 0) {
+            read_config_status = read_config_int(value, &pipe_size);
+        } else if (strcasecmp(key, "pipe zero copy") == 0) {
+            read_config_status = read_config_bool(value, &pipe_zero_copy);
+        } else if (strcasecmp(key, "compression threads") == 0) {
+            read_config_status = read_config_int(value, &compression_threads);
+        } else if (strcasecmp(key, "compression block size") == 0) {
+            read_config_status = read_config_unsigned_int(value, &compression_block_size);
+        } else if (strcasecmp(key, "compression level") == 0) {
+            read_config_status = read_config_int(value, &compression_level);
+        } else if (strcasecmp(key, "compression verify") == 0) {
+            read_config_status = read_config_bool(value, &compression_verify);
         } else if (strcasecmp(key, "gain changes buffer capacity") == 0) {
             read_config_status = read_config_int(value, &gain_changes_buffer_capacity);
         } else if (strcasecmp(key, "verbose") == 0) {
@@ -707,9 +1259,128 @@ static OutputType output_type_from_string(const char *output_type_string) {
         return OUTPUT_TYPE_SDRUNO;
     } else if (strcasecmp(output_type_string, "SDRconnect") == 0) {
         return OUTPUT_TYPE_SDRCONNECT;
+    } else if (strcasecmp(output_type_string, "compressed") == 0 || strcasecmp(output_type_string, "IQZ") == 0) {
+        return OUTPUT_TYPE_COMPRESSED;
+    } else if (strcasecmp(output_type_string, "zstd") == 0) {
+        return OUTPUT_TYPE_ZSTD;
+    } else if (strcasecmp(output_type_string, "sigmf") == 0) {
+        return OUTPUT_TYPE_SIGMF;
     } else if (strcasecmp(output_type_string, "experimental") == 0) {
         return OUTPUT_TYPE_EXPERIMENTAL;
     } else {
         return OUTPUT_TYPE_UNKNOWN;
     }
 }
+
+static SampleFormat sample_format_from_string(const char *sample_format_string) {
+    if (strcasecmp(sample_format_string, "s16") == 0 || strcasecmp(sample_format_string, "pcm16") == 0) {
+        return SAMPLE_FORMAT_S16;
+    } else if (strcasecmp(sample_format_string, "bfp8") == 0) {
+        return SAMPLE_FORMAT_BFP8;
+    } else if (strcasecmp(sample_format_string, "packed12") == 0) {
+        return SAMPLE_FORMAT_PACKED12;
+    } else if (strcasecmp(sample_format_string, "packed14") == 0) {
+        return SAMPLE_FORMAT_PACKED14;
+    } else if (strcasecmp(sample_format_string, "cf32") == 0) {
+        return SAMPLE_FORMAT_CF32;
+    } else if (strcasecmp(sample_format_string, "cs8") == 0) {
+        return SAMPLE_FORMAT_CS8;
+    } else {
+        return SAMPLE_FORMAT_UNKNOWN;
+    }
+}
+
+static SampleScale sample_scale_from_string(const char *sample_scale_string) {
+    if (strcasecmp(sample_scale_string, "fullscale") == 0 || strcasecmp(sample_scale_string, "dBFS") == 0) {
+        return SAMPLE_SCALE_FULLSCALE;
+    } else if (strcasecmp(sample_scale_string, "raw") == 0) {
+        return SAMPLE_SCALE_RAW;
+    } else if (strcasecmp(sample_scale_string, "calibrated") == 0) {
+        return SAMPLE_SCALE_CALIBRATED;
+    } else {
+        return SAMPLE_SCALE_UNKNOWN;
+    }
+}
+
+static TcpServerFormat tcp_server_format_from_string(const char *tcp_server_format_string) {
+    if (strcasecmp(tcp_server_format_string, "u8") == 0) {
+        return TCP_SERVER_FORMAT_U8;
+    } else if (strcasecmp(tcp_server_format_string, "cs8") == 0) {
+        return TCP_SERVER_FORMAT_CS8;
+    } else if (strcasecmp(tcp_server_format_string, "cs16") == 0) {
+        return TCP_SERVER_FORMAT_CS16;
+    } else {
+        return TCP_SERVER_FORMAT_UNKNOWN;
+    }
+}
+
+static SpectrumFormat spectrum_format_from_string(const char *spectrum_format_string) {
+    if (strcasecmp(spectrum_format_string, "float16") == 0) {
+        return SPECTRUM_FORMAT_FLOAT16;
+    } else if (strcasecmp(spectrum_format_string, "uint8") == 0) {
+        return SPECTRUM_FORMAT_UINT8;
+    } else {
+        return SPECTRUM_FORMAT_UNKNOWN;
+    }
+}
+
+static DiversityCombining diversity_combining_from_string(const char *diversity_combining_string) {
+    if (strcasecmp(diversity_combining_string, "none") == 0) {
+        return DIVERSITY_COMBINING_NONE;
+    } else if (strcasecmp(diversity_combining_string, "mrc") == 0) {
+        return DIVERSITY_COMBINING_MRC;
+    } else if (strcasecmp(diversity_combining_string, "selection") == 0) {
+        return DIVERSITY_COMBINING_SELECTION;
+    } else {
+        return DIVERSITY_COMBINING_UNKNOWN;
+    }
+}
+
+/* the tee outputs are opened (and their sample format is checked) by tee_open() */
+static int add_tee_output(const char *tee_output) {
+    if (num_tee_outputs >= MAX_TEE_OUTPUTS) {
+        fprintf(stderr, "too many tee outputs (max %d)\n", MAX_TEE_OUTPUTS);
+        return -1;
+    }
+    tee_outputs[num_tee_outputs] = strdup(tee_output);
+    if (tee_outputs[num_tee_outputs] == NULL) {
+        fprintf(stderr, "strdup(tee output) failed\n");
+        return -1;
+    }
+    num_tee_outputs++;
+    return 0;
+}
+
+/* <frequency>[,<sample rate>]; the channels are checked by ddc_open() */
+static int add_ddc_channel(const char *ddc_channel) {
+    if (num_ddc_channels >= MAX_DDC_CHANNELS) {
+        fprintf(stderr, "too many DDC channels (max %d)\n", MAX_DDC_CHANNELS);
+        return -1;
+    }
+    double frequency;
+    double sample_rate = 0.0;
+    int n;
+    if (sscanf(ddc_channel, "%lf%n", &frequency, &n) != 1) {
+        return -1;
+    }
+    const char *p = ddc_channel + n;
+    while (*p == ' ') {
+        p++;
+    }
+    if (*p == ',') {
+        if (sscanf(p + 1, "%lf%n", &sample_rate, &n) != 1) {
+            return -1;
+        }
+        p += 1 + n;
+        while (*p == ' ') {
+            p++;
+        }
+    }
+    if (*p != '\0' || frequency <= 0.0 || sample_rate < 0.0) {
+        return -1;
+    }
+    ddc_channel_frequencies[num_ddc_channels] = frequency;
+    ddc_channel_sample_rates[num_ddc_channels] = sample_rate;
+    num_ddc_channels++;
+    return 0;
+}
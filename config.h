@@ -22,9 +22,52 @@ typedef enum {
     OUTPUT_TYPE_LINRAD,
     OUTPUT_TYPE_SDRUNO,
     OUTPUT_TYPE_SDRCONNECT,
+    OUTPUT_TYPE_COMPRESSED,
+    OUTPUT_TYPE_ZSTD,
+    OUTPUT_TYPE_SIGMF,
     OUTPUT_TYPE_EXPERIMENTAL = 99,
 } OutputType;
 
+typedef enum {
+    SAMPLE_FORMAT_UNKNOWN,
+    SAMPLE_FORMAT_S16,          /* 16 bit signed integers */
+    SAMPLE_FORMAT_BFP8,         /* 8 bit block floating point */
+    SAMPLE_FORMAT_PACKED12,     /* 12 bit signed integers, packed */
+    SAMPLE_FORMAT_PACKED14,     /* 14 bit signed integers, packed */
+    SAMPLE_FORMAT_CF32,         /* complex 32 bit floats */
+    SAMPLE_FORMAT_CS8,          /* complex 8 bit signed integers */
+} SampleFormat;
+
+typedef enum {
+    SAMPLE_SCALE_UNKNOWN,
+    SAMPLE_SCALE_FULLSCALE,     /* 1.0 = 14 bit full scale */
+    SAMPLE_SCALE_RAW,           /* same values as the 16 bit samples */
+    SAMPLE_SCALE_CALIBRATED,    /* full scale referred to the antenna input */
+} SampleScale;
+
+typedef enum {
+    TCP_SERVER_FORMAT_UNKNOWN,
+    TCP_SERVER_FORMAT_U8,       /* 8 bit unsigned integers (rtl_tcp) */
+    TCP_SERVER_FORMAT_CS8,      /* complex 8 bit signed integers */
+    TCP_SERVER_FORMAT_CS16,     /* complex 16 bit signed integers */
+} TcpServerFormat;
+
+typedef enum {
+    SPECTRUM_FORMAT_UNKNOWN,
+    SPECTRUM_FORMAT_FLOAT16,    /* dBFS as IEEE 754 half precision floats */
+    SPECTRUM_FORMAT_UINT8,      /* spectrum range scaled to 0-255 */
+} SpectrumFormat;
+
+typedef enum {
+    DIVERSITY_COMBINING_UNKNOWN,
+    DIVERSITY_COMBINING_NONE,
+    DIVERSITY_COMBINING_MRC,        /* maximal ratio combining */
+    DIVERSITY_COMBINING_SELECTION,  /* the tuner with the stronger signal */
+} DiversityCombining;
+
+#define MAX_TEE_OUTPUTS 4
+#define MAX_DDC_CHANNELS 32
+
 
 /* global variables */
 /* RSP settings */
@@ -33,6 +76,7 @@ extern sdrplay_api_RspDuoModeT rspduo_mode;
 extern const char *antenna;
 extern double sample_rate;
 extern int decimation;
+extern double software_sample_rate;
 extern double ppm;
 extern sdrplay_api_If_kHzT if_frequency;
 extern sdrplay_api_Bw_MHzT if_bandwidth;
@@ -59,14 +103,93 @@ extern double frequency_B;
 /* streaming and output settings */
 extern int streaming_time;       /* streaming time in seconds */
 extern int marker_interval;      /* store a marker tick every N seconds */
+extern unsigned int marker_interval_samples;  /* store a marker tick every N samples */
 extern char *outfile_template;
 extern OutputType output_type;
+extern SampleFormat sample_format;
+extern unsigned int bfp_block_size;     /* frames in a block floating point block */
+extern SampleScale sample_scale;        /* cf32 only */
+extern double calibration_offset;       /* dB, calibrated scale only */
 extern unsigned int zero_sample_gaps_max_size;
 extern unsigned int blocks_buffer_capacity;
 extern unsigned int samples_buffer_capacity;
+extern int split_tuner_files;
+extern int header_checkpoint_interval;  /* rewrite WAV header sizes every N seconds */
+extern int header_checkpoint_size;      /* rewrite WAV header sizes every N MB */
+extern int header_checkpoint_sync;      /* flush the file to disk after each checkpoint */
+extern int pipe_size;                   /* stdout/named pipe buffer size (0: system default) */
+extern int pipe_zero_copy;
+/* tee outputs */
+extern const char *tee_outputs[MAX_TEE_OUTPUTS];    /* [<sample format>:]<filename> */
+extern int num_tee_outputs;
+extern unsigned int tee_buffer_capacity;    /* in number of samples */
+/* shared memory output */
+extern const char *shm_output_name;
+extern SampleFormat shm_output_format;
+extern unsigned int shm_output_capacity;    /* in number of samples */
+/* triggered recordings */
+extern int trigger_mode;
+extern double trigger_pre_time;             /* seconds before the trigger */
+extern double trigger_post_time;            /* seconds after the trigger */
+extern const char *trigger_control_socket;
+extern int power_detector_enable;
+extern double power_detector_threshold;     /* dB above the baseline */
+extern double power_detector_hysteresis;    /* dB */
+extern unsigned int power_detector_block_size;  /* in number of samples */
+extern double power_detector_baseline_time; /* seconds */
+extern double power_detector_band_low;      /* Hz from the center frequency */
+extern double power_detector_band_high;     /* Hz from the center frequency */
+extern unsigned int power_detector_fft_size;
+/* TCP server output */
+extern const char *tcp_server_address;      /* [<address>:]<port> */
+extern TcpServerFormat tcp_server_format;
+extern unsigned int tcp_server_queue_capacity;  /* in number of samples */
+extern int tcp_server_max_clients;
+/* digital downconverter (DDC) channels */
+extern double ddc_channel_frequencies[MAX_DDC_CHANNELS];    /* Hz */
+extern double ddc_channel_sample_rates[MAX_DDC_CHANNELS];   /* 0: ddc sample rate */
+extern int num_ddc_channels;
+extern double ddc_sample_rate;
+extern int ddc_threads;
+extern unsigned int ddc_buffer_capacity;    /* in number of samples */
+extern int ddc_only;                        /* no full band output file */
+/* FFT channelizer */
+extern double channelizer_spacing;          /* Hz (0: disabled) */
+extern int channelizer_oversampling;        /* 1: critically sampled, 2: 2x oversampled */
+extern int channelizer_taps_per_channel;
+extern double channelizer_range_low;        /* Hz */
+extern double channelizer_range_high;       /* Hz */
+extern int channelizer_multichannel_file;
+extern unsigned int channelizer_buffer_capacity;    /* in number of samples */
+/* spectrum (PSD/waterfall) file */
+extern int spectrum_file_enable;
+extern unsigned int spectrum_fft_size;
+extern double spectrum_interval;            /* seconds */
+extern SpectrumFormat spectrum_format;
+extern double spectrum_range_low;           /* dBFS */
+extern double spectrum_range_high;          /* dBFS */
+extern int spectrum_image;                  /* PGM image */
+extern unsigned int spectrum_buffer_capacity;   /* in number of samples */
+/* index file */
+extern int index_file_enable;
+extern int index_interval;       /* one index entry every N milliseconds */
+/* envelope file */
+extern int envelope_file_enable;
+/* overload map */
+extern int overload_map_enable;
+extern double overload_threshold;           /* dBFS */
+/* diversity combining */
+extern DiversityCombining diversity_combining;
+extern unsigned int diversity_block_size;   /* in number of samples */
+/* compressed output */
+extern int compression_threads;
+extern unsigned int compression_block_size;     /* frames in a compressed block (0: default) */
+extern int compression_level;                   /* zstd only */
+extern int compression_verify;
 /* gain filr */
 extern int gains_file_enable;
 extern int gain_changes_buffer_capacity;
+extern int events_chunk_enable;         /* gain and overload events in the WAV file */
 /* misc settings */
 extern int debug_enable;
 extern int verbose;
@@ -0,0 +1,553 @@
+/* record to file the I/Q stream(s) from a SDRplay RSP
+ * digital downconverter (DDC) channels
+ *
+ * Copyright 2025 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "config.h"
+#include "ddc.h"
+#include "output.h"
+#include "sdrplay-rsp.h"
+#include "stats.h"
+#include "wav.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+/* samples copied out of the ring (and processed) at a time by each worker */
+#define DDC_CHUNK_SAMPLES 65536
+/* the NCO phase is recomputed in double precision every this many samples */
+#define DDC_NCO_TABLE_SIZE 1024
+/* integrator width left for the input samples (63 bits minus the CIC gain) */
+#define DDC_CIC_BITS 62
+
+/* each DDC channel mixes its center frequency down to zero with an NCO,
+ * decimates with a CIC filter (order DDC_CIC_ORDER), and then by 2 with an
+ * FIR filter that compensates the droop of the CIC filter and removes
+ * what would alias into the channel.
+ * The writer copies the samples into a ring (like the tee outputs), and a
+ * small pool of worker threads, each one with its own share of the
+ * channels and its own read position, processes them; the writer never
+ * waits for the workers: if a worker falls more than the ring size behind,
+ * the samples it missed are counted as dropped, and zeros are written to
+ * its channels instead, so that the timing of the channel files is kept.
+ */
+typedef struct {
+    pthread_t thread;
+    int index;
+    unsigned long long read_sample;     /* next sample to read from the ring */
+    unsigned long long skipped_samples; /* dropped, not yet seen by the channels */
+    short *samples;                     /* samples copied out of the ring */
+    float *mixed_re;
+    float *mixed_im;
+} DdcWorker;
+
+static pthread_mutex_t ddc_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t ddc_data_ready = PTHREAD_COND_INITIALIZER;
+static short *ring = NULL;
+static unsigned long long ring_samples = 0;
+static unsigned long long write_sample = 0;     /* next sample to write to the ring */
+static unsigned int num_channels = 0;
+static bool is_ddc_stopping = false;
+static DdcWorker *workers = NULL;
+static int num_workers = 0;
+
+/* global variables */
+DdcChannel ddc_channels[MAX_DDC_CHANNELS];
+int num_ddc_outputs = 0;
+DdcStats ddc_stats = {
+    .dropped_samples = 0,
+    .overruns = 0,
+};
+
+/* internal functions */
+static int ddc_channel_init(DdcChannel *channel, double frequency, double sample_rate);
+static int ddc_channel_open(DdcChannel *channel);
+static void ddc_channel_design_fir(DdcChannel *channel);
+static void *ddc_worker_loop(void *arg);
+static void ddc_channel_process(DdcChannel *channel, DdcWorker *worker, size_t num_samples);
+static void ddc_channel_skip(DdcChannel *channel, unsigned long long num_samples);
+static size_t ddc_channel_cic_output(DdcChannel *channel, double value_re, double value_im, size_t out_index);
+static void ddc_channel_write(DdcChannel *channel, size_t num_samples);
+
+
+int ddc_open() {
+    if (num_ddc_channels == 0) {
+        return 0;
+    }
+    num_channels = is_dual_tuner ? 4 : 2;
+    for (int i = 0; i < num_ddc_channels; i++) {
+        double sample_rate = ddc_channel_sample_rates[i] > 0.0 ? ddc_channel_sample_rates[i] : ddc_sample_rate;
+        if (ddc_channel_init(&ddc_channels[i], ddc_channel_frequencies[i], sample_rate) == -1) {
+            return -1;
+        }
+        num_ddc_outputs++;
+        if (ddc_channel_open(&ddc_channels[i]) == -1) {
+            return -1;
+        }
+        if (verbose) {
+            const DdcChannel *channel = &ddc_channels[i];
+            fprintf(stderr, "DDC channel %.0lfHz (tuner %c): %s - sample rate=%.1lf decimation=%u (CIC %u, FIR 2)\n", channel->frequency, 'A' + channel->tuner, channel->output.filename, channel->sample_rate, channel->decimation, channel->cic_decimation);
+        }
+    }
+
+    ring_samples = ddc_buffer_capacity;
+    ring = (short *)malloc(ring_samples * num_channels * sizeof(short));
+    if (ring == NULL) {
+        fprintf(stderr, "malloc(DDC buffer) failed\n");
+        return -1;
+    }
+    write_sample = 0;
+    is_ddc_stopping = false;
+
+    num_workers = ddc_threads < num_ddc_outputs ? ddc_threads : num_ddc_outputs;
+    workers = (DdcWorker *)calloc(num_workers, sizeof(DdcWorker));
+    if (workers == NULL) {
+        fprintf(stderr, "calloc(DDC workers) failed\n");
+        num_workers = 0;
+        return -1;
+    }
+    for (int i = 0; i < num_workers; i++) {
+        DdcWorker *worker = &workers[i];
+        worker->index = i;
+        worker->samples = (short *)malloc(DDC_CHUNK_SAMPLES * num_channels * sizeof(short));
+        worker->mixed_re = (float *)malloc(DDC_NCO_TABLE_SIZE * sizeof(float));
+        worker->mixed_im = (float *)malloc(DDC_NCO_TABLE_SIZE * sizeof(float));
+        if (worker->samples == NULL || worker->mixed_re == NULL || worker->mixed_im == NULL) {
+            fprintf(stderr, "malloc(DDC worker buffers) failed\n");
+            num_workers = i;
+            return -1;
+        }
+        int errcode = pthread_create(&worker->thread, NULL, ddc_worker_loop, worker);
+        if (errcode != 0) {
+            fprintf(stderr, "pthread_create(DDC worker) failed: %s\n", strerror(errcode));
+            num_workers = i;
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* called by the writer for each segment; a NULL tuner is filled with zeros */
+void ddc_write(const short *const *xi, const short *const *xq, unsigned int nrx, size_t num_samples) {
+    if (num_workers == 0) {
+        return;
+    }
+    pthread_mutex_lock(&ddc_lock);
+    for (size_t offset = 0; offset < num_samples; ) {
+        unsigned long long ring_index = (write_sample + offset) % ring_samples;
+        size_t n = num_samples - offset;
+        if (n > ring_samples - ring_index) {
+            n = ring_samples - ring_index;
+        }
+        for (unsigned int tuner = 0; tuner < nrx; tuner++) {
+            short *out = ring + ring_index * num_channels + 2 * tuner;
+            if (xi[tuner] != NULL) {
+                const short *txi = xi[tuner] + offset;
+                const short *txq = xq[tuner] + offset;
+                for (size_t i = 0; i < n; i++, out += num_channels) {
+                    out[0] = txi[i];
+                    out[1] = txq[i];
+                }
+            } else {
+                for (size_t i = 0; i < n; i++, out += num_channels) {
+                    out[0] = 0;
+                    out[1] = 0;
+                }
+            }
+        }
+        offset += n;
+    }
+    write_sample += num_samples;
+
+    for (int i = 0; i < num_workers; i++) {
+        DdcWorker *worker = &workers[i];
+        if (write_sample - worker->read_sample > ring_samples) {
+            unsigned long long first_sample = write_sample - ring_samples;
+            unsigned long long dropped = first_sample - worker->read_sample;
+            if (worker->skipped_samples == 0) {
+                ddc_stats.overruns++;
+            }
+            ddc_stats.dropped_samples += dropped;
+            worker->skipped_samples += dropped;
+            worker->read_sample = first_sample;
+        }
+    }
+    pthread_cond_broadcast(&ddc_data_ready);
+    pthread_mutex_unlock(&ddc_lock);
+}
+
+/* end of streaming: the workers process what is left in the ring */
+void ddc_finish() {
+    if (num_workers == 0) {
+        return;
+    }
+    pthread_mutex_lock(&ddc_lock);
+    is_ddc_stopping = true;
+    pthread_cond_broadcast(&ddc_data_ready);
+    pthread_mutex_unlock(&ddc_lock);
+    for (int i = 0; i < num_workers; i++) {
+        pthread_join(workers[i].thread, NULL);
+        free(workers[i].samples);
+        free(workers[i].mixed_re);
+        free(workers[i].mixed_im);
+    }
+    free(workers);
+    workers = NULL;
+    num_workers = 0;
+}
+
+void ddc_close() {
+    ddc_finish();
+    for (int i = 0; i < num_ddc_outputs; i++) {
+        DdcChannel *channel = &ddc_channels[i];
+        if (channel->output.is_open) {
+            if (output_type != OUTPUT_TYPE_WAVVIEWDX_RAW) {
+                if (finalize_auxi_wav_file(&channel->output) == -1) {
+                    fprintf(stderr, "finalize() WAV file %s failed: %s\n", channel->output.filename, strerror(errno));
+                }
+            }
+            close(channel->output.fd);
+            channel->output.fd = -1;
+            channel->output.is_open = false;
+        }
+        free(channel->nco_table_re);
+        channel->nco_table_re = NULL;
+        free(channel->nco_table_im);
+        channel->nco_table_im = NULL;
+        free(channel->outsamples);
+        channel->outsamples = NULL;
+    }
+    num_ddc_outputs = 0;
+    free(ring);
+    ring = NULL;
+}
+
+/* internal functions */
+static int ddc_channel_init(DdcChannel *channel, double frequency, double sample_rate) {
+    *channel = (DdcChannel) {
+        .frequency = frequency,
+        .tuner = 0,
+        .nco_phase = 0.0,
+        .cic_count = 0,
+        .fir_index = 0,
+        .fir_phase = 0,
+        .nco_table_re = NULL,
+        .nco_table_im = NULL,
+        .outsamples = NULL,
+        .clipped_values = 0,
+        .is_failed = false,
+    };
+
+    /* the channel comes from the tuner whose center frequency is closest */
+    if (is_dual_tuner && fabs(frequency - frequency_B) < fabs(frequency - frequency_A)) {
+        channel->tuner = 1;
+    }
+    double offset = frequency - (channel->tuner == 1 ? frequency_B : frequency_A);
+
+    unsigned int decimation = (unsigned int)(output_sample_rate / sample_rate + 0.5);
+    if (decimation % 2 == 1) {
+        decimation++;
+    }
+    if (decimation < 2 || decimation / 2 > (1U << ((DDC_CIC_BITS - 17) / DDC_CIC_ORDER))) {
+        fprintf(stderr, "invalid DDC sample rate %.0lf for channel %.0lfHz with output sample rate %.0lf\n", sample_rate, frequency, output_sample_rate);
+        return -1;
+    }
+    channel->decimation = decimation;
+    channel->cic_decimation = decimation / 2;
+    channel->sample_rate = output_sample_rate / decimation;
+    if (fabs(channel->sample_rate - sample_rate) > 1e-6 * sample_rate) {
+        fprintf(stderr, "warning: DDC channel %.0lfHz sample rate is %.3lf (output sample rate / %u) instead of %.0lf\n", frequency, channel->sample_rate, decimation, sample_rate);
+    }
+    if (fabs(offset) + channel->sample_rate / 2 > output_sample_rate / 2) {
+        fprintf(stderr, "DDC channel %.0lfHz is outside the band of tuner %c (%.0lfHz +/- %.0lfHz)\n", frequency, 'A' + channel->tuner, channel->tuner == 1 ? frequency_B : frequency_A, output_sample_rate / 2);
+        return -1;
+    }
+
+    /* mixing down multiplies by exp(-j*2*pi*offset*t) */
+    channel->nco_step = offset / output_sample_rate;
+    channel->nco_table_re = (float *)malloc(DDC_NCO_TABLE_SIZE * sizeof(float));
+    channel->nco_table_im = (float *)malloc(DDC_NCO_TABLE_SIZE * sizeof(float));
+    channel->outsamples = (short *)malloc((DDC_CHUNK_SAMPLES / decimation + 2) * 2 * sizeof(short));
+    if (channel->nco_table_re == NULL || channel->nco_table_im == NULL || channel->outsamples == NULL) {
+        fprintf(stderr, "malloc(DDC channel) failed\n");
+        return -1;
+    }
+    for (unsigned int k = 0; k < DDC_NCO_TABLE_SIZE; k++) {
+        double angle = -2.0 * M_PI * fmod(channel->nco_step * k, 1.0);
+        channel->nco_table_re[k] = (float)cos(angle);
+        channel->nco_table_im[k] = (float)sin(angle);
+    }
+
+    /* the CIC gain is cic_decimation^DDC_CIC_ORDER; the input samples
+     * (up to 17 bits after mixing) are scaled up with the bits left
+     */
+    int cic_gain_bits = (int)ceil(DDC_CIC_ORDER * log2((double)channel->cic_decimation));
+    int input_shift = DDC_CIC_BITS - 17 - cic_gain_bits;
+    if (input_shift > 8) {
+        input_shift = 8;
+    }
+    if (input_shift < 0) {
+        input_shift = 0;
+    }
+    channel->cic_input_scale = (float)(1 << input_shift);
+    channel->cic_output_scale = 1.0 / (pow((double)channel->cic_decimation, DDC_CIC_ORDER) * channel->cic_input_scale);
+    ddc_channel_design_fir(channel);
+    return 0;
+}
+
+static int ddc_channel_open(DdcChannel *channel) {
+    char filename[PATH_MAX];
+    if (output_channel_filename(filename, PATH_MAX, channel->tuner, channel->frequency, channel->sample_rate) != 0) {
+        fprintf(stderr, "output_channel_filename(%s) failed\n", outfile_template);
+        return -1;
+    }
+    if (strcmp(filename, "-") == 0 || filename[0] == '|') {
+        fprintf(stderr, "stdout and named pipes are not supported for the DDC channels\n");
+        return -1;
+    }
+    channel->stats = (Stats) {
+        .data_size = 0,
+        .output_samples = 0,
+    };
+    channel->output = (OutputFile) {
+        .fd = -1,
+        .tuner = channel->tuner,
+        .num_channels = 2,
+        .frequency = channel->frequency,
+        .sample_rate = channel->sample_rate,
+        .wav_type = WAV_TYPE_UNKNOWN,
+        .stats = &channel->stats,
+        .is_open = false,
+        .index_fd = -1,
+    };
+    snprintf(channel->output.filename, sizeof(channel->output.filename), "%s", filename);
+    channel->output.fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, 0644);
+    if (channel->output.fd == -1) {
+        fprintf(stderr, "open(%s) for writing failed: %s\n", filename, strerror(errno));
+        return -1;
+    }
+    channel->output.is_open = true;
+    if (output_type != OUTPUT_TYPE_WAVVIEWDX_RAW) {
+        if (write_auxi_wav_header(&channel->output) == -1) {
+            fprintf(stderr, "write() WAV header to %s failed: %s\n", filename, strerror(errno));
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* window method: the ideal response is the inverse of the CIC response up
+ * to half the channel sample rate (a quarter of the FIR input rate), and
+ * zero above it; Blackman window
+ */
+static void ddc_channel_design_fir(DdcChannel *channel) {
+    const int num_points = 1024;
+    const double cutoff = 0.25;
+    double R = channel->cic_decimation;
+    int M = (DDC_FIR_TAPS - 1) / 2;
+    double sum = 0.0;
+    double taps[DDC_FIR_TAPS];
+    for (int n = 0; n < DDC_FIR_TAPS; n++) {
+        double h = 0.0;
+        for (int k = 0; k < num_points; k++) {
+            double f = (k + 0.5) * cutoff / num_points;
+            double cic_response = R > 1.0 ? pow(fabs(sin(M_PI * f) / (R * sin(M_PI * f / R))), DDC_CIC_ORDER) : 1.0;
+            h += cos(2.0 * M_PI * f * (n - M)) / cic_response;
+        }
+        h *= 2.0 * cutoff / num_points;
+        double window = 0.42 - 0.5 * cos(2.0 * M_PI * n / (DDC_FIR_TAPS - 1)) + 0.08 * cos(4.0 * M_PI * n / (DDC_FIR_TAPS - 1));
+        taps[n] = h * window;
+        sum += taps[n];
+    }
+    for (int n = 0; n < DDC_FIR_TAPS; n++) {
+        channel->fir_taps[n] = (float)(taps[n] / sum);
+    }
+}
+
+static void *ddc_worker_loop(void *arg) {
+    DdcWorker *worker = (DdcWorker *)arg;
+    pthread_mutex_lock(&ddc_lock);
+    for (;;) {
+        while (worker->read_sample == write_sample && !is_ddc_stopping) {
+            pthread_cond_wait(&ddc_data_ready, &ddc_lock);
+        }
+        if (worker->read_sample == write_sample) {
+            break;
+        }
+        unsigned long long skipped_samples = worker->skipped_samples;
+        worker->skipped_samples = 0;
+        unsigned long long ring_index = worker->read_sample % ring_samples;
+        size_t n = write_sample - worker->read_sample;
+        if (n > DDC_CHUNK_SAMPLES) {
+            n = DDC_CHUNK_SAMPLES;
+        }
+        if (n > ring_samples - ring_index) {
+            n = ring_samples - ring_index;
+        }
+        memcpy(worker->samples, ring + ring_index * num_channels, n * num_channels * sizeof(short));
+        worker->read_sample += n;
+        pthread_mutex_unlock(&ddc_lock);
+
+        for (int i = worker->index; i < num_ddc_outputs; i += num_workers) {
+            DdcChannel *channel = &ddc_channels[i];
+            if (channel->is_failed) {
+                continue;
+            }
+            if (skipped_samples > 0) {
+                ddc_channel_skip(channel, skipped_samples);
+            }
+            ddc_channel_process(channel, worker, n);
+        }
+
+        pthread_mutex_lock(&ddc_lock);
+    }
+    pthread_mutex_unlock(&ddc_lock);
+    return NULL;
+}
+
+static void ddc_channel_process(DdcChannel *channel, DdcWorker *worker, size_t num_samples) {
+    const short *samples = worker->samples + 2 * channel->tuner;
+    float *mixed_re = worker->mixed_re;
+    float *mixed_im = worker->mixed_im;
+    const float *table_re = channel->nco_table_re;
+    const float *table_im = channel->nco_table_im;
+    unsigned int stride = num_channels;
+    size_t out_index = 0;
+    for (size_t offset = 0; offset < num_samples; ) {
+        size_t n = num_samples - offset;
+        if (n > DDC_NCO_TABLE_SIZE) {
+            n = DDC_NCO_TABLE_SIZE;
+        }
+
+        /* NCO: the phase at the start of each block is exact, so the
+         * rounding errors of the table do not accumulate
+         */
+        double angle = -2.0 * M_PI * channel->nco_phase;
+        float base_re = (float)cos(angle);
+        float base_im = (float)sin(angle);
+        const short *x = samples + offset * stride;
+        for (size_t i = 0; i < n; i++) {
+            float wr = base_re * table_re[i] - base_im * table_im[i];
+            float wi = base_re * table_im[i] + base_im * table_re[i];
+            float xr = x[i * stride];
+            float xi = x[i * stride + 1];
+            mixed_re[i] = xr * wr - xi * wi;
+            mixed_im[i] = xr * wi + xi * wr;
+        }
+        channel->nco_phase = fmod(channel->nco_phase + fmod(channel->nco_step * n, 1.0) + 1.0, 1.0);
+
+        /* CIC: integrators at the input rate, combs at the decimated rate */
+        uint64_t *integrators_re = channel->cic_integrators[0];
+        uint64_t *integrators_im = channel->cic_integrators[1];
+        float input_scale = channel->cic_input_scale;
+        for (size_t i = 0; i < n; i++) {
+            uint64_t vr = (uint64_t)(int64_t)lrintf(mixed_re[i] * input_scale);
+            uint64_t vi = (uint64_t)(int64_t)lrintf(mixed_im[i] * input_scale);
+            integrators_re[0] += vr;
+            integrators_im[0] += vi;
+            for (int s = 1; s < DDC_CIC_ORDER; s++) {
+                integrators_re[s] += integrators_re[s-1];
+                integrators_im[s] += integrators_im[s-1];
+            }
+            if (++channel->cic_count == channel->cic_decimation) {
+                channel->cic_count = 0;
+                uint64_t yr = integrators_re[DDC_CIC_ORDER-1];
+                uint64_t yi = integrators_im[DDC_CIC_ORDER-1];
+                for (int s = 0; s < DDC_CIC_ORDER; s++) {
+                    uint64_t tr = yr;
+                    uint64_t ti = yi;
+                    yr -= channel->cic_combs[0][s];
+                    yi -= channel->cic_combs[1][s];
+                    channel->cic_combs[0][s] = tr;
+                    channel->cic_combs[1][s] = ti;
+                }
+                out_index = ddc_channel_cic_output(channel, (int64_t)yr * channel->cic_output_scale, (int64_t)yi * channel->cic_output_scale, out_index);
+            }
+        }
+        offset += n;
+    }
+    ddc_channel_write(channel, out_index);
+}
+
+/* samples dropped by the worker: the NCO moves on, and the channel gets
+ * zeros for them
+ */
+static void ddc_channel_skip(DdcChannel *channel, unsigned long long num_samples) {
+    channel->nco_phase = fmod(channel->nco_phase + fmod(channel->nco_step * num_samples, 1.0) + 1.0, 1.0);
+    unsigned long long cic_outputs = (channel->cic_count + num_samples) / channel->cic_decimation;
+    channel->cic_count = (channel->cic_count + num_samples) % channel->cic_decimation;
+    size_t max_outputs = DDC_CHUNK_SAMPLES / channel->decimation;
+    size_t out_index = 0;
+    for (unsigned long long i = 0; i < cic_outputs; i++) {
+        out_index = ddc_channel_cic_output(channel, 0.0, 0.0, out_index);
+        if (out_index >= max_outputs) {
+            ddc_channel_write(channel, out_index);
+            out_index = 0;
+        }
+    }
+    ddc_channel_write(channel, out_index);
+}
+
+/* FIR filter and decimation by 2; returns the new number of output samples */
+static size_t ddc_channel_cic_output(DdcChannel *channel, double value_re, double value_im, size_t out_index) {
+    unsigned int index = channel->fir_index;
+    channel->fir_history_re[index] = channel->fir_history_re[index + DDC_FIR_TAPS] = (float)value_re;
+    channel->fir_history_im[index] = channel->fir_history_im[index + DDC_FIR_TAPS] = (float)value_im;
+    channel->fir_index = index + 1 == DDC_FIR_TAPS ? 0 : index + 1;
+    channel->fir_phase ^= 1;
+    if (channel->fir_phase != 0) {
+        return out_index;
+    }
+    /* the history is stored twice, so the last DDC_FIR_TAPS values are
+     * always contiguous
+     */
+    const float *history_re = channel->fir_history_re + channel->fir_index;
+    const float *history_im = channel->fir_history_im + channel->fir_index;
+    const float *taps = channel->fir_taps;
+    float acc_re = 0.0f;
+    float acc_im = 0.0f;
+    for (int k = 0; k < DDC_FIR_TAPS; k++) {
+        acc_re += taps[k] * history_re[k];
+        acc_im += taps[k] * history_im[k];
+    }
+    long vr = lrintf(acc_re);
+    long vi = lrintf(acc_im);
+    if (vr > SHRT_MAX || vr < SHRT_MIN) {
+        vr = vr > SHRT_MAX ? SHRT_MAX : SHRT_MIN;
+        channel->clipped_values++;
+    }
+    if (vi > SHRT_MAX || vi < SHRT_MIN) {
+        vi = vi > SHRT_MAX ? SHRT_MAX : SHRT_MIN;
+        channel->clipped_values++;
+    }
+    channel->outsamples[2 * out_index] = (short)vr;
+    channel->outsamples[2 * out_index + 1] = (short)vi;
+    return out_index + 1;
+}
+
+static void ddc_channel_write(DdcChannel *channel, size_t num_samples) {
+    if (num_samples == 0 || channel->is_failed) {
+        return;
+    }
+    if (output_write(&channel->output, (const uint8_t *)channel->outsamples, num_samples * 2 * sizeof(short)) == -1) {
+        fprintf(stderr, "DDC channel %s failed - no more samples will be written to it\n", channel->output.filename);
+        channel->is_failed = true;
+        return;
+    }
+    channel->stats.output_samples += num_samples;
+}
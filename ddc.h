@@ -0,0 +1,68 @@
+/* record to file the I/Q stream(s) from a SDRplay RSP
+ * digital downconverter (DDC) channels
+ *
+ * Copyright 2025 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef _DDC_H
+#define _DDC_H
+
+#include "config.h"
+#include "output.h"
+#include "stats.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define DDC_CIC_ORDER 5
+#define DDC_FIR_TAPS 95
+
+/* typedefs */
+typedef struct {
+    OutputFile output;          /* fd, filename, and write stats */
+    Stats stats;
+    double frequency;           /* center frequency of the channel */
+    double sample_rate;
+    int tuner;
+    unsigned int decimation;
+    unsigned int cic_decimation;    /* followed by the FIR, decimating by 2 */
+    double nco_step;            /* cycles per input sample */
+    double nco_phase;           /* cycles */
+    float *nco_table_re;
+    float *nco_table_im;
+    uint64_t cic_integrators[2][DDC_CIC_ORDER];     /* wrap around arithmetic */
+    uint64_t cic_combs[2][DDC_CIC_ORDER];
+    unsigned int cic_count;
+    float cic_input_scale;
+    double cic_output_scale;
+    float fir_taps[DDC_FIR_TAPS];
+    float fir_history_re[2 * DDC_FIR_TAPS];
+    float fir_history_im[2 * DDC_FIR_TAPS];
+    unsigned int fir_index;
+    unsigned int fir_phase;
+    short *outsamples;
+    unsigned long long clipped_values;
+    bool is_failed;
+} DdcChannel;
+
+typedef struct {
+    unsigned long long dropped_samples;
+    unsigned long long overruns;
+} DdcStats;
+
+/* global variables */
+extern DdcChannel ddc_channels[MAX_DDC_CHANNELS];
+extern int num_ddc_outputs;
+extern DdcStats ddc_stats;
+
+/* public functions */
+int ddc_open();
+void ddc_write(const short *const *xi, const short *const *xq, unsigned int nrx, size_t num_samples);
+void ddc_finish();
+void ddc_close();
+
+#endif /* _DDC_H */
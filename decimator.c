@@ -0,0 +1,488 @@
+/* record to file the I/Q stream(s) from a SDRplay RSP
+ * software decimation (half-band filters and resampler)
+ *
+ * Copyright 2025 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "config.h"
+#include "decimator.h"
+#include "sdrplay-rsp.h"
+
+#include <limits.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* the samples from the RSP are decimated by 2 as many times as possible
+ * with half-band FIR filters (each one decimating by 2), and then, if
+ * the requested sample rate is not reached exactly, resampled by a
+ * rational factor L/M with a polyphase filter.
+ * Each filter is designed (window method, Kaiser window) to keep the
+ * aliases out of the lower 80% of the final bandwidth, so the early
+ * stages, which run at the highest rates, need only a few taps.
+ * Half of the taps of a half-band filter are zero; the samples that go
+ * with the non zero taps are kept in their own (doubled) history, so
+ * that each output is a dot product over contiguous arrays.
+ */
+#define DECIMATOR_PASSBAND 0.4              /* of the final sample rate */
+#define DECIMATOR_ATTENUATION 80.0          /* dB */
+#define DECIMATOR_KAISER_BETA 8.0
+#define DECIMATOR_MAX_HALFBAND_TAPS 255
+#define DECIMATOR_MAX_INTERPOLATION 1024
+
+typedef struct {
+    unsigned int num_taps;          /* 4k+3 */
+    unsigned int num_even_taps;     /* (num_taps + 1) / 2 */
+    unsigned int odd_length;        /* delay of the center tap, in odd samples */
+    float *even_taps;               /* the non zero taps besides the center one (0.5) */
+} HalfbandFilter;
+
+typedef struct {
+    float *even_re;                 /* doubled */
+    float *even_im;
+    unsigned int even_index;
+    float *odd_re;
+    float *odd_im;
+    unsigned int odd_index;
+    bool has_odd;                   /* odd sample received, waiting for the even one */
+} HalfbandState;
+
+typedef struct {
+    HalfbandState halfbands[DECIMATOR_MAX_STAGES];
+    float *history_re;              /* resampler, doubled */
+    float *history_im;
+    unsigned int history_index;
+    unsigned int phase;
+    float *buffer_re[2];
+    float *buffer_im[2];
+    short *out_xi;
+    short *out_xq;
+} TunerDecimator;
+
+static HalfbandFilter halfband_filters[DECIMATOR_MAX_STAGES];
+static float *resampler_taps = NULL;    /* [phase][tap], oldest sample first */
+static unsigned int resampler_taps_per_phase = 0;
+static TunerDecimator tuner_decimators[2];
+static int num_tuner_decimators = 0;
+
+/* global variables */
+double decimator_input_sample_rate = 0.0;
+int num_halfband_stages = 0;
+unsigned int resampler_interpolation = 0;
+unsigned int resampler_decimation = 0;
+DecimatorStats decimator_stats[2] = {
+    {
+        .input_samples = 0,
+        .output_samples = 0,
+        .clipped_values = 0,
+    },
+    {
+        .input_samples = 0,
+        .output_samples = 0,
+        .clipped_values = 0,
+    },
+};
+
+/* internal functions */
+static int halfband_design(HalfbandFilter *filter, double transition_width);
+static int resampler_design(unsigned int interpolation, unsigned int decimation);
+static int tuner_decimator_init(TunerDecimator *td);
+static size_t halfband_process(const HalfbandFilter *filter, HalfbandState *state, const float *in_re, const float *in_im, size_t num_samples, float *out_re, float *out_im);
+static size_t resampler_process(TunerDecimator *td, const float *in_re, const float *in_im, size_t num_samples, float *out_re, float *out_im);
+static double kaiser_window(unsigned int n, unsigned int num_taps);
+static double bessel_i0(double x);
+static unsigned long long gcd(unsigned long long a, unsigned long long b);
+
+
+/* called after the RSP has been configured: the output sample rate
+ * becomes the software sample rate
+ */
+int decimator_open() {
+    if (software_sample_rate <= 0.0) {
+        return 0;
+    }
+    double input_sample_rate = output_sample_rate;
+    double target = software_sample_rate;
+    if (target >= input_sample_rate) {
+        fprintf(stderr, "software sample rate %.0lf must be lower than the RSP output sample rate %.0lf\n", target, input_sample_rate);
+        return -1;
+    }
+
+    double rate = input_sample_rate;
+    num_halfband_stages = 0;
+    while (rate / 2 >= target * (1.0 - 1e-9) && num_halfband_stages < DECIMATOR_MAX_STAGES) {
+        rate /= 2;
+        num_halfband_stages++;
+    }
+    resampler_interpolation = 0;
+    resampler_decimation = 0;
+    if (fabs(rate - target) > 1e-6 * target) {
+        unsigned long long rate_in = (unsigned long long)llround(rate);
+        unsigned long long rate_out = (unsigned long long)llround(target);
+        if (fabs(rate - rate_in) > 1e-6 * rate || fabs(target - rate_out) > 1e-6 * target) {
+            fprintf(stderr, "software sample rate %.3lf from %.3lf: the resampler needs integer sample rates\n", target, rate);
+            return -1;
+        }
+        unsigned long long g = gcd(rate_in, rate_out);
+        if (rate_out / g > DECIMATOR_MAX_INTERPOLATION) {
+            fprintf(stderr, "software sample rate %.0lf from %.0lf: resampling ratio %llu/%llu is too complex\n", target, rate, rate_out / g, rate_in / g);
+            return -1;
+        }
+        resampler_interpolation = rate_out / g;
+        resampler_decimation = rate_in / g;
+    }
+
+    /* the aliases of each half-band stage (output rate r) come from
+     * around r, and they must stay outside the final passband
+     */
+    double passband = DECIMATOR_PASSBAND * target;
+    double stage_rate = input_sample_rate;
+    for (int s = 0; s < num_halfband_stages; s++) {
+        stage_rate /= 2;
+        if (halfband_design(&halfband_filters[s], (stage_rate - 2 * passband) / (2 * stage_rate)) == -1) {
+            decimator_close();
+            return -1;
+        }
+    }
+    if (resampler_interpolation > 0) {
+        if (resampler_design(resampler_interpolation, resampler_decimation) == -1) {
+            decimator_close();
+            return -1;
+        }
+    }
+
+    num_tuner_decimators = is_dual_tuner ? 2 : 1;
+    for (int i = 0; i < num_tuner_decimators; i++) {
+        if (tuner_decimator_init(&tuner_decimators[i]) == -1) {
+            decimator_close();
+            return -1;
+        }
+    }
+
+    decimator_input_sample_rate = input_sample_rate;
+    output_sample_rate = target;
+    if (verbose) {
+        fprintf(stderr, "software decimation: %.0lf -> %.0lf:", input_sample_rate, output_sample_rate);
+        const char *separator = " ";
+        for (int s = 0; s < num_halfband_stages; s++) {
+            fprintf(stderr, "%shalf-band %u taps", separator, halfband_filters[s].num_taps);
+            separator = ", ";
+        }
+        if (resampler_interpolation > 0) {
+            fprintf(stderr, "%sresampler %u/%u (%u taps per phase)", separator, resampler_interpolation, resampler_decimation, resampler_taps_per_phase);
+        }
+        fprintf(stderr, "\n");
+    }
+    return 0;
+}
+
+/* num_samples must not be more than DECIMATOR_CHUNK_SAMPLES; NULL input
+ * samples are zeros. The decimated samples are in buffers of the tuner,
+ * valid until the next call
+ */
+size_t decimator_process(int tuner, const short *xi, const short *xq, size_t num_samples, const short **out_xi, const short **out_xq) {
+    TunerDecimator *td = &tuner_decimators[tuner];
+    float *in_re = td->buffer_re[0];
+    float *in_im = td->buffer_im[0];
+    if (xi != NULL) {
+        for (size_t i = 0; i < num_samples; i++) {
+            in_re[i] = xi[i];
+            in_im[i] = xq[i];
+        }
+    } else {
+        for (size_t i = 0; i < num_samples; i++) {
+            in_re[i] = 0.0f;
+            in_im[i] = 0.0f;
+        }
+    }
+    size_t n = num_samples;
+    int current = 0;
+    for (int s = 0; s < num_halfband_stages; s++) {
+        n = halfband_process(&halfband_filters[s], &td->halfbands[s], td->buffer_re[current], td->buffer_im[current], n, td->buffer_re[1 - current], td->buffer_im[1 - current]);
+        current = 1 - current;
+    }
+    if (resampler_interpolation > 0) {
+        n = resampler_process(td, td->buffer_re[current], td->buffer_im[current], n, td->buffer_re[1 - current], td->buffer_im[1 - current]);
+        current = 1 - current;
+    }
+    const float *out_re = td->buffer_re[current];
+    const float *out_im = td->buffer_im[current];
+    DecimatorStats *ds = &decimator_stats[tuner];
+    for (size_t i = 0; i < n; i++) {
+        long vr = lrintf(out_re[i]);
+        long vi = lrintf(out_im[i]);
+        if (vr > SHRT_MAX || vr < SHRT_MIN) {
+            vr = vr > SHRT_MAX ? SHRT_MAX : SHRT_MIN;
+            ds->clipped_values++;
+        }
+        if (vi > SHRT_MAX || vi < SHRT_MIN) {
+            vi = vi > SHRT_MAX ? SHRT_MAX : SHRT_MIN;
+            ds->clipped_values++;
+        }
+        td->out_xi[i] = (short)vr;
+        td->out_xq[i] = (short)vi;
+    }
+    ds->input_samples += num_samples;
+    ds->output_samples += n;
+    *out_xi = td->out_xi;
+    *out_xq = td->out_xq;
+    return n;
+}
+
+/* number of output samples for a number of RSP samples (for instance the
+ * size of a gap)
+ */
+unsigned long long decimator_output_samples(unsigned long long input_samples) {
+    if (decimator_input_sample_rate <= 0.0) {
+        return input_samples;
+    }
+    return (unsigned long long)(input_samples * (output_sample_rate / decimator_input_sample_rate) + 0.5);
+}
+
+void decimator_close() {
+    for (int i = 0; i < num_tuner_decimators; i++) {
+        TunerDecimator *td = &tuner_decimators[i];
+        for (int s = 0; s < DECIMATOR_MAX_STAGES; s++) {
+            HalfbandState *state = &td->halfbands[s];
+            free(state->even_re);
+            free(state->even_im);
+            free(state->odd_re);
+            free(state->odd_im);
+        }
+        free(td->history_re);
+        free(td->history_im);
+        for (int k = 0; k < 2; k++) {
+            free(td->buffer_re[k]);
+            free(td->buffer_im[k]);
+        }
+        free(td->out_xi);
+        free(td->out_xq);
+    }
+    num_tuner_decimators = 0;
+    for (int s = 0; s < DECIMATOR_MAX_STAGES; s++) {
+        free(halfband_filters[s].even_taps);
+        halfband_filters[s].even_taps = NULL;
+    }
+    free(resampler_taps);
+    resampler_taps = NULL;
+}
+
+/* internal functions */
+
+/* windowed sinc with the cutoff at a quarter of the input rate; the
+ * transition width is relative to the input sample rate
+ */
+static int halfband_design(HalfbandFilter *filter, double transition_width) {
+    unsigned int num_taps = DECIMATOR_MAX_HALFBAND_TAPS;
+    if (transition_width > 0.0) {
+        double taps = (DECIMATOR_ATTENUATION - 8.0) / (14.36 * transition_width);
+        if (taps < num_taps) {
+            num_taps = (unsigned int)ceil(taps);
+        }
+    }
+    num_taps = (num_taps + 1) / 4 * 4 + 3;
+    if (num_taps < 7) {
+        num_taps = 7;
+    }
+    if (num_taps > DECIMATOR_MAX_HALFBAND_TAPS) {
+        num_taps = DECIMATOR_MAX_HALFBAND_TAPS;
+    }
+    filter->num_taps = num_taps;
+    filter->num_even_taps = (num_taps + 1) / 2;
+    filter->odd_length = (num_taps + 1) / 4;
+    filter->even_taps = (float *)malloc(filter->num_even_taps * sizeof(float));
+    if (filter->even_taps == NULL) {
+        fprintf(stderr, "malloc(half-band filter) failed\n");
+        return -1;
+    }
+    int center = (num_taps - 1) / 2;
+    double taps[DECIMATOR_MAX_HALFBAND_TAPS];
+    double sum = 0.0;
+    for (unsigned int j = 0; j < filter->num_even_taps; j++) {
+        int x = 2 * j - center;
+        taps[j] = sin(M_PI * x / 2.0) / (M_PI * x) * kaiser_window(2 * j, num_taps);
+        sum += taps[j];
+    }
+    /* unity gain at DC, with the center tap at 0.5 */
+    for (unsigned int j = 0; j < filter->num_even_taps; j++) {
+        filter->even_taps[j] = (float)(0.5 * taps[j] / sum);
+    }
+    return 0;
+}
+
+/* interpolation by L and decimation by M: the prototype filter runs at L
+ * times the input rate, with the cutoff at half the output rate, and it
+ * is split into L phases
+ */
+static int resampler_design(unsigned int interpolation, unsigned int decimation) {
+    /* half the transition band is 10% of the output rate */
+    unsigned int taps_per_phase = (unsigned int)ceil(25.0 * decimation / interpolation);
+    if (taps_per_phase < 16) {
+        taps_per_phase = 16;
+    }
+    unsigned int num_taps = interpolation * taps_per_phase;
+    double *taps = (double *)malloc(num_taps * sizeof(double));
+    resampler_taps = (float *)malloc(num_taps * sizeof(float));
+    if (taps == NULL || resampler_taps == NULL) {
+        fprintf(stderr, "malloc(resampler filter) failed\n");
+        free(taps);
+        return -1;
+    }
+    double cutoff = 0.5 / decimation;
+    double center = (num_taps - 1) / 2.0;
+    double sum = 0.0;
+    for (unsigned int n = 0; n < num_taps; n++) {
+        double x = n - center;
+        taps[n] = (x == 0.0 ? 2.0 * cutoff : sin(2.0 * M_PI * cutoff * x) / (M_PI * x)) * kaiser_window(n, num_taps);
+        sum += taps[n];
+    }
+    /* phase p uses taps p, p+L, p+2L, ... with the newest sample first */
+    for (unsigned int p = 0; p < interpolation; p++) {
+        for (unsigned int t = 0; t < taps_per_phase; t++) {
+            resampler_taps[p * taps_per_phase + taps_per_phase - 1 - t] = (float)(taps[p + interpolation * t] * interpolation / sum);
+        }
+    }
+    free(taps);
+    resampler_taps_per_phase = taps_per_phase;
+    return 0;
+}
+
+static int tuner_decimator_init(TunerDecimator *td) {
+    *td = (TunerDecimator) {
+        .history_re = NULL,
+        .history_im = NULL,
+        .history_index = 0,
+        .phase = 0,
+        .buffer_re = {NULL, NULL},
+        .buffer_im = {NULL, NULL},
+        .out_xi = NULL,
+        .out_xq = NULL,
+    };
+    bool is_failed = false;
+    for (int s = 0; s < num_halfband_stages; s++) {
+        const HalfbandFilter *filter = &halfband_filters[s];
+        HalfbandState *state = &td->halfbands[s];
+        state->even_re = (float *)calloc(2 * filter->num_even_taps, sizeof(float));
+        state->even_im = (float *)calloc(2 * filter->num_even_taps, sizeof(float));
+        state->odd_re = (float *)calloc(filter->odd_length, sizeof(float));
+        state->odd_im = (float *)calloc(filter->odd_length, sizeof(float));
+        state->even_index = 0;
+        state->odd_index = 0;
+        state->has_odd = false;
+        is_failed = is_failed || state->even_re == NULL || state->even_im == NULL || state->odd_re == NULL || state->odd_im == NULL;
+    }
+    if (resampler_interpolation > 0) {
+        td->history_re = (float *)calloc(2 * resampler_taps_per_phase, sizeof(float));
+        td->history_im = (float *)calloc(2 * resampler_taps_per_phase, sizeof(float));
+        is_failed = is_failed || td->history_re == NULL || td->history_im == NULL;
+    }
+    for (int k = 0; k < 2; k++) {
+        td->buffer_re[k] = (float *)malloc((DECIMATOR_CHUNK_SAMPLES + 1) * sizeof(float));
+        td->buffer_im[k] = (float *)malloc((DECIMATOR_CHUNK_SAMPLES + 1) * sizeof(float));
+        is_failed = is_failed || td->buffer_re[k] == NULL || td->buffer_im[k] == NULL;
+    }
+    td->out_xi = (short *)malloc((DECIMATOR_CHUNK_SAMPLES + 1) * sizeof(short));
+    td->out_xq = (short *)malloc((DECIMATOR_CHUNK_SAMPLES + 1) * sizeof(short));
+    is_failed = is_failed || td->out_xi == NULL || td->out_xq == NULL;
+    if (is_failed) {
+        fprintf(stderr, "malloc(software decimation buffers) failed\n");
+        return -1;
+    }
+    return 0;
+}
+
+/* the input alternates between odd samples (the center tap) and even
+ * samples (all the other non zero taps); each even sample completes an
+ * output sample
+ */
+static size_t halfband_process(const HalfbandFilter *filter, HalfbandState *state, const float *in_re, const float *in_im, size_t num_samples, float *out_re, float *out_im) {
+    unsigned int num_even_taps = filter->num_even_taps;
+    const float *taps = filter->even_taps;
+    size_t num_outputs = 0;
+    for (size_t i = 0; i < num_samples; i++) {
+        if (!state->has_odd) {
+            unsigned int index = state->odd_index;
+            state->odd_re[index] = in_re[i];
+            state->odd_im[index] = in_im[i];
+            state->odd_index = index + 1 == filter->odd_length ? 0 : index + 1;
+            state->has_odd = true;
+            continue;
+        }
+        state->has_odd = false;
+        unsigned int index = state->even_index;
+        state->even_re[index] = state->even_re[index + num_even_taps] = in_re[i];
+        state->even_im[index] = state->even_im[index + num_even_taps] = in_im[i];
+        state->even_index = index + 1 == num_even_taps ? 0 : index + 1;
+        const float *even_re = state->even_re + state->even_index;
+        const float *even_im = state->even_im + state->even_index;
+        /* the oldest odd sample is the one at the center of the filter */
+        float acc_re = 0.5f * state->odd_re[state->odd_index];
+        float acc_im = 0.5f * state->odd_im[state->odd_index];
+        for (unsigned int j = 0; j < num_even_taps; j++) {
+            acc_re += taps[j] * even_re[j];
+            acc_im += taps[j] * even_im[j];
+        }
+        out_re[num_outputs] = acc_re;
+        out_im[num_outputs] = acc_im;
+        num_outputs++;
+    }
+    return num_outputs;
+}
+
+static size_t resampler_process(TunerDecimator *td, const float *in_re, const float *in_im, size_t num_samples, float *out_re, float *out_im) {
+    unsigned int taps_per_phase = resampler_taps_per_phase;
+    size_t num_outputs = 0;
+    for (size_t i = 0; i < num_samples; i++) {
+        unsigned int index = td->history_index;
+        td->history_re[index] = td->history_re[index + taps_per_phase] = in_re[i];
+        td->history_im[index] = td->history_im[index + taps_per_phase] = in_im[i];
+        td->history_index = index + 1 == taps_per_phase ? 0 : index + 1;
+        const float *history_re = td->history_re + td->history_index;
+        const float *history_im = td->history_im + td->history_index;
+        while (td->phase < resampler_interpolation) {
+            const float *taps = resampler_taps + td->phase * taps_per_phase;
+            float acc_re = 0.0f;
+            float acc_im = 0.0f;
+            for (unsigned int t = 0; t < taps_per_phase; t++) {
+                acc_re += taps[t] * history_re[t];
+                acc_im += taps[t] * history_im[t];
+            }
+            out_re[num_outputs] = acc_re;
+            out_im[num_outputs] = acc_im;
+            num_outputs++;
+            td->phase += resampler_decimation;
+        }
+        td->phase -= resampler_interpolation;
+    }
+    return num_outputs;
+}
+
+static double kaiser_window(unsigned int n, unsigned int num_taps) {
+    double r = 2.0 * n / (num_taps - 1) - 1.0;
+    return bessel_i0(DECIMATOR_KAISER_BETA * sqrt(fmax(0.0, 1.0 - r * r))) / bessel_i0(DECIMATOR_KAISER_BETA);
+}
+
+static double bessel_i0(double x) {
+    double sum = 1.0;
+    double term = 1.0;
+    for (int k = 1; k < 50; k++) {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+        if (term < 1e-12 * sum) {
+            break;
+        }
+    }
+    return sum;
+}
+
+static unsigned long long gcd(unsigned long long a, unsigned long long b) {
+    while (b != 0) {
+        unsigned long long t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
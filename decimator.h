@@ -0,0 +1,38 @@
+/* record to file the I/Q stream(s) from a SDRplay RSP
+ * software decimation (half-band filters and resampler)
+ *
+ * Copyright 2025 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef _DECIMATOR_H
+#define _DECIMATOR_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define DECIMATOR_CHUNK_SAMPLES 16384
+#define DECIMATOR_MAX_STAGES 10
+
+/* typedefs */
+typedef struct {
+    unsigned long long input_samples;
+    unsigned long long output_samples;
+    unsigned long long clipped_values;
+} DecimatorStats;
+
+/* global variables */
+extern double decimator_input_sample_rate;     /* 0 if disabled */
+extern int num_halfband_stages;
+extern unsigned int resampler_interpolation;   /* 0 if no resampler */
+extern unsigned int resampler_decimation;
+extern DecimatorStats decimator_stats[2];    /* per tuner */
+
+/* public functions */
+int decimator_open();
+size_t decimator_process(int tuner, const short *xi, const short *xq, size_t num_samples, const short **out_xi, const short **out_xq);
+unsigned long long decimator_output_samples(unsigned long long input_samples);
+void decimator_close();
+
+#endif /* _DECIMATOR_H */
@@ -0,0 +1,114 @@
+#!/usr/bin/env python3
+# decompress an IQZ (compressed) recording to raw 16 bit I/Q samples
+#
+# Copyright 2025 Franco Venturi
+#
+# SPDX-License-Identifier: GPL-3.0-or-later
+
+from bisect import bisect_right
+import mmap
+import struct
+import sys
+
+FILE_HEADER_FORMAT = '@8sIHHIIdd'
+BLOCK_HEADER_FORMAT = '@4sII4B4B'
+INDEX_ENTRY_FORMAT = '@QQ'
+TRAILER_FORMAT = '@QQQ8s'
+
+ORDER_VERBATIM = 0xff
+ESCAPE_ONES = 24
+ESCAPE_BITS = 20
+
+def decode_block(mm, offset, num_channels):
+    block_header_size = struct.calcsize(BLOCK_HEADER_FORMAT)
+    sync, payload_size, num_frames, *params = struct.unpack_from(BLOCK_HEADER_FORMAT, mm, offset)
+    if sync != b'IQZB':
+        raise ValueError(f'invalid block at offset {offset}')
+    orders = params[:4]
+    rice_ks = params[4:]
+    payload = mm[offset + block_header_size:offset + block_header_size + payload_size]
+    if orders[0] == ORDER_VERBATIM:
+        return num_frames, payload
+
+    samples = [0] * (num_frames * num_channels)
+    bits = ''.join(f'{b:08b}' for b in payload)
+    pos = 0
+    for c in range(num_channels):
+        order = orders[c]
+        k = rice_ks[c]
+        x1 = x2 = 0
+        for i in range(num_frames):
+            if i < order:
+                x = int(bits[pos:pos+16], 2)
+                pos += 16
+                if x >= 0x8000:
+                    x -= 0x10000
+            else:
+                # unary prefix
+                end = bits.find('0', pos, pos + ESCAPE_ONES)
+                if end == -1:
+                    pos += ESCAPE_ONES
+                    u = int(bits[pos:pos+ESCAPE_BITS], 2)
+                    pos += ESCAPE_BITS
+                else:
+                    q = end - pos
+                    pos = end + 1
+                    u = (q << k) | (int(bits[pos:pos+k], 2) if k > 0 else 0)
+                    pos += k
+                residual = (u >> 1) ^ -(u & 1)
+                if order == 0:
+                    x = residual
+                elif order == 1:
+                    x = x1 + residual
+                else:
+                    x = 2 * x1 - x2 + residual
+            samples[i * num_channels + c] = x
+            x2 = x1
+            x1 = x
+    return num_frames, struct.pack(f'<{len(samples)}h', *samples)
+
+def main():
+    if len(sys.argv) < 3:
+        print(f'usage: {sys.argv[0]} <IQZ file> <raw output file> [<start frame> [<number of frames>]]', file=sys.stderr)
+        sys.exit(1)
+    filename = sys.argv[1]
+    output_filename = sys.argv[2]
+    start_frame = int(sys.argv[3]) if len(sys.argv) > 3 else 0
+    max_frames = int(sys.argv[4]) if len(sys.argv) > 4 else None
+
+    with open(filename, 'rb') as f:
+        mm = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+        magic, header_size, num_channels, bits_per_sample, block_frames, _, sample_rate, frequency = struct.unpack_from(FILE_HEADER_FORMAT, mm, 0)
+        if magic != b'RSPIQZ01':
+            print(f'{filename}: not an IQZ file', file=sys.stderr)
+            sys.exit(1)
+        trailer_size = struct.calcsize(TRAILER_FORMAT)
+        index_offset, num_blocks, num_frames, trailer_magic = struct.unpack_from(TRAILER_FORMAT, mm, len(mm) - trailer_size)
+        if trailer_magic != b'RSPIQZIX':
+            print(f'{filename}: block index not found (incomplete recording?)', file=sys.stderr)
+            sys.exit(1)
+        print(f'channels={num_channels} bits={bits_per_sample} sample_rate={sample_rate:.0f} frequency={frequency:.0f} blocks={num_blocks} frames={num_frames}', file=sys.stderr)
+
+        entry_size = struct.calcsize(INDEX_ENTRY_FORMAT)
+        index = [struct.unpack_from(INDEX_ENTRY_FORMAT, mm, index_offset + i * entry_size) for i in range(num_blocks)]
+        first_frames = [entry[1] for entry in index]
+        if max_frames is None:
+            max_frames = num_frames - start_frame
+
+        # seek to the block containing the start frame
+        frame_size = num_channels * bits_per_sample // 8
+        frames_written = 0
+        with open(output_filename, 'wb') as out:
+            i = max(0, bisect_right(first_frames, start_frame) - 1)
+            while i < num_blocks and frames_written < max_frames:
+                block_offset, first_frame = index[i]
+                nframes, data = decode_block(mm, block_offset, num_channels)
+                skip = max(0, start_frame - first_frame)
+                n = min(nframes - skip, max_frames - frames_written)
+                out.write(data[skip * frame_size:(skip + n) * frame_size])
+                frames_written += n
+                i += 1
+        print(f'frames written={frames_written}', file=sys.stderr)
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,345 @@
+/* record to file the I/Q stream(s) from a SDRplay RSP
+ * dual tuner diversity combining
+ *
+ * Copyright 2025 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "config.h"
+#include "diversity.h"
+#include "sdrplay-rsp.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DIVERSITY_VERSION 1
+#define DIVERSITY_SMOOTHING 0.5             /* weight of the latest block in the averaged covariance */
+#define DIVERSITY_SELECTION_HYSTERESIS 1.259    /* 1 dB (power ratio) */
+
+/* with both tuners on the same frequency and two antennas, the samples of
+ * the two tuners are a = h_A s + n_A and b = h_B s + n_B. For each block of
+ * 'diversity block size' samples the writer estimates the covariance matrix
+ * of (a, b) (averaged with the previous blocks); assuming the same noise
+ * power on both tuners, its principal eigenvector is proportional to
+ * (h_A, h_B), i.e. it gives the relative complex gain of the two tuners.
+ * MRC weights the tuners with the conjugate of the eigenvector, scaled so
+ * that the sum of the magnitudes of the weights is 1 (the combined signal
+ * has about the level of the inputs), and with the phase referred to tuner
+ * A. Selection combining outputs the tuner with the stronger signal (with
+ * 1 dB of hysteresis). The weights computed at the end of a block are used for the
+ * following samples; with MRC the change is spread over one block, so that
+ * there are no steps in the combined stream.
+ */
+
+/* global variables */
+DiversityStats diversity_stats = {
+    .blocks = 0,
+    .tuner_B_blocks = 0,
+};
+
+static FILE *weights_fp = NULL;
+static char weights_filename[PATH_MAX];
+static short *combined_i = NULL;
+static short *combined_q = NULL;
+/* sums over the current block */
+static long long sum_aa = 0;
+static long long sum_bb = 0;
+static long long sum_ab_re = 0;
+static long long sum_ab_im = 0;
+static unsigned int sum_samples = 0;
+static unsigned int block_samples = 0;
+/* averaged covariance */
+static bool has_covariance = false;
+static double cov_aa = 0.0;
+static double cov_bb = 0.0;
+static double cov_ab_re = 0.0;
+static double cov_ab_im = 0.0;
+/* current weights (re, im) and their change per sample */
+static float weight[2][2] = {{1.0f, 0.0f}, {0.0f, 0.0f}};
+static float weight_step[2][2] = {{0.0f, 0.0f}, {0.0f, 0.0f}};
+static unsigned int ramp_left = 0;
+static int selected_tuner = 0;
+
+/* internal functions */
+static void accumulate(const short *ai, const short *aq, const short *bi, const short *bq, size_t num_samples);
+static void combine(const short *ai, const short *aq, const short *bi, const short *bq, short *yi, short *yq, size_t num_samples);
+static void update_weights(unsigned long long sample_num);
+static inline short clip_short(float x);
+static int generate_weights_filename(const char *output_filename, char *filename, int filename_max_size);
+
+
+int diversity_open(const char *output_filename) {
+    if (diversity_combining == DIVERSITY_COMBINING_NONE) {
+        return 0;
+    }
+    if (!is_dual_tuner) {
+        fprintf(stderr, "diversity combining requires RSPduo dual tuner mode\n");
+        return -1;
+    }
+    combined_i = (short *)malloc(DIVERSITY_CHUNK_SAMPLES * sizeof(short));
+    combined_q = (short *)malloc(DIVERSITY_CHUNK_SAMPLES * sizeof(short));
+    if (combined_i == NULL || combined_q == NULL) {
+        fprintf(stderr, "malloc(diversity buffers) failed\n");
+        return -1;
+    }
+
+    /* the weights are not saved when writing to stdout or named pipes */
+    if (!(strcmp(output_filename, "-") == 0 || output_filename[0] == '|')) {
+        if (generate_weights_filename(output_filename, weights_filename, PATH_MAX) != 0) {
+            fprintf(stderr, "generate_weights_filename(%s) failed\n", output_filename);
+            return -1;
+        }
+        weights_fp = fopen(weights_filename, "wb");
+        if (weights_fp == NULL) {
+            fprintf(stderr, "fopen(%s) failed: %s\n", weights_filename, strerror(errno));
+            return -1;
+        }
+        DiversityHeader header = {
+            .magic = {'R', 'S', 'P', 'D', 'I', 'V', 'W', 'T'},
+            .version = DIVERSITY_VERSION,
+            .record_size = sizeof(DiversityRecord),
+            .mode = diversity_combining == DIVERSITY_COMBINING_MRC ? 1 : 2,
+            .unused = 0,
+            .block_size = diversity_block_size,
+            .sample_rate = output_sample_rate,
+        };
+        if (fwrite(&header, sizeof(header), 1, weights_fp) != 1) {
+            fprintf(stderr, "fwrite(%s) failed: %s\n", weights_filename, strerror(errno));
+            return -1;
+        }
+    }
+
+    if (verbose) {
+        fprintf(stderr, "diversity combining: %s - %u samples per weights estimate%s%s\n", diversity_combining == DIVERSITY_COMBINING_MRC ? "MRC" : "selection", diversity_block_size, weights_fp != NULL ? " - weights in " : "", weights_fp != NULL ? weights_filename : "");
+    }
+    return 0;
+}
+
+/* combine up to DIVERSITY_CHUNK_SAMPLES samples of the two tuners; a NULL
+ * tuner (zero filled by the writer) is not used, and the other tuner is
+ * output as it is
+ */
+size_t diversity_combine(const short *const *xi, const short *const *xq, size_t num_samples, unsigned long long sample_num, const short **cxi, const short **cxq) {
+    if (num_samples > DIVERSITY_CHUNK_SAMPLES) {
+        num_samples = DIVERSITY_CHUNK_SAMPLES;
+    }
+    if (xi[0] == NULL || xi[1] == NULL) {
+        int tuner = xi[0] != NULL ? 0 : 1;
+        *cxi = xi[tuner];
+        *cxq = xq[tuner];
+        return num_samples;
+    }
+
+    for (size_t offset = 0; offset < num_samples; ) {
+        size_t n = num_samples - offset;
+        if (n > diversity_block_size - block_samples) {
+            n = diversity_block_size - block_samples;
+        }
+        accumulate(xi[0] + offset, xq[0] + offset, xi[1] + offset, xq[1] + offset, n);
+        combine(xi[0] + offset, xq[0] + offset, xi[1] + offset, xq[1] + offset, combined_i + offset, combined_q + offset, n);
+        offset += n;
+        block_samples += n;
+        if (block_samples == diversity_block_size) {
+            update_weights(sample_num + offset);
+            block_samples = 0;
+        }
+    }
+    *cxi = combined_i;
+    *cxq = combined_q;
+    return num_samples;
+}
+
+void diversity_close() {
+    if (weights_fp != NULL) {
+        if (fclose(weights_fp) != 0) {
+            fprintf(stderr, "fclose(%s) failed: %s\n", weights_filename, strerror(errno));
+        }
+        weights_fp = NULL;
+    }
+    free(combined_i);
+    combined_i = NULL;
+    free(combined_q);
+    combined_q = NULL;
+}
+
+/* internal functions */
+
+static void accumulate(const short *ai, const short *aq, const short *bi, const short *bq, size_t num_samples) {
+    long long aa = 0;
+    long long bb = 0;
+    long long ab_re = 0;
+    long long ab_im = 0;
+    for (size_t i = 0; i < num_samples; i++) {
+        aa += (long long)ai[i] * ai[i] + (long long)aq[i] * aq[i];
+        bb += (long long)bi[i] * bi[i] + (long long)bq[i] * bq[i];
+        /* a * conj(b) */
+        ab_re += (long long)ai[i] * bi[i] + (long long)aq[i] * bq[i];
+        ab_im += (long long)aq[i] * bi[i] - (long long)ai[i] * bq[i];
+    }
+    sum_aa += aa;
+    sum_bb += bb;
+    sum_ab_re += ab_re;
+    sum_ab_im += ab_im;
+    sum_samples += num_samples;
+}
+
+static void combine(const short *ai, const short *aq, const short *bi, const short *bq, short *yi, short *yq, size_t num_samples) {
+    size_t i = 0;
+    /* MRC: move to the new weights one sample at a time */
+    for (; i < num_samples && ramp_left > 0; i++, ramp_left--) {
+        for (int tuner = 0; tuner < 2; tuner++) {
+            weight[tuner][0] += weight_step[tuner][0];
+            weight[tuner][1] += weight_step[tuner][1];
+        }
+        float wa_re = weight[0][0], wa_im = weight[0][1];
+        float wb_re = weight[1][0], wb_im = weight[1][1];
+        yi[i] = clip_short(wa_re * ai[i] - wa_im * aq[i] + wb_re * bi[i] - wb_im * bq[i]);
+        yq[i] = clip_short(wa_re * aq[i] + wa_im * ai[i] + wb_re * bq[i] + wb_im * bi[i]);
+    }
+    float wa_re = weight[0][0], wa_im = weight[0][1];
+    float wb_re = weight[1][0], wb_im = weight[1][1];
+    for (; i < num_samples; i++) {
+        yi[i] = clip_short(wa_re * ai[i] - wa_im * aq[i] + wb_re * bi[i] - wb_im * bq[i]);
+        yq[i] = clip_short(wa_re * aq[i] + wa_im * ai[i] + wb_re * bq[i] + wb_im * bi[i]);
+    }
+}
+
+static void update_weights(unsigned long long sample_num) {
+    if (sum_samples == 0) {
+        return;
+    }
+    double p = (double)sum_aa / sum_samples;
+    double q = (double)sum_bb / sum_samples;
+    double c_re = (double)sum_ab_re / sum_samples;
+    double c_im = (double)sum_ab_im / sum_samples;
+    sum_aa = 0;
+    sum_bb = 0;
+    sum_ab_re = 0;
+    sum_ab_im = 0;
+    sum_samples = 0;
+    if (has_covariance) {
+        cov_aa += DIVERSITY_SMOOTHING * (p - cov_aa);
+        cov_bb += DIVERSITY_SMOOTHING * (q - cov_bb);
+        cov_ab_re += DIVERSITY_SMOOTHING * (c_re - cov_ab_re);
+        cov_ab_im += DIVERSITY_SMOOTHING * (c_im - cov_ab_im);
+    } else {
+        cov_aa = p;
+        cov_bb = q;
+        cov_ab_re = c_re;
+        cov_ab_im = c_im;
+        has_covariance = true;
+    }
+    diversity_stats.blocks++;
+    if (cov_aa <= 0.0 && cov_bb <= 0.0) {
+        /* no signal at all - keep the current weights */
+        if (selected_tuner == 1) {
+            diversity_stats.tuner_B_blocks++;
+        }
+        return;
+    }
+
+    /* principal eigenvector of [[cov_aa, c], [conj(c), cov_bb]] */
+    double c_abs2 = cov_ab_re * cov_ab_re + cov_ab_im * cov_ab_im;
+    double half_diff = (cov_aa - cov_bb) / 2.0;
+    double lambda = (cov_aa + cov_bb) / 2.0 + sqrt(half_diff * half_diff + c_abs2);
+    double va_re, va_im, vb_re, vb_im;
+    if (cov_aa >= cov_bb) {
+        va_re = lambda - cov_bb;
+        va_im = 0.0;
+        vb_re = cov_ab_re;
+        vb_im = -cov_ab_im;
+    } else {
+        va_re = cov_ab_re;
+        va_im = cov_ab_im;
+        vb_re = lambda - cov_aa;
+        vb_im = 0.0;
+    }
+    /* refer the phase to tuner A (i.e. make v_A real) */
+    double va_abs = sqrt(va_re * va_re + va_im * va_im);
+    if (va_abs > 0.0) {
+        double r_re = va_re / va_abs;
+        double r_im = -va_im / va_abs;
+        double t_re = vb_re * r_re - vb_im * r_im;
+        double t_im = vb_re * r_im + vb_im * r_re;
+        vb_re = t_re;
+        vb_im = t_im;
+    }
+    double vb_abs = sqrt(vb_re * vb_re + vb_im * vb_im);
+
+    float new_weight[2][2];
+    if (diversity_combining == DIVERSITY_COMBINING_MRC) {
+        double scale = 1.0 / (va_abs + vb_abs);
+        new_weight[0][0] = va_abs * scale;
+        new_weight[0][1] = 0.0f;
+        new_weight[1][0] = vb_re * scale;
+        new_weight[1][1] = -vb_im * scale;
+        for (int tuner = 0; tuner < 2; tuner++) {
+            weight_step[tuner][0] = (new_weight[tuner][0] - weight[tuner][0]) / diversity_block_size;
+            weight_step[tuner][1] = (new_weight[tuner][1] - weight[tuner][1]) / diversity_block_size;
+        }
+        ramp_left = diversity_block_size;
+    } else {
+        double ratio = va_abs > 0.0 ? (vb_abs * vb_abs) / (va_abs * va_abs) : HUGE_VAL;
+        if (selected_tuner == 0 && ratio > DIVERSITY_SELECTION_HYSTERESIS) {
+            selected_tuner = 1;
+        } else if (selected_tuner == 1 && ratio < 1.0 / DIVERSITY_SELECTION_HYSTERESIS) {
+            selected_tuner = 0;
+        }
+        new_weight[0][0] = selected_tuner == 0 ? 1.0f : 0.0f;
+        new_weight[0][1] = 0.0f;
+        new_weight[1][0] = selected_tuner == 1 ? 1.0f : 0.0f;
+        new_weight[1][1] = 0.0f;
+        memcpy(weight, new_weight, sizeof(weight));
+        ramp_left = 0;
+    }
+    if (selected_tuner == 1) {
+        diversity_stats.tuner_B_blocks++;
+    }
+
+    if (weights_fp != NULL) {
+        DiversityRecord record = {
+            .sample_num = sample_num,
+            .weight = {{new_weight[0][0], new_weight[0][1]}, {new_weight[1][0], new_weight[1][1]}},
+            .gain = va_abs > 0.0 ? 20.0 * log10(vb_abs / va_abs) : INFINITY,
+            .phase = atan2(vb_im, vb_re) * 180.0 / M_PI,
+            .correlation = cov_aa > 0.0 && cov_bb > 0.0 ? sqrt(c_abs2 / (cov_aa * cov_bb)) : 0.0,
+            .unused = 0.0f,
+        };
+        if (fwrite(&record, sizeof(record), 1, weights_fp) != 1) {
+            fprintf(stderr, "fwrite(%s) failed: %s\n", weights_filename, strerror(errno));
+            fclose(weights_fp);
+            weights_fp = NULL;
+        }
+    }
+}
+
+/* the I or Q value of the combined sample can exceed 16 bits when the
+ * rotated input samples are close to full scale
+ */
+static inline short clip_short(float x) {
+    long v = lrintf(x);
+    return v > SHRT_MAX ? SHRT_MAX : v < SHRT_MIN ? SHRT_MIN : (short)v;
+}
+
+static int generate_weights_filename(const char *output_filename, char *filename, int filename_max_size) {
+    const char extension[] = ".diversity";
+    const char *p = strrchr(output_filename, '.');
+    const char *sep = strrchr(output_filename, '/');
+    const char *sep2 = strrchr(output_filename, '\\');
+    if (sep2 > sep)
+        sep = sep2;
+    if (p == NULL || (sep != NULL && p < sep))
+        p = output_filename + strlen(output_filename);
+    size_t sz = (size_t)(p - output_filename);
+    if (sz + sizeof(extension) > (size_t)filename_max_size)
+        return -1;
+    memcpy(filename, output_filename, sz);
+    memcpy(filename + sz, extension, sizeof(extension));
+    return 0;
+}
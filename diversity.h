@@ -0,0 +1,51 @@
+/* record to file the I/Q stream(s) from a SDRplay RSP
+ * dual tuner diversity combining
+ *
+ * Copyright 2025 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef _DIVERSITY_H
+#define _DIVERSITY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* samples combined in one call */
+#define DIVERSITY_CHUNK_SAMPLES 65536
+
+/* typedefs */
+typedef struct {
+    char magic[8];              /* "RSPDIVWT" */
+    uint16_t version;
+    uint16_t record_size;
+    uint16_t mode;              /* 1: MRC, 2: selection */
+    uint16_t unused;
+    uint64_t block_size;        /* samples per weights estimate */
+    double sample_rate;
+} DiversityHeader;
+
+typedef struct {
+    uint64_t sample_num;        /* first output sample with the new weights */
+    float weight[2][2];         /* tuner A, tuner B (re, im) */
+    float gain;                 /* amplitude of tuner B relative to tuner A (dB) */
+    float phase;                /* phase of tuner B relative to tuner A (degrees) */
+    float correlation;          /* magnitude of the A/B correlation coefficient */
+    float unused;
+} DiversityRecord;
+
+typedef struct {
+    unsigned long long blocks;
+    unsigned long long tuner_B_blocks;  /* selection: blocks with tuner B selected */
+} DiversityStats;
+
+/* global variables */
+extern DiversityStats diversity_stats;
+
+/* public functions */
+int diversity_open(const char *output_filename);
+size_t diversity_combine(const short *const *xi, const short *const *xq, size_t num_samples, unsigned long long sample_num, const short **cxi, const short **cxq);
+void diversity_close();
+
+#endif /* _DIVERSITY_H */
@@ -0,0 +1,383 @@
+/* record to file the I/Q stream(s) from a SDRplay RSP
+ * envelope (min/max/RMS pyramid) file
+ *
+ * Copyright 2025 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "config.h"
+#include "envelope.h"
+#include "output.h"
+#include "sdrplay-rsp.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+#define ENVELOPE_VERSION 1
+#define ENVELOPE_WRITE_ENTRIES 256      /* first level entries written at a time */
+
+/* the envelope of each PCM channel (min, max, and RMS of the samples) is
+ * kept for blocks of 2^10 samples (first level), 2^14 samples (second
+ * level), and so on, up to 2^38 samples; each level is computed from the
+ * running sums of the level below, as the samples are written.
+ * Each level is an array of fixed size entries in the file. The other
+ * levels get a region of the file sized for the streaming time (plus some
+ * slack) right after the header, and the first level, which can grow
+ * without limits, comes after them. The entries of all the levels are
+ * written every ENVELOPE_WRITE_ENTRIES entries of the first level, each
+ * time followed by the header with the number of entries of each level,
+ * so the memory used does not depend on the length of the recording, and
+ * the file is usable (up to the last write) even if the recording ends
+ * abruptly.
+ */
+typedef struct {
+    short min;
+    short max;
+    double sum_squares;
+} EnvelopeAccumulator;
+
+typedef struct Envelope {
+    int fd;
+    char filename[PATH_MAX];
+    int num_channels;
+    size_t entry_size;
+    int num_levels;                                             /* levels in the file */
+    EnvelopeAccumulator *accumulators[ENVELOPE_MAX_LEVELS];     /* one per channel */
+    unsigned long long accumulated_samples[ENVELOPE_MAX_LEVELS];
+    long long *first_level_sum_squares;                         /* one per channel */
+    EnvelopeValue *write_buffers[ENVELOPE_MAX_LEVELS];          /* entries not written yet */
+    unsigned int write_buffer_entries[ENVELOPE_MAX_LEVELS];
+    uint64_t offsets[ENVELOPE_MAX_LEVELS];                      /* file offset of each level */
+    unsigned long long capacity[ENVELOPE_MAX_LEVELS];           /* in entries (0: no limit) */
+    unsigned long long num_entries[ENVELOPE_MAX_LEVELS];
+    unsigned long long written_entries[ENVELOPE_MAX_LEVELS];
+    unsigned long long dropped_entries;                         /* beyond the capacity */
+    unsigned long long num_samples;
+} Envelope;
+
+/* internal functions */
+static int generate_envelope_filename(const char *output_filename, char *envelope_filename, int envelope_filename_max_size);
+static int envelope_add_entry(Envelope *envelope, int level);
+static int envelope_flush(Envelope *envelope);
+static int envelope_write_header(Envelope *envelope, bool is_final);
+static int envelope_write_at(Envelope *envelope, const void *buf, size_t count, uint64_t offset);
+static void envelope_free(Envelope *envelope);
+
+
+int envelope_open(OutputFile *output) {
+    if (strcmp(output->filename, "-") == 0 || output->filename[0] == '|') {
+        fprintf(stderr, "envelope file not supported when writing to stdout or named pipes\n");
+        return -1;
+    }
+    Envelope *envelope = (Envelope *)calloc(1, sizeof(Envelope));
+    if (envelope == NULL) {
+        fprintf(stderr, "calloc(envelope) failed\n");
+        return -1;
+    }
+    envelope->fd = -1;
+    output->envelope = envelope;
+    if (generate_envelope_filename(output->filename, envelope->filename, PATH_MAX) != 0) {
+        fprintf(stderr, "generate_envelope_filename(%s) failed\n", output->filename);
+        return -1;
+    }
+    int num_channels = output->num_channels;
+    envelope->num_channels = num_channels;
+    envelope->entry_size = num_channels * sizeof(EnvelopeValue);
+    for (int level = 0; level < ENVELOPE_MAX_LEVELS; level++) {
+        envelope->accumulators[level] = (EnvelopeAccumulator *)malloc(num_channels * sizeof(EnvelopeAccumulator));
+        envelope->write_buffers[level] = (EnvelopeValue *)malloc(ENVELOPE_WRITE_ENTRIES * envelope->entry_size);
+        if (envelope->accumulators[level] == NULL || envelope->write_buffers[level] == NULL) {
+            fprintf(stderr, "malloc(envelope buffers) failed\n");
+            return -1;
+        }
+        for (int channel = 0; channel < num_channels; channel++) {
+            envelope->accumulators[level][channel] = (EnvelopeAccumulator) {
+                .min = SHRT_MAX,
+                .max = SHRT_MIN,
+                .sum_squares = 0.0,
+            };
+        }
+    }
+    envelope->first_level_sum_squares = (long long *)calloc(num_channels, sizeof(long long));
+    if (envelope->first_level_sum_squares == NULL) {
+        fprintf(stderr, "malloc(envelope buffers) failed\n");
+        return -1;
+    }
+
+    /* the other levels down to the one with a single entry, for the
+     * streaming time plus some slack; the first level goes after them
+     */
+    double max_samples = (streaming_time * 1.01 + 2.0) * output_sample_rate;
+    uint64_t offset = sizeof(EnvelopeHeader);
+    envelope->num_levels = 1;
+    for (int level = 1; level < ENVELOPE_MAX_LEVELS; level++) {
+        int log2_samples = ENVELOPE_FIRST_LEVEL_LOG2 + level * ENVELOPE_LEVEL_STEP_LOG2;
+        unsigned long long capacity = (unsigned long long)ceil(max_samples / (double)(1ULL << log2_samples));
+        if (capacity < 1) {
+            capacity = 1;
+        }
+        envelope->offsets[level] = offset;
+        envelope->capacity[level] = capacity;
+        offset += capacity * envelope->entry_size;
+        envelope->num_levels++;
+        if (capacity == 1) {
+            break;
+        }
+    }
+    envelope->offsets[0] = offset;
+    envelope->capacity[0] = 0;
+
+    envelope->fd = open(envelope->filename, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, 0644);
+    if (envelope->fd == -1) {
+        fprintf(stderr, "open(%s) for writing failed: %s\n", envelope->filename, strerror(errno));
+        return -1;
+    }
+    if (envelope_write_header(envelope, false) == -1) {
+        return -1;
+    }
+    return 0;
+}
+
+/* a tuner with no samples (NULL) is all zeros */
+int envelope_update(OutputFile *output, const short *const *xi, const short *const *xq, unsigned int nrx, size_t num_samples) {
+    Envelope *envelope = output->envelope;
+    const unsigned long long first_level_samples = 1ULL << ENVELOPE_FIRST_LEVEL_LOG2;
+    size_t offset = 0;
+    while (offset < num_samples) {
+        size_t n = first_level_samples - envelope->accumulated_samples[0];
+        if (n > num_samples - offset) {
+            n = num_samples - offset;
+        }
+        for (unsigned int tuner = 0; tuner < nrx; tuner++) {
+            for (int iq = 0; iq < 2; iq++) {
+                int channel = 2 * tuner + iq;
+                EnvelopeAccumulator *accumulator = &envelope->accumulators[0][channel];
+                const short *x = iq == 0 ? xi[tuner] : xq[tuner];
+                short vmin = accumulator->min;
+                short vmax = accumulator->max;
+                if (x == NULL) {
+                    accumulator->min = vmin < 0 ? vmin : 0;
+                    accumulator->max = vmax > 0 ? vmax : 0;
+                    continue;
+                }
+                x += offset;
+                long long sum_squares = 0;
+                for (size_t i = 0; i < n; i++) {
+                    short v = x[i];
+                    vmin = v < vmin ? v : vmin;
+                    vmax = v > vmax ? v : vmax;
+                    sum_squares += (int)v * v;
+                }
+                accumulator->min = vmin;
+                accumulator->max = vmax;
+                envelope->first_level_sum_squares[channel] += sum_squares;
+            }
+        }
+        envelope->accumulated_samples[0] += n;
+        envelope->num_samples += n;
+        offset += n;
+        if (envelope->accumulated_samples[0] == first_level_samples) {
+            if (envelope_add_entry(envelope, 0) == -1) {
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+/* the last entry of each level covers the samples left at the end */
+int envelope_close(OutputFile *output) {
+    Envelope *envelope = output->envelope;
+    if (envelope == NULL) {
+        return 0;
+    }
+    int ret = 0;
+    if (envelope->fd != -1) {
+        for (int level = 0; level < envelope->num_levels && ret == 0; level++) {
+            if (envelope->accumulated_samples[level] > 0) {
+                ret = envelope_add_entry(envelope, level);
+            }
+        }
+        if (ret == 0) {
+            ret = envelope_flush(envelope);
+        }
+        if (ret == 0) {
+            ret = envelope_write_header(envelope, true);
+        }
+        if (envelope->dropped_entries > 0) {
+            fprintf(stderr, "warning: %llu envelope entries beyond the streaming time not saved\n", envelope->dropped_entries);
+        }
+        close(envelope->fd);
+        envelope->fd = -1;
+    }
+    envelope_free(envelope);
+    output->envelope = NULL;
+    return ret;
+}
+
+/* internal functions */
+static int generate_envelope_filename(const char *output_filename, char *envelope_filename, int envelope_filename_max_size) {
+    const char envelope_extension[] = ".envelope";
+    const char *p = strrchr(output_filename, '.');
+    const char *sep = strrchr(output_filename, '/');
+    const char *sep2 = strrchr(output_filename, '\\');
+    if (sep2 > sep)
+        sep = sep2;
+    if (p == NULL || (sep != NULL && p < sep))
+        p = output_filename + strlen(output_filename);
+    size_t sz = (size_t)(p - output_filename);
+    if (sz + sizeof(envelope_extension) > (size_t)envelope_filename_max_size)
+        return -1;
+    memcpy(envelope_filename, output_filename, sz);
+    memcpy(envelope_filename + sz, envelope_extension, sizeof(envelope_extension));
+    return 0;
+}
+
+/* closes the entry of a level and adds it to the running sums of the
+ * next level; the entries past the region of a level are dropped
+ */
+static int envelope_add_entry(Envelope *envelope, int level) {
+    int num_channels = envelope->num_channels;
+    bool is_saved = level < envelope->num_levels &&
+                    (envelope->capacity[level] == 0 || envelope->num_entries[level] < envelope->capacity[level]);
+    EnvelopeValue *entry = envelope->write_buffers[level] + envelope->write_buffer_entries[level] * num_channels;
+    unsigned long long num_samples = envelope->accumulated_samples[level];
+    bool has_next_level = level + 1 < ENVELOPE_MAX_LEVELS;
+    for (int channel = 0; channel < num_channels; channel++) {
+        EnvelopeAccumulator *accumulator = &envelope->accumulators[level][channel];
+        if (level == 0) {
+            accumulator->sum_squares = (double)envelope->first_level_sum_squares[channel];
+            envelope->first_level_sum_squares[channel] = 0;
+        }
+        entry[channel] = (EnvelopeValue) {
+            .min = accumulator->min,
+            .max = accumulator->max,
+            .rms = (uint16_t)lrint(sqrt(accumulator->sum_squares / num_samples)),
+        };
+        if (has_next_level) {
+            EnvelopeAccumulator *next = &envelope->accumulators[level + 1][channel];
+            next->min = accumulator->min < next->min ? accumulator->min : next->min;
+            next->max = accumulator->max > next->max ? accumulator->max : next->max;
+            next->sum_squares += accumulator->sum_squares;
+        }
+        *accumulator = (EnvelopeAccumulator) {
+            .min = SHRT_MAX,
+            .max = SHRT_MIN,
+            .sum_squares = 0.0,
+        };
+    }
+    if (is_saved) {
+        envelope->num_entries[level]++;
+        envelope->write_buffer_entries[level]++;
+    } else if (level < envelope->num_levels) {
+        envelope->dropped_entries++;
+    }
+    envelope->accumulated_samples[level] = 0;
+    /* the other levels fill up at least 16 times slower than the first one */
+    if (level == 0 && envelope->write_buffer_entries[0] == ENVELOPE_WRITE_ENTRIES) {
+        if (envelope_flush(envelope) == -1) {
+            return -1;
+        }
+    }
+    if (has_next_level) {
+        envelope->accumulated_samples[level + 1] += num_samples;
+        int next_level_log2 = ENVELOPE_FIRST_LEVEL_LOG2 + (level + 1) * ENVELOPE_LEVEL_STEP_LOG2;
+        if (envelope->accumulated_samples[level + 1] == 1ULL << next_level_log2) {
+            return envelope_add_entry(envelope, level + 1);
+        }
+    }
+    return 0;
+}
+
+/* writes the pending entries of all the levels, and then the header with
+ * their number
+ */
+static int envelope_flush(Envelope *envelope) {
+    for (int level = 0; level < envelope->num_levels; level++) {
+        unsigned int entries = envelope->write_buffer_entries[level];
+        if (entries == 0) {
+            continue;
+        }
+        uint64_t offset = envelope->offsets[level] + envelope->written_entries[level] * envelope->entry_size;
+        if (envelope_write_at(envelope, envelope->write_buffers[level], entries * envelope->entry_size, offset) == -1) {
+            fprintf(stderr, "write() envelope entries failed: %s\n", strerror(errno));
+            return -1;
+        }
+        envelope->written_entries[level] += entries;
+        envelope->write_buffer_entries[level] = 0;
+    }
+    return envelope_write_header(envelope, false);
+}
+
+/* while recording all the levels are listed, even if still empty; the
+ * final header lists them only down to the one with a single entry
+ */
+static int envelope_write_header(Envelope *envelope, bool is_final) {
+    EnvelopeHeader envelope_header = {
+        .magic = {'R', 'S', 'P', 'E', 'N', 'V', 'L', 'P'},
+        .version = ENVELOPE_VERSION,
+        .header_size = sizeof(EnvelopeHeader),
+        .num_channels = envelope->num_channels,
+        .num_levels = 0,
+        .num_samples = envelope->num_samples,
+        .sample_rate = output_sample_rate,
+    };
+    for (int level = 0; level < envelope->num_levels; level++) {
+        if (is_final && envelope->written_entries[level] == 0) {
+            break;
+        }
+        envelope_header.levels[level] = (EnvelopeLevel) {
+            .log2_samples = ENVELOPE_FIRST_LEVEL_LOG2 + level * ENVELOPE_LEVEL_STEP_LOG2,
+            .unused = 0,
+            .offset = envelope->offsets[level],
+            .num_entries = envelope->written_entries[level],
+        };
+        envelope_header.num_levels++;
+        if (is_final && envelope->written_entries[level] == 1) {
+            break;
+        }
+    }
+    if (envelope_write_at(envelope, &envelope_header, sizeof(envelope_header), 0) == -1) {
+        fprintf(stderr, "update envelope header failed: %s\n", strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+static int envelope_write_at(Envelope *envelope, const void *buf, size_t count, uint64_t offset) {
+#ifndef WIN32
+    if (pwrite(envelope->fd, buf, count, (off_t)offset) == -1) {
+        return -1;
+    }
+#else
+    /* no pwrite() on Windows - nothing else uses the file position */
+    if (lseek(envelope->fd, (off_t)offset, SEEK_SET) == -1) {
+        return -1;
+    }
+    if (write(envelope->fd, buf, count) == -1) {
+        return -1;
+    }
+#endif /* WIN32 */
+    return 0;
+}
+
+static void envelope_free(Envelope *envelope) {
+    for (int level = 0; level < ENVELOPE_MAX_LEVELS; level++) {
+        free(envelope->accumulators[level]);
+        free(envelope->write_buffers[level]);
+    }
+    free(envelope->first_level_sum_squares);
+    free(envelope);
+}
@@ -0,0 +1,51 @@
+/* record to file the I/Q stream(s) from a SDRplay RSP
+ * envelope (min/max/RMS pyramid) file
+ *
+ * Copyright 2025 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef _ENVELOPE_H
+#define _ENVELOPE_H
+
+#include "output.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define ENVELOPE_MAX_LEVELS 8
+#define ENVELOPE_FIRST_LEVEL_LOG2 10    /* 1024 samples per entry */
+#define ENVELOPE_LEVEL_STEP_LOG2 4      /* 16 entries of a level per entry of the next one */
+
+/* typedefs */
+typedef struct {
+    uint32_t log2_samples;      /* samples per entry: 2^log2_samples */
+    uint32_t unused;
+    uint64_t offset;            /* file offset of the first entry */
+    uint64_t num_entries;
+} EnvelopeLevel;
+
+typedef struct {
+    char magic[8];              /* "RSPENVLP" */
+    uint16_t version;
+    uint16_t header_size;
+    uint16_t num_channels;      /* PCM channels in the recording */
+    uint16_t num_levels;
+    uint64_t num_samples;       /* samples in the recording */
+    double sample_rate;
+    EnvelopeLevel levels[ENVELOPE_MAX_LEVELS];
+} EnvelopeHeader;
+
+typedef struct {
+    int16_t min;
+    int16_t max;
+    uint16_t rms;
+} EnvelopeValue;
+
+/* public functions */
+int envelope_open(OutputFile *output);
+int envelope_update(OutputFile *output, const short *const *xi, const short *const *xq, unsigned int nrx, size_t num_samples);
+int envelope_close(OutputFile *output);
+
+#endif /* _ENVELOPE_H */
@@ -100,6 +100,19 @@ def ds64_chunk(ds64_bytes):
     print('Data Size :', data_size)
     sample_count = sampleCountHigh << 32 | sampleCountLow
     print('Sample Count :', sample_count)
+    return data_size
+
+def r64m_chunk(r64m_bytes):
+    # EBU TECH 3306 marker entries
+    entry_size = 28 + 256 + 4 + 16 + 16
+    num_markers = len(r64m_bytes) // entry_size
+    print('Markers :', num_markers)
+    for i in range(num_markers):
+        flags, sampleOffsetLow, sampleOffsetHigh, byteOffsetLow, byteOffsetHigh, _, _, labelText = struct.unpack_from('<7I256s', r64m_bytes, i * entry_size)
+        sample_offset = sampleOffsetHigh << 32 | sampleOffsetLow
+        byte_offset = byteOffsetHigh << 32 | byteOffsetLow
+        label = labelText.split(b'\0', 1)[0].decode()
+        print(f'Marker {i} : flags={flags:#x} sample_offset={sample_offset} byte_offset={byte_offset} label={label}')
 
 def main():
     filename = sys.argv[1]
@@ -114,6 +127,7 @@ def main():
         if not (hdrchunk_id in [b'RIFF', b'RF64'] and hdrchunk_fmt == b'WAVE'):
             raise ValueError("Invalid WAV file")
 
+        ds64_data_size = None
         while True:
             # read the next chunk header
             chunk_bytes = wav.read(8)
@@ -126,8 +140,12 @@ def main():
             print('Chunk ID :', chunk_id)
             print('Chunk Size :', chunk_size if chunk_size != 0xFFFFFFFF else -1)
             if chunk_id == b'data':
-                #wav.seek(chunk_size)
-                break
+                # skip the samples; there may be other chunks after them
+                if chunk_size == 0xFFFFFFFF and ds64_data_size is not None:
+                    chunk_size = ds64_data_size
+                wav.seek(chunk_size + (chunk_size & 1), 1)
+                print()
+                continue
             else:
                 chunk_bytes = wav.read(chunk_size)
             if chunk_id == b'fmt ':
@@ -141,7 +159,9 @@ def main():
                 elif chunk_bytes.startswith('<?xml '.encode('UTF-16-LE')):
                     auxi_sdrconsole_chunk(chunk_bytes)
             elif chunk_id == b'ds64':
-                ds64_chunk(chunk_bytes)
+                ds64_data_size = ds64_chunk(chunk_bytes)
+            elif chunk_id == b'r64m':
+                r64m_chunk(chunk_bytes)
             elif chunk_id == b'JUNK':
                 # nothing interesting here
                 pass
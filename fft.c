@@ -0,0 +1,208 @@
+/* record to file the I/Q stream(s) from a SDRplay RSP
+ * small mixed radix (2, 3, 5) FFT
+ *
+ * Copyright 2025 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "fft.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* iterative in-place decimation in time FFT on split real/imaginary
+ * arrays; the sizes used here (up to a few thousand points) are small
+ * enough that the tables fit in L1/L2 cache.
+ * Powers of 2 use radix 2 butterflies and an in-place bit reversal; the
+ * other sizes (products of 2, 3, and 5, for instance 200 channels of
+ * 10kHz in 2MHz) are reordered into a scratch buffer first, and each
+ * stage combines its sub-transforms with a small direct DFT.
+ */
+
+/* internal functions */
+static void fft_forward_radix2(const FFT *fft, float *re, float *im);
+static void fft_forward_mixed_radix(const FFT *fft, float *re, float *im);
+
+
+int fft_init(FFT *fft, unsigned int size) {
+    *fft = (FFT) {
+        .size = 0,
+        .log2_size = 0,
+        .num_factors = 0,
+        .cos_table = NULL,
+        .sin_table = NULL,
+        .permutation = NULL,
+        .scratch_re = NULL,
+        .scratch_im = NULL,
+    };
+    unsigned int n = size;
+    const unsigned int radixes[] = {2, 3, 5};
+    for (int r = 0; r < 3; r++) {
+        while (n % radixes[r] == 0 && n > 1 && fft->num_factors < FFT_MAX_FACTORS) {
+            fft->factors[fft->num_factors++] = radixes[r];
+            n /= radixes[r];
+        }
+    }
+    if (size < 2 || n != 1) {
+        fprintf(stderr, "invalid FFT size: %u (must be a product of 2, 3, and 5)\n", size);
+        return -1;
+    }
+    if ((size & (size - 1)) == 0) {
+        fft->log2_size = fft->num_factors;
+    }
+
+    fft->cos_table = (float *)malloc(size * sizeof(float));
+    fft->sin_table = (float *)malloc(size * sizeof(float));
+    fft->permutation = (unsigned int *)malloc(size * sizeof(unsigned int));
+    if (fft->log2_size == 0) {
+        fft->scratch_re = (float *)malloc(size * sizeof(float));
+        fft->scratch_im = (float *)malloc(size * sizeof(float));
+    }
+    if (fft->cos_table == NULL || fft->sin_table == NULL || fft->permutation == NULL || (fft->log2_size == 0 && (fft->scratch_re == NULL || fft->scratch_im == NULL))) {
+        fprintf(stderr, "malloc(FFT tables) failed\n");
+        fft_free(fft);
+        return -1;
+    }
+    for (unsigned int k = 0; k < size; k++) {
+        double angle = -2.0 * M_PI * k / size;
+        fft->cos_table[k] = (float)cos(angle);
+        fft->sin_table[k] = (float)sin(angle);
+    }
+    /* mixed radix digit reversal (bit reversal for powers of 2) */
+    for (unsigned int i = 0; i < size; i++) {
+        unsigned int pos = i;
+        unsigned int index = 0;
+        unsigned int multiplier = 1;
+        unsigned int span = size;
+        for (int s = fft->num_factors - 1; s >= 0; s--) {
+            unsigned int m = span / fft->factors[s];
+            index += (pos / m) * multiplier;
+            pos %= m;
+            multiplier *= fft->factors[s];
+            span = m;
+        }
+        fft->permutation[i] = index;
+    }
+    fft->size = size;
+    return 0;
+}
+
+void fft_forward(const FFT *fft, float *re, float *im) {
+    if (fft->log2_size > 0) {
+        fft_forward_radix2(fft, re, im);
+    } else {
+        fft_forward_mixed_radix(fft, re, im);
+    }
+}
+
+void fft_free(FFT *fft) {
+    free(fft->cos_table);
+    free(fft->sin_table);
+    free(fft->permutation);
+    free(fft->scratch_re);
+    free(fft->scratch_im);
+    fft->cos_table = NULL;
+    fft->sin_table = NULL;
+    fft->permutation = NULL;
+    fft->scratch_re = NULL;
+    fft->scratch_im = NULL;
+    fft->size = 0;
+}
+
+void fft_hann_window(float *window, unsigned int size) {
+    for (unsigned int i = 0; i < size; i++) {
+        window[i] = (float)(0.5 - 0.5 * cos(2.0 * M_PI * i / size));
+    }
+}
+
+/* internal functions */
+static void fft_forward_radix2(const FFT *fft, float *re, float *im) {
+    unsigned int size = fft->size;
+    for (unsigned int i = 0; i < size; i++) {
+        unsigned int j = fft->permutation[i];
+        if (j > i) {
+            float tmp = re[i];
+            re[i] = re[j];
+            re[j] = tmp;
+            tmp = im[i];
+            im[i] = im[j];
+            im[j] = tmp;
+        }
+    }
+    for (unsigned int half = 1, stride = size / 2; half < size; half *= 2, stride /= 2) {
+        for (unsigned int start = 0; start < size; start += 2 * half) {
+            float *are = re + start;
+            float *aim = im + start;
+            float *bre = re + start + half;
+            float *bim = im + start + half;
+            for (unsigned int k = 0; k < half; k++) {
+                float wr = fft->cos_table[k * stride];
+                float wi = fft->sin_table[k * stride];
+                float tr = bre[k] * wr - bim[k] * wi;
+                float ti = bre[k] * wi + bim[k] * wr;
+                bre[k] = are[k] - tr;
+                bim[k] = aim[k] - ti;
+                are[k] += tr;
+                aim[k] += ti;
+            }
+        }
+    }
+}
+
+static void fft_forward_mixed_radix(const FFT *fft, float *re, float *im) {
+    unsigned int size = fft->size;
+    float *xre = fft->scratch_re;
+    float *xim = fft->scratch_im;
+    for (unsigned int i = 0; i < size; i++) {
+        xre[i] = re[fft->permutation[i]];
+        xim[i] = im[fft->permutation[i]];
+    }
+    unsigned int m = 1;
+    for (unsigned int s = 0; s < fft->num_factors; s++) {
+        unsigned int p = fft->factors[s];
+        unsigned int span = p * m;
+        unsigned int twiddle_step = size / span;
+        unsigned int root_step = size / p;
+        for (unsigned int start = 0; start < size; start += span) {
+            for (unsigned int k = 0; k < m; k++) {
+                float ar[5];
+                float ai[5];
+                for (unsigned int j = 0; j < p; j++) {
+                    unsigned int index = start + j * m + k;
+                    unsigned int t = j * k * twiddle_step;
+                    float wr = fft->cos_table[t];
+                    float wi = fft->sin_table[t];
+                    ar[j] = xre[index] * wr - xim[index] * wi;
+                    ai[j] = xre[index] * wi + xim[index] * wr;
+                }
+                if (p == 2) {
+                    xre[start + k] = ar[0] + ar[1];
+                    xim[start + k] = ai[0] + ai[1];
+                    xre[start + k + m] = ar[0] - ar[1];
+                    xim[start + k + m] = ai[0] - ai[1];
+                    continue;
+                }
+                for (unsigned int q = 0; q < p; q++) {
+                    float sr = 0.0f;
+                    float si = 0.0f;
+                    for (unsigned int j = 0; j < p; j++) {
+                        unsigned int t = ((j * q) % p) * root_step;
+                        float wr = fft->cos_table[t];
+                        float wi = fft->sin_table[t];
+                        sr += ar[j] * wr - ai[j] * wi;
+                        si += ar[j] * wi + ai[j] * wr;
+                    }
+                    xre[start + k + q * m] = sr;
+                    xim[start + k + q * m] = si;
+                }
+            }
+        }
+        m = span;
+    }
+    for (unsigned int i = 0; i < size; i++) {
+        re[i] = xre[i];
+        im[i] = xim[i];
+    }
+}
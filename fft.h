@@ -0,0 +1,33 @@
+/* record to file the I/Q stream(s) from a SDRplay RSP
+ * small mixed radix (2, 3, 5) FFT
+ *
+ * Copyright 2025 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef _FFT_H
+#define _FFT_H
+
+#define FFT_MAX_FACTORS 32
+
+/* typedefs */
+typedef struct {
+    unsigned int size;
+    unsigned int log2_size;         /* 0 if the size is not a power of 2 */
+    unsigned int num_factors;
+    unsigned int factors[FFT_MAX_FACTORS];
+    float *cos_table;               /* size twiddle factors */
+    float *sin_table;
+    unsigned int *permutation;      /* input order for the first stage */
+    float *scratch_re;              /* mixed radix only */
+    float *scratch_im;
+} FFT;
+
+/* public functions */
+int fft_init(FFT *fft, unsigned int size);
+void fft_forward(const FFT *fft, float *re, float *im);
+void fft_free(FFT *fft);
+void fft_hann_window(float *window, unsigned int size);
+
+#endif /* _FFT_H */
@@ -0,0 +1,170 @@
+/* record to file the I/Q stream(s) from a SDRplay RSP
+ * recording index
+ *
+ * Copyright 2025 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "buffers.h"
+#include "config.h"
+#include "index.h"
+#include "sdrplay-rsp.h"
+#include "stats.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+#define INDEX_VERSION 1
+
+/* internal functions */
+static int generate_index_filename(const char *output_filename, char *index_filename, int index_filename_max_size);
+
+
+int index_open(OutputFile *output) {
+    if (strcmp(output->filename, "-") == 0 || output->filename[0] == '|') {
+        fprintf(stderr, "index file not supported when writing to stdout or named pipes\n");
+        return -1;
+    }
+    if (output_type == OUTPUT_TYPE_COMPRESSED || output_type == OUTPUT_TYPE_ZSTD) {
+        fprintf(stderr, "index file not supported for compressed output (the block index is in the file)\n");
+        return -1;
+    }
+    char index_filename[PATH_MAX];
+    if (generate_index_filename(output->filename, index_filename, PATH_MAX) != 0) {
+        fprintf(stderr, "generate_index_filename(%s) failed\n", output->filename);
+        return -1;
+    }
+
+    /* the index is opened right after the header of the recording */
+    off_t data_offset = lseek(output->fd, 0, SEEK_CUR);
+    if (data_offset == -1) {
+        fprintf(stderr, "lseek(%s) failed: %s\n", output->filename, strerror(errno));
+        return -1;
+    }
+    output->index_data_offset = data_offset;
+
+    unsigned long long interval_samples = output_sample_rate * index_interval / 1000.0 + 0.5;
+    output->index_interval_samples = interval_samples > 0 ? interval_samples : 1;
+    output->index_next_sample = 0;
+    output->index_skipped_samples = 0;
+    output->index_flags = 0;
+    output->index_resync_events = 0;
+    for (int tuner = 0; tuner < 2; tuner++) {
+        output->index_gain_changes[tuner] = 0;
+        output->index_overloads[tuner] = 0;
+        output->index_gRdB[tuner] = 0xff;
+        output->index_lnaGRdB[tuner] = 0xff;
+    }
+
+    output->index_fd = open(index_filename, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, 0644);
+    if (output->index_fd == -1) {
+        fprintf(stderr, "open(%s) for writing failed: %s\n", index_filename, strerror(errno));
+        return -1;
+    }
+
+    IndexHeader index_header = {
+        .magic = {'R', 'S', 'P', 'I', 'N', 'D', 'E', 'X'},
+        .version = INDEX_VERSION,
+        .entry_size = sizeof(IndexEntry),
+        .num_channels = output->num_channels,
+        .unused = 0,
+        .interval_samples = output->index_interval_samples,
+        .sample_rate = output_sample_rate
+    };
+    if (write(output->index_fd, &index_header, sizeof(index_header)) == -1) {
+        fprintf(stderr, "write() index header failed: %s\n", strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+/* called by the writer for each block taken from a tuner of this output;
+ * the gain and the events are those of the block, so they match the
+ * samples being written rather than the latest callback
+ */
+void index_add_block(OutputFile *output, int tuner, const BlockDescriptor *block) {
+    if (output->index_fd == -1) {
+        return;
+    }
+    if (block->gain_changes != output->index_gain_changes[tuner]) {
+        output->index_flags |= INDEX_FLAG_GAIN_CHANGE;
+        output->index_gain_changes[tuner] = block->gain_changes;
+    }
+    if (block->overload_detected != output->index_overloads[tuner]) {
+        output->index_flags |= INDEX_FLAG_OVERLOAD;
+        output->index_overloads[tuner] = block->overload_detected;
+    }
+    if (block->clipped_values > 0) {
+        output->index_flags |= INDEX_FLAG_CLIPPED;
+    }
+    output->index_gRdB[tuner] = block->gRdB;
+    output->index_lnaGRdB[tuner] = block->lnaGRdB;
+}
+
+/* add an entry for every index interval boundary already in the recording;
+ * the timestamps are derived from the sample count since the start of the
+ * recording (including the skipped gaps), not from the write time
+ */
+int index_update(OutputFile *output) {
+    if (stats.resync_events != output->index_resync_events) {
+        output->index_flags |= INDEX_FLAG_RESYNC;
+        output->index_resync_events = stats.resync_events;
+    }
+
+    long long start_ns = timeinfo.start_ts.tv_sec * 1000000000LL + timeinfo.start_ts.tv_nsec;
+    unsigned int frame_size = output->num_channels * sizeof(short);
+    while (output->index_next_sample < output->stats->output_samples) {
+        unsigned long long sample_num = output->index_next_sample;
+        double elapsed = (double)(sample_num + output->index_skipped_samples) / output_sample_rate;
+        IndexEntry index_entry = {
+            .sample_num = sample_num,
+            .byte_offset = output->index_data_offset + sample_num * frame_size,
+            .timestamp = start_ns + (long long)(elapsed * 1e9 + 0.5),
+            .gRdB = {output->index_gRdB[0], output->index_gRdB[1]},
+            .lnaGRdB = {output->index_lnaGRdB[0], output->index_lnaGRdB[1]},
+            .flags = output->index_flags,
+            .unused = {0, 0, 0}
+        };
+        if (write(output->index_fd, &index_entry, sizeof(index_entry)) == -1) {
+            fprintf(stderr, "write() index entry failed: %s\n", strerror(errno));
+            return -1;
+        }
+        output->index_flags = 0;
+        output->index_next_sample += output->index_interval_samples;
+    }
+    return 0;
+}
+
+void index_close(OutputFile *output) {
+    if (output->index_fd != -1) {
+        close(output->index_fd);
+        output->index_fd = -1;
+    }
+}
+
+/* internal functions */
+static int generate_index_filename(const char *output_filename, char *index_filename, int index_filename_max_size) {
+    const char index_extension[] = ".index";
+    const char *p = strrchr(output_filename, '.');
+    const char *sep = strrchr(output_filename, '/');
+    const char *sep2 = strrchr(output_filename, '\\');
+    if (sep2 > sep)
+        sep = sep2;
+    if (p == NULL || (sep != NULL && p < sep))
+        p = output_filename + strlen(output_filename);
+    size_t sz = (size_t)(p - output_filename);
+    if (sz + sizeof(index_extension) > (size_t)index_filename_max_size)
+        return -1;
+    memcpy(index_filename, output_filename, sz);
+    memcpy(index_filename + sz, index_extension, sizeof(index_extension));
+    return 0;
+}
@@ -0,0 +1,52 @@
+/* record to file the I/Q stream(s) from a SDRplay RSP
+ * recording index
+ *
+ * Copyright 2025 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef _INDEX_H
+#define _INDEX_H
+
+#include "buffers.h"
+#include "output.h"
+
+#include <stdint.h>
+
+/* index flags (events since the previous index entry) */
+#define INDEX_FLAG_GAP_FILLED   0x01    /* dropped samples replaced with zeros */
+#define INDEX_FLAG_GAP_SKIPPED  0x02    /* dropped samples not in the file */
+#define INDEX_FLAG_RESYNC       0x04    /* dual tuner streams resynchronized */
+#define INDEX_FLAG_GAIN_CHANGE  0x08
+#define INDEX_FLAG_CLIPPED      0x10    /* I or Q values at full scale */
+#define INDEX_FLAG_OVERLOAD     0x20    /* power overload detected */
+
+/* typedefs */
+typedef struct {
+    char magic[8];              /* "RSPINDEX" */
+    uint16_t version;
+    uint16_t entry_size;
+    uint16_t num_channels;      /* PCM channels in the recording */
+    uint16_t unused;
+    uint64_t interval_samples;  /* samples between two index entries */
+    double sample_rate;
+} IndexHeader;
+
+typedef struct {
+    uint64_t sample_num;        /* sample number in the recording */
+    uint64_t byte_offset;       /* offset of this sample in the recording */
+    int64_t timestamp;          /* UTC time in ns since the epoch */
+    uint8_t gRdB[2];            /* tuner A, tuner B */
+    uint8_t lnaGRdB[2];
+    uint8_t flags;
+    uint8_t unused[3];
+} IndexEntry;
+
+/* public functions */
+int index_open(OutputFile *output);
+void index_add_block(OutputFile *output, int tuner, const BlockDescriptor *block);
+int index_update(OutputFile *output);
+void index_close(OutputFile *output);
+
+#endif /* _INDEX_H */
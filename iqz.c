@@ -0,0 +1,329 @@
+/* record to file the I/Q stream(s) from a SDRplay RSP
+ * lossless I/Q compression (IQZ format)
+ *
+ * Copyright 2025 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "config.h"
+#include "iqz.h"
+#include "sdrplay-rsp.h"
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+/* IQZ file layout:
+ *   - file header (IQZFileHeader)
+ *   - one or more blocks, each one with a block header (IQZBlockHeader)
+ *     followed by its payload
+ *   - block index (one IQZIndexEntry for each block)
+ *   - trailer (IQZTrailer) at the very end of the file
+ *
+ * Each channel in a block is predicted with a fixed polynomial predictor
+ * of order 0, 1, or 2 (raw, delta, or second order delta), whichever gives
+ * the smallest residuals; the first 'order' samples are stored as 16 bit
+ * values and the residuals are zigzag mapped and Rice coded. All the
+ * channels of a block share one bitstream (MSB first).
+ */
+
+#define IQZ_MAX_ORDER 2
+#define IQZ_MAX_RICE_K 19
+#define IQZ_ESCAPE_ONES 24      /* unary prefix that flags an escaped value */
+#define IQZ_ESCAPE_BITS 20      /* escaped values are stored with this many bits */
+/* worst case: escape prefix + escaped value for every sample */
+#define IQZ_MAX_BYTES_PER_SAMPLE ((IQZ_ESCAPE_ONES + IQZ_ESCAPE_BITS + 7) / 8)
+
+/* typedefs */
+typedef struct {
+    uint8_t *data;
+    size_t size;
+    uint64_t acc;
+    unsigned int nbits;
+} BitWriter;
+
+typedef struct {
+    const uint8_t *data;
+    size_t size;
+    size_t pos;
+    uint64_t acc;
+    unsigned int nbits;
+} BitReader;
+
+/* internal functions */
+static inline void put_bits(BitWriter *bw, uint32_t value, unsigned int n);
+static inline void flush_bits(BitWriter *bw);
+static inline int get_bits(BitReader *br, unsigned int n, uint32_t *value);
+static void encode_channel(BitWriter *bw, const int32_t *x, unsigned int n, uint32_t *u, uint8_t *order, uint8_t *rice_k);
+
+
+int iqz_write_header(OutputFile *output, unsigned int block_frames) {
+    if (output->num_channels > IQZ_MAX_CHANNELS) {
+        fprintf(stderr, "IQZ compression supports up to %d channels\n", IQZ_MAX_CHANNELS);
+        return -1;
+    }
+    IQZFileHeader file_header = {
+        .magic = {'R', 'S', 'P', 'I', 'Q', 'Z', '0', '1'},
+        .header_size = sizeof(IQZFileHeader),
+        .num_channels = output->num_channels,
+        .bits_per_sample = 16,
+        .block_frames = block_frames,
+        .unused = 0,
+        .sample_rate = output_sample_rate,
+        .frequency = output->frequency
+    };
+    if (output_write(output, (const uint8_t *)&file_header, sizeof(file_header)) == -1) {
+        fprintf(stderr, "write() IQZ header failed\n");
+        return -1;
+    }
+    return 0;
+}
+
+size_t iqz_max_block_size(unsigned int num_frames, int num_channels) {
+    return sizeof(IQZBlockHeader) + (size_t)num_frames * num_channels * IQZ_MAX_BYTES_PER_SAMPLE + 8;
+}
+
+size_t iqz_encode_block(const short *samples, unsigned int num_frames, int num_channels, uint8_t *out, int32_t *x, uint32_t *u, bool *is_verbatim) {
+    IQZBlockHeader block_header = {
+        .sync = {'I', 'Q', 'Z', 'B'},
+        .payload_size = 0,
+        .num_frames = num_frames,
+        .order = {0, 0, 0, 0},
+        .rice_k = {0, 0, 0, 0}
+    };
+    BitWriter bw = {
+        .data = out + sizeof(IQZBlockHeader),
+        .size = 0,
+        .acc = 0,
+        .nbits = 0
+    };
+    for (int c = 0; c < num_channels; c++) {
+        /* de-interleave */
+        for (unsigned int i = 0; i < num_frames; i++) {
+            x[i] = samples[i * num_channels + c];
+        }
+        encode_channel(&bw, x, num_frames, u, &block_header.order[c], &block_header.rice_k[c]);
+    }
+    flush_bits(&bw);
+
+    size_t raw_size = num_frames * num_channels * sizeof(short);
+    *is_verbatim = bw.size >= raw_size;
+    if (*is_verbatim) {
+        /* noise-like block: store it as is */
+        memset(block_header.order, IQZ_ORDER_VERBATIM, sizeof(block_header.order));
+        memset(block_header.rice_k, 0, sizeof(block_header.rice_k));
+        memcpy(out + sizeof(IQZBlockHeader), samples, raw_size);
+        bw.size = raw_size;
+    }
+    block_header.payload_size = bw.size;
+    memcpy(out, &block_header, sizeof(block_header));
+    return sizeof(IQZBlockHeader) + bw.size;
+}
+
+/* returns the number of frames decoded, or -1 if the block is invalid */
+int iqz_decode_block(const uint8_t *block, size_t block_size, int num_channels, short *samples, unsigned int max_frames) {
+    if (block_size < sizeof(IQZBlockHeader) || num_channels < 1 || num_channels > IQZ_MAX_CHANNELS) {
+        return -1;
+    }
+    IQZBlockHeader block_header;
+    memcpy(&block_header, block, sizeof(block_header));
+    if (memcmp(block_header.sync, "IQZB", 4) != 0 ||
+        block_header.payload_size > block_size - sizeof(IQZBlockHeader) ||
+        block_header.num_frames > max_frames) {
+        return -1;
+    }
+    unsigned int n = block_header.num_frames;
+    const uint8_t *payload = block + sizeof(IQZBlockHeader);
+    if (block_header.order[0] == IQZ_ORDER_VERBATIM) {
+        if (block_header.payload_size != n * num_channels * sizeof(short)) {
+            return -1;
+        }
+        memcpy(samples, payload, block_header.payload_size);
+        return n;
+    }
+
+    BitReader br = {
+        .data = payload,
+        .size = block_header.payload_size,
+        .pos = 0,
+        .acc = 0,
+        .nbits = 0
+    };
+    for (int c = 0; c < num_channels; c++) {
+        unsigned int order = block_header.order[c];
+        unsigned int k = block_header.rice_k[c];
+        if (order > IQZ_MAX_ORDER || k > IQZ_MAX_RICE_K) {
+            return -1;
+        }
+        int32_t x1 = 0;
+        int32_t x2 = 0;
+        for (unsigned int i = 0; i < n; i++) {
+            int32_t x;
+            if (i < order) {
+                uint32_t v;
+                if (get_bits(&br, 16, &v) == -1)
+                    return -1;
+                x = (int16_t)v;
+            } else {
+                unsigned int q = 0;
+                uint32_t bit;
+                do {
+                    if (get_bits(&br, 1, &bit) == -1)
+                        return -1;
+                } while (bit == 1 && ++q < IQZ_ESCAPE_ONES);
+                uint32_t u;
+                if (q == IQZ_ESCAPE_ONES) {
+                    if (get_bits(&br, IQZ_ESCAPE_BITS, &u) == -1)
+                        return -1;
+                } else {
+                    uint32_t low = 0;
+                    if (k > 0 && get_bits(&br, k, &low) == -1)
+                        return -1;
+                    u = (q << k) | low;
+                }
+                int32_t residual = (int32_t)(u >> 1) ^ -(int32_t)(u & 1);
+                int32_t prediction = order == 0 ? 0 : order == 1 ? x1 : 2 * x1 - x2;
+                x = prediction + residual;
+                if (x < SHRT_MIN || x > SHRT_MAX)
+                    return -1;
+            }
+            samples[i * num_channels + c] = x;
+            x2 = x1;
+            x1 = x;
+        }
+    }
+    return n;
+}
+
+
+/* the block index and the trailer go at the end of the file */
+int iqz_write_index(OutputFile *output, const CompressedBlockInfo *blocks, size_t num_blocks, uint64_t index_offset, uint64_t num_frames) {
+    for (size_t i = 0; i < num_blocks; i++) {
+        IQZIndexEntry index_entry = {
+            .offset = blocks[i].offset,
+            .first_frame = blocks[i].first_frame
+        };
+        if (output_write(output, (const uint8_t *)&index_entry, sizeof(index_entry)) == -1) {
+            fprintf(stderr, "write() IQZ index failed\n");
+            return -1;
+        }
+    }
+    IQZTrailer trailer = {
+        .index_offset = index_offset,
+        .num_blocks = num_blocks,
+        .num_frames = num_frames,
+        .magic = {'R', 'S', 'P', 'I', 'Q', 'Z', 'I', 'X'}
+    };
+    if (output_write(output, (const uint8_t *)&trailer, sizeof(trailer)) == -1) {
+        fprintf(stderr, "write() IQZ trailer failed\n");
+        return -1;
+    }
+    return 0;
+}
+
+
+/* internal functions */
+static inline void put_bits(BitWriter *bw, uint32_t value, unsigned int n) {
+    /* n <= 24, so the accumulator never holds more than 32 bits */
+    bw->acc = (bw->acc << n) | value;
+    bw->nbits += n;
+    while (bw->nbits >= 8) {
+        bw->nbits -= 8;
+        bw->data[bw->size++] = (uint8_t)(bw->acc >> bw->nbits);
+    }
+}
+
+static inline void flush_bits(BitWriter *bw) {
+    if (bw->nbits > 0) {
+        put_bits(bw, 0, 8 - bw->nbits);
+    }
+}
+
+static inline int get_bits(BitReader *br, unsigned int n, uint32_t *value) {
+    while (br->nbits < n) {
+        if (br->pos >= br->size)
+            return -1;
+        br->acc = (br->acc << 8) | br->data[br->pos++];
+        br->nbits += 8;
+    }
+    br->nbits -= n;
+    *value = (uint32_t)(br->acc >> br->nbits) & ((1U << n) - 1);
+    return 0;
+}
+
+static void encode_channel(BitWriter *bw, const int32_t *x, unsigned int n, uint32_t *u, uint8_t *order, uint8_t *rice_k) {
+    /* pick the predictor with the smallest sum of absolute residuals */
+    uint64_t sum0 = 0;
+    uint64_t sum1 = 0;
+    uint64_t sum2 = 0;
+    for (unsigned int i = 2; i < n; i++) {
+        int32_t r = x[i];
+        sum0 += r >= 0 ? r : -r;
+    }
+    for (unsigned int i = 2; i < n; i++) {
+        int32_t r = x[i] - x[i-1];
+        sum1 += r >= 0 ? r : -r;
+    }
+    for (unsigned int i = 2; i < n; i++) {
+        int32_t r = x[i] - 2 * x[i-1] + x[i-2];
+        sum2 += r >= 0 ? r : -r;
+    }
+    unsigned int best_order = 0;
+    if (sum1 < sum0)
+        best_order = 1;
+    if (sum2 < (best_order == 0 ? sum0 : sum1))
+        best_order = 2;
+    if (best_order > n)
+        best_order = n;
+
+    /* zigzag mapped residuals */
+    uint64_t sum = 0;
+    if (best_order == 0) {
+        for (unsigned int i = 0; i < n; i++) {
+            int32_t r = x[i];
+            u[i] = ((uint32_t)r << 1) ^ (uint32_t)(r >> 31);
+        }
+    } else if (best_order == 1) {
+        for (unsigned int i = 1; i < n; i++) {
+            int32_t r = x[i] - x[i-1];
+            u[i] = ((uint32_t)r << 1) ^ (uint32_t)(r >> 31);
+        }
+    } else {
+        for (unsigned int i = 2; i < n; i++) {
+            int32_t r = x[i] - 2 * x[i-1] + x[i-2];
+            u[i] = ((uint32_t)r << 1) ^ (uint32_t)(r >> 31);
+        }
+    }
+    for (unsigned int i = best_order; i < n; i++) {
+        sum += u[i];
+    }
+
+    /* Rice parameter: roughly log2 of the mean residual */
+    uint64_t count = n - best_order;
+    unsigned int k = 0;
+    while (k < IQZ_MAX_RICE_K && (count << (k + 1)) <= sum) {
+        k++;
+    }
+
+    for (unsigned int i = 0; i < best_order; i++) {
+        put_bits(bw, (uint16_t)x[i], 16);
+    }
+    for (unsigned int i = best_order; i < n; i++) {
+        uint32_t q = u[i] >> k;
+        if (q < IQZ_ESCAPE_ONES) {
+            /* q ones followed by a zero */
+            put_bits(bw, (1U << (q + 1)) - 2, q + 1);
+            if (k > 0) {
+                put_bits(bw, u[i] & ((1U << k) - 1), k);
+            }
+        } else {
+            put_bits(bw, (1U << IQZ_ESCAPE_ONES) - 1, IQZ_ESCAPE_ONES);
+            put_bits(bw, u[i], IQZ_ESCAPE_BITS);
+        }
+    }
+
+    *order = best_order;
+    *rice_k = k;
+}
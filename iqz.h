@@ -0,0 +1,61 @@
+/* record to file the I/Q stream(s) from a SDRplay RSP
+ * lossless I/Q compression (IQZ format)
+ *
+ * Copyright 2025 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef _IQZ_H
+#define _IQZ_H
+
+#include "compressor.h"
+#include "output.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define IQZ_MAX_CHANNELS 4
+#define IQZ_ORDER_VERBATIM 0xff     /* block stored uncompressed */
+
+/* typedefs */
+typedef struct {
+    char magic[8];              /* "RSPIQZ01" */
+    uint32_t header_size;
+    uint16_t num_channels;      /* PCM channels (I and Q for each tuner) */
+    uint16_t bits_per_sample;
+    uint32_t block_frames;      /* frames (one sample per channel) in a block */
+    uint32_t unused;
+    double sample_rate;
+    double frequency;
+} IQZFileHeader;
+
+typedef struct {
+    char sync[4];               /* "IQZB" */
+    uint32_t payload_size;      /* bytes following this header */
+    uint32_t num_frames;
+    uint8_t order[IQZ_MAX_CHANNELS];    /* predictor order for each channel */
+    uint8_t rice_k[IQZ_MAX_CHANNELS];   /* Rice parameter for each channel */
+} IQZBlockHeader;
+
+typedef struct {
+    uint64_t offset;            /* file offset of the block header */
+    uint64_t first_frame;
+} IQZIndexEntry;
+
+typedef struct {
+    uint64_t index_offset;      /* file offset of the first index entry */
+    uint64_t num_blocks;
+    uint64_t num_frames;
+    char magic[8];              /* "RSPIQZIX" */
+} IQZTrailer;
+
+/* public functions */
+int iqz_write_header(OutputFile *output, unsigned int block_frames);
+size_t iqz_max_block_size(unsigned int num_frames, int num_channels);
+size_t iqz_encode_block(const short *samples, unsigned int num_frames, int num_channels, uint8_t *out, int32_t *x, uint32_t *u, bool *is_verbatim);
+int iqz_decode_block(const uint8_t *block, size_t block_size, int num_channels, short *samples, unsigned int max_frames);
+int iqz_write_index(OutputFile *output, const CompressedBlockInfo *blocks, size_t num_blocks, uint64_t index_offset, uint64_t num_frames);
+
+#endif /* _IQZ_H */
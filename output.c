@@ -6,16 +6,36 @@
  * SPDX-License-Identifier: GPL-3.0-or-later
  */
 
+#ifdef __linux__
+#define _GNU_SOURCE     /* F_SETPIPE_SZ, vmsplice() */
+#endif /* __linux__ */
+
+#include "channelizer.h"
+#include "compressor.h"
 #include "config.h"
+#include "ddc.h"
+#include "diversity.h"
+#include "envelope.h"
+#include "index.h"
 #include "output.h"
+#include "overload-map.h"
+#include "power-detector.h"
 #include "rsp-recorder.h"
+#include "sample-format.h"
 #include "sdrplay-rsp.h"
+#include "shm-output.h"
+#include "sigmf.h"
+#include "spectrum.h"
+#include "tcp-server.h"
+#include "tee.h"
+#include "trigger.h"
 #include "wav.h"
 
 #include <ctype.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <limits.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -26,6 +46,11 @@
 // _setmode
 #include <io.h>
 #endif /* WIN32 */
+#ifdef __linux__
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#endif /* __linux__ */
 
 #ifndef O_BINARY
 #define O_BINARY 0
@@ -33,91 +58,125 @@
 
 
 /* global variables */
-int outputfd = -1;
+OutputFile output_files[2];
+int num_output_files = 0;
 int gainsfd = -1;
-short *outsamples = NULL;
 
-static bool is_output_open = false;
-static bool is_outsamples_buffer_allocated = false;
 static bool is_gains_open = false;
 
+/* the checkpoints are flushed to disk by a separate thread, so that the
+ * writer never waits for the disk
+ */
+static pthread_t sync_thread;
+static bool is_sync_thread_running = false;
+static bool is_sync_stopping = false;
+static pthread_mutex_t sync_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t sync_requested = PTHREAD_COND_INITIALIZER;
+
 /* internal functions */
-static int generate_output_filename(char *output_filename, int output_filename_max_size);
+static int output_file_open(OutputFile *output, int tuner, const char *output_filename);
+static int generate_output_filename(char *output_filename, int output_filename_max_size, int tuner, time_t t);
+static int expand_filename_template(char *output_filename, int output_filename_max_size, int tuner, time_t t, double frequency, double sample_rate, SampleFormat format);
+static int insert_tuner_suffix(char *output_filename, int output_filename_max_size, int tuner);
+static int insert_filename_suffix(char *output_filename, int output_filename_max_size, const char *suffix);
 static int generate_gains_filename(const char *output_filename, char *gains_filename, int gains_filename_max_size);
-static int write_linrad_header();
+static int write_linrad_header(OutputFile *output);
+static void update_write_stats(Stats *stats, const struct timespec *before_write_ts, const struct timespec *after_write_ts, ssize_t nwritten, size_t count);
+static void *checkpoint_sync_loop(void *arg);
+static void pipe_output_open(OutputFile *output);
+static void pipe_output_close(OutputFile *output);
+#ifdef __linux__
+static int pipe_output_write(OutputFile *output, const uint8_t *buf, size_t count);
+static int pipe_output_vmsplice(OutputFile *output, const uint8_t *buf, size_t count);
+#endif /* __linux__ */
 
 
 int output_open() {
     int errcode;
 
+    time_t t = time(NULL);
     char output_filename[PATH_MAX];
-    errcode = generate_output_filename(output_filename, PATH_MAX);
+    errcode = generate_output_filename(output_filename, PATH_MAX, -1, t);
     if (errcode != 0) {
         fprintf(stderr, "generate_output_filename(%s) failed\n", outfile_template);
         return -1;
     }
 
-    if (strcmp(output_filename, "-") == 0) {
-        if (!(output_type == OUTPUT_TYPE_WAVVIEWDX_RAW || output_type == OUTPUT_TYPE_LINRAD)) {
-            fprintf(stderr, "stdout is only supported for WavViewDX-raw and Linrad formats\n");
+    if (is_dual_tuner && split_tuner_files) {
+        /* one file per tuner, each with its own metadata */
+        if (strcmp(output_filename, "-") == 0 || output_filename[0] == '|') {
+            fprintf(stderr, "stdout and named pipes are not supported with one file per tuner\n");
             return -1;
         }
-        outputfd = fileno(stdout);
-#ifdef WIN32
-        _setmode(outputfd, _O_BINARY);
-#endif
-    } else if (output_filename[0] == '|') {
-        if (!(output_type == OUTPUT_TYPE_WAVVIEWDX_RAW || output_type == OUTPUT_TYPE_LINRAD)) {
-            fprintf(stderr, "named pipe is only supported for WavViewDX-raw and Linrad formats\n");
-            return -1;
+        for (int tuner = 0; tuner < 2; tuner++) {
+            char tuner_filename[PATH_MAX];
+            errcode = generate_output_filename(tuner_filename, PATH_MAX, tuner, t);
+            if (errcode == 0) {
+                errcode = insert_tuner_suffix(tuner_filename, PATH_MAX, tuner);
+            }
+            if (errcode != 0) {
+                fprintf(stderr, "generate_output_filename(%s) for tuner %c failed\n", outfile_template, 'A' + tuner);
+                return -1;
+            }
+            if (output_file_open(&output_files[tuner], tuner, tuner_filename) == -1) {
+                return -1;
+            }
+            num_output_files++;
         }
-        int startidx = 1;
-        int endidx = strlen(output_filename);
-        while (startidx < endidx && isspace(output_filename[startidx]))
-            startidx++;
-        char * output_pipename = output_filename + startidx;
-        if (strlen(output_pipename) == 0) {
-            fprintf(stderr, "empty named pipe name\n");
+    } else {
+        if (output_file_open(&output_files[0], -1, output_filename) == -1) {
             return -1;
         }
-        outputfd = open(output_pipename, O_WRONLY | O_BINARY);
-    } else {
-        outputfd = open(output_filename, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, 0644);
+        num_output_files = 1;
     }
-    if (outputfd == -1) {
-        fprintf(stderr, "open(%s) for writing failed: %s\n", output_filename, strerror(errno));
-        return -1;
-    }
-    is_output_open = true;
 
-    if (output_type == OUTPUT_TYPE_LINRAD) {
-        if (write_linrad_header() == -1) {
-            fprintf(stderr, "write() Linrad header failed: %s\n", strerror(errno));
-            return -1;
-        }
-    } else if (output_type == OUTPUT_TYPE_SDRUNO) {
-        if (write_sdruno_header() == -1) {
-            fprintf(stderr, "write() SDRuno header failed: %s\n", strerror(errno));
+    if (output_type == OUTPUT_TYPE_SIGMF) {
+        if (sigmf_open() == -1) {
             return -1;
         }
-    } else if (output_type == OUTPUT_TYPE_SDRCONNECT) {
-        if (write_sdrconnect_header() == -1) {
-            fprintf(stderr, "write() SDRconnect header failed: %s\n", strerror(errno));
-            return -1;
-        }
-    } else if (output_type == OUTPUT_TYPE_EXPERIMENTAL) {
-        if (write_experimental_header() == -1) {
-            fprintf(stderr, "write() experimental format header failed: %s\n", strerror(errno));
+    }
+
+    if (header_checkpoint_sync && (header_checkpoint_interval > 0 || header_checkpoint_size > 0) &&
+        (output_type == OUTPUT_TYPE_SDRUNO || output_type == OUTPUT_TYPE_SDRCONNECT || output_type == OUTPUT_TYPE_EXPERIMENTAL)) {
+        is_sync_stopping = false;
+        errcode = pthread_create(&sync_thread, NULL, checkpoint_sync_loop, NULL);
+        if (errcode != 0) {
+            fprintf(stderr, "pthread_create(checkpoint sync) failed - errcode=%d\n", errcode);
             return -1;
         }
+        is_sync_thread_running = true;
     }
 
-    outsamples = (short *)malloc(samples_buffer_capacity * sizeof(short));   
-    if (outsamples == NULL) {
-        fprintf(stderr, "malloc(outsamples) failed\n");
+    if (tee_open() == -1) {
+        return -1;
+    }
+    if (ddc_open() == -1) {
+        return -1;
+    }
+    if (channelizer_open() == -1) {
+        return -1;
+    }
+    if (shm_output_open() == -1) {
+        return -1;
+    }
+    if (tcp_server_open() == -1) {
+        return -1;
+    }
+    if (trigger_open() == -1) {
+        return -1;
+    }
+    if (power_detector_open() == -1) {
+        return -1;
+    }
+    if (spectrum_open(output_filename) == -1) {
+        return -1;
+    }
+    if (overload_map_open(output_filename) == -1) {
+        return -1;
+    }
+    if (diversity_open(output_filename) == -1) {
         return -1;
     }
-    is_outsamples_buffer_allocated = true; 
 
     if (gains_file_enable) {
         if (strrchr(output_filename, '.') == NULL) {
@@ -141,29 +200,57 @@ int output_open() {
 }
 
 void output_close() {
-    if (is_outsamples_buffer_allocated) {
-        free(outsamples);
-        outsamples = NULL;
-        is_outsamples_buffer_allocated = false;
-    }
-    if (is_output_open) {
-        if (output_type == OUTPUT_TYPE_SDRUNO) {
-            if (finalize_sdruno_file() == -1) {
-                fprintf(stderr, "finalize() SDRuno file failed: %s\n", strerror(errno));
-            }
-        } else if (output_type == OUTPUT_TYPE_SDRCONNECT) {
-            if (finalize_sdrconnect_file() == -1) {
-                fprintf(stderr, "finalize() SDRconnect file failed: %s\n", strerror(errno));
-            }
-        } else if (output_type == OUTPUT_TYPE_EXPERIMENTAL) {
-            if (finalize_experimental_file() == -1) {
-                fprintf(stderr, "finalize() experimental format file failed: %s\n", strerror(errno));
+    if (is_sync_thread_running) {
+        pthread_mutex_lock(&sync_lock);
+        is_sync_stopping = true;
+        pthread_cond_signal(&sync_requested);
+        pthread_mutex_unlock(&sync_lock);
+        pthread_join(sync_thread, NULL);
+        is_sync_thread_running = false;
+    }
+    sigmf_close();
+    for (int i = 0; i < num_output_files; i++) {
+        OutputFile *output = &output_files[i];
+        free(output->outsamples);
+        output->outsamples = NULL;
+        if (output->is_open) {
+            if (output_type == OUTPUT_TYPE_SDRUNO) {
+                if (finalize_sdruno_file(output) == -1) {
+                    fprintf(stderr, "finalize() SDRuno file failed: %s\n", strerror(errno));
+                }
+            } else if (output_type == OUTPUT_TYPE_SDRCONNECT) {
+                if (finalize_sdrconnect_file(output) == -1) {
+                    fprintf(stderr, "finalize() SDRconnect file failed: %s\n", strerror(errno));
+                }
+            } else if (output_type == OUTPUT_TYPE_EXPERIMENTAL) {
+                if (finalize_experimental_file(output) == -1) {
+                    fprintf(stderr, "finalize() experimental format file failed: %s\n", strerror(errno));
+                }
+            } else if (output_type == OUTPUT_TYPE_COMPRESSED || output_type == OUTPUT_TYPE_ZSTD) {
+                if (compressor_close(output) == -1) {
+                    fprintf(stderr, "finalize() compressed file failed\n");
+                }
             }
+            close(output->fd);
+            output->fd = -1;
+            output->is_open = false;
+            pipe_output_close(output);
         }
-        close(outputfd);
-        outputfd = -1;
-        is_output_open = false;
+        sample_format_close(output);
+        index_close(output);
+        envelope_close(output);
     }
+    num_output_files = 0;
+    tee_close();
+    ddc_close();
+    channelizer_close();
+    shm_output_close();
+    tcp_server_close();
+    power_detector_close();
+    trigger_close();
+    spectrum_close();
+    overload_map_close();
+    diversity_close();
     if (is_gains_open) {
         close(gainsfd);
         gainsfd = -1;
@@ -171,6 +258,118 @@ void output_close() {
     }
 }
 
+int output_write(OutputFile *output, const uint8_t *buf, size_t count) {
+#ifdef __linux__
+    if (output->pipe_ring != NULL) {
+        return pipe_output_write(output, buf, count);
+    }
+#endif /* __linux__ */
+    Stats *stats = output->stats;
+    struct timespec before_write_ts;
+    struct timespec after_write_ts;
+    while (count > 0) {
+        clock_gettime(CLOCK_REALTIME, &before_write_ts);
+        ssize_t nwritten = write(output->fd, buf, count);
+        clock_gettime(CLOCK_REALTIME, &after_write_ts);
+        update_write_stats(stats, &before_write_ts, &after_write_ts, nwritten, count);
+        if (nwritten == -1) {
+            fprintf(stderr, "write samples failed: %s\n", strerror(errno));
+            return -1;
+        }
+        buf += nwritten;
+        count -= nwritten;
+    }
+    return 0;
+}
+
+/* returns a region of count bytes (rounded up to whole pages) in the zero
+ * copy ring of a pipe output, so the caller can put the samples there and
+ * have them moved to the pipe by output_write() without any copy; returns
+ * NULL if the output has no zero copy ring
+ */
+uint8_t *output_pipe_buffer(OutputFile *output, size_t count) {
+    if (output->pipe_ring == NULL || count > output->pipe_chunk_max) {
+        return NULL;
+    }
+    size_t page_size = sysconf(_SC_PAGESIZE);
+    size_t size = (count + page_size - 1) / page_size * page_size;
+    if (output->pipe_ring_offset + size > output->pipe_ring_size) {
+#ifdef __linux__
+        /* the ring is only large enough for the pipe size it was made for;
+         * if the reader has enlarged the pipe, the start of the ring could
+         * still be in the pipe (see pipe_output_vmsplice())
+         */
+        int current_pipe_size = fcntl(output->fd, F_GETPIPE_SZ);
+        if (current_pipe_size == -1 || (unsigned long long)current_pipe_size > output->stats->pipe_size) {
+            fprintf(stderr, "pipe size changed to %d bytes - zero copy disabled\n", current_pipe_size);
+            /* the pages still in the pipe are kept by the kernel */
+            munmap(output->pipe_ring, output->pipe_ring_size);
+            output->pipe_ring = NULL;
+            return NULL;
+        }
+#endif /* __linux__ */
+        output->pipe_ring_offset = 0;
+    }
+    uint8_t *buf = output->pipe_ring + output->pipe_ring_offset;
+    output->pipe_ring_offset += size;
+    return buf;
+}
+
+/* end of streaming: write out the samples still buffered for the output
+ * sample format or for the compressor
+ */
+int output_finish(OutputFile *output) {
+    if (output->compressor != NULL) {
+        return compressor_finish(output);
+    }
+    return sample_format_finish(output);
+}
+
+/* periodically rewrite the sizes in the WAV header, so that a recording
+ * interrupted by a crash or a power loss is still a valid file
+ */
+int output_checkpoint(OutputFile *output) {
+    if (!output->is_open) {
+        return 0;
+    }
+    if (!(output_type == OUTPUT_TYPE_SDRUNO || output_type == OUTPUT_TYPE_SDRCONNECT || output_type == OUTPUT_TYPE_EXPERIMENTAL)) {
+        return 0;
+    }
+    if (header_checkpoint_interval <= 0 && header_checkpoint_size <= 0) {
+        return 0;
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    bool is_checkpoint_due = false;
+    if (header_checkpoint_interval > 0 && now.tv_sec - output->checkpoint_ts.tv_sec >= header_checkpoint_interval) {
+        is_checkpoint_due = true;
+    }
+    if (header_checkpoint_size > 0 && output->stats->data_size - output->checkpoint_data_size >= header_checkpoint_size * 1048576ULL) {
+        is_checkpoint_due = true;
+    }
+    if (!is_checkpoint_due) {
+        return 0;
+    }
+
+    /* on failure, try again at the next interval */
+    output->checkpoint_ts = now;
+    output->checkpoint_data_size = output->stats->data_size;
+    if (checkpoint_wav_file(output) == -1) {
+        fprintf(stderr, "checkpoint() WAV header failed: %s\n", strerror(errno));
+        return -1;
+    }
+    output->stats->header_checkpoints++;
+
+    if (is_sync_thread_running) {
+        pthread_mutex_lock(&sync_lock);
+        output->is_sync_pending = true;
+        pthread_cond_signal(&sync_requested);
+        pthread_mutex_unlock(&sync_lock);
+    }
+    return 0;
+}
+
 int output_validate_filename() {
     const char wavviewdx_raw_placeholder[] = "{WAVVIEWDX-RAW}";
     int wavviewdx_raw_placeholder_len = sizeof(wavviewdx_raw_placeholder) - 1;
@@ -238,7 +437,207 @@ int output_validate_filename() {
     return 0;
 }
 
-static int generate_output_filename(char *output_filename, int output_filename_max_size) {
+/* the filename of a triggered recording is generated from the output
+ * filename template at the time of the trigger, followed by the exact
+ * timestamp and the sample number of the trigger
+ */
+int output_trigger_filename(char *filename, int filename_max_size, const struct timespec *ts, unsigned long long sample_num) {
+    if (generate_output_filename(filename, filename_max_size, -1, ts->tv_sec) != 0) {
+        return -1;
+    }
+    struct tm *tm = gmtime(&ts->tv_sec);
+    char datetime[32];
+    strftime(datetime, sizeof(datetime), "%Y%m%dT%H%M%S", tm);
+    char suffix[80];
+    snprintf(suffix, sizeof(suffix), "_trigger_%s.%06ldZ_%llu", datetime, ts->tv_nsec / 1000, sample_num);
+    return insert_filename_suffix(filename, filename_max_size, suffix);
+}
+
+/* the filename of a DDC or channelizer channel is generated from the
+ * output filename template with the center frequency and the sample rate
+ * of the channel; if the template has no frequency macros (or the name
+ * would be the same as the full band output file), the frequency is added
+ * at the end of the filename
+ */
+int output_channel_filename(char *filename, int filename_max_size, int tuner, double frequency, double sample_rate) {
+    time_t t = time(NULL);
+    if (expand_filename_template(filename, filename_max_size, tuner, t, frequency, sample_rate, SAMPLE_FORMAT_S16) != 0) {
+        return -1;
+    }
+    char other_filename[PATH_MAX];
+    if (expand_filename_template(other_filename, PATH_MAX, tuner, t, frequency + 1000.0, sample_rate, SAMPLE_FORMAT_S16) != 0) {
+        return -1;
+    }
+    bool add_frequency = strcmp(filename, other_filename) == 0;
+    for (int i = 0; i < num_output_files; i++) {
+        if (strcmp(filename, output_files[i].filename) == 0) {
+            add_frequency = true;
+        }
+    }
+    if (!add_frequency) {
+        return 0;
+    }
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), "_%.0lfHz", frequency);
+    return insert_filename_suffix(filename, filename_max_size, suffix);
+}
+
+/* the filename of the multichannel channelizer file of a tuner is
+ * generated from the output filename template with the center frequency
+ * of the tuner and the sample rate of the channels, followed by
+ * '_channelizer' (and the tuner in dual tuner mode)
+ */
+int output_channelizer_filename(char *filename, int filename_max_size, int tuner, double sample_rate) {
+    time_t t = time(NULL);
+    double frequency = tuner == 1 ? frequency_B : frequency_A;
+    if (expand_filename_template(filename, filename_max_size, tuner, t, frequency, sample_rate, SAMPLE_FORMAT_S16) != 0) {
+        return -1;
+    }
+    if (insert_filename_suffix(filename, filename_max_size, "_channelizer") != 0) {
+        return -1;
+    }
+    if (is_dual_tuner) {
+        return insert_tuner_suffix(filename, filename_max_size, tuner);
+    }
+    return 0;
+}
+
+static int output_file_open(OutputFile *output, int tuner, const char *output_filename) {
+    *output = (OutputFile) {
+        .fd = -1,
+        .tuner = tuner,
+        .num_channels = tuner == -1 && is_dual_tuner && diversity_combining == DIVERSITY_COMBINING_NONE ? 4 : 2,
+        .frequency = tuner == 1 ? frequency_B : frequency_A,
+        .wav_type = WAV_TYPE_UNKNOWN,
+        .stats = tuner == 1 ? &stats_B : &stats,
+        .outsamples = NULL,
+        .is_open = false,
+        .filename = "",
+        .checkpoint_ts = {0, 0},
+        .checkpoint_data_size = 0,
+        .is_sync_pending = false,
+        .index_fd = -1,
+        .compressor = NULL,
+        .envelope = NULL,
+        .converted = NULL,
+        .converted_capacity = 0,
+        .converted_size = 0,
+        .pending = NULL,
+        .pending_values = 0,
+        .pipe_ring = NULL,
+        .pipe_ring_size = 0,
+        .pipe_ring_offset = 0,
+        .pipe_chunk_max = 0,
+    };
+    clock_gettime(CLOCK_MONOTONIC, &output->checkpoint_ts);
+    snprintf(output->filename, sizeof(output->filename), "%s", output_filename);
+
+    /* in trigger mode the samples go to the triggered recordings instead,
+     * and with 'ddc only' just to the DDC and channelizer channels
+     */
+    if (trigger_mode || ddc_only) {
+        if (strcmp(output_filename, "-") == 0 || output_filename[0] == '|') {
+            fprintf(stderr, "stdout and named pipes are not supported in %s\n", trigger_mode ? "trigger mode" : "DDC only mode");
+            return -1;
+        }
+        return 0;
+    }
+
+    if (strcmp(output_filename, "-") == 0) {
+        if (!(output_type == OUTPUT_TYPE_WAVVIEWDX_RAW || output_type == OUTPUT_TYPE_LINRAD || output_type == OUTPUT_TYPE_COMPRESSED || output_type == OUTPUT_TYPE_ZSTD)) {
+            fprintf(stderr, "stdout is only supported for WavViewDX-raw, Linrad, compressed, and zstd formats\n");
+            return -1;
+        }
+        output->fd = fileno(stdout);
+#ifdef WIN32
+        _setmode(output->fd, _O_BINARY);
+#endif
+    } else if (output_filename[0] == '|') {
+        if (!(output_type == OUTPUT_TYPE_WAVVIEWDX_RAW || output_type == OUTPUT_TYPE_LINRAD || output_type == OUTPUT_TYPE_COMPRESSED || output_type == OUTPUT_TYPE_ZSTD)) {
+            fprintf(stderr, "named pipe is only supported for WavViewDX-raw, Linrad, compressed, and zstd formats\n");
+            return -1;
+        }
+        int startidx = 1;
+        int endidx = strlen(output_filename);
+        while (startidx < endidx && isspace(output_filename[startidx]))
+            startidx++;
+        const char * output_pipename = output_filename + startidx;
+        if (strlen(output_pipename) == 0) {
+            fprintf(stderr, "empty named pipe name\n");
+            return -1;
+        }
+        output->fd = open(output_pipename, O_WRONLY | O_BINARY);
+    } else {
+        output->fd = open(output_filename, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, 0644);
+    }
+    if (output->fd == -1) {
+        fprintf(stderr, "open(%s) for writing failed: %s\n", output_filename, strerror(errno));
+        return -1;
+    }
+    output->is_open = true;
+    if (strcmp(output_filename, "-") == 0 || output_filename[0] == '|') {
+        pipe_output_open(output);
+    }
+
+    if (output_type == OUTPUT_TYPE_LINRAD) {
+        if (write_linrad_header(output) == -1) {
+            fprintf(stderr, "write() Linrad header failed: %s\n", strerror(errno));
+            return -1;
+        }
+    } else if (output_type == OUTPUT_TYPE_SDRUNO) {
+        if (write_sdruno_header(output) == -1) {
+            fprintf(stderr, "write() SDRuno header failed: %s\n", strerror(errno));
+            return -1;
+        }
+    } else if (output_type == OUTPUT_TYPE_SDRCONNECT) {
+        if (write_sdrconnect_header(output) == -1) {
+            fprintf(stderr, "write() SDRconnect header failed: %s\n", strerror(errno));
+            return -1;
+        }
+    } else if (output_type == OUTPUT_TYPE_EXPERIMENTAL) {
+        if (write_experimental_header(output) == -1) {
+            fprintf(stderr, "write() experimental format header failed: %s\n", strerror(errno));
+            return -1;
+        }
+    } else if (output_type == OUTPUT_TYPE_COMPRESSED || output_type == OUTPUT_TYPE_ZSTD) {
+        if (compressor_open(output) == -1) {
+            return -1;
+        }
+    }
+
+    if (sample_format_open(output) == -1) {
+        return -1;
+    }
+
+    if (index_file_enable) {
+        if (index_open(output) == -1) {
+            return -1;
+        }
+    }
+    if (envelope_file_enable) {
+        if (envelope_open(output) == -1) {
+            return -1;
+        }
+    }
+
+    output->outsamples = (short *)malloc(samples_buffer_capacity * sizeof(short));
+    if (output->outsamples == NULL) {
+        fprintf(stderr, "malloc(outsamples) failed\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+static int generate_output_filename(char *output_filename, int output_filename_max_size, int tuner, time_t t) {
+    double frequency = tuner == 1 ? frequency_B : frequency_A;
+    return expand_filename_template(output_filename, output_filename_max_size, tuner, t, frequency, output_sample_rate, sample_format);
+}
+
+/* the macros are expanded with the given frequency (unless it is a dual
+ * tuner file), sample rate, and sample format
+ */
+static int expand_filename_template(char *output_filename, int output_filename_max_size, int tuner, time_t t, double frequency, double sample_rate, SampleFormat format) {
     const char wavviewdx_raw_placeholder[] = "{WAVVIEWDX-RAW}";
     int wavviewdx_raw_placeholder_len = sizeof(wavviewdx_raw_placeholder) - 1;
     const char sdruno_placeholder[] = "{SDRUNO}";
@@ -258,8 +657,8 @@ static int generate_output_filename(char *output_filename, int output_filename_m
     const char localtime_placeholder[] = "{LOCALTIME}";
     int localtime_placeholder_len = sizeof(localtime_placeholder) - 1;
 
-    time_t t = time(NULL);
     struct tm *tm = gmtime(&t);
+    bool single_frequency = !is_dual_tuner || tuner != -1 || frequency_A == frequency_B;
 
     const char *src = outfile_template;
     char *dst = output_filename;
@@ -281,7 +680,7 @@ static int generate_output_filename(char *output_filename, int output_filename_m
                 struct tm *localtm = localtime(&t);
                 strftime(tsbuf, sizeof(tsbuf), "%Y%m%d-%H%M%S", localtm);
             }
-            size_t nwvdr = snprintf(dst, sz, "iq_pcm16_ch%d_cf%.0lf_sr%.0lf_dt%s", is_dual_tuner ? 2 :1, frequency_A, output_sample_rate, tsbuf);
+            size_t nwvdr = snprintf(dst, sz, "iq_%s_ch%d_cf%.0lf_sr%.0lf_dt%s", sample_format_name(format), is_dual_tuner && tuner == -1 && diversity_combining == DIVERSITY_COMBINING_NONE ? 2 : 1, frequency, sample_rate, tsbuf);
             if (nwvdr >= sz)
                 return -1;
             src += wavviewdx_raw_placeholder_len;
@@ -290,7 +689,7 @@ static int generate_output_filename(char *output_filename, int output_filename_m
             sz = dstlast - dst;
             char tsbuf[16];
             strftime(tsbuf, sizeof(tsbuf), "%Y%m%d_%H%M%S", tm);
-            size_t nsu = snprintf(dst, sz, "SDRuno_%sZ_%.0lfkHz", tsbuf, frequency_A / 1e3);
+            size_t nsu = snprintf(dst, sz, "SDRuno_%sZ_%.0lfkHz", tsbuf, frequency / 1e3);
             if (nsu >= sz)
                 return -1;
             src += sdruno_placeholder_len;
@@ -300,7 +699,7 @@ static int generate_output_filename(char *output_filename, int output_filename_m
             struct tm *localtm = localtime(&t);
             char tsbuf[16];
             strftime(tsbuf, sizeof(tsbuf), "%Y%m%d_%H%M%S", localtm);
-            size_t nsc = snprintf(dst, sz, "SDRconnect_IQ_%s_%.0lfHZ", tsbuf, frequency_A);
+            size_t nsc = snprintf(dst, sz, "SDRconnect_IQ_%s_%.0lfHZ", tsbuf, frequency);
             if (nsc >= sz)
                 return -1;
             src += sdrconnect_placeholder_len;
@@ -308,8 +707,8 @@ static int generate_output_filename(char *output_filename, int output_filename_m
         } else if (strncmp(src, freq_placeholder, freq_placeholder_len) == 0) {
             sz = dstlast - dst;
             size_t nf;
-            if (!is_dual_tuner || frequency_A == frequency_B) {
-                nf = snprintf(dst, sz, "%.0lf", frequency_A);
+            if (single_frequency) {
+                nf = snprintf(dst, sz, "%.0lf", frequency);
             } else {
                 nf = snprintf(dst, sz, "%.0lf-%.0lf", frequency_A, frequency_B);
             }
@@ -320,8 +719,8 @@ static int generate_output_filename(char *output_filename, int output_filename_m
         } else if (strncmp(src, freqhz_placeholder, freqhz_placeholder_len) == 0) {
             sz = dstlast - dst;
             size_t nf;
-            if (!is_dual_tuner || frequency_A == frequency_B) {
-                nf = snprintf(dst, sz, "%.0lfHz", frequency_A);
+            if (single_frequency) {
+                nf = snprintf(dst, sz, "%.0lfHz", frequency);
             } else {
                 nf = snprintf(dst, sz, "%.0lfHz-%.0lfHz", frequency_A, frequency_B);
             }
@@ -332,8 +731,8 @@ static int generate_output_filename(char *output_filename, int output_filename_m
         } else if (strncmp(src, freqkhz_placeholder, freqkhz_placeholder_len) == 0) {
             sz = dstlast - dst;
             size_t nf;
-            if (!is_dual_tuner || frequency_A == frequency_B) {
-                nf = snprintf(dst, sz, "%.0lfkHz", frequency_A / 1e3);
+            if (single_frequency) {
+                nf = snprintf(dst, sz, "%.0lfkHz", frequency / 1e3);
             } else {
                 nf = snprintf(dst, sz, "%.0lfkHz-%.0lfkHz", frequency_A / 1e3, frequency_B / 1e3);
             }
@@ -380,6 +779,31 @@ static int generate_output_filename(char *output_filename, int output_filename_m
     return 0;
 }
 
+/* insert '_A' or '_B' right before the filename extension */
+static int insert_tuner_suffix(char *output_filename, int output_filename_max_size, int tuner) {
+    char suffix[] = "_A";
+    suffix[1] = 'A' + tuner;
+    return insert_filename_suffix(output_filename, output_filename_max_size, suffix);
+}
+
+/* the suffix goes before the extension */
+static int insert_filename_suffix(char *output_filename, int output_filename_max_size, const char *suffix) {
+    size_t suffix_len = strlen(suffix);
+    size_t len = strlen(output_filename);
+    if (len + suffix_len + 1 > (size_t)output_filename_max_size)
+        return -1;
+    char *p = strrchr(output_filename, '.');
+    char *sep = strrchr(output_filename, '/');
+    char *sep2 = strrchr(output_filename, '\\');
+    if (sep2 > sep)
+        sep = sep2;
+    if (p == NULL || (sep != NULL && p < sep))
+        p = output_filename + len;
+    memmove(p + suffix_len, p, strlen(p) + 1);
+    memcpy(p, suffix, suffix_len);
+    return 0;
+}
+
 static int generate_gains_filename(const char *output_filename, char *gains_filename, int gains_filename_max_size) {
     const char gains_extension[] = ".gains";
     char *p = strrchr(output_filename, '.');
@@ -409,8 +833,8 @@ typedef struct __attribute__((packed)) {
     unsigned char save_init_flag;
 } LinradHeader;
 
-static int write_linrad_header() {
-    if (is_dual_tuner && frequency_A != frequency_B) {
+static int write_linrad_header(OutputFile *output) {
+    if (output->num_channels > 2 && frequency_A != frequency_B) {
         fprintf(stderr, "warning: Linrad header does not support different passband center frequencies for the two tuners\n");
     }
     struct timespec ts;
@@ -420,7 +844,7 @@ static int write_linrad_header() {
     int rx_input_mode = LINRAD_IQ_DATA | LINRAD_DIGITAL_IQ;
     int rx_rf_channels = 1;
     int rx_ad_channels = 2;
-    if (is_dual_tuner) {
+    if (output->num_channels > 2) {
         rx_input_mode |= LINRAD_TWO_CHANNELS;
         rx_rf_channels = 2;
         rx_ad_channels = 4;
@@ -428,7 +852,7 @@ static int write_linrad_header() {
     LinradHeader linrad_header = {
         .remember_proprietary_chunk = LINRAD_REMEMBER_UNKNOWN,
         .timestamp = timestamp,
-        .passband_center = frequency_A / 1e6,
+        .passband_center = output->frequency / 1e6,
         .passband_direction = 1,
         .rx_input_mode = rx_input_mode,
         .rx_rf_channels = rx_rf_channels,
@@ -436,10 +860,203 @@ static int write_linrad_header() {
         .rx_ad_speed = output_sample_rate,
         .save_init_flag = 0
     };
-    if (write(outputfd, &linrad_header, sizeof(linrad_header)) == -1) {
+    if (write(output->fd, &linrad_header, sizeof(linrad_header)) == -1) {
         fprintf(stderr, "write linrad header failed: %s\n", strerror(errno));
         return -1;
     }
 
     return 0;
 }
+
+static void update_write_stats(Stats *stats, const struct timespec *before_write_ts, const struct timespec *after_write_ts, ssize_t nwritten, size_t count) {
+    stats->total_writes++;
+    unsigned long long write_elapsed = (after_write_ts->tv_sec - before_write_ts->tv_sec) * 1000000000ULL + after_write_ts->tv_nsec - before_write_ts->tv_nsec;
+    stats->total_write_elapsed += write_elapsed;
+    if (write_elapsed > stats->max_write_elapsed) {
+        stats->max_write_elapsed = write_elapsed;
+    }
+    if (nwritten == -1) {
+        return;
+    }
+    if (nwritten == (ssize_t)count) {
+        stats->full_writes++;
+    } else if (nwritten == 0) {
+        stats->zero_writes++;
+    } else if (nwritten < (ssize_t)count) {
+        stats->partial_writes++;
+    }
+    stats->data_size += nwritten;
+}
+
+/* flush the files with a pending checkpoint (samples and header) to disk */
+static void *checkpoint_sync_loop(void *arg) {
+    (void)arg;
+    pthread_mutex_lock(&sync_lock);
+    while (true) {
+        OutputFile *output = NULL;
+        for (int i = 0; i < num_output_files; i++) {
+            if (output_files[i].is_sync_pending) {
+                output = &output_files[i];
+                break;
+            }
+        }
+        if (output == NULL) {
+            if (is_sync_stopping) {
+                break;
+            }
+            pthread_cond_wait(&sync_requested, &sync_lock);
+            continue;
+        }
+        output->is_sync_pending = false;
+        pthread_mutex_unlock(&sync_lock);
+#ifndef WIN32
+        if (fdatasync(output->fd) == -1) {
+#else
+        if (_commit(output->fd) == -1) {
+#endif /* WIN32 */
+            fprintf(stderr, "checkpoint sync of %s failed: %s\n", output->filename, strerror(errno));
+        }
+        pthread_mutex_lock(&sync_lock);
+    }
+    pthread_mutex_unlock(&sync_lock);
+    return NULL;
+}
+
+/* stdout and named pipes: a larger pipe buffer means fewer (and fuller)
+ * writes; with zero copy the samples are moved to the pipe with vmsplice()
+ * from a ring of pages, instead of being copied by write().
+ * The ring is larger than the pipe buffer by two regions, so when a region
+ * is reused the pipe reader has already consumed it. SPLICE_F_GIFT is not
+ * used, because the pages of the ring are reused.
+ */
+static void pipe_output_open(OutputFile *output) {
+#ifdef __linux__
+    struct stat st;
+    if (fstat(output->fd, &st) == -1 || !S_ISFIFO(st.st_mode)) {
+        return;
+    }
+    if (pipe_size > 0) {
+        if (fcntl(output->fd, F_SETPIPE_SZ, pipe_size) == -1) {
+            /* for unprivileged users the limit is /proc/sys/fs/pipe-max-size */
+            fprintf(stderr, "fcntl(F_SETPIPE_SZ, %d) failed: %s - using the current pipe size\n", pipe_size, strerror(errno));
+        }
+    }
+    int current_pipe_size = fcntl(output->fd, F_GETPIPE_SZ);
+    if (current_pipe_size == -1) {
+        return;
+    }
+    output->stats->pipe_size = current_pipe_size;
+    if (!pipe_zero_copy) {
+        return;
+    }
+    size_t page_size = sysconf(_SC_PAGESIZE);
+    size_t chunk_max = (samples_buffer_capacity * sizeof(short) + page_size - 1) / page_size * page_size;
+    size_t ring_size = (current_pipe_size + page_size - 1) / page_size * page_size + 2 * chunk_max;
+    void *ring = mmap(NULL, ring_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring == MAP_FAILED) {
+        fprintf(stderr, "mmap(pipe ring) failed: %s - zero copy disabled\n", strerror(errno));
+        return;
+    }
+    output->pipe_ring = (uint8_t *)ring;
+    output->pipe_ring_size = ring_size;
+    output->pipe_ring_offset = 0;
+    output->pipe_chunk_max = chunk_max;
+    if (verbose) {
+        fprintf(stderr, "pipe size = %d bytes - zero copy enabled\n", current_pipe_size);
+    }
+#else
+    (void)output;
+#endif /* __linux__ */
+}
+
+static void pipe_output_close(OutputFile *output) {
+#ifdef __linux__
+    /* the pages still in the pipe are kept by the kernel */
+    if (output->pipe_ring != NULL) {
+        munmap(output->pipe_ring, output->pipe_ring_size);
+        output->pipe_ring = NULL;
+    }
+#else
+    (void)output;
+#endif /* __linux__ */
+}
+
+#ifdef __linux__
+static int pipe_output_write(OutputFile *output, const uint8_t *buf, size_t count) {
+    while (count > 0) {
+        const uint8_t *data = buf;
+        size_t n = count;
+        if (!(buf >= output->pipe_ring && buf + count <= output->pipe_ring + output->pipe_ring_size)) {
+            /* headers, converted or compressed samples: copy them to the ring */
+            n = count < output->pipe_chunk_max ? count : output->pipe_chunk_max;
+            uint8_t *region = output_pipe_buffer(output, n);
+            if (region == NULL) {
+                /* zero copy disabled */
+                return output_write(output, buf, count);
+            }
+            memcpy(region, buf, n);
+            data = region;
+        }
+        int ret = pipe_output_vmsplice(output, data, n);
+        if (ret == -1) {
+            return -1;
+        }
+        if (ret == 1) {
+            /* vmsplice() not available - back to write() (the data could
+             * be in the ring, so it is unmapped afterwards)
+             */
+            uint8_t *pipe_ring = output->pipe_ring;
+            output->pipe_ring = NULL;
+            int status = output_write(output, buf, count);
+            munmap(pipe_ring, output->pipe_ring_size);
+            return status;
+        }
+        buf += n;
+        count -= n;
+    }
+    return 0;
+}
+
+/* without SPLICE_F_GIFT the pages are not handed over to the pipe: the
+ * pipe keeps references to the pages of the ring, and the reader sees
+ * whatever they contain when it reads them. The ring is sized so that a
+ * region is reused only after the pipe buffer has been drained; this
+ * holds only as long as the pages stay in this pipe. If the reader
+ * enlarges the pipe (F_SETPIPE_SZ) the writer can get ahead of it (this
+ * is checked whenever the ring wraps around), and if the reader moves
+ * the pages onward with splice() or tee() they stay referenced after it
+ * has read them; in both cases the writer overwrites samples that the
+ * reader has not used yet, and the data is silently corrupted. Such
+ * readers should be used with 'pipe zero copy = false'.
+ * Returns 1 if vmsplice() is not supported for this output
+ */
+static int pipe_output_vmsplice(OutputFile *output, const uint8_t *buf, size_t count) {
+    Stats *stats = output->stats;
+    struct timespec before_write_ts;
+    struct timespec after_write_ts;
+    while (count > 0) {
+        struct iovec iov = {
+            .iov_base = (void *)buf,
+            .iov_len = count,
+        };
+        clock_gettime(CLOCK_REALTIME, &before_write_ts);
+        ssize_t nwritten = vmsplice(output->fd, &iov, 1, 0);
+        clock_gettime(CLOCK_REALTIME, &after_write_ts);
+        if (nwritten == -1 && (errno == EINVAL || errno == ENOSYS) && stats->zero_copy_writes == 0) {
+            if (verbose) {
+                fprintf(stderr, "vmsplice() failed: %s - zero copy disabled\n", strerror(errno));
+            }
+            return 1;
+        }
+        update_write_stats(stats, &before_write_ts, &after_write_ts, nwritten, count);
+        if (nwritten == -1) {
+            fprintf(stderr, "vmsplice samples failed: %s\n", strerror(errno));
+            return -1;
+        }
+        stats->zero_copy_writes++;
+        buf += nwritten;
+        count -= nwritten;
+    }
+    return 0;
+}
+#endif /* __linux__ */
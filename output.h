@@ -9,14 +9,74 @@
 #ifndef _OUTPUT_H
 #define _OUTPUT_H
 
+#include "stats.h"
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+/* typedefs */
+typedef enum {
+    WAV_TYPE_UNKNOWN,
+    WAV_TYPE_RIFF,      /* 32 bit */
+    WAV_TYPE_RF64,      /* 62 bit */
+} WavType;
+
+typedef struct {
+    int fd;
+    int tuner;              /* 0: tuner A, 1: tuner B, -1: all tuners interleaved */
+    int num_channels;       /* number of PCM channels (I and Q for each tuner) */
+    double frequency;       /* center frequency stored in the metadata */
+    double sample_rate;     /* sample rate in the metadata (0: output sample rate) */
+    WavType wav_type;
+    Stats *stats;
+    short *outsamples;
+    bool is_open;
+    char filename[PATH_MAX];
+    struct timespec checkpoint_ts;              /* last WAV header checkpoint */
+    unsigned long long checkpoint_data_size;
+    bool is_sync_pending;                       /* checkpoint waiting to be flushed to disk */
+    int index_fd;                               /* recording index (-1 if disabled) */
+    unsigned long long index_data_offset;
+    unsigned long long index_interval_samples;
+    unsigned long long index_next_sample;
+    unsigned long long index_skipped_samples;
+    unsigned char index_flags;
+    unsigned long long index_resync_events;
+    unsigned int index_gain_changes[2];         /* tuner state of the latest block written */
+    unsigned int index_overloads[2];
+    uint8_t index_gRdB[2];
+    uint8_t index_lnaGRdB[2];
+    struct Compressor *compressor;              /* compressed output types only */
+    struct Envelope *envelope;                  /* envelope file (NULL if disabled) */
+    uint8_t *converted;                         /* samples in the output sample format */
+    size_t converted_capacity;
+    size_t converted_size;
+    short *pending;                             /* samples waiting for a full block */
+    size_t pending_values;
+    uint8_t *pipe_ring;                         /* zero copy pipe output (NULL if disabled) */
+    size_t pipe_ring_size;
+    size_t pipe_ring_offset;
+    size_t pipe_chunk_max;                      /* largest region in the ring */
+} OutputFile;
+
 /* global variables */
-extern int outputfd;
+extern OutputFile output_files[2];
+extern int num_output_files;
 extern int gainsfd;
-extern short *outsamples;
 
 /* public functions */
 int output_open();
 void output_close();
+int output_write(OutputFile *output, const uint8_t *buf, size_t count);
+uint8_t *output_pipe_buffer(OutputFile *output, size_t count);
+int output_finish(OutputFile *output);
+int output_checkpoint(OutputFile *output);
 int output_validate_filename();
+int output_trigger_filename(char *filename, int filename_max_size, const struct timespec *ts, unsigned long long sample_num);
+int output_channel_filename(char *filename, int filename_max_size, int tuner, double frequency, double sample_rate);
+int output_channelizer_filename(char *filename, int filename_max_size, int tuner, double sample_rate);
 
 #endif /* _OUTPUT_H */
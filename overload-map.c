@@ -0,0 +1,210 @@
+/* record to file the I/Q stream(s) from a SDRplay RSP
+ * per second overload map
+ *
+ * Copyright 2025 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "buffers.h"
+#include "callbacks.h"
+#include "config.h"
+#include "decimator.h"
+#include "overload-map.h"
+#include "sample-scale.h"
+#include "sdrplay-rsp.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+/* the RX callbacks count the I and Q values at full scale and near full
+ * scale in each block; the writers add up the counts of the blocks they
+ * receive into one row per tuner for each second of samples, together with
+ * the peak value, the power overload events, and the gain reduction at the
+ * end of the second. The seconds are counted in samples received from the
+ * RSP (before any software decimation), which is also how the power
+ * overload events are timed. The rows follow the sample numbers of the
+ * blocks, so a gap in the stream closes the current row, and the next
+ * row starts after the gap.
+ */
+
+/* typedefs */
+typedef struct {
+    unsigned long long first_sample;    /* first sample of the row */
+    unsigned int next_sample_num;       /* expected sample number of the next block */
+    bool has_next_sample_num;
+    unsigned long long samples;
+    unsigned long long clipped_values;
+    unsigned long long near_full_scale_values;
+    unsigned short peak;
+    unsigned long long overload_detected;   /* event counters at the start of the row */
+    unsigned long long overload_corrected;
+} OverloadMapRow;
+
+static FILE *map_fp = NULL;
+static pthread_mutex_t map_lock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned long long samples_per_row = 0;
+static double map_sample_rate = 0.0;
+static OverloadMapRow rows[2];
+
+/* internal functions */
+static void write_row(int tuner);
+static int generate_overload_map_filename(const char *output_filename, char *filename, int filename_max_size);
+
+
+int overload_map_open(const char *output_filename) {
+    if (!overload_map_enable) {
+        return 0;
+    }
+    if (strcmp(output_filename, "-") == 0 || output_filename[0] == '|') {
+        fprintf(stderr, "overload map not supported when writing to stdout or named pipes\n");
+        return -1;
+    }
+    char map_filename[PATH_MAX];
+    if (generate_overload_map_filename(output_filename, map_filename, PATH_MAX) != 0) {
+        fprintf(stderr, "generate_overload_map_filename(%s) failed\n", output_filename);
+        return -1;
+    }
+    map_fp = fopen(map_filename, "w");
+    if (map_fp == NULL) {
+        fprintf(stderr, "fopen(%s) failed: %s\n", map_filename, strerror(errno));
+        return -1;
+    }
+    fprintf(map_fp, "timestamp,tuner,sample,samples,clipped,near_full_scale,peak_dbfs,overload_detected,overload_corrected,gRdB,lnaGRdB\n");
+    fflush(map_fp);
+
+    /* with software decimation the blocks are at the RSP sample rate */
+    map_sample_rate = decimator_input_sample_rate > 0.0 ? decimator_input_sample_rate : output_sample_rate;
+    samples_per_row = (unsigned long long)(map_sample_rate + 0.5);
+    for (int tuner = 0; tuner < 2; tuner++) {
+        rows[tuner] = (OverloadMapRow) {
+            .first_sample = 0,
+            .next_sample_num = 0,
+            .has_next_sample_num = false,
+            .samples = 0,
+            .clipped_values = 0,
+            .near_full_scale_values = 0,
+            .peak = 0,
+            .overload_detected = num_power_overload_detected[tuner],
+            .overload_corrected = num_power_overload_corrected[tuner],
+        };
+    }
+
+    if (verbose) {
+        fprintf(stderr, "overload map: values at or above %.1lf dBFS counted as near full scale - map in %s\n", overload_threshold, map_filename);
+    }
+    return 0;
+}
+
+/* called by the writer for each block received from the tuner */
+void overload_map_add(int tuner, const BlockDescriptor *block) {
+    if (map_fp == NULL) {
+        return;
+    }
+    OverloadMapRow *row = &rows[tuner];
+    if (row->has_next_sample_num) {
+        /* the sample numbers from the RSP are 32 bit and wrap around */
+        int gap = (int)(block->first_sample_num - row->next_sample_num);
+        if (gap > 0) {
+            if (row->samples > 0) {
+                write_row(tuner);
+            }
+            row->first_sample += gap;
+        }
+    }
+    unsigned int nsntmp = (block->first_sample_num + block->num_samples) * internal_decimation;
+    row->next_sample_num = (nsntmp + (nsntmp % 4 < 2)) / internal_decimation;
+    row->has_next_sample_num = true;
+    row->samples += block->num_samples;
+    row->clipped_values += block->clipped_values;
+    row->near_full_scale_values += block->near_full_scale_values;
+    row->peak = row->peak > block->peak ? row->peak : block->peak;
+    if (row->samples >= samples_per_row) {
+        write_row(tuner);
+    }
+}
+
+/* the last (partial) second of each tuner */
+void overload_map_finish() {
+    if (map_fp == NULL) {
+        return;
+    }
+    int num_tuners = is_dual_tuner ? 2 : 1;
+    for (int tuner = 0; tuner < num_tuners; tuner++) {
+        if (rows[tuner].samples > 0) {
+            write_row(tuner);
+        }
+    }
+}
+
+void overload_map_close() {
+    if (map_fp != NULL) {
+        fclose(map_fp);
+        map_fp = NULL;
+    }
+}
+
+/* internal functions */
+static void write_row(int tuner) {
+    OverloadMapRow *row = &rows[tuner];
+    unsigned long long overload_detected = num_power_overload_detected[tuner];
+    unsigned long long overload_corrected = num_power_overload_corrected[tuner];
+
+    long long start_ns = timeinfo.start_ts.tv_sec * 1000000000LL + timeinfo.start_ts.tv_nsec;
+    long long row_ns = start_ns + (long long)((double)row->first_sample / map_sample_rate * 1e9 + 0.5);
+    time_t row_sec = row_ns / 1000000000LL;
+    double peak_dbfs = row->peak > 0 ? 20.0 * log10((double)row->peak / FULL_SCALE_14BIT) : -INFINITY;
+
+    /* in one file per tuner mode the two writers share the map */
+    pthread_mutex_lock(&map_lock);
+    struct tm tm;
+#ifdef WIN32
+    gmtime_s(&tm, &row_sec);
+#else
+    gmtime_r(&row_sec, &tm);
+#endif /* WIN32 */
+    char datetime[32];
+    strftime(datetime, sizeof(datetime), "%Y-%m-%dT%H:%M:%S", &tm);
+    fprintf(map_fp, "%s.%03lldZ,%c,%llu,%llu,%llu,%llu,%.1lf,%llu,%llu,%d,%d\n",
+        datetime, (row_ns % 1000000000LL) / 1000000, 'A' + tuner,
+        row->first_sample, row->samples, row->clipped_values, row->near_full_scale_values, peak_dbfs,
+        overload_detected - row->overload_detected, overload_corrected - row->overload_corrected,
+        current_gRdB[tuner], current_lnaGRdB[tuner]);
+    fflush(map_fp);
+    pthread_mutex_unlock(&map_lock);
+
+    *row = (OverloadMapRow) {
+        .first_sample = row->first_sample + row->samples,
+        .next_sample_num = row->next_sample_num,
+        .has_next_sample_num = row->has_next_sample_num,
+        .samples = 0,
+        .clipped_values = 0,
+        .near_full_scale_values = 0,
+        .peak = 0,
+        .overload_detected = overload_detected,
+        .overload_corrected = overload_corrected,
+    };
+}
+
+static int generate_overload_map_filename(const char *output_filename, char *filename, int filename_max_size) {
+    const char extension[] = ".overload.csv";
+    const char *p = strrchr(output_filename, '.');
+    const char *sep = strrchr(output_filename, '/');
+    const char *sep2 = strrchr(output_filename, '\\');
+    if (sep2 > sep)
+        sep = sep2;
+    if (p == NULL || (sep != NULL && p < sep))
+        p = output_filename + strlen(output_filename);
+    size_t sz = (size_t)(p - output_filename);
+    if (sz + sizeof(extension) > (size_t)filename_max_size)
+        return -1;
+    memcpy(filename, output_filename, sz);
+    memcpy(filename + sz, extension, sizeof(extension));
+    return 0;
+}
@@ -0,0 +1,20 @@
+/* record to file the I/Q stream(s) from a SDRplay RSP
+ * per second overload map
+ *
+ * Copyright 2025 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef _OVERLOAD_MAP_H
+#define _OVERLOAD_MAP_H
+
+#include "buffers.h"
+
+/* public functions */
+int overload_map_open(const char *output_filename);
+void overload_map_add(int tuner, const BlockDescriptor *block);
+void overload_map_finish();
+void overload_map_close();
+
+#endif /* _OVERLOAD_MAP_H */
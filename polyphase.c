@@ -0,0 +1,183 @@
+/* record to file the I/Q stream(s) from a SDRplay RSP
+ * polyphase filter bank (FFT channelizer)
+ *
+ * Copyright 2025 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "fft.h"
+#include "polyphase.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* analysis filter bank: channel k (k = 0 .. M-1, the channels above M/2
+ * are the negative frequencies) is the input mixed down by k/M cycles per
+ * sample and low pass filtered by the prototype filter, decimated by M or
+ * by M/2 (2x oversampled).
+ * For each output frame the last M*T samples are weighted by the
+ * prototype filter and folded into M sums, which are rotated by the time
+ * index modulo M (so that the phase of each channel stays continuous when
+ * the decimation is M/2) and transformed with an M points FFT.
+ * The history is stored twice, so that the weighting loop runs over
+ * contiguous arrays.
+ */
+#define POLYPHASE_KAISER_BETA 8.0
+
+/* internal functions */
+static void design_prototype(Polyphase *pp);
+static double bessel_i0(double x);
+static void compute_frame(Polyphase *pp, float *out_re, float *out_im);
+
+
+int polyphase_init(Polyphase *pp, unsigned int num_channels, unsigned int oversampling, unsigned int taps_per_channel) {
+    *pp = (Polyphase) {
+        .num_channels = num_channels,
+        .taps_per_channel = taps_per_channel,
+        .num_taps = num_channels * taps_per_channel,
+        .taps = NULL,
+        .history_re = NULL,
+        .history_im = NULL,
+        .history_index = 0,
+        .input_count = 0,
+        .time_index = 0,
+        .fft = { .size = 0 },
+        .acc_re = NULL,
+        .acc_im = NULL,
+    };
+    if (!(oversampling == 1 || (oversampling == 2 && num_channels % 2 == 0)) || taps_per_channel < 1) {
+        fprintf(stderr, "invalid polyphase filter bank: channels=%u oversampling=%u taps per channel=%u\n", num_channels, oversampling, taps_per_channel);
+        return -1;
+    }
+    pp->decimation = num_channels / oversampling;
+    if (fft_init(&pp->fft, num_channels) == -1) {
+        return -1;
+    }
+    pp->taps = (float *)malloc(pp->num_taps * sizeof(float));
+    pp->history_re = (float *)calloc(2 * pp->num_taps, sizeof(float));
+    pp->history_im = (float *)calloc(2 * pp->num_taps, sizeof(float));
+    pp->acc_re = (float *)malloc(num_channels * sizeof(float));
+    pp->acc_im = (float *)malloc(num_channels * sizeof(float));
+    if (pp->taps == NULL || pp->history_re == NULL || pp->history_im == NULL || pp->acc_re == NULL || pp->acc_im == NULL) {
+        fprintf(stderr, "malloc(polyphase filter bank) failed\n");
+        polyphase_free(pp);
+        return -1;
+    }
+    design_prototype(pp);
+    return 0;
+}
+
+/* processes the samples (I/Q pairs 'stride' shorts apart; NULL for zeros)
+ * and writes M values per output frame to out_re and out_im, which must
+ * have room for num_samples / decimation + 1 frames; returns the number of
+ * frames
+ */
+size_t polyphase_process(Polyphase *pp, const short *samples, size_t stride, size_t num_samples, float *out_re, float *out_im) {
+    unsigned int num_taps = pp->num_taps;
+    size_t num_frames = 0;
+    for (size_t i = 0; i < num_samples; i++) {
+        unsigned int index = pp->history_index;
+        float vr = 0.0f;
+        float vi = 0.0f;
+        if (samples != NULL) {
+            vr = samples[i * stride];
+            vi = samples[i * stride + 1];
+        }
+        pp->history_re[index] = pp->history_re[index + num_taps] = vr;
+        pp->history_im[index] = pp->history_im[index + num_taps] = vi;
+        pp->history_index = index + 1 == num_taps ? 0 : index + 1;
+        pp->time_index = pp->time_index + 1 == pp->num_channels ? 0 : pp->time_index + 1;
+        if (++pp->input_count == pp->decimation) {
+            pp->input_count = 0;
+            compute_frame(pp, out_re + num_frames * pp->num_channels, out_im + num_frames * pp->num_channels);
+            num_frames++;
+        }
+    }
+    return num_frames;
+}
+
+void polyphase_free(Polyphase *pp) {
+    fft_free(&pp->fft);
+    free(pp->taps);
+    free(pp->history_re);
+    free(pp->history_im);
+    free(pp->acc_re);
+    free(pp->acc_im);
+    pp->taps = NULL;
+    pp->history_re = NULL;
+    pp->history_im = NULL;
+    pp->acc_re = NULL;
+    pp->acc_im = NULL;
+}
+
+/* internal functions */
+
+/* windowed sinc with the cutoff at half the channel spacing (Kaiser
+ * window), normalized for unity gain at the center of the channel
+ */
+static void design_prototype(Polyphase *pp) {
+    unsigned int num_taps = pp->num_taps;
+    double cutoff = 0.5 / pp->num_channels;
+    double center = (num_taps - 1) / 2.0;
+    double i0_beta = bessel_i0(POLYPHASE_KAISER_BETA);
+    double sum = 0.0;
+    for (unsigned int n = 0; n < num_taps; n++) {
+        double x = n - center;
+        double h = x == 0.0 ? 2.0 * cutoff : sin(2.0 * M_PI * cutoff * x) / (M_PI * x);
+        double r = num_taps > 1 ? 2.0 * n / (num_taps - 1) - 1.0 : 0.0;
+        double window = bessel_i0(POLYPHASE_KAISER_BETA * sqrt(fmax(0.0, 1.0 - r * r))) / i0_beta;
+        /* symmetric, so the time reversal is not needed */
+        pp->taps[n] = (float)(h * window);
+        sum += h * window;
+    }
+    for (unsigned int n = 0; n < num_taps; n++) {
+        pp->taps[n] = (float)(pp->taps[n] / sum);
+    }
+}
+
+static double bessel_i0(double x) {
+    double sum = 1.0;
+    double term = 1.0;
+    for (int k = 1; k < 50; k++) {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+        if (term < 1e-12 * sum) {
+            break;
+        }
+    }
+    return sum;
+}
+
+static void compute_frame(Polyphase *pp, float *out_re, float *out_im) {
+    unsigned int M = pp->num_channels;
+    float *restrict acc_re = pp->acc_re;
+    float *restrict acc_im = pp->acc_im;
+    for (unsigned int u = 0; u < M; u++) {
+        acc_re[u] = 0.0f;
+        acc_im[u] = 0.0f;
+    }
+    /* the window starts with the oldest sample */
+    const float *history_re = pp->history_re + pp->history_index;
+    const float *history_im = pp->history_im + pp->history_index;
+    for (unsigned int r = 0; r < pp->taps_per_channel; r++) {
+        const float *restrict taps = pp->taps + r * M;
+        const float *restrict hr = history_re + r * M;
+        const float *restrict hi = history_im + r * M;
+        for (unsigned int u = 0; u < M; u++) {
+            acc_re[u] += taps[u] * hr[u];
+            acc_im[u] += taps[u] * hi[u];
+        }
+    }
+    /* the sum for the newest sample goes to position time_index - 1, the
+     * one before it to time_index - 2, and so on
+     */
+    unsigned int rotation = pp->time_index;
+    for (unsigned int u = 0; u < M; u++) {
+        unsigned int position = u + rotation < M ? u + rotation : u + rotation - M;
+        out_re[position] = acc_re[u];
+        out_im[position] = acc_im[u];
+    }
+    fft_forward(&pp->fft, out_re, out_im);
+}
@@ -0,0 +1,38 @@
+/* record to file the I/Q stream(s) from a SDRplay RSP
+ * polyphase filter bank (FFT channelizer)
+ *
+ * Copyright 2025 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef _POLYPHASE_H
+#define _POLYPHASE_H
+
+#include "fft.h"
+
+#include <stddef.h>
+
+/* typedefs */
+typedef struct {
+    unsigned int num_channels;      /* M: FFT size */
+    unsigned int decimation;        /* M (critically sampled) or M/2 */
+    unsigned int taps_per_channel;
+    unsigned int num_taps;          /* M * taps_per_channel */
+    float *taps;                    /* prototype filter, oldest sample first */
+    float *history_re;              /* last num_taps samples, stored twice */
+    float *history_im;
+    unsigned int history_index;
+    unsigned int input_count;       /* samples since the last frame */
+    unsigned int time_index;        /* sample number modulo M */
+    FFT fft;
+    float *acc_re;
+    float *acc_im;
+} Polyphase;
+
+/* public functions */
+int polyphase_init(Polyphase *pp, unsigned int num_channels, unsigned int oversampling, unsigned int taps_per_channel);
+size_t polyphase_process(Polyphase *pp, const short *samples, size_t stride, size_t num_samples, float *out_re, float *out_im);
+void polyphase_free(Polyphase *pp);
+
+#endif /* _POLYPHASE_H */
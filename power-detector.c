@@ -0,0 +1,291 @@
+/* record to file the I/Q stream(s) from a SDRplay RSP
+ * power (squelch) detector for triggered recordings
+ *
+ * Copyright 2025 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "config.h"
+#include "fft.h"
+#include "power-detector.h"
+#include "sample-format.h"
+#include "sdrplay-rsp.h"
+#include "trigger.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* the writer measures the mean power of tuner A over blocks of
+ * 'power detector block size' samples, either over the whole band
+ * (|I|^2+|Q|^2) or, when 'power detector band' is set, over the FFT bins
+ * of that sub-band. The baseline is an exponential moving average of the
+ * block power with a time constant of 'power detector baseline time'
+ * seconds, and it is frozen while the detector is active.
+ * The detector starts (and fires a trigger) when the level goes above the
+ * baseline by 'power detector threshold' dB, and it stops when the level
+ * falls below that by 'power detector hysteresis' dB; while it is active
+ * the triggered recording is extended.
+ * Blocks with gaps filled with zeros are ignored.
+ */
+#define POWER_DETECTOR_WARMUP_TIME 1.0      /* seconds */
+#define POWER_DETECTOR_MIN_LEVEL -200.0     /* dBFS */
+
+/* global variables */
+PowerDetectorStats power_detector_stats = {
+    .blocks = 0,
+    .starts = 0,
+    .stops = 0,
+    .baseline = POWER_DETECTOR_MIN_LEVEL,
+    .max_level = POWER_DETECTOR_MIN_LEVEL,
+};
+
+static bool is_open = false;
+static bool is_active = false;
+static unsigned long long sample_num = 0;
+static unsigned long long warmup_samples = 0;
+static unsigned int block_samples = 0;
+static unsigned int block_fill = 0;
+static bool block_has_gap = false;
+static uint64_t block_power_sum = 0;
+static double baseline_power = 0.0;
+static bool has_baseline = false;
+static double alpha = 0.0;
+
+/* sub-band */
+static FFT fft = {
+    .size = 0,
+};
+static float *window = NULL;
+static float *frame_re = NULL;
+static float *frame_im = NULL;
+static unsigned int frame_fill = 0;
+static unsigned int *band_bins = NULL;
+static unsigned int num_band_bins = 0;
+static double band_scale = 0.0;
+static double block_band_sum = 0.0;
+
+/* internal functions */
+static uint64_t sum_power(const short *xi, const short *xq, size_t num_samples);
+static void add_frames(const short *xi, const short *xq, size_t num_samples);
+static void block_decision(unsigned long long block_start, double power);
+static double power_to_dBFS(double power);
+
+
+int power_detector_open() {
+    if (!power_detector_enable) {
+        return 0;
+    }
+    block_samples = power_detector_block_size;
+    block_fill = 0;
+    block_has_gap = false;
+    block_power_sum = 0;
+    block_band_sum = 0.0;
+    sample_num = 0;
+    is_active = false;
+    has_baseline = false;
+    warmup_samples = (unsigned long long)(fmin(POWER_DETECTOR_WARMUP_TIME, power_detector_baseline_time) * output_sample_rate + 0.5);
+    alpha = block_samples / (power_detector_baseline_time * output_sample_rate);
+    if (alpha > 1.0) {
+        alpha = 1.0;
+    }
+
+    if (power_detector_band_low != power_detector_band_high) {
+        if (power_detector_band_low < -output_sample_rate / 2 || power_detector_band_high > output_sample_rate / 2) {
+            fprintf(stderr, "power detector band %.0lf,%.0lf is outside the output bandwidth (+/-%.0lf Hz)\n", power_detector_band_low, power_detector_band_high, output_sample_rate / 2);
+            return -1;
+        }
+        unsigned int size = power_detector_fft_size;
+        if (fft_init(&fft, size) == -1) {
+            return -1;
+        }
+        window = (float *)malloc(size * sizeof(float));
+        frame_re = (float *)malloc(size * sizeof(float));
+        frame_im = (float *)malloc(size * sizeof(float));
+        band_bins = (unsigned int *)malloc(size * sizeof(unsigned int));
+        if (window == NULL || frame_re == NULL || frame_im == NULL || band_bins == NULL) {
+            fprintf(stderr, "malloc(power detector) failed\n");
+            power_detector_close();
+            return -1;
+        }
+        fft_hann_window(window, size);
+        double window_power = 0.0;
+        for (unsigned int i = 0; i < size; i++) {
+            window_power += window[i] * window[i];
+        }
+        /* power in the band relative to full scale (Parseval) */
+        band_scale = 1.0 / (size * window_power * FULL_SCALE_14BIT * FULL_SCALE_14BIT);
+        long first_bin = (long)ceil(power_detector_band_low * size / output_sample_rate);
+        long last_bin = (long)floor(power_detector_band_high * size / output_sample_rate);
+        if (last_bin < first_bin) {
+            /* narrower than one bin */
+            first_bin = (long)floor((power_detector_band_low + power_detector_band_high) / 2 * size / output_sample_rate + 0.5);
+            last_bin = first_bin;
+        }
+        num_band_bins = 0;
+        for (long k = first_bin; k <= last_bin && num_band_bins < size; k++) {
+            band_bins[num_band_bins++] = (unsigned int)((k % (long)size + size) % size);
+        }
+        frame_fill = 0;
+    }
+
+    is_open = true;
+    if (verbose) {
+        if (fft.size > 0) {
+            fprintf(stderr, "power detector: threshold=%.1lfdB hysteresis=%.1lfdB block=%u samples band=%.0lf,%.0lfHz (%u FFT bins of %u)\n", power_detector_threshold, power_detector_hysteresis, block_samples, power_detector_band_low, power_detector_band_high, num_band_bins, fft.size);
+        } else {
+            fprintf(stderr, "power detector: threshold=%.1lfdB hysteresis=%.1lfdB block=%u samples\n", power_detector_threshold, power_detector_hysteresis, block_samples);
+        }
+    }
+    return 0;
+}
+
+/* called by the writer for each segment, after trigger_write(); a NULL
+ * tuner is a gap filled with zeros
+ */
+void power_detector_write(const short *const *xi, const short *const *xq, size_t num_samples) {
+    if (!is_open) {
+        return;
+    }
+    const short *txi = xi[0];
+    const short *txq = xq[0];
+    for (size_t offset = 0; offset < num_samples; ) {
+        size_t n = num_samples - offset;
+        if (n > block_samples - block_fill) {
+            n = block_samples - block_fill;
+        }
+        if (txi == NULL) {
+            block_has_gap = true;
+            if (fft.size > 0) {
+                add_frames(NULL, NULL, n);
+            }
+        } else if (fft.size > 0) {
+            add_frames(txi + offset, txq + offset, n);
+        } else {
+            block_power_sum += sum_power(txi + offset, txq + offset, n);
+        }
+        block_fill += n;
+        offset += n;
+        sample_num += n;
+        if (block_fill == block_samples) {
+            double power;
+            if (fft.size > 0) {
+                power = block_band_sum / (block_samples / fft.size);
+            } else {
+                power = (double)block_power_sum / (block_samples * (double)FULL_SCALE_14BIT * FULL_SCALE_14BIT);
+            }
+            if (!block_has_gap) {
+                block_decision(sample_num - block_samples, power);
+            } else if (is_active) {
+                trigger_extend(sample_num);
+            }
+            block_fill = 0;
+            block_has_gap = false;
+            block_power_sum = 0;
+            block_band_sum = 0.0;
+        }
+    }
+}
+
+void power_detector_close() {
+    if (is_open && is_active) {
+        trigger_log_event(sample_num, "detector stop", "end of recording");
+    }
+    is_open = false;
+    is_active = false;
+    fft_free(&fft);
+    free(window);
+    free(frame_re);
+    free(frame_im);
+    free(band_bins);
+    window = NULL;
+    frame_re = NULL;
+    frame_im = NULL;
+    band_bins = NULL;
+    num_band_bins = 0;
+}
+
+/* internal functions */
+
+static uint64_t sum_power(const short *xi, const short *xq, size_t num_samples) {
+    uint64_t sum = 0;
+    for (size_t i = 0; i < num_samples; i++) {
+        int32_t vi = xi[i];
+        int32_t vq = xq[i];
+        sum += (uint32_t)(vi * vi) + (uint32_t)(vq * vq);
+    }
+    return sum;
+}
+
+static void add_frames(const short *xi, const short *xq, size_t num_samples) {
+    unsigned int size = fft.size;
+    for (size_t offset = 0; offset < num_samples; ) {
+        size_t n = num_samples - offset;
+        if (n > size - frame_fill) {
+            n = size - frame_fill;
+        }
+        if (xi != NULL) {
+            for (size_t i = 0; i < n; i++) {
+                frame_re[frame_fill + i] = xi[offset + i] * window[frame_fill + i];
+                frame_im[frame_fill + i] = xq[offset + i] * window[frame_fill + i];
+            }
+        } else {
+            for (size_t i = 0; i < n; i++) {
+                frame_re[frame_fill + i] = 0.0f;
+                frame_im[frame_fill + i] = 0.0f;
+            }
+        }
+        frame_fill += n;
+        offset += n;
+        if (frame_fill == size) {
+            fft_forward(&fft, frame_re, frame_im);
+            double energy = 0.0;
+            for (unsigned int k = 0; k < num_band_bins; k++) {
+                unsigned int bin = band_bins[k];
+                energy += frame_re[bin] * frame_re[bin] + frame_im[bin] * frame_im[bin];
+            }
+            block_band_sum += energy * band_scale;
+            frame_fill = 0;
+        }
+    }
+}
+
+static void block_decision(unsigned long long block_start, double power) {
+    double level = power_to_dBFS(power);
+    power_detector_stats.blocks++;
+    if (level > power_detector_stats.max_level) {
+        power_detector_stats.max_level = level;
+    }
+    if (!has_baseline) {
+        baseline_power = power;
+        has_baseline = true;
+    }
+    double baseline = power_to_dBFS(baseline_power);
+    power_detector_stats.baseline = baseline;
+    char detail[64];
+    if (!is_active) {
+        if (block_start >= warmup_samples && level > baseline + power_detector_threshold) {
+            is_active = true;
+            power_detector_stats.starts++;
+            snprintf(detail, sizeof(detail), "level=%.1lfdBFS baseline=%.1lfdBFS", level, baseline);
+            trigger_log_event(block_start, "detector start", detail);
+            trigger_fire(block_start, "power detector");
+            return;
+        }
+        baseline_power += alpha * (power - baseline_power);
+    } else if (level < baseline + power_detector_threshold - power_detector_hysteresis) {
+        is_active = false;
+        power_detector_stats.stops++;
+        snprintf(detail, sizeof(detail), "level=%.1lfdBFS baseline=%.1lfdBFS", level, baseline);
+        trigger_log_event(block_start, "detector stop", detail);
+    } else {
+        trigger_extend(block_start + block_samples);
+    }
+}
+
+static double power_to_dBFS(double power) {
+    return power > 0.0 ? fmax(10.0 * log10(power), POWER_DETECTOR_MIN_LEVEL) : POWER_DETECTOR_MIN_LEVEL;
+}
@@ -0,0 +1,31 @@
+/* record to file the I/Q stream(s) from a SDRplay RSP
+ * power (squelch) detector for triggered recordings
+ *
+ * Copyright 2025 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef _POWER_DETECTOR_H
+#define _POWER_DETECTOR_H
+
+#include <stddef.h>
+
+/* typedefs */
+typedef struct {
+    unsigned long long blocks;
+    unsigned long long starts;
+    unsigned long long stops;
+    double baseline;                    /* dBFS */
+    double max_level;                   /* dBFS */
+} PowerDetectorStats;
+
+/* global variables */
+extern PowerDetectorStats power_detector_stats;
+
+/* public functions */
+int power_detector_open();
+void power_detector_write(const short *const *xi, const short *const *xq, size_t num_samples);
+void power_detector_close();
+
+#endif /* _POWER_DETECTOR_H */
@@ -8,6 +8,7 @@
 
 #include "buffers.h"
 #include "config.h"
+#include "decimator.h"
 #include "output.h"
 #include "rsp-recorder.h"
 #include "sdrplay-rsp.h"
@@ -33,6 +34,9 @@ int main(int argc, char *argv[])
     if (sdrplay_configure_rsp() == -1) {
         main_exit(EXIT_FAILURE);
     }
+    if (decimator_open() == -1) {
+        main_exit(EXIT_FAILURE);
+    }
     if (buffers_create() == -1) {
         main_exit(EXIT_FAILURE);
     }
@@ -54,7 +58,9 @@ int main(int argc, char *argv[])
 void main_exit(int exit_status)
 {
     sdrplay_rsp_close();
-    buffers_free();
+    /* the output files are finalized using the time markers */
     output_close();
+    buffers_free();
+    decimator_close();
     exit(exit_status);
 }
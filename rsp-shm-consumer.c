@@ -0,0 +1,90 @@
+/* record to file the I/Q stream(s) from a SDRplay RSP
+ * example consumer for the shared memory ring output
+ * (prints the average power of each tuner once per second)
+ *
+ * Copyright 2025 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "rsp-shm.h"
+#include "sample-scale.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static double sample_value(const RspShmHeader *header, const void *samples, size_t index) {
+    switch (header->sample_format) {
+        case RSP_SHM_FORMAT_CF32:
+            return ((const float *)samples)[index];
+        case RSP_SHM_FORMAT_CS8:
+            return ((const int8_t *)samples)[index] / 128.0;
+        default:
+            return ((const int16_t *)samples)[index] / FULL_SCALE_14BIT;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <shared memory name> (for instance /rsp-recorder)\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    RspShmReader reader;
+    if (rsp_shm_reader_open(&reader, argv[1]) == -1) {
+        return EXIT_FAILURE;
+    }
+    const RspShmHeader *header = reader.header;
+    unsigned int num_tuners = header->num_channels / 2;
+    fprintf(stderr, "format=%u channels=%u sample_rate=%.0lf frequency=%.0lf/%.0lf ring=%llu samples\n",
+            header->sample_format, header->num_channels, header->sample_rate,
+            header->frequency[0], header->frequency[1], (unsigned long long)header->ring_samples);
+
+    unsigned long long samples_per_report = header->sample_rate > 0 ? (unsigned long long)header->sample_rate : 1000000;
+    unsigned long long num_samples = 0;
+    unsigned long long total_samples = 0;
+    double power[2] = {0.0, 0.0};
+    for (;;) {
+        long long available = rsp_shm_reader_wait(&reader, 1000);
+        if (available == -1) {
+            break;
+        }
+        if (available == 0) {
+            continue;
+        }
+        /* zero copy: the samples are used straight from the ring */
+        size_t n;
+        const void *samples = rsp_shm_reader_peek(&reader, &n);
+        double block_power[2] = {0.0, 0.0};
+        for (size_t i = 0; i < n; i++) {
+            for (unsigned int tuner = 0; tuner < num_tuners; tuner++) {
+                double vi = sample_value(header, samples, i * header->num_channels + 2 * tuner);
+                double vq = sample_value(header, samples, i * header->num_channels + 2 * tuner + 1);
+                block_power[tuner] += vi * vi + vq * vq;
+            }
+        }
+        if (rsp_shm_reader_release(&reader, n) == -1) {
+            /* overwritten while we were reading it */
+            continue;
+        }
+        for (unsigned int tuner = 0; tuner < num_tuners; tuner++) {
+            power[tuner] += block_power[tuner];
+        }
+        num_samples += n;
+        total_samples += n;
+        if (num_samples >= samples_per_report) {
+            printf("samples=%llu dropped=%llu", total_samples, (unsigned long long)reader.dropped_samples);
+            for (unsigned int tuner = 0; tuner < num_tuners; tuner++) {
+                double average_power = power[tuner] / num_samples;
+                printf(" power%c=%.1lfdBFS", 'A' + tuner, average_power > 0.0 ? 10.0 * log10(average_power) : -999.9);
+                power[tuner] = 0.0;
+            }
+            printf("\n");
+            fflush(stdout);
+            num_samples = 0;
+        }
+    }
+    printf("end of recording - samples=%llu dropped=%llu\n", total_samples, (unsigned long long)reader.dropped_samples);
+    rsp_shm_reader_close(&reader);
+    return EXIT_SUCCESS;
+}
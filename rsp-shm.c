@@ -0,0 +1,205 @@
+/* record to file the I/Q stream(s) from a SDRplay RSP
+ * shared memory ring: reader library
+ *
+ * Copyright 2025 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "rsp-shm.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif /* __linux__ */
+
+/* without futexes the readers poll the write sequence */
+#define RSP_SHM_POLL_INTERVAL_MS 1
+
+/* internal functions */
+static void wait_for_futex(const RspShmHeader *header, uint32_t futex, int timeout_ms);
+
+
+/* attach to the shared memory ring (read only); reading starts from the
+ * samples written after this call
+ */
+int rsp_shm_reader_open(RspShmReader *reader, const char *name) {
+    *reader = (RspShmReader) {
+        .fd = -1,
+        .map = NULL,
+        .map_size = 0,
+        .header = NULL,
+        .ring = NULL,
+        .read_sample = 0,
+        .dropped_samples = 0,
+    };
+    reader->fd = shm_open(name, O_RDONLY, 0);
+    if (reader->fd == -1) {
+        fprintf(stderr, "shm_open(%s) failed: %s\n", name, strerror(errno));
+        return -1;
+    }
+    struct stat st;
+    if (fstat(reader->fd, &st) == -1) {
+        fprintf(stderr, "fstat(%s) failed: %s\n", name, strerror(errno));
+        rsp_shm_reader_close(reader);
+        return -1;
+    }
+    if ((size_t)st.st_size < RSP_SHM_HEADER_SIZE) {
+        fprintf(stderr, "shared memory %s is too small\n", name);
+        rsp_shm_reader_close(reader);
+        return -1;
+    }
+    reader->map_size = st.st_size;
+    reader->map = mmap(NULL, reader->map_size, PROT_READ, MAP_SHARED, reader->fd, 0);
+    if (reader->map == MAP_FAILED) {
+        fprintf(stderr, "mmap(%s) failed: %s\n", name, strerror(errno));
+        reader->map = NULL;
+        rsp_shm_reader_close(reader);
+        return -1;
+    }
+    const RspShmHeader *header = (const RspShmHeader *)reader->map;
+    if (memcmp(header->magic, RSP_SHM_MAGIC, sizeof(header->magic)) != 0 || header->version != RSP_SHM_VERSION) {
+        fprintf(stderr, "shared memory %s is not a RSP ring (or has a different version)\n", name);
+        rsp_shm_reader_close(reader);
+        return -1;
+    }
+    if (header->header_size + header->ring_samples * header->bytes_per_sample > reader->map_size) {
+        fprintf(stderr, "shared memory %s is truncated\n", name);
+        rsp_shm_reader_close(reader);
+        return -1;
+    }
+    reader->header = header;
+    reader->ring = (const uint8_t *)reader->map + header->header_size;
+    reader->read_sample = __atomic_load_n(&header->write_sample, __ATOMIC_ACQUIRE);
+    return 0;
+}
+
+/* wait until there are new samples; returns the number of samples
+ * available (0 on timeout), or -1 when the recording has finished and
+ * all the samples have been read
+ */
+long long rsp_shm_reader_wait(RspShmReader *reader, int timeout_ms) {
+    const RspShmHeader *header = reader->header;
+    struct timespec start_ts;
+    clock_gettime(CLOCK_MONOTONIC, &start_ts);
+    for (;;) {
+        uint32_t futex = __atomic_load_n(&header->futex, __ATOMIC_ACQUIRE);
+        uint64_t write_sample = __atomic_load_n(&header->write_sample, __ATOMIC_ACQUIRE);
+        if (write_sample != reader->read_sample) {
+            return write_sample - reader->read_sample;
+        }
+        if (__atomic_load_n(&header->state, __ATOMIC_ACQUIRE) == RSP_SHM_STATE_FINISHED) {
+            return -1;
+        }
+        struct timespec now_ts;
+        clock_gettime(CLOCK_MONOTONIC, &now_ts);
+        long long elapsed_ms = (now_ts.tv_sec - start_ts.tv_sec) * 1000LL + (now_ts.tv_nsec - start_ts.tv_nsec) / 1000000;
+        if (elapsed_ms >= timeout_ms) {
+            return 0;
+        }
+        wait_for_futex(header, futex, timeout_ms - elapsed_ms);
+    }
+}
+
+/* zero copy access: returns a pointer to the next contiguous samples in
+ * the ring; they must be released with rsp_shm_reader_release(), which
+ * also tells if they were overwritten while they were being used
+ */
+const void *rsp_shm_reader_peek(RspShmReader *reader, size_t *num_samples) {
+    const RspShmHeader *header = reader->header;
+    uint64_t write_sample = __atomic_load_n(&header->write_sample, __ATOMIC_ACQUIRE);
+    if (write_sample - reader->read_sample > header->ring_samples) {
+        /* the reader is too slow - skip to the oldest samples in the ring */
+        uint64_t first_sample = write_sample - header->ring_samples;
+        reader->dropped_samples += first_sample - reader->read_sample;
+        reader->read_sample = first_sample;
+    }
+    uint64_t ring_index = reader->read_sample % header->ring_samples;
+    uint64_t n = write_sample - reader->read_sample;
+    if (n > header->ring_samples - ring_index) {
+        n = header->ring_samples - ring_index;
+    }
+    *num_samples = n;
+    return reader->ring + ring_index * header->bytes_per_sample;
+}
+
+/* returns 0 if the samples were still valid, -1 if the writer overwrote
+ * them (in this case they are counted as dropped)
+ */
+int rsp_shm_reader_release(RspShmReader *reader, size_t num_samples) {
+    const RspShmHeader *header = reader->header;
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    uint64_t reserve_sample = __atomic_load_n(&header->reserve_sample, __ATOMIC_RELAXED);
+    int status = 0;
+    if (reserve_sample > reader->read_sample + header->ring_samples) {
+        reader->dropped_samples += num_samples;
+        status = -1;
+    }
+    reader->read_sample += num_samples;
+    return status;
+}
+
+/* copy up to max_samples samples to the buffer; returns the number of
+ * samples copied
+ */
+size_t rsp_shm_reader_read(RspShmReader *reader, void *buffer, size_t max_samples) {
+    size_t bytes_per_sample = reader->header->bytes_per_sample;
+    size_t total = 0;
+    while (total < max_samples) {
+        size_t n;
+        const void *samples = rsp_shm_reader_peek(reader, &n);
+        if (n == 0) {
+            break;
+        }
+        if (n > max_samples - total) {
+            n = max_samples - total;
+        }
+        memcpy((uint8_t *)buffer + total * bytes_per_sample, samples, n * bytes_per_sample);
+        if (rsp_shm_reader_release(reader, n) == 0) {
+            total += n;
+        }
+    }
+    return total;
+}
+
+void rsp_shm_reader_close(RspShmReader *reader) {
+    if (reader->map != NULL) {
+        munmap(reader->map, reader->map_size);
+        reader->map = NULL;
+    }
+    if (reader->fd != -1) {
+        close(reader->fd);
+        reader->fd = -1;
+    }
+    reader->header = NULL;
+    reader->ring = NULL;
+}
+
+/* internal functions */
+static void wait_for_futex(const RspShmHeader *header, uint32_t futex, int timeout_ms) {
+#ifdef __linux__
+    struct timespec timeout = {
+        .tv_sec = timeout_ms / 1000,
+        .tv_nsec = (timeout_ms % 1000) * 1000000L,
+    };
+    /* shared futex - the ring is mapped by different processes */
+    syscall(SYS_futex, &header->futex, FUTEX_WAIT, futex, &timeout, NULL, 0);
+#else
+    (void)header;
+    (void)futex;
+    int interval_ms = timeout_ms < RSP_SHM_POLL_INTERVAL_MS ? timeout_ms : RSP_SHM_POLL_INTERVAL_MS;
+    struct timespec interval = {
+        .tv_sec = 0,
+        .tv_nsec = interval_ms * 1000000L,
+    };
+    nanosleep(&interval, NULL);
+#endif /* __linux__ */
+}
@@ -0,0 +1,74 @@
+/* record to file the I/Q stream(s) from a SDRplay RSP
+ * shared memory ring: layout and reader library
+ *
+ * Copyright 2025 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef _RSP_SHM_H
+#define _RSP_SHM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* the shared memory object starts with this header (one page), followed
+ * by the ring of 'ring_samples' samples ('bytes_per_sample' bytes each,
+ * I and Q for each tuner interleaved); sample number n is at index
+ * n % ring_samples. The writer first advances 'reserve_sample', then
+ * writes the samples, and finally advances 'write_sample' and increments
+ * 'futex' (waking up the readers waiting on it), so a reader can detect
+ * the samples overwritten while it was reading them.
+ * All the fields are little endian; the sequence fields must be read with
+ * atomic loads.
+ */
+#define RSP_SHM_MAGIC "RSPSHMRG"
+#define RSP_SHM_VERSION 1
+#define RSP_SHM_HEADER_SIZE 4096
+
+#define RSP_SHM_FORMAT_S16  1   /* 16 bit signed integers */
+#define RSP_SHM_FORMAT_CF32 2   /* complex 32 bit floats (1.0 = 14 bit full scale) */
+#define RSP_SHM_FORMAT_CS8  3   /* complex 8 bit signed integers */
+
+#define RSP_SHM_STATE_RUNNING  1
+#define RSP_SHM_STATE_FINISHED 2
+
+/* typedefs */
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    uint32_t sample_format;
+    uint32_t num_channels;          /* 2 x number of tuners */
+    uint32_t bytes_per_sample;      /* all channels */
+    uint32_t unused;
+    uint64_t ring_samples;
+    double sample_rate;
+    double frequency[2];            /* tuner A, tuner B */
+    int64_t start_time_ns;          /* UTC, nanoseconds since the epoch */
+    /* updated while streaming */
+    uint64_t reserve_sample;
+    uint64_t write_sample;
+    uint32_t futex;
+    uint32_t state;
+} RspShmHeader;
+
+typedef struct {
+    int fd;
+    void *map;
+    size_t map_size;
+    const RspShmHeader *header;
+    const uint8_t *ring;
+    uint64_t read_sample;
+    uint64_t dropped_samples;
+} RspShmReader;
+
+/* reader library */
+int rsp_shm_reader_open(RspShmReader *reader, const char *name);
+long long rsp_shm_reader_wait(RspShmReader *reader, int timeout_ms);
+const void *rsp_shm_reader_peek(RspShmReader *reader, size_t *num_samples);
+int rsp_shm_reader_release(RspShmReader *reader, size_t num_samples);
+size_t rsp_shm_reader_read(RspShmReader *reader, void *buffer, size_t max_samples);
+void rsp_shm_reader_close(RspShmReader *reader);
+
+#endif /* _RSP_SHM_H */
@@ -0,0 +1,549 @@
+/* record to file the I/Q stream(s) from a SDRplay RSP
+ * output sample formats
+ *
+ * Copyright 2025 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "config.h"
+#include "output.h"
+#include "sample-format.h"
+#include "sdrplay-rsp.h"
+#include "stats.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* block floating point (bfp8) format:
+ * the stream begins with a BFP8Header with the number of channels and the
+ * block size, so that it can be decoded without any other information;
+ * the samples are grouped in blocks of 'bfp block size' frames (one frame
+ * is I and Q for each tuner); each block is written as one byte with the
+ * block exponent e, followed by one signed 8 bit mantissa m for each value,
+ * so that the original 16 bit value is m * 2^e (up to the quantization).
+ * The last block of a recording may be shorter.
+ */
+#define BFP8_BLOCKS_PER_WRITE 64
+#define BFP8_MANTISSA_MAX 127
+
+/* packed formats (packed12 and packed14):
+ * the samples are stored as 14 bit signed integers (the range of the RSP
+ * samples), or rounded to 12 bits; the values are packed little endian,
+ * least significant bits first, in groups of 2 values in 3 bytes
+ * (packed12) or 4 values in 7 bytes (packed14). Values outside the 14 bit
+ * range are clipped (and the 12 bit values are saturated). The last group of a recording is
+ * padded with zeros.
+ */
+#define PACKED_GROUPS_PER_WRITE 65536
+#define PACKED12_GROUP_VALUES 2
+#define PACKED12_GROUP_BYTES 3
+#define PACKED14_GROUP_VALUES 4
+#define PACKED14_GROUP_BYTES 7
+#define PACKED_BENCHMARK_VALUES 4194304
+
+/* complex formats (cf32 and cs8):
+ * the 16 bit samples are converted while they are interleaved, straight
+ * from the tuner buffers; cf32 values are scaled according to 'sample
+ * scale' (by default 1.0 is the 14 bit full scale), cs8 values are the 8
+ * most significant of the 14 bits, rounded and saturated
+ */
+#define CS8_SHIFT 6
+
+/* internal functions */
+static int bfp8_write(OutputFile *output, const short *samples, size_t num_values);
+static int bfp8_write_header(OutputFile *output);
+static void bfp8_encode_block(OutputFile *output, const short *samples, size_t num_values);
+static int packed_write(OutputFile *output, const short *samples, size_t num_values);
+static void packed_encode_groups(OutputFile *output, const short *samples, size_t num_groups);
+static void packed_benchmark();
+static void complex_scales(const OutputFile *output, unsigned int nrx, float *scales);
+static int complex_write(OutputFile *output, const short *const *xi, const short *const *xq, size_t in_stride, unsigned int nrx, size_t num_samples);
+static int flush_converted(OutputFile *output);
+
+
+const char *sample_format_name(SampleFormat format) {
+    switch (format) {
+        case SAMPLE_FORMAT_S16:
+            return "pcm16";
+        case SAMPLE_FORMAT_BFP8:
+            return "bfp8";
+        case SAMPLE_FORMAT_PACKED12:
+            return "packed12";
+        case SAMPLE_FORMAT_PACKED14:
+            return "packed14";
+        case SAMPLE_FORMAT_CF32:
+            return "cf32";
+        case SAMPLE_FORMAT_CS8:
+            return "cs8";
+        default:
+            return "unknown";
+    }
+}
+
+int sample_format_open(OutputFile *output) {
+    if (sample_format == SAMPLE_FORMAT_BFP8) {
+        size_t block_values = (size_t)bfp_block_size * output->num_channels;
+        output->converted_capacity = BFP8_BLOCKS_PER_WRITE * (1 + block_values);
+        output->pending = (short *)malloc(block_values * sizeof(short));
+        if (output->pending == NULL) {
+            fprintf(stderr, "malloc(pending samples) failed\n");
+            return -1;
+        }
+        if (bfp8_write_header(output) == -1) {
+            return -1;
+        }
+    } else if (sample_format == SAMPLE_FORMAT_PACKED12 || sample_format == SAMPLE_FORMAT_PACKED14) {
+        output->converted_capacity = PACKED_GROUPS_PER_WRITE * PACKED14_GROUP_BYTES;
+        output->pending = (short *)malloc(PACKED14_GROUP_VALUES * sizeof(short));
+        if (output->pending == NULL) {
+            fprintf(stderr, "malloc(pending samples) failed\n");
+            return -1;
+        }
+        if (verbose) {
+            packed_benchmark();
+        }
+    } else if (sample_format == SAMPLE_FORMAT_CF32) {
+        output->converted_capacity = samples_buffer_capacity * sizeof(float);
+    } else if (sample_format == SAMPLE_FORMAT_CS8) {
+        output->converted_capacity = samples_buffer_capacity * sizeof(int8_t);
+    }
+    if (output->converted_capacity > 0) {
+        output->converted = (uint8_t *)malloc(output->converted_capacity);
+        if (output->converted == NULL) {
+            fprintf(stderr, "malloc(converted samples) failed\n");
+            return -1;
+        }
+    }
+    output->converted_size = 0;
+    output->pending_values = 0;
+    return 0;
+}
+
+int sample_format_write(OutputFile *output, const short *samples, size_t num_values) {
+    if (sample_format == SAMPLE_FORMAT_BFP8) {
+        return bfp8_write(output, samples, num_values);
+    } else if (sample_format == SAMPLE_FORMAT_PACKED12 || sample_format == SAMPLE_FORMAT_PACKED14) {
+        return packed_write(output, samples, num_values);
+    } else if (sample_format == SAMPLE_FORMAT_CF32 || sample_format == SAMPLE_FORMAT_CS8) {
+        /* 16 bit samples already interleaved (for instance the zeros that
+         * fill the gaps)
+         */
+        const short *xi[2];
+        const short *xq[2];
+        unsigned int nrx = output->num_channels / 2;
+        for (unsigned int tuner = 0; tuner < nrx; tuner++) {
+            xi[tuner] = samples + 2 * tuner;
+            xq[tuner] = samples + 2 * tuner + 1;
+        }
+        return complex_write(output, xi, xq, output->num_channels, nrx, num_values / output->num_channels);
+    }
+    return output_write(output, (const uint8_t *)samples, num_values * sizeof(short));
+}
+
+/* write out the last (partial) block */
+int sample_format_finish(OutputFile *output) {
+    if (sample_format == SAMPLE_FORMAT_BFP8 && output->pending_values > 0) {
+        bfp8_encode_block(output, output->pending, output->pending_values);
+        output->pending_values = 0;
+    }
+    if ((sample_format == SAMPLE_FORMAT_PACKED12 || sample_format == SAMPLE_FORMAT_PACKED14) && output->pending_values > 0) {
+        size_t group_values = sample_format == SAMPLE_FORMAT_PACKED12 ? PACKED12_GROUP_VALUES : PACKED14_GROUP_VALUES;
+        memset(output->pending + output->pending_values, 0, (group_values - output->pending_values) * sizeof(short));
+        packed_encode_groups(output, output->pending, 1);
+        output->pending_values = 0;
+    }
+    return flush_converted(output);
+}
+
+/* convert the samples from the tuners (NULL means no data - fill with
+ * zeros) to the cf32 or cs8 sample format while interleaving them
+ */
+int sample_format_write_interleaved(OutputFile *output, const short *const *xi, const short *const *xq, unsigned int nrx, size_t num_samples) {
+    return complex_write(output, xi, xq, 1, nrx, num_samples);
+}
+
+/* pack kernels: 'num_values' must be a multiple of the group size;
+ * return the number of values clipped to the 14 bit range
+ */
+size_t pack12(const short *samples, size_t num_values, uint8_t *out) {
+    size_t clipped = 0;
+    for (size_t i = 0; i < num_values; i += PACKED12_GROUP_VALUES, out += PACKED12_GROUP_BYTES) {
+        int32_t a = samples[i];
+        int32_t b = samples[i+1];
+        clipped += (a < SAMPLE_MIN_14BIT || a > SAMPLE_MAX_14BIT) + (b < SAMPLE_MIN_14BIT || b > SAMPLE_MAX_14BIT);
+        a = a < SAMPLE_MIN_14BIT ? SAMPLE_MIN_14BIT : a > SAMPLE_MAX_14BIT ? SAMPLE_MAX_14BIT : a;
+        b = b < SAMPLE_MIN_14BIT ? SAMPLE_MIN_14BIT : b > SAMPLE_MAX_14BIT ? SAMPLE_MAX_14BIT : b;
+        /* round to 12 bits (the values near the top would round up to 2048) */
+        a = (a + 2) >> 2;
+        b = (b + 2) >> 2;
+        a = a > 2047 ? 2047 : a;
+        b = b > 2047 ? 2047 : b;
+        uint32_t w = ((uint32_t)a & 0xfff) | (((uint32_t)b & 0xfff) << 12);
+        out[0] = w;
+        out[1] = w >> 8;
+        out[2] = w >> 16;
+    }
+    return clipped;
+}
+
+size_t pack14(const short *samples, size_t num_values, uint8_t *out) {
+    size_t clipped = 0;
+    for (size_t i = 0; i < num_values; i += PACKED14_GROUP_VALUES, out += PACKED14_GROUP_BYTES) {
+        uint64_t w = 0;
+        for (int j = 0; j < PACKED14_GROUP_VALUES; j++) {
+            int32_t a = samples[i+j];
+            clipped += a < SAMPLE_MIN_14BIT || a > SAMPLE_MAX_14BIT;
+            a = a < SAMPLE_MIN_14BIT ? SAMPLE_MIN_14BIT : a > SAMPLE_MAX_14BIT ? SAMPLE_MAX_14BIT : a;
+            w |= ((uint64_t)a & 0x3fff) << (14 * j);
+        }
+        for (int j = 0; j < PACKED14_GROUP_BYTES; j++) {
+            out[j] = w >> (8 * j);
+        }
+    }
+    return clipped;
+}
+
+/* unpack kernels: the values are returned in the 14 bit range */
+void unpack12(const uint8_t *in, size_t num_values, short *samples) {
+    for (size_t i = 0; i < num_values; i += PACKED12_GROUP_VALUES, in += PACKED12_GROUP_BYTES) {
+        uint32_t w = in[0] | (in[1] << 8) | ((uint32_t)in[2] << 16);
+        /* sign extend and scale back to 14 bits */
+        samples[i] = ((int32_t)(w << 20) >> 20) * 4;
+        samples[i+1] = ((int32_t)(w << 8) >> 20) * 4;
+    }
+}
+
+void unpack14(const uint8_t *in, size_t num_values, short *samples) {
+    for (size_t i = 0; i < num_values; i += PACKED14_GROUP_VALUES, in += PACKED14_GROUP_BYTES) {
+        uint64_t w = 0;
+        for (int j = 0; j < PACKED14_GROUP_BYTES; j++) {
+            w |= (uint64_t)in[j] << (8 * j);
+        }
+        for (int j = 0; j < PACKED14_GROUP_VALUES; j++) {
+            samples[i+j] = (int64_t)(w << (50 - 14 * j)) >> 50;
+        }
+    }
+}
+
+void interleave_cf32(const short *xi, const short *xq, size_t in_stride, size_t num_samples, float scale, float *out, size_t out_stride) {
+    if (xi == NULL) {
+        for (size_t i = 0; i < num_samples; i++, out += out_stride) {
+            out[0] = 0.0f;
+            out[1] = 0.0f;
+        }
+        return;
+    }
+    for (size_t i = 0; i < num_samples; i++, out += out_stride) {
+        out[0] = xi[i * in_stride] * scale;
+        out[1] = xq[i * in_stride] * scale;
+    }
+}
+
+size_t interleave_cs8(const short *xi, const short *xq, size_t in_stride, size_t num_samples, int8_t *out, size_t out_stride) {
+    if (xi == NULL) {
+        for (size_t i = 0; i < num_samples; i++, out += out_stride) {
+            out[0] = 0;
+            out[1] = 0;
+        }
+        return 0;
+    }
+    const int round = 1 << (CS8_SHIFT - 1);
+    size_t clipped = 0;
+    for (size_t i = 0; i < num_samples; i++, out += out_stride) {
+        int vi = (xi[i * in_stride] + round) >> CS8_SHIFT;
+        int vq = (xq[i * in_stride] + round) >> CS8_SHIFT;
+        clipped += (vi < INT8_MIN || vi > INT8_MAX) + (vq < INT8_MIN || vq > INT8_MAX);
+        out[0] = vi < INT8_MIN ? INT8_MIN : vi > INT8_MAX ? INT8_MAX : vi;
+        out[1] = vq < INT8_MIN ? INT8_MIN : vq > INT8_MAX ? INT8_MAX : vq;
+    }
+    return clipped;
+}
+
+void sample_format_close(OutputFile *output) {
+    free(output->converted);
+    output->converted = NULL;
+    output->converted_capacity = 0;
+    free(output->pending);
+    output->pending = NULL;
+}
+
+
+/* internal functions */
+static int bfp8_write_header(OutputFile *output) {
+    BFP8Header bfp8_header = {
+        .magic = {'R', 'S', 'P', 'B', 'F', 'P', '0', '1'},
+        .header_size = sizeof(BFP8Header),
+        .num_channels = (uint16_t)output->num_channels,
+        .block_frames = bfp_block_size,
+        .sample_rate = output_sample_rate
+    };
+    if (output_write(output, (const uint8_t *)&bfp8_header, sizeof(bfp8_header)) == -1) {
+        fprintf(stderr, "write bfp8 header failed\n");
+        return -1;
+    }
+    return 0;
+}
+
+static int bfp8_write(OutputFile *output, const short *samples, size_t num_values) {
+    size_t block_values = (size_t)bfp_block_size * output->num_channels;
+
+    /* complete the block left over from the previous write first */
+    if (output->pending_values > 0) {
+        size_t n = block_values - output->pending_values;
+        if (n > num_values)
+            n = num_values;
+        memcpy(output->pending + output->pending_values, samples, n * sizeof(short));
+        output->pending_values += n;
+        samples += n;
+        num_values -= n;
+        if (output->pending_values < block_values) {
+            return 0;
+        }
+        bfp8_encode_block(output, output->pending, block_values);
+        output->pending_values = 0;
+    }
+
+    while (num_values >= block_values) {
+        if (output->converted_size + 1 + block_values > output->converted_capacity) {
+            if (flush_converted(output) == -1) {
+                return -1;
+            }
+        }
+        bfp8_encode_block(output, samples, block_values);
+        samples += block_values;
+        num_values -= block_values;
+    }
+
+    if (num_values > 0) {
+        memcpy(output->pending, samples, num_values * sizeof(short));
+        output->pending_values = num_values;
+    }
+    return flush_converted(output);
+}
+
+static void bfp8_encode_block(OutputFile *output, const short *samples, size_t num_values) {
+    int maxabs = 0;
+    for (size_t i = 0; i < num_values; i++) {
+        int a = samples[i] >= 0 ? samples[i] : -samples[i];
+        maxabs = a > maxabs ? a : maxabs;
+    }
+    unsigned int exponent = 0;
+    while ((maxabs >> exponent) > BFP8_MANTISSA_MAX) {
+        exponent++;
+    }
+
+    uint8_t *out = output->converted + output->converted_size;
+    int8_t *mantissas = (int8_t *)(out + 1);
+    out[0] = exponent;
+    int round = exponent > 0 ? 1 << (exponent - 1) : 0;
+    for (size_t i = 0; i < num_values; i++) {
+        int m = (samples[i] + round) >> exponent;
+        mantissas[i] = m > BFP8_MANTISSA_MAX ? BFP8_MANTISSA_MAX : m;
+    }
+    output->converted_size += 1 + num_values;
+
+    /* quantization noise and signal power, for the final stats */
+    double error_energy = 0.0;
+    double signal_energy = 0.0;
+    int scale = 1 << exponent;
+    for (size_t i = 0; i < num_values; i++) {
+        int d = samples[i] - mantissas[i] * scale;
+        error_energy += d * d;
+        signal_energy += samples[i] * samples[i];
+    }
+    Stats *stats = output->stats;
+    stats->bfp_blocks++;
+    stats->bfp_values += num_values;
+    stats->bfp_error_energy += error_energy;
+    /* the quietest block (gaps filled with zeros excluded) is used as an
+     * estimate of the noise floor
+     */
+    double power = signal_energy / num_values;
+    if (power > 0.0 && (stats->bfp_noise_floor == 0.0 || power < stats->bfp_noise_floor)) {
+        stats->bfp_noise_floor = power;
+    }
+}
+
+static int packed_write(OutputFile *output, const short *samples, size_t num_values) {
+    size_t group_values = sample_format == SAMPLE_FORMAT_PACKED12 ? PACKED12_GROUP_VALUES : PACKED14_GROUP_VALUES;
+    size_t group_bytes = sample_format == SAMPLE_FORMAT_PACKED12 ? PACKED12_GROUP_BYTES : PACKED14_GROUP_BYTES;
+
+    /* complete the group left over from the previous write first */
+    if (output->pending_values > 0) {
+        size_t n = group_values - output->pending_values;
+        if (n > num_values)
+            n = num_values;
+        memcpy(output->pending + output->pending_values, samples, n * sizeof(short));
+        output->pending_values += n;
+        samples += n;
+        num_values -= n;
+        if (output->pending_values < group_values) {
+            return 0;
+        }
+        packed_encode_groups(output, output->pending, 1);
+        output->pending_values = 0;
+    }
+
+    while (num_values >= group_values) {
+        size_t num_groups = num_values / group_values;
+        size_t room = (output->converted_capacity - output->converted_size) / group_bytes;
+        if (room == 0) {
+            if (flush_converted(output) == -1) {
+                return -1;
+            }
+            continue;
+        }
+        if (num_groups > room)
+            num_groups = room;
+        packed_encode_groups(output, samples, num_groups);
+        samples += num_groups * group_values;
+        num_values -= num_groups * group_values;
+    }
+
+    if (num_values > 0) {
+        memcpy(output->pending, samples, num_values * sizeof(short));
+        output->pending_values = num_values;
+    }
+    return flush_converted(output);
+}
+
+static void packed_encode_groups(OutputFile *output, const short *samples, size_t num_groups) {
+    struct timespec before_pack_ts;
+    struct timespec after_pack_ts;
+    uint8_t *out = output->converted + output->converted_size;
+    size_t num_values;
+    size_t clipped;
+    clock_gettime(CLOCK_MONOTONIC, &before_pack_ts);
+    if (sample_format == SAMPLE_FORMAT_PACKED12) {
+        num_values = num_groups * PACKED12_GROUP_VALUES;
+        clipped = pack12(samples, num_values, out);
+        output->converted_size += num_groups * PACKED12_GROUP_BYTES;
+    } else {
+        num_values = num_groups * PACKED14_GROUP_VALUES;
+        clipped = pack14(samples, num_values, out);
+        output->converted_size += num_groups * PACKED14_GROUP_BYTES;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &after_pack_ts);
+    Stats *stats = output->stats;
+    stats->conversion_input_bytes += num_values * sizeof(short);
+    stats->conversion_elapsed += (after_pack_ts.tv_sec - before_pack_ts.tv_sec) * 1000000000ULL + after_pack_ts.tv_nsec - before_pack_ts.tv_nsec;
+    stats->conversion_clipped_values += clipped;
+}
+
+/* measure the throughput of the pack and unpack kernels (and check that
+ * they round trip) with synthetic samples
+ */
+static void packed_benchmark() {
+    short *samples = (short *)malloc(PACKED_BENCHMARK_VALUES * sizeof(short));
+    short *unpacked = (short *)malloc(PACKED_BENCHMARK_VALUES * sizeof(short));
+    uint8_t *packed = (uint8_t *)malloc(PACKED_BENCHMARK_VALUES / PACKED14_GROUP_VALUES * PACKED14_GROUP_BYTES);
+    if (samples == NULL || unpacked == NULL || packed == NULL) {
+        fprintf(stderr, "malloc(benchmark buffers) failed\n");
+        free(samples);
+        free(unpacked);
+        free(packed);
+        return;
+    }
+    uint32_t seed = 1;
+    for (size_t i = 0; i < PACKED_BENCHMARK_VALUES; i++) {
+        seed = seed * 1664525 + 1013904223;
+        /* 12 bit samples (2 LSBs zero) for packed12, 14 bit samples for packed14 */
+        int32_t v = (int32_t)(seed >> 18) - 8192;
+        samples[i] = sample_format == SAMPLE_FORMAT_PACKED12 ? v & ~3 : v;
+    }
+
+    struct timespec t0, t1, t2;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    if (sample_format == SAMPLE_FORMAT_PACKED12) {
+        pack12(samples, PACKED_BENCHMARK_VALUES, packed);
+    } else {
+        pack14(samples, PACKED_BENCHMARK_VALUES, packed);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    if (sample_format == SAMPLE_FORMAT_PACKED12) {
+        unpack12(packed, PACKED_BENCHMARK_VALUES, unpacked);
+    } else {
+        unpack14(packed, PACKED_BENCHMARK_VALUES, unpacked);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t2);
+
+    double pack_elapsed = (t1.tv_sec - t0.tv_sec) + 1e-9 * (t1.tv_nsec - t0.tv_nsec);
+    double unpack_elapsed = (t2.tv_sec - t1.tv_sec) + 1e-9 * (t2.tv_nsec - t1.tv_nsec);
+    double megabytes = PACKED_BENCHMARK_VALUES * sizeof(short) / 1e6;
+    bool is_round_trip_ok = memcmp(samples, unpacked, PACKED_BENCHMARK_VALUES * sizeof(short)) == 0;
+    fprintf(stderr, "%s kernels: pack %.0lf MB/s, unpack %.0lf MB/s, round trip %s\n", sample_format_name(sample_format), megabytes / pack_elapsed, megabytes / unpack_elapsed, is_round_trip_ok ? "ok" : "FAILED");
+    free(samples);
+    free(unpacked);
+    free(packed);
+}
+
+static int complex_write(OutputFile *output, const short *const *xi, const short *const *xq, size_t in_stride, unsigned int nrx, size_t num_samples) {
+    size_t values_per_sample = 2 * nrx;
+    size_t value_size = sample_format == SAMPLE_FORMAT_CF32 ? sizeof(float) : sizeof(int8_t);
+    size_t max_samples = output->converted_capacity / (values_per_sample * value_size);
+    float scales[2];
+    complex_scales(output, nrx, scales);
+    Stats *stats = output->stats;
+
+    for (size_t offset = 0; offset < num_samples; ) {
+        size_t n = num_samples - offset < max_samples ? num_samples - offset : max_samples;
+        struct timespec before_convert_ts;
+        struct timespec after_convert_ts;
+        clock_gettime(CLOCK_MONOTONIC, &before_convert_ts);
+        for (unsigned int tuner = 0; tuner < nrx; tuner++) {
+            const short *txi = xi[tuner] != NULL ? xi[tuner] + offset * in_stride : NULL;
+            const short *txq = xq[tuner] != NULL ? xq[tuner] + offset * in_stride : NULL;
+            if (sample_format == SAMPLE_FORMAT_CF32) {
+                interleave_cf32(txi, txq, in_stride, n, scales[tuner], (float *)output->converted + 2 * tuner, values_per_sample);
+            } else {
+                stats->conversion_clipped_values += interleave_cs8(txi, txq, in_stride, n, (int8_t *)output->converted + 2 * tuner, values_per_sample);
+            }
+        }
+        clock_gettime(CLOCK_MONOTONIC, &after_convert_ts);
+        stats->conversion_input_bytes += n * values_per_sample * sizeof(short);
+        stats->conversion_elapsed += (after_convert_ts.tv_sec - before_convert_ts.tv_sec) * 1000000000ULL + after_convert_ts.tv_nsec - before_convert_ts.tv_nsec;
+        output->converted_size = n * values_per_sample * value_size;
+        if (flush_converted(output) == -1) {
+            return -1;
+        }
+        offset += n;
+    }
+    return 0;
+}
+
+/* scale factor for the cf32 values of each tuner; with the calibrated
+ * scale the current gain is read for every write, so that gain changes
+ * are followed within one buffer
+ */
+static void complex_scales(const OutputFile *output, unsigned int nrx, float *scales) {
+    for (unsigned int tuner = 0; tuner < nrx; tuner++) {
+        switch (sample_scale) {
+            case SAMPLE_SCALE_RAW:
+                scales[tuner] = 1.0f;
+                break;
+            case SAMPLE_SCALE_CALIBRATED: {
+                float gain = sdrplay_get_current_gain(output->tuner == 1 ? 1 : tuner);
+                scales[tuner] = pow(10.0, (calibration_offset - gain) / 20.0) / FULL_SCALE_14BIT;
+                break;
+            }
+            default:
+                scales[tuner] = 1.0f / FULL_SCALE_14BIT;
+                break;
+        }
+    }
+}
+
+static int flush_converted(OutputFile *output) {
+    if (output->converted_size == 0) {
+        return 0;
+    }
+    int ret = output_write(output, output->converted, output->converted_size);
+    output->converted_size = 0;
+    return ret;
+}
@@ -0,0 +1,42 @@
+/* record to file the I/Q stream(s) from a SDRplay RSP
+ * output sample formats
+ *
+ * Copyright 2025 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef _SAMPLE_FORMAT_H
+#define _SAMPLE_FORMAT_H
+
+#include "config.h"
+#include "output.h"
+#include "sample-scale.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* typedefs */
+typedef struct {
+    char magic[8];              /* "RSPBFP01" */
+    uint16_t header_size;
+    uint16_t num_channels;      /* I and Q for each tuner */
+    uint32_t block_frames;      /* frames (one sample per channel) in a block */
+    double sample_rate;
+} BFP8Header;
+
+/* public functions */
+const char *sample_format_name(SampleFormat format);
+int sample_format_open(OutputFile *output);
+int sample_format_write(OutputFile *output, const short *samples, size_t num_values);
+int sample_format_finish(OutputFile *output);
+void sample_format_close(OutputFile *output);
+int sample_format_write_interleaved(OutputFile *output, const short *const *xi, const short *const *xq, unsigned int nrx, size_t num_samples);
+size_t pack12(const short *samples, size_t num_values, uint8_t *out);
+size_t pack14(const short *samples, size_t num_values, uint8_t *out);
+void unpack12(const uint8_t *in, size_t num_values, short *samples);
+void unpack14(const uint8_t *in, size_t num_values, short *samples);
+void interleave_cf32(const short *xi, const short *xq, size_t in_stride, size_t num_samples, float scale, float *out, size_t out_stride);
+size_t interleave_cs8(const short *xi, const short *xq, size_t in_stride, size_t num_samples, int8_t *out, size_t out_stride);
+
+#endif /* _SAMPLE_FORMAT_H */
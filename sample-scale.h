@@ -0,0 +1,23 @@
+/* record to file the I/Q stream(s) from a SDRplay RSP
+ * full scale of the samples
+ *
+ * Copyright 2025 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef _SAMPLE_SCALE_H
+#define _SAMPLE_SCALE_H
+
+/* the SDRplay API returns the samples as 16 bit shorts with 14 bit values
+ * (-8192 to 8191); 8192 is the full scale throughout the recorder (1.0 in
+ * cf32, 0 dBFS in the power and peak levels), and the values at the 14 bit
+ * limits are the clipped ones. Only the software decimation filters can
+ * produce values outside this range; the 14 and 12 bit sample formats
+ * clip them (and count them)
+ */
+#define FULL_SCALE_14BIT 8192.0f
+#define SAMPLE_MIN_14BIT (-8192)
+#define SAMPLE_MAX_14BIT 8191
+
+#endif /* _SAMPLE_SCALE_H */
@@ -9,9 +9,11 @@
 #include "callbacks.h"
 #include "config.h"
 #include "rsp-recorder.h"
+#include "sample-scale.h"
 #include "sdrplay-rsp.h"
 
 #include <limits.h>
+#include <math.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <string.h>
@@ -576,13 +578,20 @@ int sdrplay_start_streaming() {
     // callbacks and callback contexts
     sdrplay_api_CallbackFnsT callbackFns;
 
+    /* values at or above this level (relative to the 14 bit full scale)
+     * are counted as near full scale
+     */
+    long level = lrint(FULL_SCALE_14BIT * pow(10.0, overload_threshold / 20.0));
+    short near_full_scale_level = (short)(level < SAMPLE_MAX_14BIT ? level : SAMPLE_MAX_14BIT);
+
     if (!is_dual_tuner) {
         // single tuner case
         rx_context_A = (RXContext) {
             .next_sample_num = 0xffffffff,
             .internal_decimation = internal_decimation,
-            .blocks_resource = &blocks_resource,
-            .samples_resource = &samples_resource,
+            .near_full_scale_level = near_full_scale_level,
+            .blocks_resource = &blocks_resource_A,
+            .samples_resource = &samples_resource_A,
             .timeinfo = &timeinfo,
             .rx_stats = &rx_stats_A,
         };
@@ -614,16 +623,18 @@ int sdrplay_start_streaming() {
         rx_context_A = (RXContext) {
             .next_sample_num = 0xffffffff,
             .internal_decimation = internal_decimation,
-            .blocks_resource = &blocks_resource,
-            .samples_resource = &samples_resource,
+            .near_full_scale_level = near_full_scale_level,
+            .blocks_resource = &blocks_resource_A,
+            .samples_resource = &samples_resource_A,
             .timeinfo = &timeinfo,
             .rx_stats = &rx_stats_A,
         };
         rx_context_B = (RXContext) {
             .next_sample_num = 0xffffffff,
             .internal_decimation = internal_decimation,
-            .blocks_resource = &blocks_resource,
-            .samples_resource = &samples_resource,
+            .near_full_scale_level = near_full_scale_level,
+            .blocks_resource = &blocks_resource_B,
+            .samples_resource = &samples_resource_B,
             .timeinfo = NULL,
             .rx_stats = &rx_stats_B,
         };
@@ -716,8 +727,31 @@ float sdrplay_get_current_gain(int tuner) {
     return 0;
 }
 
-unsigned long long estimate_data_size() {
-    unsigned int nrx = is_dual_tuner ? 2 : 1;
+const char *sdrplay_get_hardware_name() {
+    switch (device.hwVer) {
+    case SDRPLAY_RSP1_ID:
+        return "RSP1";
+    case SDRPLAY_RSP1A_ID:
+        return "RSP1A";
+    case SDRPLAY_RSP1B_ID:
+        return "RSP1B";
+    case SDRPLAY_RSP2_ID:
+        return "RSP2";
+    case SDRPLAY_RSPduo_ID:
+        return "RSPduo";
+    case SDRPLAY_RSPdx_ID:
+        return "RSPdx";
+    case SDRPLAY_RSPdxR2_ID:
+        return "RSPdx-R2";
+    }
+    return "unknown RSP";
+}
+
+const char *sdrplay_get_serial_number() {
+    return device.SerNo;
+}
+
+unsigned long long estimate_data_size(unsigned int nrx) {
     return (unsigned long long) output_sample_rate * nrx * 2 * sizeof(short) * streaming_time;
 }
 
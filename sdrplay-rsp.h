@@ -25,6 +25,8 @@ int sdrplay_configure_rsp();
 int sdrplay_start_streaming();
 void sdrplay_acknowledge_power_overload(sdrplay_api_TunerSelectT tuner);
 float sdrplay_get_current_gain(int tuner);
-unsigned long long estimate_data_size();
+const char *sdrplay_get_hardware_name();
+const char *sdrplay_get_serial_number();
+unsigned long long estimate_data_size(unsigned int nrx);
 
 #endif /* _SDRPLAY_RSP_H */
@@ -0,0 +1,238 @@
+/* record to file the I/Q stream(s) from a SDRplay RSP
+ * shared memory ring output
+ *
+ * Copyright 2025 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "config.h"
+#include "output.h"
+#include "rsp-shm.h"
+#include "sample-format.h"
+#include "sdrplay-rsp.h"
+#include "shm-output.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <limits.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif /* __linux__ */
+#endif /* WIN32 */
+
+/* the writer writes the samples straight into the shared memory ring
+ * (converting them to the ring sample format), so the local consumers can
+ * follow the stream without any system call; see rsp-shm.h for the layout
+ */
+
+/* global variables */
+unsigned long long shm_output_samples = 0;
+
+#ifndef WIN32
+static RspShmHeader *header = NULL;
+static uint8_t *ring = NULL;
+static size_t map_size = 0;
+static unsigned int num_channels = 0;
+
+/* internal functions */
+static void shm_output_write_chunk(const short *const *xi, const short *const *xq, unsigned int nrx, size_t num_samples);
+#endif /* WIN32 */
+
+
+int shm_output_open() {
+    if (shm_output_name == NULL) {
+        return 0;
+    }
+#ifndef WIN32
+    if (num_output_files != 1) {
+        fprintf(stderr, "shared memory output is not supported with one file per tuner\n");
+        return -1;
+    }
+    num_channels = output_files[0].num_channels;
+    uint32_t format;
+    size_t value_size;
+    switch (shm_output_format) {
+        case SAMPLE_FORMAT_S16:
+            format = RSP_SHM_FORMAT_S16;
+            value_size = sizeof(short);
+            break;
+        case SAMPLE_FORMAT_CF32:
+            format = RSP_SHM_FORMAT_CF32;
+            value_size = sizeof(float);
+            break;
+        case SAMPLE_FORMAT_CS8:
+            format = RSP_SHM_FORMAT_CS8;
+            value_size = sizeof(int8_t);
+            break;
+        default:
+            fprintf(stderr, "invalid shared memory sample format: %s\n", sample_format_name(shm_output_format));
+            return -1;
+    }
+    size_t bytes_per_sample = num_channels * value_size;
+    map_size = RSP_SHM_HEADER_SIZE + (size_t)shm_output_capacity * bytes_per_sample;
+
+    int fd = shm_open(shm_output_name, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) {
+        fprintf(stderr, "shm_open(%s) failed: %s\n", shm_output_name, strerror(errno));
+        return -1;
+    }
+    if (ftruncate(fd, map_size) == -1) {
+        fprintf(stderr, "ftruncate(%s) failed: %s\n", shm_output_name, strerror(errno));
+        close(fd);
+        shm_unlink(shm_output_name);
+        return -1;
+    }
+    void *map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "mmap(%s) failed: %s\n", shm_output_name, strerror(errno));
+        shm_unlink(shm_output_name);
+        return -1;
+    }
+    header = (RspShmHeader *)map;
+    ring = (uint8_t *)map + RSP_SHM_HEADER_SIZE;
+
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    memcpy(header->magic, RSP_SHM_MAGIC, sizeof(header->magic));
+    header->version = RSP_SHM_VERSION;
+    header->header_size = RSP_SHM_HEADER_SIZE;
+    header->sample_format = format;
+    header->num_channels = num_channels;
+    header->bytes_per_sample = bytes_per_sample;
+    header->ring_samples = shm_output_capacity;
+    header->sample_rate = output_sample_rate;
+    header->frequency[0] = frequency_A;
+    header->frequency[1] = is_dual_tuner ? frequency_B : 0.0;
+    header->start_time_ns = ts.tv_sec * 1000000000LL + ts.tv_nsec;
+    header->reserve_sample = 0;
+    header->write_sample = 0;
+    header->futex = 0;
+    __atomic_store_n(&header->state, RSP_SHM_STATE_RUNNING, __ATOMIC_RELEASE);
+    shm_output_samples = 0;
+
+    if (verbose) {
+        fprintf(stderr, "shared memory output %s: %u samples (%s)\n", shm_output_name, shm_output_capacity, sample_format_name(shm_output_format));
+    }
+    return 0;
+#else
+    fprintf(stderr, "shared memory output is not supported on Windows\n");
+    return -1;
+#endif /* WIN32 */
+}
+
+/* called by the writer for each segment; a NULL tuner is filled with zeros */
+void shm_output_write(const short *const *xi, const short *const *xq, unsigned int nrx, size_t num_samples) {
+#ifndef WIN32
+    if (header == NULL) {
+        return;
+    }
+    /* at most half of the ring at a time, so the readers can keep up */
+    size_t max_samples = header->ring_samples / 2;
+    for (size_t offset = 0; offset < num_samples; ) {
+        size_t n = num_samples - offset < max_samples ? num_samples - offset : max_samples;
+        const short *txi[2] = {NULL, NULL};
+        const short *txq[2] = {NULL, NULL};
+        for (unsigned int tuner = 0; tuner < nrx; tuner++) {
+            if (xi[tuner] != NULL) {
+                txi[tuner] = xi[tuner] + offset;
+                txq[tuner] = xq[tuner] + offset;
+            }
+        }
+        shm_output_write_chunk(txi, txq, nrx, n);
+        offset += n;
+    }
+#else
+    (void)xi;
+    (void)xq;
+    (void)nrx;
+    (void)num_samples;
+#endif /* WIN32 */
+}
+
+/* the shared memory object is removed, but the readers still attached
+ * can read the last samples
+ */
+void shm_output_close() {
+#ifndef WIN32
+    if (header == NULL) {
+        return;
+    }
+    __atomic_store_n(&header->state, RSP_SHM_STATE_FINISHED, __ATOMIC_RELEASE);
+    __atomic_add_fetch(&header->futex, 1, __ATOMIC_RELEASE);
+#ifdef __linux__
+    syscall(SYS_futex, &header->futex, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+#endif /* __linux__ */
+    munmap(header, map_size);
+    header = NULL;
+    ring = NULL;
+    shm_unlink(shm_output_name);
+#endif /* WIN32 */
+}
+
+/* internal functions */
+#ifndef WIN32
+static void shm_output_write_chunk(const short *const *xi, const short *const *xq, unsigned int nrx, size_t num_samples) {
+    uint64_t write_sample = header->write_sample;
+    uint64_t ring_samples = header->ring_samples;
+    size_t bytes_per_sample = header->bytes_per_sample;
+
+    /* tell the readers which samples are about to be overwritten */
+    __atomic_store_n(&header->reserve_sample, write_sample + num_samples, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    for (size_t offset = 0; offset < num_samples; ) {
+        uint64_t ring_index = (write_sample + offset) % ring_samples;
+        size_t n = num_samples - offset;
+        if (n > ring_samples - ring_index) {
+            n = ring_samples - ring_index;
+        }
+        uint8_t *out = ring + ring_index * bytes_per_sample;
+        for (unsigned int tuner = 0; tuner < nrx; tuner++) {
+            const short *txi = xi[tuner] != NULL ? xi[tuner] + offset : NULL;
+            const short *txq = xq[tuner] != NULL ? xq[tuner] + offset : NULL;
+            switch (shm_output_format) {
+                case SAMPLE_FORMAT_CF32:
+                    interleave_cf32(txi, txq, 1, n, 1.0f / FULL_SCALE_14BIT, (float *)out + 2 * tuner, num_channels);
+                    break;
+                case SAMPLE_FORMAT_CS8:
+                    interleave_cs8(txi, txq, 1, n, (int8_t *)out + 2 * tuner, num_channels);
+                    break;
+                default: {
+                    short *outsamples = (short *)out + 2 * tuner;
+                    if (txi != NULL) {
+                        for (size_t i = 0; i < n; i++, outsamples += num_channels) {
+                            outsamples[0] = txi[i];
+                            outsamples[1] = txq[i];
+                        }
+                    } else {
+                        for (size_t i = 0; i < n; i++, outsamples += num_channels) {
+                            outsamples[0] = 0;
+                            outsamples[1] = 0;
+                        }
+                    }
+                    break;
+                }
+            }
+        }
+        offset += n;
+    }
+
+    /* publish the new samples and wake up the readers */
+    __atomic_store_n(&header->write_sample, write_sample + num_samples, __ATOMIC_RELEASE);
+    __atomic_add_fetch(&header->futex, 1, __ATOMIC_RELEASE);
+#ifdef __linux__
+    syscall(SYS_futex, &header->futex, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+#endif /* __linux__ */
+    shm_output_samples += num_samples;
+}
+#endif /* WIN32 */
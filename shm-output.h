@@ -0,0 +1,22 @@
+/* record to file the I/Q stream(s) from a SDRplay RSP
+ * shared memory ring output
+ *
+ * Copyright 2025 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef _SHM_OUTPUT_H
+#define _SHM_OUTPUT_H
+
+#include <stddef.h>
+
+/* global variables */
+extern unsigned long long shm_output_samples;
+
+/* public functions */
+int shm_output_open();
+void shm_output_write(const short *const *xi, const short *const *xq, unsigned int nrx, size_t num_samples);
+void shm_output_close();
+
+#endif /* _SHM_OUTPUT_H */
@@ -0,0 +1,60 @@
+#!/usr/bin/env python3
+# show an overview of a recording from its envelope file
+#
+# Copyright 2025 Franco Venturi
+#
+# SPDX-License-Identifier: GPL-3.0-or-later
+
+import math
+import mmap
+import struct
+import sys
+
+HEADER_FORMAT = '@8s4HQd'
+LEVEL_FORMAT = '@2IQQ'
+MAX_LEVELS = 8
+VALUE_FORMAT = '@hhH'
+
+def main():
+    filename = sys.argv[1]
+    # optional: number of lines of the overview (default: 40)
+    num_lines = int(sys.argv[2]) if len(sys.argv) > 2 else 40
+    with open(filename, 'rb') as f:
+        mm = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+        magic, version, header_size, num_channels, num_levels, num_samples, sample_rate = struct.unpack_from(HEADER_FORMAT, mm, 0)
+        if magic != b'RSPENVLP':
+            print(f'{filename}: not an envelope file', file=sys.stderr)
+            sys.exit(1)
+        levels = [struct.unpack_from(LEVEL_FORMAT, mm, struct.calcsize(HEADER_FORMAT) + i * struct.calcsize(LEVEL_FORMAT)) for i in range(num_levels)]
+        print(f'version={version} channels={num_channels} sample_rate={sample_rate:.0f} samples={num_samples} levels={num_levels}')
+        for log2_samples, _, offset, num_entries in levels:
+            print(f'    level: 2^{log2_samples} samples per entry, {num_entries} entries at offset {offset}')
+        if num_levels == 0:
+            return
+
+        # the coarsest level with at least one entry per line
+        log2_samples, _, offset, num_entries = levels[0]
+        for level in levels:
+            if level[3] >= num_lines:
+                log2_samples, _, offset, num_entries = level
+        if num_entries == 0:
+            return
+        entry_size = num_channels * struct.calcsize(VALUE_FORMAT)
+
+        def entry(i):
+            return [struct.unpack_from(VALUE_FORMAT, mm, offset + i * entry_size + c * struct.calcsize(VALUE_FORMAT)) for c in range(num_channels)]
+
+        per_line = math.ceil(num_entries / num_lines)
+        for first in range(0, num_entries, per_line):
+            entries = [entry(i) for i in range(first, min(first + per_line, num_entries))]
+            seconds = (first << log2_samples) / sample_rate
+            columns = []
+            for c in range(num_channels):
+                vmin = min(e[c][0] for e in entries)
+                vmax = max(e[c][1] for e in entries)
+                rms = math.sqrt(sum(e[c][2] ** 2 for e in entries) / len(entries))
+                columns.append(f'[{vmin:6d},{vmax:6d}] rms={rms:7.1f}')
+            print(f'{seconds:10.3f}s  ' + '  '.join(columns))
+
+if __name__ == '__main__':
+    main()
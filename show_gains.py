@@ -1,5 +1,5 @@
 #!/usr/bin/env python3
-# show gains data
+# show gains data (from a gains file, or from the 'rspe' chunk in a WAV file)
 #
 # Copyright 2025 Franco Venturi
 #
@@ -8,15 +8,51 @@
 import struct
 import sys
 
+event_types = {0: 'gain change', 1: 'overload detected', 2: 'overload corrected'}
+
+def find_events_chunk(f):
+    # the 'rspe' chunk immediately follows the 'data' chunk; None if this
+    # is a gains file, 0 if it is a WAV file without events
+    f.seek(0)
+    riff_id = f.read(4)
+    if riff_id == b'RIFF':
+        return 0
+    if riff_id != b'RF64':
+        return None
+    f.seek(12)
+    data_size = None
+    while True:
+        header = f.read(8)
+        if len(header) < 8:
+            return 0
+        chunk_id, chunk_size = struct.unpack('<4sI', header)
+        if chunk_id == b'ds64':
+            _, data_size, _, _ = struct.unpack('<QQQI', f.read(28))
+            f.seek(chunk_size - 28, 1)
+            continue
+        if chunk_id == b'data' and chunk_size == 0xffffffff:
+            chunk_size = data_size
+        if chunk_id == b'rspe':
+            return chunk_size
+        f.seek(chunk_size + (chunk_size & 1), 1)
+
 def main():
     filename = sys.argv[1]
     with open(filename, 'rb') as f:
-        while True:
+        events_size = find_events_chunk(f)
+        if events_size is None:
+            f.seek(0)
+        while events_size is None or events_size > 0:
             gain_change = f.read(16)
-            if not gain_change:
+            if len(gain_change) < 16:
                 break
-            sample_num, currGain, tuner, gRdB, lnaGRdB = struct.unpack('@Qf3Bx', gain_change)
-            print(f'sample_num={sample_num} currGain={currGain:.3f} tuner={tuner} gRdB={gRdB} lnaGRdB={lnaGRdB}')
+            if events_size is None:
+                sample_num, currGain, tuner, gRdB, lnaGRdB = struct.unpack('@Qf3Bx', gain_change)
+                print(f'sample_num={sample_num} currGain={currGain:.3f} tuner={tuner} gRdB={gRdB} lnaGRdB={lnaGRdB}')
+            else:
+                sample_num, currGain, tuner, gRdB, lnaGRdB, event_type = struct.unpack('@Qf4B', gain_change)
+                print(f'sample_num={sample_num} type={event_types.get(event_type, event_type)} currGain={currGain:.3f} tuner={tuner} gRdB={gRdB} lnaGRdB={lnaGRdB}')
+                events_size -= 16
 
 if __name__ == '__main__':
     main()
@@ -0,0 +1,64 @@
+#!/usr/bin/env python3
+# show recording index data
+#
+# Copyright 2025 Franco Venturi
+#
+# SPDX-License-Identifier: GPL-3.0-or-later
+
+from datetime import datetime, timezone
+import mmap
+import struct
+import sys
+
+HEADER_FORMAT = '@8s4HQd'
+ENTRY_FORMAT = '@QQq4BB3x'
+
+FLAGS = {0x01: 'gap-filled', 0x02: 'gap-skipped', 0x04: 'resync', 0x08: 'gain-change', 0x10: 'clipped', 0x20: 'overload'}
+
+def main():
+    filename = sys.argv[1]
+    # optional: UTC time (ISO8601) to look up
+    lookup_time = None
+    if len(sys.argv) > 2:
+        lookup_time = datetime.fromisoformat(sys.argv[2].replace('Z', '+00:00'))
+        if lookup_time.tzinfo is None:
+            lookup_time = lookup_time.replace(tzinfo=timezone.utc)
+    with open(filename, 'rb') as f:
+        mm = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+        header_size = struct.calcsize(HEADER_FORMAT)
+        magic, version, entry_size, num_channels, _, interval_samples, sample_rate = struct.unpack_from(HEADER_FORMAT, mm, 0)
+        if magic != b'RSPINDEX':
+            print(f'{filename}: not a recording index file', file=sys.stderr)
+            sys.exit(1)
+        num_entries = (len(mm) - header_size) // entry_size
+        print(f'version={version} channels={num_channels} sample_rate={sample_rate:.0f} interval_samples={interval_samples} entries={num_entries}')
+
+        def entry(i):
+            return struct.unpack_from(ENTRY_FORMAT, mm, header_size + i * entry_size)
+
+        def show(i):
+            sample_num, byte_offset, timestamp, gRdB_A, gRdB_B, lnaGRdB_A, lnaGRdB_B, flags = entry(i)
+            ts = datetime.fromtimestamp(timestamp // 1000000000, timezone.utc).strftime('%Y-%m-%dT%H:%M:%S')
+            flags_str = ','.join(name for bit, name in FLAGS.items() if flags & bit)
+            print(f'sample_num={sample_num} byte_offset={byte_offset} time={ts}.{timestamp % 1000000000:09d}Z gRdB={gRdB_A}/{gRdB_B} lnaGRdB={lnaGRdB_A}/{lnaGRdB_B} flags={flags_str}')
+
+        if lookup_time is None:
+            for i in range(num_entries):
+                show(i)
+        elif num_entries > 0:
+            # the stride is fixed in samples, but a skipped gap moves the
+            # timestamps of the following entries forward: binary search for
+            # the last entry at or before the given time
+            lookup_ns = int(lookup_time.timestamp() * 1e9)
+            lo = 0
+            hi = num_entries
+            while lo < hi:
+                mid = (lo + hi) // 2
+                if entry(mid)[2] <= lookup_ns:
+                    lo = mid + 1
+                else:
+                    hi = mid
+            show(max(0, lo - 1))
+
+if __name__ == '__main__':
+    main()
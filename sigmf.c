@@ -0,0 +1,381 @@
+/* record to file the I/Q stream(s) from a SDRplay RSP
+ * SigMF metadata
+ *
+ * Copyright 2025 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "buffers.h"
+#include "config.h"
+#include "output.h"
+#include "sdrplay-rsp.h"
+#include "sigmf.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define SIGMF_VERSION "1.0.0"
+#define SIGMF_DATA_EXTENSION ".sigmf-data"
+#define SIGMF_META_EXTENSION ".sigmf-meta"
+#define SIGMF_META_INTERVAL 1          /* seconds between two metadata rewrites */
+#define SIGMF_EVENTS_INITIAL_CAPACITY 1024
+
+/* the events are queued by the writer(s), and the metadata file is
+ * rewritten from a copy of the queue by a side thread, so the JSON
+ * generation is never done in the sample path; each rewrite goes to a
+ * temporary file which is then renamed, so the metadata file is always a
+ * complete JSON document
+ */
+static pthread_mutex_t sigmf_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t sigmf_stop = PTHREAD_COND_INITIALIZER;
+static pthread_t sigmf_thread;
+static bool is_sigmf_open = false;
+static bool is_sigmf_stopping = false;
+static SigMFEvent *events = NULL;
+static size_t num_events = 0;
+static size_t events_capacity = 0;
+static unsigned long long events_lost = 0;
+static char meta_filenames[2][PATH_MAX];
+
+/* internal functions */
+static void *sigmf_thread_loop(void *arg);
+static SigMFEvent *sigmf_events_snapshot(size_t *n);
+static int sigmf_write_meta(const OutputFile *output, const char *meta_filename, const SigMFEvent *snapshot, size_t n);
+static int compare_events(const void *a, const void *b);
+static const char *sigmf_datatype();
+static void format_datetime(char *buffer, size_t size, const struct timespec *ts);
+
+
+int sigmf_open() {
+    for (int i = 0; i < num_output_files; i++) {
+        const char *filename = output_files[i].filename;
+        size_t len = strlen(filename);
+        size_t extlen = sizeof(SIGMF_DATA_EXTENSION) - 1;
+        if (len <= extlen || strcmp(filename + len - extlen, SIGMF_DATA_EXTENSION) != 0) {
+            fprintf(stderr, "SigMF output filename must end with '%s': %s\n", SIGMF_DATA_EXTENSION, filename);
+            return -1;
+        }
+        int n = snprintf(meta_filenames[i], PATH_MAX, "%.*s%s", (int)(len - extlen), filename, SIGMF_META_EXTENSION);
+        if (n >= PATH_MAX) {
+            fprintf(stderr, "SigMF metadata filename too long: %s\n", filename);
+            return -1;
+        }
+    }
+
+    events = (SigMFEvent *)malloc(SIGMF_EVENTS_INITIAL_CAPACITY * sizeof(SigMFEvent));
+    if (events == NULL) {
+        fprintf(stderr, "malloc(SigMF events) failed\n");
+        return -1;
+    }
+    events_capacity = SIGMF_EVENTS_INITIAL_CAPACITY;
+    num_events = 0;
+    events_lost = 0;
+
+    /* write a first version of the metadata right away */
+    for (int i = 0; i < num_output_files; i++) {
+        if (sigmf_write_meta(&output_files[i], meta_filenames[i], NULL, 0) == -1) {
+            return -1;
+        }
+    }
+
+    is_sigmf_stopping = false;
+    int errcode = pthread_create(&sigmf_thread, NULL, sigmf_thread_loop, NULL);
+    if (errcode != 0) {
+        fprintf(stderr, "pthread_create(SigMF thread) failed: %s\n", strerror(errcode));
+        return -1;
+    }
+    pthread_mutex_lock(&sigmf_lock);
+    is_sigmf_open = true;
+    pthread_mutex_unlock(&sigmf_lock);
+    return 0;
+}
+
+/* stop the side thread and write the final metadata */
+void sigmf_close() {
+    pthread_mutex_lock(&sigmf_lock);
+    if (!is_sigmf_open) {
+        pthread_mutex_unlock(&sigmf_lock);
+        free(events);
+        events = NULL;
+        return;
+    }
+    is_sigmf_open = false;
+    is_sigmf_stopping = true;
+    pthread_cond_signal(&sigmf_stop);
+    pthread_mutex_unlock(&sigmf_lock);
+    pthread_join(sigmf_thread, NULL);
+
+    qsort(events, num_events, sizeof(SigMFEvent), compare_events);
+    for (int i = 0; i < num_output_files; i++) {
+        if (sigmf_write_meta(&output_files[i], meta_filenames[i], events, num_events) == -1) {
+            fprintf(stderr, "write SigMF metadata %s failed\n", meta_filenames[i]);
+        }
+    }
+    if (events_lost > 0) {
+        fprintf(stderr, "warning: %llu SigMF annotations lost\n", events_lost);
+    }
+    free(events);
+    events = NULL;
+    events_capacity = 0;
+    num_events = 0;
+}
+
+/* queue an event for the metadata (it does nothing for the other output types) */
+void sigmf_add_event(const SigMFEvent *event) {
+    pthread_mutex_lock(&sigmf_lock);
+    if (!is_sigmf_open) {
+        pthread_mutex_unlock(&sigmf_lock);
+        return;
+    }
+    if (num_events == events_capacity) {
+        SigMFEvent *new_events = (SigMFEvent *)realloc(events, 2 * events_capacity * sizeof(SigMFEvent));
+        if (new_events == NULL) {
+            events_lost++;
+            pthread_mutex_unlock(&sigmf_lock);
+            return;
+        }
+        events = new_events;
+        events_capacity *= 2;
+    }
+    events[num_events++] = *event;
+    pthread_mutex_unlock(&sigmf_lock);
+}
+
+
+/* internal functions */
+static void *sigmf_thread_loop(void *arg) {
+    (void)arg;
+    pthread_mutex_lock(&sigmf_lock);
+    while (!is_sigmf_stopping) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += SIGMF_META_INTERVAL;
+        pthread_cond_timedwait(&sigmf_stop, &sigmf_lock, &deadline);
+        if (is_sigmf_stopping) {
+            break;
+        }
+        pthread_mutex_unlock(&sigmf_lock);
+
+        size_t n;
+        SigMFEvent *snapshot = sigmf_events_snapshot(&n);
+        for (int i = 0; i < num_output_files; i++) {
+            /* on failure, try again at the next interval */
+            sigmf_write_meta(&output_files[i], meta_filenames[i], snapshot, n);
+        }
+        free(snapshot);
+
+        pthread_mutex_lock(&sigmf_lock);
+    }
+    pthread_mutex_unlock(&sigmf_lock);
+    return NULL;
+}
+
+static SigMFEvent *sigmf_events_snapshot(size_t *n) {
+    pthread_mutex_lock(&sigmf_lock);
+    *n = num_events;
+    SigMFEvent *snapshot = (SigMFEvent *)malloc((num_events > 0 ? num_events : 1) * sizeof(SigMFEvent));
+    if (snapshot == NULL) {
+        *n = 0;
+    } else {
+        memcpy(snapshot, events, num_events * sizeof(SigMFEvent));
+    }
+    pthread_mutex_unlock(&sigmf_lock);
+    if (snapshot != NULL) {
+        qsort(snapshot, *n, sizeof(SigMFEvent), compare_events);
+    }
+    return snapshot;
+}
+
+static int sigmf_write_meta(const OutputFile *output, const char *meta_filename, const SigMFEvent *snapshot, size_t n) {
+    char tmp_filename[PATH_MAX + 4];
+    snprintf(tmp_filename, sizeof(tmp_filename), "%s.tmp", meta_filename);
+    FILE *fp = fopen(tmp_filename, "w");
+    if (fp == NULL) {
+        fprintf(stderr, "fopen(%s) for writing failed: %s\n", tmp_filename, strerror(errno));
+        return -1;
+    }
+
+    int num_tuners = output->num_channels / 2;
+    fprintf(fp, "{\n");
+    fprintf(fp, "    \"global\": {\n");
+    fprintf(fp, "        \"core:datatype\": \"%s\",\n", sigmf_datatype());
+    fprintf(fp, "        \"core:sample_rate\": %.10g,\n", output_sample_rate);
+    fprintf(fp, "        \"core:version\": \"%s\",\n", SIGMF_VERSION);
+    fprintf(fp, "        \"core:num_channels\": %d,\n", num_tuners);
+    fprintf(fp, "        \"core:hw\": \"SDRplay %s SerNo=%s\",\n", sdrplay_get_hardware_name(), sdrplay_get_serial_number());
+    if (num_tuners > 1) {
+        fprintf(fp, "        \"core:description\": \"RSPduo dual tuner recording - tuner A at %.0lf Hz, tuner B at %.0lf Hz\",\n", frequency_A, frequency_B);
+    } else if (output->tuner != -1) {
+        fprintf(fp, "        \"core:description\": \"RSPduo dual tuner recording - tuner %c\",\n", 'A' + output->tuner);
+    } else if (diversity_combining != DIVERSITY_COMBINING_NONE) {
+        fprintf(fp, "        \"core:description\": \"RSPduo dual tuner recording - tuners A and B combined (%s)\",\n", diversity_combining == DIVERSITY_COMBINING_MRC ? "MRC" : "selection");
+    }
+    fprintf(fp, "        \"core:recorder\": \"rsp-recorder\"\n");
+    fprintf(fp, "    },\n");
+
+    /* a new capture segment starts after every gap that is not in the file */
+    struct timespec start_ts = timeinfo.start_ts;
+    char datetime[40];
+    fprintf(fp, "    \"captures\": [\n");
+    fprintf(fp, "        {\n");
+    fprintf(fp, "            \"core:sample_start\": 0,\n");
+    if (start_ts.tv_sec != 0) {
+        format_datetime(datetime, sizeof(datetime), &start_ts);
+        fprintf(fp, "            \"core:datetime\": \"%s\",\n", datetime);
+    }
+    fprintf(fp, "            \"core:frequency\": %.0lf\n", output->frequency);
+    fprintf(fp, "        }");
+    unsigned long long skipped_samples = 0;
+    for (size_t i = 0; i < n; i++) {
+        const SigMFEvent *event = &snapshot[i];
+        if (event->type != SIGMF_EVENT_GAP_SKIPPED || !(event->tuner == -1 || event->tuner == output->tuner)) {
+            continue;
+        }
+        skipped_samples += event->num_samples;
+        fprintf(fp, ",\n");
+        fprintf(fp, "        {\n");
+        fprintf(fp, "            \"core:sample_start\": %llu,\n", (unsigned long long)event->sample_num);
+        if (start_ts.tv_sec != 0) {
+            double elapsed = (event->sample_num + skipped_samples) / output_sample_rate;
+            struct timespec ts = start_ts;
+            ts.tv_sec += (time_t)elapsed;
+            ts.tv_nsec += (long)((elapsed - (time_t)elapsed) * 1e9);
+            if (ts.tv_nsec >= 1000000000L) {
+                ts.tv_sec++;
+                ts.tv_nsec -= 1000000000L;
+            }
+            format_datetime(datetime, sizeof(datetime), &ts);
+            fprintf(fp, "            \"core:datetime\": \"%s\",\n", datetime);
+        }
+        fprintf(fp, "            \"core:frequency\": %.0lf\n", output->frequency);
+        fprintf(fp, "        }");
+    }
+    fprintf(fp, "\n    ],\n");
+
+    /* annotations: events and time markers, both in sample order */
+    fprintf(fp, "    \"annotations\": [");
+    const char *separator = "\n";
+    TimeMarkersChunk *markers_chunk = timeinfo.markers_first;
+    unsigned int marker_index = 0;
+    unsigned long long markers_left = markers_chunk != NULL ? time_markers_count(&timeinfo) : 0;
+    size_t i = 0;
+    while (true) {
+        if (markers_left > 0 && marker_index == TIME_MARKERS_CHUNK_SIZE) {
+            markers_chunk = markers_chunk->next;
+            marker_index = 0;
+        }
+        const TimeMarker *marker = markers_left > 0 ? &markers_chunk->markers[marker_index] : NULL;
+        const SigMFEvent *event = NULL;
+        while (i < n && !(snapshot[i].tuner == -1 || output->tuner == -1 || snapshot[i].tuner == output->tuner)) {
+            i++;
+        }
+        if (i < n) {
+            event = &snapshot[i];
+        }
+        if (marker == NULL && event == NULL) {
+            break;
+        }
+
+        fprintf(fp, "%s        {\n", separator);
+        separator = ",\n";
+        if (marker != NULL && (event == NULL || marker->sample_num <= event->sample_num)) {
+            format_datetime(datetime, sizeof(datetime), &marker->ts);
+            fprintf(fp, "            \"core:sample_start\": %llu,\n", marker->sample_num);
+            fprintf(fp, "            \"core:label\": \"time marker\",\n");
+            fprintf(fp, "            \"core:comment\": \"%s\"\n", datetime);
+            marker_index++;
+            markers_left--;
+        } else {
+            char tuner_name[16] = "";
+            if (event->tuner != -1 && (num_tuners > 1 || output->tuner != -1)) {
+                snprintf(tuner_name, sizeof(tuner_name), "tuner %c - ", 'A' + event->tuner);
+            }
+            fprintf(fp, "            \"core:sample_start\": %llu,\n", (unsigned long long)event->sample_num);
+            switch (event->type) {
+                case SIGMF_EVENT_GAIN_CHANGE:
+                    fprintf(fp, "            \"core:label\": \"gain change\",\n");
+                    fprintf(fp, "            \"core:comment\": \"%sgain=%.3f dB gRdB=%u LNAgRdB=%u\"\n", tuner_name, event->gain, event->gRdB, event->lnaGRdB);
+                    break;
+                case SIGMF_EVENT_GAP_FILLED:
+                    fprintf(fp, "            \"core:sample_count\": %llu,\n", (unsigned long long)event->num_samples);
+                    fprintf(fp, "            \"core:label\": \"dropped samples\",\n");
+                    fprintf(fp, "            \"core:comment\": \"%s%llu samples filled with zeros\"\n", tuner_name, (unsigned long long)event->num_samples);
+                    break;
+                case SIGMF_EVENT_GAP_SKIPPED:
+                    fprintf(fp, "            \"core:label\": \"dropped samples\",\n");
+                    fprintf(fp, "            \"core:comment\": \"%s%llu samples skipped\"\n", tuner_name, (unsigned long long)event->num_samples);
+                    break;
+                case SIGMF_EVENT_OVERLOAD_DETECTED:
+                    fprintf(fp, "            \"core:label\": \"power overload detected\",\n");
+                    fprintf(fp, "            \"core:comment\": \"%spower overload detected\"\n", tuner_name);
+                    break;
+                case SIGMF_EVENT_OVERLOAD_CORRECTED:
+                    fprintf(fp, "            \"core:label\": \"power overload corrected\",\n");
+                    fprintf(fp, "            \"core:comment\": \"%spower overload corrected\"\n", tuner_name);
+                    break;
+            }
+            i++;
+        }
+        fprintf(fp, "        }");
+    }
+    fprintf(fp, "\n    ]\n");
+    fprintf(fp, "}\n");
+
+    if (fclose(fp) != 0) {
+        fprintf(stderr, "write SigMF metadata %s failed: %s\n", tmp_filename, strerror(errno));
+        return -1;
+    }
+#ifdef WIN32
+    /* rename() does not replace an existing file in Windows */
+    remove(meta_filename);
+#endif /* WIN32 */
+    if (rename(tmp_filename, meta_filename) == -1) {
+        fprintf(stderr, "rename(%s) failed: %s\n", tmp_filename, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+static int compare_events(const void *a, const void *b) {
+    const SigMFEvent *ea = (const SigMFEvent *)a;
+    const SigMFEvent *eb = (const SigMFEvent *)b;
+    if (ea->sample_num != eb->sample_num) {
+        return ea->sample_num < eb->sample_num ? -1 : 1;
+    }
+    if (ea->type != eb->type) {
+        return ea->type < eb->type ? -1 : 1;
+    }
+    return ea->tuner - eb->tuner;
+}
+
+static const char *sigmf_datatype() {
+    switch (sample_format) {
+        case SAMPLE_FORMAT_CF32:
+            return "cf32_le";
+        case SAMPLE_FORMAT_CS8:
+            return "ci8";
+        default:
+            return "ci16_le";
+    }
+}
+
+/* ISO8601/RFC3339 timestamp with nanoseconds */
+static void format_datetime(char *buffer, size_t size, const struct timespec *ts) {
+    /* this runs in the metadata thread */
+    struct tm tm;
+#ifdef WIN32
+    gmtime_s(&tm, &ts->tv_sec);
+#else
+    gmtime_r(&ts->tv_sec, &tm);
+#endif /* WIN32 */
+    char datetime[20];
+    strftime(datetime, sizeof(datetime), "%Y-%m-%dT%H:%M:%S", &tm);
+    snprintf(buffer, size, "%s.%09luZ", datetime, ts->tv_nsec);
+}
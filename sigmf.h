@@ -0,0 +1,38 @@
+/* record to file the I/Q stream(s) from a SDRplay RSP
+ * SigMF metadata
+ *
+ * Copyright 2025 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef _SIGMF_H
+#define _SIGMF_H
+
+#include <stdint.h>
+
+/* typedefs */
+typedef enum {
+    SIGMF_EVENT_GAIN_CHANGE,
+    SIGMF_EVENT_GAP_FILLED,
+    SIGMF_EVENT_GAP_SKIPPED,
+    SIGMF_EVENT_OVERLOAD_DETECTED,
+    SIGMF_EVENT_OVERLOAD_CORRECTED,
+} SigMFEventType;
+
+typedef struct {
+    uint64_t sample_num;        /* sample number in the recording */
+    uint64_t num_samples;       /* gaps only */
+    SigMFEventType type;
+    int tuner;                  /* -1: all tuners */
+    float gain;                 /* gain changes only */
+    uint8_t gRdB;
+    uint8_t lnaGRdB;
+} SigMFEvent;
+
+/* public functions */
+int sigmf_open();
+void sigmf_close();
+void sigmf_add_event(const SigMFEvent *event);
+
+#endif /* _SIGMF_H */
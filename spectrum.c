@@ -0,0 +1,592 @@
+/* record to file the I/Q stream(s) from a SDRplay RSP
+ * spectrum (PSD/waterfall) file
+ *
+ * Copyright 2025 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "buffers.h"
+#include "config.h"
+#include "fft.h"
+#include "sample-format.h"
+#include "sdrplay-rsp.h"
+#include "spectrum.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+#define SPECTRUM_VERSION 1
+#define SPECTRUM_CHUNK_SAMPLES 65536
+#define SPECTRUM_MAX_GAPS 64
+#define SPECTRUM_POWER_FLOOR 1e-30      /* -300 dBFS */
+#define SPECTRUM_FLOAT16_NAN 0x7e00
+
+/* the samples are cut into consecutive FFT frames (Hann window, no
+ * overlap), and the power spectra of the frames are averaged over each
+ * 'spectrum interval'; every average is a row of the spectrum file.
+ * Like the DDC channels, the writer copies the samples into a ring, and
+ * a worker thread computes the spectra; the writer never waits for the
+ * worker, and if the worker falls behind by more than the ring, the
+ * frames it missed are skipped and counted in the row. The gaps of
+ * dropped samples skipped in the recording are also skipped frames, so
+ * that the rows are always 'spectrum interval' apart.
+ */
+typedef struct {
+    unsigned long long sample;          /* position of the gap in the ring */
+    unsigned long long num_samples;
+} SpectrumGap;
+
+static pthread_mutex_t spectrum_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t spectrum_data_ready = PTHREAD_COND_INITIALIZER;
+static pthread_t spectrum_thread;
+static bool is_worker_running = false;
+static bool is_spectrum_stopping = false;
+static short *ring = NULL;
+static unsigned long long ring_samples = 0;
+static unsigned long long write_sample = 0;     /* next sample to write to the ring */
+static unsigned long long read_sample = 0;      /* next sample to read from the ring */
+static unsigned long long skipped_samples = 0;  /* dropped, not yet seen by the worker */
+static unsigned int ring_channels = 0;
+static SpectrumGap gaps[SPECTRUM_MAX_GAPS];
+static int first_gap = 0;
+static int num_gaps = 0;
+
+/* used only by the worker thread */
+static unsigned int num_tuners = 0;
+static FFT fft = { .cos_table = NULL };
+static float *window = NULL;
+static double power_scale = 0.0;
+static float *frame_re[2] = {NULL, NULL};
+static float *frame_im[2] = {NULL, NULL};
+static double *power_sum = NULL;                /* num_tuners x fft size */
+static unsigned int frame_fill = 0;
+static bool is_frame_skipped = false;
+static unsigned int frames_per_row = 0;
+static unsigned int row_frames = 0;
+static unsigned int row_skipped_frames = 0;
+static unsigned long long row_sample_num = 0;
+static short *samples = NULL;                   /* samples copied out of the ring */
+static uint8_t *row = NULL;
+static size_t row_size = 0;
+static uint8_t *image_row = NULL;
+static unsigned long long image_rows = 0;
+
+static SpectrumHeader spectrum_header;
+static int spectrum_fd = -1;
+static int image_fd = -1;
+static bool is_spectrum_failed = false;
+static bool is_image_failed = false;
+static char spectrum_filename[PATH_MAX];
+static char image_filename[PATH_MAX];
+
+/* global variables */
+SpectrumStats spectrum_stats = {
+    .rows = 0,
+    .frames = 0,
+    .skipped_frames = 0,
+    .dropped_samples = 0,
+    .overruns = 0,
+};
+
+/* internal functions */
+static int generate_spectrum_filename(const char *output_filename, const char *extension, char *filename, int filename_max_size);
+static int write_image_header();
+static void *spectrum_worker_loop(void *arg);
+static void spectrum_skip_frames(unsigned long long num_samples);
+static void spectrum_process(const short *samples, size_t num_samples);
+static void spectrum_end_frame();
+static void spectrum_write_row();
+static uint16_t float_to_half(float value);
+
+
+int spectrum_open(const char *output_filename) {
+    if (!spectrum_file_enable) {
+        return 0;
+    }
+    if (strcmp(output_filename, "-") == 0 || output_filename[0] == '|') {
+        fprintf(stderr, "spectrum file not supported when writing to stdout or named pipes\n");
+        return -1;
+    }
+    if (generate_spectrum_filename(output_filename, ".spectrum", spectrum_filename, PATH_MAX) != 0) {
+        fprintf(stderr, "generate_spectrum_filename(%s) failed\n", output_filename);
+        return -1;
+    }
+    if (spectrum_image && generate_spectrum_filename(output_filename, ".pgm", image_filename, PATH_MAX) != 0) {
+        fprintf(stderr, "generate_spectrum_filename(%s) failed\n", output_filename);
+        return -1;
+    }
+
+    unsigned int size = spectrum_fft_size;
+    if (fft_init(&fft, size) == -1) {
+        return -1;
+    }
+    num_tuners = is_dual_tuner ? 2 : 1;
+    ring_channels = 2 * num_tuners;
+    size_t value_size = spectrum_format == SPECTRUM_FORMAT_FLOAT16 ? sizeof(uint16_t) : sizeof(uint8_t);
+    row_size = sizeof(SpectrumRowHeader) + num_tuners * size * value_size;
+    window = (float *)malloc(size * sizeof(float));
+    power_sum = (double *)calloc(num_tuners * size, sizeof(double));
+    samples = (short *)malloc(SPECTRUM_CHUNK_SAMPLES * ring_channels * sizeof(short));
+    row = (uint8_t *)malloc(row_size);
+    image_row = (uint8_t *)malloc(num_tuners * size);
+    if (window == NULL || power_sum == NULL || samples == NULL || row == NULL || image_row == NULL) {
+        fprintf(stderr, "malloc(spectrum buffers) failed\n");
+        return -1;
+    }
+    for (unsigned int tuner = 0; tuner < num_tuners; tuner++) {
+        frame_re[tuner] = (float *)malloc(size * sizeof(float));
+        frame_im[tuner] = (float *)malloc(size * sizeof(float));
+        if (frame_re[tuner] == NULL || frame_im[tuner] == NULL) {
+            fprintf(stderr, "malloc(spectrum buffers) failed\n");
+            return -1;
+        }
+    }
+
+    /* a full scale tone is 0 dBFS in its bin */
+    fft_hann_window(window, size);
+    double window_sum = 0.0;
+    for (unsigned int i = 0; i < size; i++) {
+        window_sum += window[i];
+    }
+    power_scale = 1.0 / (window_sum * window_sum * FULL_SCALE_14BIT * FULL_SCALE_14BIT);
+    frames_per_row = (unsigned int)(spectrum_interval * output_sample_rate / size + 0.5);
+    if (frames_per_row == 0) {
+        frames_per_row = 1;
+    }
+    frame_fill = 0;
+    is_frame_skipped = false;
+    row_frames = 0;
+    row_skipped_frames = 0;
+    row_sample_num = 0;
+    image_rows = 0;
+    is_spectrum_failed = false;
+    is_image_failed = false;
+
+    spectrum_fd = open(spectrum_filename, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, 0644);
+    if (spectrum_fd == -1) {
+        fprintf(stderr, "open(%s) for writing failed: %s\n", spectrum_filename, strerror(errno));
+        return -1;
+    }
+    /* the start time is filled in by spectrum_close() */
+    spectrum_header = (SpectrumHeader) {
+        .magic = {'R', 'S', 'P', 'S', 'P', 'E', 'C', 'T'},
+        .version = SPECTRUM_VERSION,
+        .header_size = sizeof(SpectrumHeader),
+        .format = spectrum_format,
+        .num_tuners = num_tuners,
+        .fft_size = size,
+        .row_size = row_size,
+        .frames_per_row = frames_per_row,
+        .unused = 0,
+        .sample_rate = output_sample_rate,
+        .frequency = {frequency_A, is_dual_tuner ? frequency_B : 0.0},
+        .range_low = spectrum_range_low,
+        .range_high = spectrum_range_high,
+        .start_time = 0,
+    };
+    if (write(spectrum_fd, &spectrum_header, sizeof(spectrum_header)) == -1) {
+        fprintf(stderr, "write() spectrum header failed: %s\n", strerror(errno));
+        return -1;
+    }
+    if (spectrum_image) {
+        image_fd = open(image_filename, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, 0644);
+        if (image_fd == -1) {
+            fprintf(stderr, "open(%s) for writing failed: %s\n", image_filename, strerror(errno));
+            return -1;
+        }
+        if (write_image_header() == -1) {
+            return -1;
+        }
+    }
+
+    ring_samples = spectrum_buffer_capacity;
+    ring = (short *)malloc(ring_samples * ring_channels * sizeof(short));
+    if (ring == NULL) {
+        fprintf(stderr, "malloc(spectrum buffer) failed\n");
+        return -1;
+    }
+    write_sample = 0;
+    read_sample = 0;
+    skipped_samples = 0;
+    first_gap = 0;
+    num_gaps = 0;
+    is_spectrum_stopping = false;
+
+    int errcode = pthread_create(&spectrum_thread, NULL, spectrum_worker_loop, NULL);
+    if (errcode != 0) {
+        fprintf(stderr, "pthread_create(spectrum worker) failed: %s\n", strerror(errcode));
+        return -1;
+    }
+    is_worker_running = true;
+    if (verbose) {
+        fprintf(stderr, "spectrum file: %s - %u points FFT, %u frames per row (%.3lfs)\n", spectrum_filename, size, frames_per_row, frames_per_row * size / output_sample_rate);
+    }
+    return 0;
+}
+
+/* called by the writer for each segment; a NULL tuner is filled with zeros */
+void spectrum_write(const short *const *xi, const short *const *xq, unsigned int nrx, size_t num_samples) {
+    if (!is_worker_running) {
+        return;
+    }
+    pthread_mutex_lock(&spectrum_lock);
+    for (size_t offset = 0; offset < num_samples; ) {
+        unsigned long long ring_index = (write_sample + offset) % ring_samples;
+        size_t n = num_samples - offset;
+        if (n > ring_samples - ring_index) {
+            n = ring_samples - ring_index;
+        }
+        for (unsigned int tuner = 0; tuner < nrx; tuner++) {
+            short *out = ring + ring_index * ring_channels + 2 * tuner;
+            if (xi[tuner] != NULL) {
+                const short *txi = xi[tuner] + offset;
+                const short *txq = xq[tuner] + offset;
+                for (size_t i = 0; i < n; i++, out += ring_channels) {
+                    out[0] = txi[i];
+                    out[1] = txq[i];
+                }
+            } else {
+                for (size_t i = 0; i < n; i++, out += ring_channels) {
+                    out[0] = 0;
+                    out[1] = 0;
+                }
+            }
+        }
+        offset += n;
+    }
+    write_sample += num_samples;
+
+    if (write_sample - read_sample > ring_samples) {
+        unsigned long long first_sample = write_sample - ring_samples;
+        unsigned long long dropped = first_sample - read_sample;
+        if (skipped_samples == 0) {
+            spectrum_stats.overruns++;
+        }
+        spectrum_stats.dropped_samples += dropped;
+        skipped_samples += dropped;
+        read_sample = first_sample;
+    }
+    pthread_cond_signal(&spectrum_data_ready);
+    pthread_mutex_unlock(&spectrum_lock);
+}
+
+/* a gap of dropped samples that is not in the recording */
+void spectrum_skip(unsigned long long num_samples) {
+    if (!is_worker_running) {
+        return;
+    }
+    pthread_mutex_lock(&spectrum_lock);
+    int last_gap = (first_gap + num_gaps - 1) % SPECTRUM_MAX_GAPS;
+    if (num_gaps > 0 && (gaps[last_gap].sample == write_sample || num_gaps == SPECTRUM_MAX_GAPS)) {
+        /* if there are too many gaps, they are merged with the last one */
+        gaps[last_gap].num_samples += num_samples;
+    } else {
+        int gap = (first_gap + num_gaps) % SPECTRUM_MAX_GAPS;
+        gaps[gap].sample = write_sample;
+        gaps[gap].num_samples = num_samples;
+        num_gaps++;
+    }
+    pthread_cond_signal(&spectrum_data_ready);
+    pthread_mutex_unlock(&spectrum_lock);
+}
+
+/* end of streaming: the worker processes what is left in the ring */
+void spectrum_finish() {
+    if (!is_worker_running) {
+        return;
+    }
+    pthread_mutex_lock(&spectrum_lock);
+    is_spectrum_stopping = true;
+    pthread_cond_signal(&spectrum_data_ready);
+    pthread_mutex_unlock(&spectrum_lock);
+    pthread_join(spectrum_thread, NULL);
+    is_worker_running = false;
+}
+
+void spectrum_close() {
+    spectrum_finish();
+    if (spectrum_fd != -1) {
+        spectrum_header.start_time = timeinfo.start_ts.tv_sec * 1000000000LL + timeinfo.start_ts.tv_nsec;
+        if (lseek(spectrum_fd, 0, SEEK_SET) == -1 || write(spectrum_fd, &spectrum_header, sizeof(spectrum_header)) == -1) {
+            fprintf(stderr, "update spectrum header failed: %s\n", strerror(errno));
+        }
+        close(spectrum_fd);
+        spectrum_fd = -1;
+    }
+    if (image_fd != -1) {
+        if (lseek(image_fd, 0, SEEK_SET) == -1 || write_image_header() == -1) {
+            fprintf(stderr, "update spectrum image header failed: %s\n", strerror(errno));
+        }
+        close(image_fd);
+        image_fd = -1;
+    }
+    fft_free(&fft);
+    free(window);
+    window = NULL;
+    free(power_sum);
+    power_sum = NULL;
+    for (int tuner = 0; tuner < 2; tuner++) {
+        free(frame_re[tuner]);
+        frame_re[tuner] = NULL;
+        free(frame_im[tuner]);
+        frame_im[tuner] = NULL;
+    }
+    free(samples);
+    samples = NULL;
+    free(row);
+    row = NULL;
+    free(image_row);
+    image_row = NULL;
+    free(ring);
+    ring = NULL;
+}
+
+/* internal functions */
+static int generate_spectrum_filename(const char *output_filename, const char *extension, char *filename, int filename_max_size) {
+    const char *p = strrchr(output_filename, '.');
+    const char *sep = strrchr(output_filename, '/');
+    const char *sep2 = strrchr(output_filename, '\\');
+    if (sep2 > sep)
+        sep = sep2;
+    if (p == NULL || (sep != NULL && p < sep))
+        p = output_filename + strlen(output_filename);
+    size_t sz = (size_t)(p - output_filename);
+    size_t extension_size = strlen(extension) + 1;
+    if (sz + extension_size > (size_t)filename_max_size)
+        return -1;
+    memcpy(filename, output_filename, sz);
+    memcpy(filename + sz, extension, extension_size);
+    return 0;
+}
+
+/* binary PGM; the height is padded so that the header can be rewritten
+ * in place with the final number of rows
+ */
+static int write_image_header() {
+    char image_header[64];
+    int n = snprintf(image_header, sizeof(image_header), "P5\n%u %10llu\n255\n", num_tuners * spectrum_fft_size, image_rows);
+    if (write(image_fd, image_header, n) == -1) {
+        fprintf(stderr, "write() spectrum image header failed: %s\n", strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+static void *spectrum_worker_loop(void *arg) {
+    (void)arg;
+    pthread_mutex_lock(&spectrum_lock);
+    for (;;) {
+        bool has_gap = num_gaps > 0 && gaps[first_gap].sample <= read_sample;
+        while (read_sample == write_sample && !has_gap && !is_spectrum_stopping) {
+            pthread_cond_wait(&spectrum_data_ready, &spectrum_lock);
+            has_gap = num_gaps > 0 && gaps[first_gap].sample <= read_sample;
+        }
+        if (read_sample == write_sample && !has_gap) {
+            break;
+        }
+        unsigned long long num_skipped = skipped_samples;
+        skipped_samples = 0;
+        while (num_gaps > 0 && gaps[first_gap].sample <= read_sample) {
+            num_skipped += gaps[first_gap].num_samples;
+            first_gap = (first_gap + 1) % SPECTRUM_MAX_GAPS;
+            num_gaps--;
+        }
+        unsigned long long ring_index = read_sample % ring_samples;
+        size_t n = write_sample - read_sample;
+        if (n > SPECTRUM_CHUNK_SAMPLES) {
+            n = SPECTRUM_CHUNK_SAMPLES;
+        }
+        if (n > ring_samples - ring_index) {
+            n = ring_samples - ring_index;
+        }
+        if (num_gaps > 0 && gaps[first_gap].sample - read_sample < n) {
+            n = gaps[first_gap].sample - read_sample;
+        }
+        memcpy(samples, ring + ring_index * ring_channels, n * ring_channels * sizeof(short));
+        read_sample += n;
+        pthread_mutex_unlock(&spectrum_lock);
+
+        spectrum_skip_frames(num_skipped);
+        spectrum_process(samples, n);
+
+        pthread_mutex_lock(&spectrum_lock);
+    }
+    pthread_mutex_unlock(&spectrum_lock);
+
+    /* the last row can be shorter than the others */
+    if (row_frames + row_skipped_frames > 0) {
+        spectrum_write_row();
+    }
+    return NULL;
+}
+
+static void spectrum_skip_frames(unsigned long long num_samples) {
+    while (num_samples > 0) {
+        unsigned int n = spectrum_fft_size - frame_fill;
+        if (num_samples < n) {
+            n = (unsigned int)num_samples;
+        }
+        frame_fill += n;
+        num_samples -= n;
+        is_frame_skipped = true;
+        if (frame_fill == spectrum_fft_size) {
+            spectrum_end_frame();
+        }
+    }
+}
+
+static void spectrum_process(const short *samples, size_t num_samples) {
+    size_t offset = 0;
+    while (offset < num_samples) {
+        size_t n = spectrum_fft_size - frame_fill;
+        if (n > num_samples - offset) {
+            n = num_samples - offset;
+        }
+        for (unsigned int tuner = 0; tuner < num_tuners; tuner++) {
+            const short *in = samples + offset * ring_channels + 2 * tuner;
+            float *re = frame_re[tuner] + frame_fill;
+            float *im = frame_im[tuner] + frame_fill;
+            const float *w = window + frame_fill;
+            for (size_t i = 0; i < n; i++, in += ring_channels) {
+                re[i] = in[0] * w[i];
+                im[i] = in[1] * w[i];
+            }
+        }
+        frame_fill += n;
+        offset += n;
+        if (frame_fill == spectrum_fft_size) {
+            spectrum_end_frame();
+        }
+    }
+}
+
+static void spectrum_end_frame() {
+    unsigned int size = spectrum_fft_size;
+    if (is_frame_skipped) {
+        row_skipped_frames++;
+        spectrum_stats.skipped_frames++;
+    } else {
+        for (unsigned int tuner = 0; tuner < num_tuners; tuner++) {
+            float *re = frame_re[tuner];
+            float *im = frame_im[tuner];
+            double *power = power_sum + tuner * size;
+            fft_forward(&fft, re, im);
+            for (unsigned int k = 0; k < size; k++) {
+                power[k] += re[k] * re[k] + im[k] * im[k];
+            }
+        }
+        row_frames++;
+        spectrum_stats.frames++;
+    }
+    frame_fill = 0;
+    is_frame_skipped = false;
+    if (row_frames + row_skipped_frames == frames_per_row) {
+        spectrum_write_row();
+    }
+}
+
+/* the bins go from the lowest to the highest frequency: bin j is at
+ * center frequency + (j - fft size / 2) * sample rate / fft size
+ */
+static void spectrum_write_row() {
+    unsigned int size = spectrum_fft_size;
+    unsigned int half = size / 2;
+    double range = spectrum_range_high - spectrum_range_low;
+    uint16_t *values16 = (uint16_t *)(row + sizeof(SpectrumRowHeader));
+    uint8_t *values8 = row + sizeof(SpectrumRowHeader);
+    for (unsigned int tuner = 0; tuner < num_tuners; tuner++) {
+        const double *power = power_sum + tuner * size;
+        for (unsigned int j = 0; j < size; j++) {
+            unsigned int k = (j + size - half) % size;
+            unsigned int index = tuner * size + j;
+            uint8_t pixel = 0;
+            float db = NAN;
+            if (row_frames > 0) {
+                db = (float)(10.0 * log10(power[k] / row_frames * power_scale + SPECTRUM_POWER_FLOOR));
+                double level = (db - spectrum_range_low) / range * 255.0 + 0.5;
+                pixel = level <= 0.0 ? 0 : level >= 255.0 ? 255 : (uint8_t)level;
+            }
+            image_row[index] = pixel;
+            if (spectrum_format == SPECTRUM_FORMAT_FLOAT16) {
+                values16[index] = row_frames > 0 ? float_to_half(db) : SPECTRUM_FLOAT16_NAN;
+            } else {
+                values8[index] = pixel;
+            }
+        }
+    }
+    long long start_ns = timeinfo.start_ts.tv_sec * 1000000000LL + timeinfo.start_ts.tv_nsec;
+    SpectrumRowHeader row_header = {
+        .sample_num = row_sample_num,
+        .timestamp = start_ns + (long long)(row_sample_num / output_sample_rate * 1e9 + 0.5),
+        .frames = row_frames,
+        .skipped_frames = row_skipped_frames,
+    };
+    memcpy(row, &row_header, sizeof(row_header));
+    if (!is_spectrum_failed) {
+        if (write(spectrum_fd, row, row_size) == -1) {
+            fprintf(stderr, "write() spectrum row failed: %s - no more rows will be written\n", strerror(errno));
+            is_spectrum_failed = true;
+        }
+    }
+    if (image_fd != -1 && !is_image_failed) {
+        if (write(image_fd, image_row, num_tuners * size) == -1) {
+            fprintf(stderr, "write() spectrum image row failed: %s - no more rows will be written\n", strerror(errno));
+            is_image_failed = true;
+        } else {
+            image_rows++;
+        }
+    }
+    spectrum_stats.rows++;
+
+    row_sample_num += (unsigned long long)(row_frames + row_skipped_frames) * size;
+    row_frames = 0;
+    row_skipped_frames = 0;
+    memset(power_sum, 0, num_tuners * size * sizeof(double));
+}
+
+/* IEEE 754 half precision, round to nearest (the dBFS values are always
+ * well inside the normal range)
+ */
+static uint16_t float_to_half(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    uint16_t sign = (bits >> 16) & 0x8000;
+    int exponent = (int)((bits >> 23) & 0xff) - 127 + 15;
+    uint32_t mantissa = bits & 0x7fffff;
+    if (((bits >> 23) & 0xff) == 0xff) {
+        return sign | 0x7c00 | (mantissa != 0 ? 0x200 : 0);
+    }
+    if (exponent >= 31) {
+        return sign | 0x7c00;
+    }
+    if (exponent <= 0) {
+        if (exponent < -10) {
+            return sign;
+        }
+        mantissa |= 0x800000;
+        unsigned int shift = 14 - exponent;
+        uint16_t half = mantissa >> shift;
+        if ((mantissa >> (shift - 1)) & 1) {
+            half++;
+        }
+        return sign | half;
+    }
+    uint16_t half = sign | (exponent << 10) | (mantissa >> 13);
+    if (mantissa & 0x1000) {
+        half++;
+    }
+    return half;
+}
@@ -0,0 +1,58 @@
+/* record to file the I/Q stream(s) from a SDRplay RSP
+ * spectrum (PSD/waterfall) file
+ *
+ * Copyright 2025 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef _SPECTRUM_H
+#define _SPECTRUM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* typedefs */
+typedef struct {
+    char magic[8];              /* "RSPSPECT" */
+    uint16_t version;
+    uint16_t header_size;
+    uint16_t format;            /* 1: float16, 2: uint8 */
+    uint16_t num_tuners;
+    uint32_t fft_size;
+    uint32_t row_size;          /* bytes, including the row header */
+    uint32_t frames_per_row;
+    uint32_t unused;
+    double sample_rate;
+    double frequency[2];        /* tuner A, tuner B */
+    float range_low;            /* dBFS for the uint8 value 0 */
+    float range_high;           /* dBFS for the uint8 value 255 */
+    int64_t start_time;         /* UTC time in ns since the epoch */
+} SpectrumHeader;
+
+typedef struct {
+    uint64_t sample_num;        /* first sample of the row (gaps included) */
+    int64_t timestamp;          /* UTC time in ns since the epoch */
+    uint32_t frames;            /* FFT frames in the average */
+    uint32_t skipped_frames;    /* FFT frames not in the average */
+} SpectrumRowHeader;
+
+typedef struct {
+    unsigned long long rows;
+    unsigned long long frames;
+    unsigned long long skipped_frames;
+    unsigned long long dropped_samples;
+    unsigned long long overruns;
+} SpectrumStats;
+
+/* global variables */
+extern SpectrumStats spectrum_stats;
+
+/* public functions */
+int spectrum_open(const char *output_filename);
+void spectrum_write(const short *const *xi, const short *const *xq, unsigned int nrx, size_t num_samples);
+void spectrum_skip(unsigned long long num_samples);
+void spectrum_finish();
+void spectrum_close();
+
+#endif /* _SPECTRUM_H */
@@ -7,8 +7,19 @@
  */
 
 #include "callbacks.h"
+#include "channelizer.h"
+#include "ddc.h"
+#include "decimator.h"
+#include "diversity.h"
+#include "output.h"
+#include "power-detector.h"
 #include "sdrplay-rsp.h"
+#include "shm-output.h"
+#include "spectrum.h"
 #include "stats.h"
+#include "tcp-server.h"
+#include "tee.h"
+#include "trigger.h"
 
 #include <limits.h>
 #include <math.h>
@@ -24,6 +35,56 @@ Stats stats = {
     .full_writes = 0,
     .partial_writes = 0,
     .zero_writes = 0,
+    .pipe_size = 0,
+    .zero_copy_writes = 0,
+    .header_checkpoints = 0,
+    .resync_events = 0,
+    .resync_zero_filled_samples = 0,
+    .resync_trimmed_samples = 0,
+    .compression_input_bytes = 0,
+    .compression_output_bytes = 0,
+    .compression_encode_elapsed = 0,
+    .compression_blocks = 0,
+    .compression_verbatim_blocks = 0,
+    .compression_verify_errors = 0,
+    .bfp_blocks = 0,
+    .bfp_values = 0,
+    .bfp_error_energy = 0.0,
+    .bfp_noise_floor = 0.0,
+    .conversion_input_bytes = 0,
+    .conversion_elapsed = 0,
+    .conversion_clipped_values = 0,
+};
+
+/* output file for tuner B (one file per tuner mode only) */
+Stats stats_B = {
+    .data_size = 0,
+    .output_samples = 0,
+    .total_writes = 0,
+    .total_write_elapsed = 0,
+    .max_write_elapsed = 0,
+    .full_writes = 0,
+    .partial_writes = 0,
+    .zero_writes = 0,
+    .pipe_size = 0,
+    .zero_copy_writes = 0,
+    .header_checkpoints = 0,
+    .resync_events = 0,
+    .resync_zero_filled_samples = 0,
+    .resync_trimmed_samples = 0,
+    .compression_input_bytes = 0,
+    .compression_output_bytes = 0,
+    .compression_encode_elapsed = 0,
+    .compression_blocks = 0,
+    .compression_verbatim_blocks = 0,
+    .compression_verify_errors = 0,
+    .bfp_blocks = 0,
+    .bfp_values = 0,
+    .bfp_error_energy = 0.0,
+    .bfp_noise_floor = 0.0,
+    .conversion_input_bytes = 0,
+    .conversion_elapsed = 0,
+    .conversion_clipped_values = 0,
 };
 
 RXStats rx_stats_A = {
@@ -37,6 +98,8 @@ RXStats rx_stats_A = {
     .imax = SHRT_MIN,
     .qmin = SHRT_MAX,
     .qmax = SHRT_MIN,
+    .clipped_values = 0,
+    .near_full_scale_values = 0,
 };
 RXStats rx_stats_B = {
     .earliest_callback = {0, 0},
@@ -49,10 +112,13 @@ RXStats rx_stats_B = {
     .imax = SHRT_MIN,
     .qmin = SHRT_MAX,
     .qmax = SHRT_MIN,
+    .clipped_values = 0,
+    .near_full_scale_values = 0,
 };
 
 /* internal functions */
 double get_dynamic_range(short imin, short imax, short qmin, short qmax);
+static void print_write_stats(const Stats *output_stats, const char *prefix);
 
 
 int print_stats() {
@@ -68,8 +134,13 @@ int print_stats() {
         fprintf(stderr, "I samples range = [%hd,%hd]\n", rx_stats_A.imin, rx_stats_A.imax);
         fprintf(stderr, "Q samples range = [%hd,%hd]\n", rx_stats_A.qmin, rx_stats_A.qmax);
         fprintf(stderr, "I/Q dynamic range = %.1lf dBFS\n", get_dynamic_range(rx_stats_A.imin, rx_stats_A.imax, rx_stats_A.qmin, rx_stats_A.qmax));
+        fprintf(stderr, "I/Q clipped values = %llu\n", rx_stats_A.clipped_values);
+        fprintf(stderr, "I/Q values near full scale = %llu\n", rx_stats_A.near_full_scale_values);
         fprintf(stderr, "samples per rx_callback range = [%u,%u]\n", rx_stats_A.num_samples_min, rx_stats_A.num_samples_max);
         fprintf(stderr, "output samples = %llu\n", stats.output_samples);
+        if (decimator_input_sample_rate > 0.0) {
+            fprintf(stderr, "software decimation clipped values = %llu\n", decimator_stats[0].clipped_values);
+        }
         fprintf(stderr, "power overload detected events = %llu\n", num_power_overload_detected[0]);
         fprintf(stderr, "power overload corrected events = %llu\n", num_power_overload_corrected[0]);
         fprintf(stderr, "gain changes = %llu\n", num_gain_changes[0]);
@@ -89,27 +160,177 @@ int print_stats() {
         fprintf(stderr, "I/Q dynamic range = %.1lf dBFS / %.1lf dBFS\n",
             get_dynamic_range(rx_stats_A.imin, rx_stats_A.imax, rx_stats_A.qmin, rx_stats_A.qmax),
             get_dynamic_range(rx_stats_B.imin, rx_stats_B.imax, rx_stats_B.qmin, rx_stats_B.qmax));
+        fprintf(stderr, "I/Q clipped values = %llu / %llu\n", rx_stats_A.clipped_values, rx_stats_B.clipped_values);
+        fprintf(stderr, "I/Q values near full scale = %llu / %llu\n", rx_stats_A.near_full_scale_values, rx_stats_B.near_full_scale_values);
         fprintf(stderr, "samples per rx_callback range = [%u,%u] / [%u,%u]\n", rx_stats_A.num_samples_min, rx_stats_A.num_samples_max, rx_stats_B.num_samples_min, rx_stats_B.num_samples_max);
-        fprintf(stderr, "output samples = %llu (x2)\n", stats.output_samples);
+        if (num_output_files == 2) {
+            fprintf(stderr, "output samples = %llu / %llu\n", stats.output_samples, stats_B.output_samples);
+        } else if (diversity_combining != DIVERSITY_COMBINING_NONE) {
+            fprintf(stderr, "output samples = %llu (combined)\n", stats.output_samples);
+        } else {
+            fprintf(stderr, "output samples = %llu (x2)\n", stats.output_samples);
+        }
+        if (decimator_input_sample_rate > 0.0) {
+            fprintf(stderr, "software decimation clipped values = %llu / %llu\n", decimator_stats[0].clipped_values, decimator_stats[1].clipped_values);
+        }
         fprintf(stderr, "power overload detected events = %llu / %llu\n", num_power_overload_detected[0], num_power_overload_detected[1]);
         fprintf(stderr, "power overload corrected events = %llu / %llu\n", num_power_overload_corrected[0], num_power_overload_corrected[1]);
         fprintf(stderr, "gain changes = %llu / %llu\n", num_gain_changes[0], num_gain_changes[1]);
+        if (diversity_combining != DIVERSITY_COMBINING_NONE) {
+            fprintf(stderr, "diversity combining blocks = %llu\n", diversity_stats.blocks);
+            if (diversity_combining == DIVERSITY_COMBINING_SELECTION) {
+                fprintf(stderr, "diversity combining tuner B selected blocks = %llu\n", diversity_stats.tuner_B_blocks);
+            }
+        }
+        fprintf(stderr, "tuners resync events = %llu\n", stats.resync_events);
+        fprintf(stderr, "tuners resync zero filled samples = %llu\n", stats.resync_zero_filled_samples);
+        fprintf(stderr, "tuners resync trimmed samples = %llu\n", stats.resync_trimmed_samples);
+    }
+    if (num_output_files == 2) {
+        fprintf(stderr, "data size = %llu / %llu\n", stats.data_size, stats_B.data_size);
+    } else {
+        fprintf(stderr, "data size = %llu\n", stats.data_size);
+    }
+    if (!is_dual_tuner) {
+        fprintf(stderr, "blocks buffer usage = %u/%u\n", blocks_resource_A.nused_max, blocks_resource_A.size);
+        fprintf(stderr, "samples buffer usage = %u/%u\n", samples_resource_A.nused_max, samples_resource_A.size);
+    } else {
+        fprintf(stderr, "blocks buffer usage = %u/%u / %u/%u\n", blocks_resource_A.nused_max, blocks_resource_A.size, blocks_resource_B.nused_max, blocks_resource_B.size);
+        fprintf(stderr, "samples buffer usage = %u/%u / %u/%u\n", samples_resource_A.nused_max, samples_resource_A.size, samples_resource_B.nused_max, samples_resource_B.size);
+    }
+    if (timeinfo.markers_first != NULL) {
+        fprintf(stderr, "time markers = %llu\n", timeinfo.num_markers);
+        if (timeinfo.markers_lost > 0) {
+            fprintf(stderr, "time markers lost = %llu\n", timeinfo.markers_lost);
+        }
+    }
+    print_write_stats(&stats, num_output_files == 2 ? "A " : "");
+    if (num_output_files == 2) {
+        print_write_stats(&stats_B, "B ");
+    }
+    if (shm_output_name != NULL) {
+        fprintf(stderr, "shared memory output samples = %llu\n", shm_output_samples);
+    }
+    if (trigger_mode) {
+        fprintf(stderr, "triggers = %llu\n", trigger_stats.triggers);
+        fprintf(stderr, "merged triggers = %llu\n", trigger_stats.merged_triggers);
+        fprintf(stderr, "triggered recordings = %llu\n", trigger_stats.recordings);
+        fprintf(stderr, "triggered recordings samples = %llu\n", trigger_stats.samples);
+    }
+    if (power_detector_enable) {
+        fprintf(stderr, "power detector starts = %llu\n", power_detector_stats.starts);
+        fprintf(stderr, "power detector stops = %llu\n", power_detector_stats.stops);
+        fprintf(stderr, "power detector baseline = %.1lfdBFS\n", power_detector_stats.baseline);
+        fprintf(stderr, "power detector max level = %.1lfdBFS\n", power_detector_stats.max_level);
+    }
+    if (tcp_server_address != NULL) {
+        fprintf(stderr, "TCP server clients = %llu\n", tcp_server_stats.clients);
+        fprintf(stderr, "TCP server bytes sent = %llu\n", tcp_server_stats.bytes_sent);
+        fprintf(stderr, "TCP server dropped samples = %llu\n", tcp_server_stats.dropped_samples);
+        fprintf(stderr, "TCP server commands = %llu\n", tcp_server_stats.commands);
+    }
+    for (int i = 0; i < num_tee_sinks; i++) {
+        const TeeSink *sink = &tee_sinks[i];
+        char prefix[16];
+        snprintf(prefix, sizeof(prefix), "tee %d ", i + 1);
+        fprintf(stderr, "%soutput samples = %llu\n", prefix, sink->stats.output_samples);
+        fprintf(stderr, "%sdropped samples = %llu\n", prefix, sink->dropped_samples);
+        fprintf(stderr, "%soverruns = %llu\n", prefix, sink->overruns);
+        print_write_stats(&sink->stats, prefix);
+    }
+    for (int i = 0; i < num_ddc_outputs; i++) {
+        const DdcChannel *channel = &ddc_channels[i];
+        char prefix[32];
+        snprintf(prefix, sizeof(prefix), "DDC %.0lfHz ", channel->frequency);
+        fprintf(stderr, "%soutput samples = %llu\n", prefix, channel->stats.output_samples);
+        if (channel->clipped_values > 0) {
+            fprintf(stderr, "%sclipped values = %llu\n", prefix, channel->clipped_values);
+        }
+        print_write_stats(&channel->stats, prefix);
+    }
+    if (num_ddc_outputs > 0) {
+        fprintf(stderr, "DDC dropped samples = %llu\n", ddc_stats.dropped_samples);
+        fprintf(stderr, "DDC overruns = %llu\n", ddc_stats.overruns);
+    }
+    for (int i = 0; i < num_channelizer_tuners; i++) {
+        const ChannelizerTuner *ct = &channelizer_tuners[i];
+        char prefix[32];
+        snprintf(prefix, sizeof(prefix), "channelizer %c ", 'A' + ct->tuner);
+        fprintf(stderr, "%schannels = %d\n", prefix, ct->num_channels);
+        fprintf(stderr, "%soutput samples = %llu\n", prefix, ct->output_samples);
+        if (ct->clipped_values > 0) {
+            fprintf(stderr, "%sclipped values = %llu\n", prefix, ct->clipped_values);
+        }
+        if (ct->multichannel_output.stats != NULL) {
+            print_write_stats(&ct->multichannel_stats, prefix);
+        }
+    }
+    if (num_channelizer_tuners > 0) {
+        fprintf(stderr, "channelizer dropped samples = %llu\n", channelizer_stats.dropped_samples);
+        fprintf(stderr, "channelizer overruns = %llu\n", channelizer_stats.overruns);
+    }
+    if (spectrum_file_enable) {
+        fprintf(stderr, "spectrum rows = %llu\n", spectrum_stats.rows);
+        fprintf(stderr, "spectrum frames = %llu\n", spectrum_stats.frames);
+        fprintf(stderr, "spectrum skipped frames = %llu\n", spectrum_stats.skipped_frames);
+        fprintf(stderr, "spectrum dropped samples = %llu\n", spectrum_stats.dropped_samples);
+        fprintf(stderr, "spectrum overruns = %llu\n", spectrum_stats.overruns);
     }
-    fprintf(stderr, "data size = %llu\n", stats.data_size);
-    fprintf(stderr, "blocks buffer usage = %u/%u\n", blocks_resource.nused_max, blocks_resource.size);
-    fprintf(stderr, "samples buffer usage = %u/%u\n", samples_resource.nused_max, samples_resource.size);
-    unsigned long long average_write_elapsed = stats.total_write_elapsed / stats.total_writes;
-    fprintf(stderr, "average write elapsed = %llu.%09llu\n", average_write_elapsed / 1000000000ULL, average_write_elapsed % 1000000000ULL);
-    fprintf(stderr, "max write elapsed = %llu.%09llu\n", stats.max_write_elapsed / 1000000000ULL, stats.max_write_elapsed % 1000000000ULL);
-    fprintf(stderr, "total writes = %llu\n", stats.total_writes);
-    fprintf(stderr, "full writes = %llu\n", stats.full_writes);
-    fprintf(stderr, "partial writes = %llu\n", stats.partial_writes);
-    fprintf(stderr, "zero writes = %llu\n", stats.zero_writes);
 
     return 0;
 }
 
 /* internal functions */
+static void print_write_stats(const Stats *output_stats, const char *prefix) {
+    unsigned long long average_write_elapsed = output_stats->total_writes > 0 ? output_stats->total_write_elapsed / output_stats->total_writes : 0;
+    fprintf(stderr, "%saverage write elapsed = %llu.%09llu\n", prefix, average_write_elapsed / 1000000000ULL, average_write_elapsed % 1000000000ULL);
+    fprintf(stderr, "%smax write elapsed = %llu.%09llu\n", prefix, output_stats->max_write_elapsed / 1000000000ULL, output_stats->max_write_elapsed % 1000000000ULL);
+    fprintf(stderr, "%stotal writes = %llu\n", prefix, output_stats->total_writes);
+    fprintf(stderr, "%sfull writes = %llu\n", prefix, output_stats->full_writes);
+    fprintf(stderr, "%spartial writes = %llu\n", prefix, output_stats->partial_writes);
+    fprintf(stderr, "%szero writes = %llu\n", prefix, output_stats->zero_writes);
+    if (output_stats->pipe_size > 0) {
+        fprintf(stderr, "%spipe size = %llu\n", prefix, output_stats->pipe_size);
+        fprintf(stderr, "%szero copy writes = %llu\n", prefix, output_stats->zero_copy_writes);
+    }
+    if (output_stats->header_checkpoints > 0) {
+        fprintf(stderr, "%sheader checkpoints = %llu\n", prefix, output_stats->header_checkpoints);
+    }
+    if (output_stats->compression_blocks > 0) {
+        double compression_ratio = output_stats->compression_output_bytes > 0 ? (double)output_stats->compression_input_bytes / output_stats->compression_output_bytes : 0.0;
+        double encoder_throughput = output_stats->compression_encode_elapsed > 0 ? output_stats->compression_input_bytes * 1e3 / output_stats->compression_encode_elapsed : 0.0;
+        fprintf(stderr, "%scompression ratio = %.3lf\n", prefix, compression_ratio);
+        fprintf(stderr, "%sencoder throughput = %.1lf MB/s (per thread)\n", prefix, encoder_throughput);
+        fprintf(stderr, "%scompressed blocks = %llu\n", prefix, output_stats->compression_blocks);
+        if (output_stats->compression_verbatim_blocks > 0) {
+            fprintf(stderr, "%sblocks stored uncompressed = %llu\n", prefix, output_stats->compression_verbatim_blocks);
+        }
+        if (output_stats->compression_verify_errors > 0) {
+            fprintf(stderr, "%scompression verify errors = %llu\n", prefix, output_stats->compression_verify_errors);
+        }
+    }
+    if (output_stats->bfp_blocks > 0) {
+        /* powers relative to a full scale sine wave */
+        double full_scale_power = (double)SHRT_MAX * SHRT_MAX / 2.0;
+        double quantization_noise = output_stats->bfp_error_energy / output_stats->bfp_values;
+        fprintf(stderr, "%sBFP8 blocks = %llu\n", prefix, output_stats->bfp_blocks);
+        if (quantization_noise > 0.0 && output_stats->bfp_noise_floor > 0.0) {
+            double quantization_noise_dBFS = 10.0 * log10(quantization_noise / full_scale_power);
+            double noise_floor_dBFS = 10.0 * log10(output_stats->bfp_noise_floor / full_scale_power);
+            fprintf(stderr, "%sBFP8 quantization noise = %.1lf dBFS\n", prefix, quantization_noise_dBFS);
+            fprintf(stderr, "%sBFP8 noise floor (quietest block) = %.1lf dBFS\n", prefix, noise_floor_dBFS);
+            fprintf(stderr, "%sBFP8 quantization noise below noise floor = %.1lf dB\n", prefix, noise_floor_dBFS - quantization_noise_dBFS);
+        } else {
+            fprintf(stderr, "%sBFP8 quantization noise = none\n", prefix);
+        }
+    }
+    if (output_stats->conversion_input_bytes > 0) {
+        double conversion_throughput = output_stats->conversion_elapsed > 0 ? output_stats->conversion_input_bytes * 1e3 / output_stats->conversion_elapsed : 0.0;
+        fprintf(stderr, "%ssample conversion throughput = %.1lf MB/s\n", prefix, conversion_throughput);
+        fprintf(stderr, "%ssample conversion clipped values = %llu\n", prefix, output_stats->conversion_clipped_values);
+    }
+}
+
 double get_dynamic_range(short imin, short imax, short qmin, short qmax) {
     double iq_over_fs_max = 0.0;
     if (imin < 0) {
@@ -9,6 +9,8 @@
 #ifndef _STATS_H
 #define _STATS_H
 
+#include <time.h>
+
 /* typedefs */
 typedef struct {
     unsigned long long data_size;
@@ -19,6 +21,25 @@ typedef struct {
     unsigned long long full_writes;
     unsigned long long partial_writes;
     unsigned long long zero_writes;
+    unsigned long long pipe_size;
+    unsigned long long zero_copy_writes;
+    unsigned long long header_checkpoints;
+    unsigned long long resync_events;
+    unsigned long long resync_zero_filled_samples;
+    unsigned long long resync_trimmed_samples;
+    unsigned long long compression_input_bytes;
+    unsigned long long compression_output_bytes;    /* compressed payload (no headers, index, or trailer) */
+    unsigned long long compression_encode_elapsed;
+    unsigned long long compression_blocks;
+    unsigned long long compression_verbatim_blocks;
+    unsigned long long compression_verify_errors;
+    unsigned long long bfp_blocks;
+    unsigned long long bfp_values;
+    double bfp_error_energy;            /* quantization error */
+    double bfp_noise_floor;             /* power of the quietest block */
+    unsigned long long conversion_input_bytes;
+    unsigned long long conversion_elapsed;
+    unsigned long long conversion_clipped_values;
 } Stats;
 
 typedef struct {
@@ -32,10 +53,13 @@ typedef struct {
     short imax;
     short qmin;
     short qmax;
+    unsigned long long clipped_values;
+    unsigned long long near_full_scale_values;
 } RXStats;
 
 /* global variables */
 extern Stats stats;
+extern Stats stats_B;
 extern RXStats rx_stats_A;
 extern RXStats rx_stats_B;
 
@@ -9,6 +9,7 @@
 #include <errno.h>
 #include <limits.h>
 #include <signal.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <string.h>
 #include <time.h>
@@ -19,25 +20,97 @@
 #endif /* WIN32 */
 
 #include "buffers.h"
+#include "channelizer.h"
+#include "compressor.h"
 #include "config.h"
+#include "ddc.h"
+#include "decimator.h"
+#include "diversity.h"
+#include "envelope.h"
+#include "index.h"
 #include "output.h"
+#include "overload-map.h"
+#include "power-detector.h"
+#include "sample-format.h"
 #include "sdrplay-rsp.h"
+#include "shm-output.h"
+#include "sigmf.h"
+#include "spectrum.h"
 #include "stats.h"
 #include "streaming.h"
+#include "tcp-server.h"
+#include "tee.h"
+#include "trigger.h"
 
 #define UNUSED(x) (void)(x)
 
+/* in dual tuner mode, if one tuner has this many blocks waiting and the
+ * other tuner has none, stop waiting and zero fill the missing side
+ */
+#define RESYNC_MAX_PENDING_BLOCKS 8
+
+/* typedefs */
+typedef struct {
+    char rx_id;
+    ResourceDescriptor *blocks_resource;
+    ResourceDescriptor *samples_resource;
+    OutputFile *output;         /* output file of the writer of this tuner */
+    BlockDescriptor *block;     /* block being consumed (NULL if none) */
+    unsigned int offset;        /* samples of the current block already consumed */
+    bool finished;              /* end of streaming block received */
+    /* event counters of the last block written (see output_block_events) */
+    unsigned int gain_changes;
+    unsigned int overload_detected;
+    unsigned int overload_corrected;
+} TunerCursor;
+
+typedef struct {
+    unsigned int first_sample_num;
+    unsigned int num_samples;
+    const short *xi[2];         /* NULL means this tuner has no data - fill with zeros */
+    const short *xq[2];
+    unsigned int consumed[2];   /* samples to consume from each tuner after output */
+    const BlockDescriptor *first_block[2];      /* block starting with this segment (NULL if none) */
+} SampleSegment;
+
+/* each writer interleaves the samples from one or two tuners into
+ * its own output file; in one file per tuner mode there are two writers,
+ * each running in its own thread
+ */
+typedef struct {
+    TunerCursor *cursors[2];
+    unsigned int nrx;
+    OutputFile *output;
+    unsigned int next_sample_num;
+    bool is_resyncing;          /* dual tuner: the tuners are out of sync */
+    bool output_gains;
+} Writer;
+
 // perhaps we need a mutex around streaming_status
 StreamingStatus streaming_status = STREAMING_STATUS_STARTING;
 
+static unsigned int writers_running = 0;
+
 /* internal functions */
 static void signal_handler(int signum);
 #ifdef WIN32
 static VOID CALLBACK windows_timer_handler(PVOID lpParam, BOOLEAN TimerOrWaitFired);
 #endif /* WIN32 */
-static int next_block_descriptor_single(BlockDescriptor **pBlock);
-static int next_block_descriptors_dual(BlockDescriptor **pBlockA, BlockDescriptor **pBlockB);
-static int write_buffer(const uint8_t *buf, size_t count);
+static void *writer_loop(void *arg);
+static bool is_segment_ready(Writer *writer);
+static unsigned int tuner_cursor_pending(TunerCursor *cursor);
+static int tuner_cursor_fetch(TunerCursor *cursor);
+static void tuner_cursor_consume(TunerCursor *cursor, unsigned int num_samples);
+static void tuner_cursor_set_segment(TunerCursor *cursor, int tuner, unsigned int num_samples, SampleSegment *segment);
+static int next_segment_single(TunerCursor *cursor, SampleSegment *segment);
+static int next_segment_dual(Writer *writer, SampleSegment *segment);
+static int output_segment(Writer *writer, const SampleSegment *segment);
+static int write_decimated(Writer *writer, const short *const *xi, const short *const *xq, unsigned int num_samples);
+static int write_samples(Writer *writer, const short *const *xi, const short *const *xq, unsigned int num_samples);
+static int write_combined(Writer *writer, const short *const *xi, const short *const *xq, unsigned int num_samples);
+static int write_output(OutputFile *output, const short *const *xi, const short *const *xq, unsigned int nrx, unsigned int num_samples);
+static int write_buffer(OutputFile *output, const uint8_t *buf, size_t count);
+static void output_block_events(OutputFile *output, TunerCursor *cursor, const BlockDescriptor *block);
 static void output_gain_changes();
 
 
@@ -61,6 +134,60 @@ int stream() {
 #endif /* WIN32 */
 
     unsigned int nrx = is_dual_tuner ? 2 : 1;
+    TunerCursor cursors[2] = {
+        {
+            .rx_id = 'A',
+            .blocks_resource = &blocks_resource_A,
+            .samples_resource = &samples_resource_A,
+            .output = &output_files[0],
+            .block = NULL,
+            .offset = 0,
+            .finished = false,
+            .gain_changes = 0,
+            .overload_detected = 0,
+            .overload_corrected = 0,
+        },
+        {
+            .rx_id = 'B',
+            .blocks_resource = &blocks_resource_B,
+            .samples_resource = &samples_resource_B,
+            .output = &output_files[num_output_files == 2 ? 1 : 0],
+            .block = NULL,
+            .offset = 0,
+            .finished = false,
+            .gain_changes = 0,
+            .overload_detected = 0,
+            .overload_corrected = 0,
+        },
+    };
+
+    Writer writers[2];
+    int num_writers;
+    if (num_output_files == 2) {
+        /* one file per tuner */
+        for (int i = 0; i < 2; i++) {
+            writers[i] = (Writer) {
+                .cursors = {&cursors[i], NULL},
+                .nrx = 1,
+                .output = &output_files[i],
+                .next_sample_num = 0xffffffff,
+                .is_resyncing = false,
+                .output_gains = i == 0 && gainsfd != -1,
+            };
+        }
+        num_writers = 2;
+    } else {
+        writers[0] = (Writer) {
+            .cursors = {&cursors[0], &cursors[1]},
+            .nrx = nrx,
+            .output = &output_files[0],
+            .next_sample_num = 0xffffffff,
+            .is_resyncing = false,
+            .output_gains = gainsfd != -1,
+        };
+        num_writers = 1;
+    }
+    writers_running = num_writers;
 
     if (verbose) {
         fprintf(stderr, "streaming for %d seconds\n", streaming_time);
@@ -68,123 +195,25 @@ int stream() {
 
     streaming_status = STREAMING_STATUS_RUNNING;
 
-    unsigned int next_sample_num = 0xffffffff;
-    while (streaming_status == STREAMING_STATUS_RUNNING || streaming_status == STREAMING_STATUS_TERMINATE) {
-        pthread_mutex_lock(blocks_resource.lock);
-        while (blocks_resource.nready < nrx) {
-            pthread_cond_wait(blocks_resource.is_ready, blocks_resource.lock);
-        }
-        pthread_mutex_unlock(blocks_resource.lock);
-        while (blocks_resource.nready >= nrx) {
-            pthread_mutex_lock(blocks_resource.lock);
-            blocks_resource.nready -= nrx;
-            pthread_mutex_unlock(blocks_resource.lock);
-
-            BlockDescriptor *blockA = NULL;
-            BlockDescriptor *blockB = NULL;
-            if (!is_dual_tuner) {
-                if (next_block_descriptor_single(&blockA) == -1) {
-                    goto output_loop_finally;
-                }
-            } else {
-                if (next_block_descriptors_dual(&blockA, &blockB) == -1) {
-                    goto output_loop_finally;
-                }
-            }
-            unsigned int first_sample_num = blockA->first_sample_num;
-            unsigned int num_samples = blockA->num_samples;
-            if (num_samples == 0) {
-                streaming_status = STREAMING_STATUS_DONE;
-                goto output_loop_finally;
-            }
-            unsigned int dropped_samples;
-            if (!(next_sample_num == 0xffffffff || blockA->first_sample_num == next_sample_num)) {
-                if (next_sample_num < first_sample_num) {
-                    dropped_samples = first_sample_num - next_sample_num;
-                } else {
-                    dropped_samples = UINT_MAX - (first_sample_num - next_sample_num) + 1;
-                }
-                bool fill_gap_with_zeros = dropped_samples <= zero_sample_gaps_max_size;
-                struct timespec ts;
-                clock_gettime(CLOCK_REALTIME, &ts);
-                fprintf(stderr, "%.24s - dropped %u samples - next_sample_num=%d first_sample_num=%u - %s\n", ctime(&ts.tv_sec), dropped_samples, next_sample_num, first_sample_num, fill_gap_with_zeros ? "filling gap with zeros" : "skipping gap");
-                if (fill_gap_with_zeros) {
-                    uint8_t *outdata = (uint8_t *)outsamples;
-                    size_t bytes_left = dropped_samples * nrx * 2 * sizeof(short);
-                    memset(outdata, 0, bytes_left);
-                    if (write_buffer(outdata, bytes_left) == -1) {
-                        goto output_loop_finally;
-                    }
-                    stats.output_samples += dropped_samples;
-                }
-            }
-            unsigned int nsntmp = (first_sample_num + num_samples) * internal_decimation;
-            next_sample_num = (nsntmp + (nsntmp % 4 < 2)) / internal_decimation;
-
-            /* single tuner case:
-             *     rearrange samples in pairs (I_A, Q_A)
-             * dual tuner case:
-             *     rearrange samples in 'quadruples' (I_A, Q_A, I_B, Q_B)
-             */
-            int values_per_sample = 2 * nrx;
-            /* I tuner A */
-            int inoffset = blockA->samples_index;
-            int outoffset = 0;
-            for (unsigned int i = 0; i < num_samples; i++, inoffset++, outoffset += values_per_sample) {
-                outsamples[outoffset] = insamples[inoffset];
-            }
-            /* Q tuner A */
-            inoffset = blockA->samples_index + num_samples;
-            outoffset = 1;
-            for (unsigned int i = 0; i < num_samples; i++, inoffset++, outoffset += values_per_sample) {
-                outsamples[outoffset] = insamples[inoffset];
-            }
-            if (is_dual_tuner) {
-                /* I tuner B */
-                inoffset = blockB->samples_index;
-                outoffset = 2;
-                for (unsigned int i = 0; i < num_samples; i++, inoffset++, outoffset += values_per_sample) {
-                    outsamples[outoffset] = insamples[inoffset];
-                }
-                /* Q tuner B */
-                inoffset = blockB->samples_index + num_samples;
-                outoffset = 3;
-                for (unsigned int i = 0; i < num_samples; i++, inoffset++, outoffset += values_per_sample) {
-                    outsamples[outoffset] = insamples[inoffset];
-                }
-            }
-
-            uint8_t *outdata = (uint8_t *)outsamples;
-            size_t bytes_left = num_samples * values_per_sample * sizeof(short);
-            if (write_buffer(outdata, bytes_left) == -1) {
-                goto output_loop_finally;
-            }
-            stats.output_samples += num_samples;
-
-output_loop_finally:
-            pthread_mutex_lock(blocks_resource.lock);
-            blocks_resource.nused -= nrx;
-            pthread_mutex_unlock(blocks_resource.lock);
-            unsigned int num_samples_written = blockA->num_samples;
-            if (is_dual_tuner) {
-                num_samples_written += blockB->num_samples;
-            }
-            if (num_samples_written > 0) {
-                pthread_mutex_lock(samples_resource.lock);
-                /* multiply by 2 to take into account that both I and Q */
-                samples_resource.nused -= 2 * num_samples_written;
-                pthread_mutex_unlock(samples_resource.lock);
-            }
-
-            if (!(streaming_status == STREAMING_STATUS_RUNNING || streaming_status == STREAMING_STATUS_TERMINATE)) {
-                break;
-            }
-        }
-
-        if (gainsfd != -1) {
-            output_gain_changes();
+    if (num_writers == 2) {
+        pthread_t writer_thread;
+        int errcode = pthread_create(&writer_thread, NULL, writer_loop, &writers[1]);
+        if (errcode != 0) {
+            fprintf(stderr, "pthread_create(writer B) failed - errcode=%d\n", errcode);
+            streaming_status = STREAMING_STATUS_FAILED;
+            return -1;
         }
+        writer_loop(&writers[0]);
+        pthread_join(writer_thread, NULL);
+    } else {
+        writer_loop(&writers[0]);
     }
+    tee_finish();
+    ddc_finish();
+    channelizer_finish();
+    tcp_server_finish();
+    spectrum_finish();
+    overload_map_finish();
     return 0;
 }
 
@@ -206,83 +235,625 @@ static VOID CALLBACK windows_timer_handler(PVOID lpParam, BOOLEAN TimerOrWaitFir
 }
 #endif /* WIN32 */
 
-static int next_block_descriptor_single(BlockDescriptor **pBlock)
-{
-    unsigned int read_index = blocks_resource.read_index;
-    BlockDescriptor *block = (BlockDescriptor *) blocks_resource.resource + read_index;
-    read_index = (read_index + 1) % blocks_resource.size;
-    blocks_resource.read_index = read_index;
+static void *writer_loop(void *arg) {
+    Writer *writer = (Writer *)arg;
+    bool finished = false;
+    while (!finished && (streaming_status == STREAMING_STATUS_RUNNING || streaming_status == STREAMING_STATUS_TERMINATE)) {
+        pthread_mutex_lock(blocks_resource_A.lock);
+        while (!is_segment_ready(writer)) {
+            pthread_cond_wait(blocks_resource_A.is_ready, blocks_resource_A.lock);
+        }
+        pthread_mutex_unlock(blocks_resource_A.lock);
+
+        SampleSegment segment;
+        int status;
+        while ((status = writer->nrx == 1 ? next_segment_single(writer->cursors[0], &segment) : next_segment_dual(writer, &segment)) == 1) {
+            int output_status = output_segment(writer, &segment);
+            for (unsigned int i = 0; i < writer->nrx; i++) {
+                tuner_cursor_consume(writer->cursors[i], segment.consumed[i]);
+            }
+            if (output_status == -1) {
+                break;
+            }
+            output_checkpoint(writer->output);
+            if (!(streaming_status == STREAMING_STATUS_RUNNING || streaming_status == STREAMING_STATUS_TERMINATE)) {
+                break;
+            }
+        }
+        if (status == -1 && (streaming_status == STREAMING_STATUS_RUNNING || streaming_status == STREAMING_STATUS_TERMINATE)) {
+            /* end of streaming for this writer */
+            finished = true;
+        }
+
+        if (writer->output_gains) {
+            output_gain_changes();
+        }
+    }
 
-    if (!(block->rx_id == 'A')) {
-        fprintf(stderr, "invalid rx_id - %c\n", block->rx_id);
+    /* flush the buffered output here, so that it is included in the stats */
+    if (output_finish(writer->output) == -1) {
         streaming_status = STREAMING_STATUS_FAILED;
-        return -1;
     }
-    *pBlock = block;
-    return 0;
+
+    /* the last writer to finish marks the streaming as done */
+    pthread_mutex_lock(blocks_resource_A.lock);
+    writers_running--;
+    if (writers_running == 0 && (streaming_status == STREAMING_STATUS_RUNNING || streaming_status == STREAMING_STATUS_TERMINATE)) {
+        streaming_status = STREAMING_STATUS_DONE;
+    }
+    pthread_cond_broadcast(blocks_resource_A.is_ready);
+    pthread_mutex_unlock(blocks_resource_A.lock);
+    return NULL;
 }
 
-static int next_block_descriptors_dual(BlockDescriptor **pBlockA, BlockDescriptor **pBlockB)
-{
-    unsigned int read_index = blocks_resource.read_index;
-    BlockDescriptor *blockA = (BlockDescriptor *) blocks_resource.resource + read_index;
-    read_index = (read_index + 1) % blocks_resource.size;
-    BlockDescriptor *blockB = (BlockDescriptor *) blocks_resource.resource + read_index;
-    read_index = (read_index + 1) % blocks_resource.size;
-    blocks_resource.read_index = read_index;
-
-    if (!(blockA->rx_id == 'A' && blockB->rx_id == 'B')) {
-        fprintf(stderr, "mismatch rx_id - %c %c\n", blockA->rx_id, blockB->rx_id);
+/* must be called with the blocks lock held */
+static bool is_segment_ready(Writer *writer) {
+    if (!(streaming_status == STREAMING_STATUS_RUNNING || streaming_status == STREAMING_STATUS_TERMINATE)) {
+        return true;
+    }
+    bool has_data[2];
+    unsigned int pending[2];
+    for (unsigned int i = 0; i < writer->nrx; i++) {
+        TunerCursor *cursor = writer->cursors[i];
+        pending[i] = cursor->blocks_resource->nready + (cursor->block != NULL ? 1 : 0);
+        has_data[i] = cursor->finished || pending[i] > 0;
+    }
+    if (writer->nrx == 1) {
+        return has_data[0];
+    }
+    return (has_data[0] && has_data[1]) ||
+           pending[0] >= RESYNC_MAX_PENDING_BLOCKS ||
+           pending[1] >= RESYNC_MAX_PENDING_BLOCKS;
+}
+
+static unsigned int tuner_cursor_pending(TunerCursor *cursor) {
+    pthread_mutex_lock(cursor->blocks_resource->lock);
+    unsigned int pending = cursor->blocks_resource->nready;
+    pthread_mutex_unlock(cursor->blocks_resource->lock);
+    if (cursor->block != NULL) {
+        pending++;
+    }
+    return pending;
+}
+
+static int tuner_cursor_fetch(TunerCursor *cursor) {
+    if (cursor->block != NULL || cursor->finished) {
+        return 0;
+    }
+    ResourceDescriptor *blocks_resource = cursor->blocks_resource;
+    pthread_mutex_lock(blocks_resource->lock);
+    bool has_block = blocks_resource->nready > 0;
+    if (has_block) {
+        blocks_resource->nready--;
+    }
+    pthread_mutex_unlock(blocks_resource->lock);
+    if (!has_block) {
+        return 0;
+    }
+
+    unsigned int read_index = blocks_resource->read_index;
+    BlockDescriptor *block = (BlockDescriptor *) blocks_resource->resource + read_index;
+    blocks_resource->read_index = (read_index + 1) % blocks_resource->size;
+    if (!(block->rx_id == cursor->rx_id)) {
+        fprintf(stderr, "invalid rx_id - expected=%c found=%c\n", cursor->rx_id, block->rx_id);
         streaming_status = STREAMING_STATUS_FAILED;
         return -1;
     }
-    if (!(blockA->first_sample_num == blockB->first_sample_num)) {
-        fprintf(stderr, "mismatch first_sample_num - %u %u\n", blockA->first_sample_num, blockB->first_sample_num);
-        streaming_status = STREAMING_STATUS_FAILED;
+    cursor->block = block;
+    cursor->offset = 0;
+    if (block->num_samples == 0) {
+        /* end of streaming */
+        cursor->finished = true;
+        tuner_cursor_consume(cursor, 0);
+    } else {
+        overload_map_add(cursor->rx_id - 'A', block);
+        index_add_block(cursor->output, cursor->rx_id - 'A', block);
+    }
+    return 0;
+}
+
+static void tuner_cursor_consume(TunerCursor *cursor, unsigned int num_samples) {
+    BlockDescriptor *block = cursor->block;
+    if (block == NULL) {
+        return;
+    }
+    cursor->offset += num_samples;
+    if (cursor->offset < block->num_samples) {
+        return;
+    }
+
+    /* the whole block has been consumed - release it */
+    unsigned int block_num_samples = block->num_samples;
+    cursor->block = NULL;
+    cursor->offset = 0;
+    pthread_mutex_lock(cursor->blocks_resource->lock);
+    cursor->blocks_resource->nused--;
+    pthread_mutex_unlock(cursor->blocks_resource->lock);
+    if (block_num_samples > 0) {
+        pthread_mutex_lock(cursor->samples_resource->lock);
+        /* multiply by 2 to take into account that both I and Q */
+        cursor->samples_resource->nused -= 2 * block_num_samples;
+        pthread_mutex_unlock(cursor->samples_resource->lock);
+    }
+}
+
+static void tuner_cursor_set_segment(TunerCursor *cursor, int tuner, unsigned int num_samples, SampleSegment *segment) {
+    BlockDescriptor *block = cursor->block;
+    const short *samples = (const short *) cursor->samples_resource->resource + block->samples_index;
+    segment->xi[tuner] = samples + cursor->offset;
+    segment->xq[tuner] = samples + block->num_samples + cursor->offset;
+    segment->consumed[tuner] = num_samples;
+    if (cursor->offset == 0) {
+        segment->first_block[tuner] = block;
+    }
+}
+
+static int next_segment_single(TunerCursor *cursor, SampleSegment *segment) {
+    TunerCursor *cursorA = cursor;
+    if (tuner_cursor_fetch(cursorA) == -1) {
         return -1;
     }
-    if (!(blockA->num_samples == blockB->num_samples)) {
-        fprintf(stderr, "mismatch num_samples - %u %u\n", blockA->num_samples, blockB->num_samples);
-        streaming_status = STREAMING_STATUS_FAILED;
+    if (cursorA->finished) {
         return -1;
     }
-    *pBlockA = blockA;
-    *pBlockB = blockB;
+    if (cursorA->block == NULL) {
+        return 0;
+    }
+    unsigned int num_samples = cursorA->block->num_samples - cursorA->offset;
+    *segment = (SampleSegment) {
+        .first_sample_num = cursorA->block->first_sample_num + cursorA->offset,
+        .num_samples = num_samples,
+        .xi = {NULL, NULL},
+        .xq = {NULL, NULL},
+        .consumed = {0, 0},
+        .first_block = {NULL, NULL},
+    };
+    tuner_cursor_set_segment(cursorA, 0, num_samples, segment);
+    return 1;
+}
+
+/* pairing stage for the dual tuner case
+ * the blocks from the two tuners are aligned on their sample numbers;
+ * samples that are present on only one side are either paired with zeros
+ * (if the gap is small enough) or trimmed; samples that arrive late, when
+ * the other tuner has already been written past them alone, are discarded
+ */
+static int next_segment_dual(Writer *writer, SampleSegment *segment) {
+    for (;;) {
+        TunerCursor *cursorA = writer->cursors[0];
+        TunerCursor *cursorB = writer->cursors[1];
+        if (tuner_cursor_fetch(cursorA) == -1 || tuner_cursor_fetch(cursorB) == -1) {
+            return -1;
+        }
+        if (cursorA->finished || cursorB->finished) {
+            return -1;
+        }
+        BlockDescriptor *blockA = cursorA->block;
+        BlockDescriptor *blockB = cursorB->block;
+
+        /* samples before the next sample to write */
+        if (writer->next_sample_num != 0xffffffff) {
+            bool is_stale = false;
+            for (int i = 0; i < 2; i++) {
+                TunerCursor *cursor = writer->cursors[i];
+                if (cursor->block == NULL) {
+                    continue;
+                }
+                int behind = (int)(writer->next_sample_num - (cursor->block->first_sample_num + cursor->offset));
+                if (behind > 0) {
+                    unsigned int num_samples = cursor->block->num_samples - cursor->offset;
+                    if (num_samples > (unsigned int)behind) {
+                        num_samples = behind;
+                    }
+                    stats.resync_trimmed_samples += num_samples;
+                    tuner_cursor_consume(cursor, num_samples);
+                    is_stale = true;
+                }
+            }
+            if (is_stale) {
+                continue;
+            }
+        }
+
+        /* present: bit 0 -> tuner A has samples, bit 1 -> tuner B has samples */
+        int present = 0;
+        unsigned int first_sample_num = 0;
+        unsigned int num_samples = 0;
+        bool trim = false;
+        if (blockA != NULL && blockB != NULL) {
+            unsigned int first_sample_num_A = blockA->first_sample_num + cursorA->offset;
+            unsigned int first_sample_num_B = blockB->first_sample_num + cursorB->offset;
+            unsigned int num_samples_A = blockA->num_samples - cursorA->offset;
+            unsigned int num_samples_B = blockB->num_samples - cursorB->offset;
+            int diff = (int)(first_sample_num_B - first_sample_num_A);
+            if (diff == 0) {
+                present = 3;
+                first_sample_num = first_sample_num_A;
+                num_samples = num_samples_A < num_samples_B ? num_samples_A : num_samples_B;
+            } else if (diff > 0) {
+                /* tuner B is missing the samples before first_sample_num_B */
+                present = 1;
+                first_sample_num = first_sample_num_A;
+                num_samples = num_samples_A < (unsigned int)diff ? num_samples_A : (unsigned int)diff;
+                trim = (unsigned int)diff > zero_sample_gaps_max_size;
+            } else {
+                /* tuner A is missing the samples before first_sample_num_A */
+                present = 2;
+                first_sample_num = first_sample_num_B;
+                num_samples = num_samples_B < (unsigned int)(-diff) ? num_samples_B : (unsigned int)(-diff);
+                trim = (unsigned int)(-diff) > zero_sample_gaps_max_size;
+            }
+        } else if (blockA != NULL) {
+            if (tuner_cursor_pending(cursorA) < RESYNC_MAX_PENDING_BLOCKS) {
+                return 0;
+            }
+            /* tuner B has been silent for too long */
+            present = 1;
+            first_sample_num = blockA->first_sample_num + cursorA->offset;
+            num_samples = blockA->num_samples - cursorA->offset;
+        } else if (blockB != NULL) {
+            if (tuner_cursor_pending(cursorB) < RESYNC_MAX_PENDING_BLOCKS) {
+                return 0;
+            }
+            /* tuner A has been silent for too long */
+            present = 2;
+            first_sample_num = blockB->first_sample_num + cursorB->offset;
+            num_samples = blockB->num_samples - cursorB->offset;
+        } else {
+            return 0;
+        }
+
+        if (present == 3) {
+            writer->is_resyncing = false;
+        } else {
+            if (!writer->is_resyncing) {
+                struct timespec ts;
+                clock_gettime(CLOCK_REALTIME, &ts);
+                fprintf(stderr, "%.24s - tuners out of sync - tuner %c missing samples from sample_num=%u - %s\n", ctime(&ts.tv_sec), present == 1 ? 'B' : 'A', first_sample_num, trim ? "trimming" : "filling with zeros");
+                stats.resync_events++;
+                writer->is_resyncing = true;
+            }
+            if (trim) {
+                stats.resync_trimmed_samples += num_samples;
+                tuner_cursor_consume(present == 1 ? cursorA : cursorB, num_samples);
+                continue;
+            }
+            stats.resync_zero_filled_samples += num_samples;
+        }
+
+        *segment = (SampleSegment) {
+            .first_sample_num = first_sample_num,
+            .num_samples = num_samples,
+            .xi = {NULL, NULL},
+            .xq = {NULL, NULL},
+            .consumed = {0, 0},
+            .first_block = {NULL, NULL},
+        };
+        if (present & 1) {
+            tuner_cursor_set_segment(cursorA, 0, num_samples, segment);
+        }
+        if (present & 2) {
+            tuner_cursor_set_segment(cursorB, 1, num_samples, segment);
+        }
+        return 1;
+    }
+}
+
+static int output_segment(Writer *writer, const SampleSegment *segment) {
+    OutputFile *output = writer->output;
+    short *outsamples = output->outsamples;
+    unsigned int nrx = writer->nrx;
+    bool is_decimating = decimator_input_sample_rate > 0.0;
+    unsigned int *next_sample_num = &writer->next_sample_num;
+    unsigned int first_sample_num = segment->first_sample_num;
+    unsigned int num_samples = segment->num_samples;
+    unsigned int dropped_samples;
+    if (!(*next_sample_num == 0xffffffff || first_sample_num == *next_sample_num)) {
+        if (*next_sample_num < first_sample_num) {
+            dropped_samples = first_sample_num - *next_sample_num;
+        } else {
+            dropped_samples = UINT_MAX - (first_sample_num - *next_sample_num) + 1;
+        }
+        bool fill_gap_with_zeros = dropped_samples <= zero_sample_gaps_max_size;
+        /* with software decimation the sample numbers are at the RSP rate */
+        unsigned long long gap_samples = decimator_output_samples(dropped_samples);
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        fprintf(stderr, "%.24s - dropped %u samples - next_sample_num=%d first_sample_num=%u - %s\n", ctime(&ts.tv_sec), dropped_samples, *next_sample_num, first_sample_num, fill_gap_with_zeros ? "filling gap with zeros" : "skipping gap");
+        SigMFEvent sigmf_event = {
+            .sample_num = output->stats->output_samples,
+            .num_samples = gap_samples,
+            .type = fill_gap_with_zeros ? SIGMF_EVENT_GAP_FILLED : SIGMF_EVENT_GAP_SKIPPED,
+            .tuner = output->tuner,
+            .gain = 0.0,
+            .gRdB = 0,
+            .lnaGRdB = 0,
+        };
+        sigmf_add_event(&sigmf_event);
+        if (fill_gap_with_zeros && is_decimating) {
+            const short *zeros[2] = {NULL, NULL};
+            if (write_decimated(writer, zeros, zeros, dropped_samples) == -1) {
+                return -1;
+            }
+            output->index_flags |= INDEX_FLAG_GAP_FILLED;
+        } else if (fill_gap_with_zeros) {
+            const short *zeros[2] = {NULL, NULL};
+            if (trigger_mode) {
+                trigger_write(zeros, zeros, nrx, dropped_samples);
+                power_detector_write(zeros, zeros, dropped_samples);
+            } else if (!ddc_only) {
+                /* with diversity combining the output file has one tuner */
+                uint8_t *outdata = (uint8_t *)outsamples;
+                size_t bytes_left = dropped_samples * output->num_channels * sizeof(short);
+                memset(outdata, 0, bytes_left);
+                if (write_buffer(output, outdata, bytes_left) == -1) {
+                    return -1;
+                }
+                if (output->envelope != NULL) {
+                    if (envelope_update(output, zeros, zeros, output->num_channels / 2, dropped_samples) == -1) {
+                        streaming_status = STREAMING_STATUS_FAILED;
+                        return -1;
+                    }
+                }
+            }
+            tee_write(zeros, zeros, nrx, dropped_samples);
+            ddc_write(zeros, zeros, nrx, dropped_samples);
+            channelizer_write(zeros, zeros, nrx, dropped_samples);
+            spectrum_write(zeros, zeros, nrx, dropped_samples);
+            shm_output_write(zeros, zeros, nrx, dropped_samples);
+            tcp_server_write(zeros, zeros, nrx, dropped_samples);
+            output->stats->output_samples += dropped_samples;
+            output->index_flags |= INDEX_FLAG_GAP_FILLED;
+            if (output->index_fd != -1) {
+                if (index_update(output) == -1) {
+                    return -1;
+                }
+            }
+        } else {
+            output->index_skipped_samples += gap_samples;
+            output->index_flags |= INDEX_FLAG_GAP_SKIPPED;
+            trigger_skip(gap_samples);
+            spectrum_skip(gap_samples);
+        }
+    }
+    unsigned int nsntmp = (first_sample_num + num_samples) * internal_decimation;
+    *next_sample_num = (nsntmp + (nsntmp % 4 < 2)) / internal_decimation;
+
+    /* the time markers and the events are placed at the first sample of
+     * a block
+     */
+    for (unsigned int i = 0; i < nrx; i++) {
+        const BlockDescriptor *block = segment->first_block[i];
+        if (block == NULL) {
+            continue;
+        }
+        if (block->rx_id == 'A') {
+            time_markers_update(&timeinfo, &block->ts, output->stats->output_samples);
+        }
+        output_block_events(output, writer->cursors[i], block);
+    }
+
+    if (is_decimating) {
+        return write_decimated(writer, segment->xi, segment->xq, num_samples);
+    }
+    return write_samples(writer, segment->xi, segment->xq, num_samples);
+}
+
+/* software decimation: the samples of each tuner go through its decimator
+ * in chunks, and the decimated samples are written like the others
+ */
+static int write_decimated(Writer *writer, const short *const *xi, const short *const *xq, unsigned int num_samples) {
+    unsigned int nrx = writer->nrx;
+    for (unsigned int offset = 0; offset < num_samples; ) {
+        unsigned int n = num_samples - offset;
+        if (n > DECIMATOR_CHUNK_SAMPLES) {
+            n = DECIMATOR_CHUNK_SAMPLES;
+        }
+        const short *dxi[2] = {NULL, NULL};
+        const short *dxq[2] = {NULL, NULL};
+        size_t num_decimated = 0;
+        for (unsigned int i = 0; i < nrx; i++) {
+            /* in one file per tuner mode each writer has just one tuner */
+            int tuner = writer->output->tuner == -1 ? (int)i : writer->output->tuner;
+            num_decimated = decimator_process(tuner, xi[i] != NULL ? xi[i] + offset : NULL, xq[i] != NULL ? xq[i] + offset : NULL, n, &dxi[i], &dxq[i]);
+        }
+        if (num_decimated > 0) {
+            if (write_samples(writer, dxi, dxq, num_decimated) == -1) {
+                return -1;
+            }
+        }
+        offset += n;
+    }
+    return 0;
+}
+
+static int write_samples(Writer *writer, const short *const *xi, const short *const *xq, unsigned int num_samples) {
+    OutputFile *output = writer->output;
+    unsigned int nrx = writer->nrx;
+
+    tee_write(xi, xq, nrx, num_samples);
+    ddc_write(xi, xq, nrx, num_samples);
+    channelizer_write(xi, xq, nrx, num_samples);
+    spectrum_write(xi, xq, nrx, num_samples);
+    shm_output_write(xi, xq, nrx, num_samples);
+    tcp_server_write(xi, xq, nrx, num_samples);
+    if (trigger_mode) {
+        trigger_write(xi, xq, nrx, num_samples);
+        power_detector_write(xi, xq, num_samples);
+        output->stats->output_samples += num_samples;
+        return 0;
+    }
+    if (ddc_only) {
+        output->stats->output_samples += num_samples;
+        return 0;
+    }
+    if (diversity_combining != DIVERSITY_COMBINING_NONE) {
+        return write_combined(writer, xi, xq, num_samples);
+    }
+    return write_output(output, xi, xq, nrx, num_samples);
+}
+
+/* diversity combining: the sinks above get both tuners, the output file
+ * gets the combined stream
+ */
+static int write_combined(Writer *writer, const short *const *xi, const short *const *xq, unsigned int num_samples) {
+    OutputFile *output = writer->output;
+    for (unsigned int offset = 0; offset < num_samples; ) {
+        const short *txi[2] = {xi[0] != NULL ? xi[0] + offset : NULL, xi[1] != NULL ? xi[1] + offset : NULL};
+        const short *txq[2] = {xq[0] != NULL ? xq[0] + offset : NULL, xq[1] != NULL ? xq[1] + offset : NULL};
+        const short *cxi[1];
+        const short *cxq[1];
+        size_t n = diversity_combine(txi, txq, num_samples - offset, output->stats->output_samples, &cxi[0], &cxq[0]);
+        if (write_output(output, cxi, cxq, 1, n) == -1) {
+            return -1;
+        }
+        offset += n;
+    }
     return 0;
 }
 
-static int write_buffer(const uint8_t *buf, size_t count) {
-    struct timespec before_write_ts;
-    struct timespec after_write_ts;
-    while (count > 0) {
-        clock_gettime(CLOCK_REALTIME, &before_write_ts);
-        ssize_t nwritten = write(outputfd, buf, count);
-        clock_gettime(CLOCK_REALTIME, &after_write_ts);
-        stats.total_writes++;
-        unsigned long long write_elapsed = (after_write_ts.tv_sec - before_write_ts.tv_sec) * 1000000000ULL + after_write_ts.tv_nsec - before_write_ts.tv_nsec;
-        stats.total_write_elapsed += write_elapsed;
-        if (write_elapsed > stats.max_write_elapsed) {
-            stats.max_write_elapsed = write_elapsed;
+static int write_output(OutputFile *output, const short *const *xi, const short *const *xq, unsigned int nrx, unsigned int num_samples) {
+    short *outsamples = output->outsamples;
+    if (output->envelope != NULL) {
+        if (envelope_update(output, xi, xq, nrx, num_samples) == -1) {
+            streaming_status = STREAMING_STATUS_FAILED;
+            return -1;
         }
-        if (nwritten == -1) {
-            fprintf(stderr, "write samples failed: %s\n", strerror(errno));
+    }
+
+    int values_per_sample = 2 * nrx;
+    if (sample_format == SAMPLE_FORMAT_CF32 || sample_format == SAMPLE_FORMAT_CS8) {
+        /* convert while interleaving, without the 16 bit output buffer */
+        if (sample_format_write_interleaved(output, xi, xq, nrx, num_samples) == -1) {
             streaming_status = STREAMING_STATUS_FAILED;
             return -1;
         }
-        if (nwritten == (ssize_t)count) {
-            stats.full_writes++;
-        } else if (nwritten == 0) {
-            stats.zero_writes++;
-        } else if (nwritten < (ssize_t)count) {
-            stats.partial_writes++;
+        output->stats->output_samples += num_samples;
+        return 0;
+    }
+    /* with the zero copy pipe output the samples are interleaved straight
+     * into the pipe ring
+     */
+    if (output->pipe_ring != NULL && output->compressor == NULL && sample_format == SAMPLE_FORMAT_S16) {
+        uint8_t *pipe_buffer = output_pipe_buffer(output, num_samples * values_per_sample * sizeof(short));
+        if (pipe_buffer != NULL) {
+            outsamples = (short *)pipe_buffer;
+        }
+    }
+    /* single tuner case:
+     *     rearrange samples in pairs (I_A, Q_A)
+     * dual tuner case:
+     *     rearrange samples in 'quadruples' (I_A, Q_A, I_B, Q_B)
+     * a tuner with no samples in this segment is filled with zeros
+     */
+    for (unsigned int tuner = 0; tuner < nrx; tuner++) {
+        const short *txi = xi[tuner];
+        const short *txq = xq[tuner];
+        int outoffset = 2 * tuner;
+        if (txi != NULL) {
+            for (unsigned int i = 0; i < num_samples; i++, outoffset += values_per_sample) {
+                outsamples[outoffset] = txi[i];
+                outsamples[outoffset + 1] = txq[i];
+            }
+        } else {
+            for (unsigned int i = 0; i < num_samples; i++, outoffset += values_per_sample) {
+                outsamples[outoffset] = 0;
+                outsamples[outoffset + 1] = 0;
+            }
+        }
+    }
+
+    uint8_t *outdata = (uint8_t *)outsamples;
+    size_t bytes_left = num_samples * values_per_sample * sizeof(short);
+    if (write_buffer(output, outdata, bytes_left) == -1) {
+        return -1;
+    }
+    output->stats->output_samples += num_samples;
+    if (output->index_fd != -1) {
+        if (index_update(output) == -1) {
+            return -1;
         }
-        buf += nwritten;
-        count -= nwritten;
-        stats.data_size += nwritten;
     }
     return 0;
 }
 
+static int write_buffer(OutputFile *output, const uint8_t *buf, size_t count) {
+    int ret;
+    if (output->compressor != NULL) {
+        ret = compressor_write(output, buf, count);
+    } else if (sample_format != SAMPLE_FORMAT_S16) {
+        ret = sample_format_write(output, (const short *)buf, count / sizeof(short));
+    } else {
+        ret = output_write(output, buf, count);
+    }
+    if (ret == -1) {
+        streaming_status = STREAMING_STATUS_FAILED;
+        return -1;
+    }
+    return 0;
+}
+
+/* the event counters stamped on the blocks by the RX callback tell which
+ * events happened since the previous block of this tuner; these events
+ * are placed at the position of the block in the output file (SigMF
+ * annotations and WAV 'rspe' chunk)
+ */
+static void output_block_events(OutputFile *output, TunerCursor *cursor, const BlockDescriptor *block) {
+    EventRecord record = {
+        .sample_num = output->stats->output_samples,
+        .currGain = 0.0,
+        .tuner = cursor->rx_id - 'A',
+        .gRdB = block->gRdB,
+        .lnaGRdB = block->lnaGRdB,
+    };
+    SigMFEvent sigmf_event = {
+        .sample_num = output->stats->output_samples,
+        .num_samples = 0,
+        .tuner = cursor->rx_id - 'A',
+        .gain = 0.0,
+        .gRdB = 0,
+        .lnaGRdB = 0,
+    };
+    if (block->gain_changes != cursor->gain_changes) {
+        sigmf_event.type = SIGMF_EVENT_GAIN_CHANGE;
+        sigmf_event.gain = block->currGain;
+        sigmf_event.gRdB = block->gRdB;
+        sigmf_event.lnaGRdB = block->lnaGRdB;
+        sigmf_add_event(&sigmf_event);
+        if (event_records.first != NULL) {
+            record.currGain = block->currGain;
+            record.type = EVENT_TYPE_GAIN_CHANGE;
+            event_records_add(&event_records, &record);
+            record.currGain = 0.0;
+        }
+        cursor->gain_changes = block->gain_changes;
+    }
+    if (block->overload_detected != cursor->overload_detected) {
+        sigmf_event.type = SIGMF_EVENT_OVERLOAD_DETECTED;
+        sigmf_event.gain = 0.0;
+        sigmf_event.gRdB = 0;
+        sigmf_event.lnaGRdB = 0;
+        sigmf_add_event(&sigmf_event);
+        if (event_records.first != NULL) {
+            record.type = EVENT_TYPE_OVERLOAD_DETECTED;
+            event_records_add(&event_records, &record);
+        }
+        cursor->overload_detected = block->overload_detected;
+    }
+    if (block->overload_corrected != cursor->overload_corrected) {
+        sigmf_event.type = SIGMF_EVENT_OVERLOAD_CORRECTED;
+        sigmf_event.gain = 0.0;
+        sigmf_event.gRdB = 0;
+        sigmf_event.lnaGRdB = 0;
+        sigmf_add_event(&sigmf_event);
+        if (event_records.first != NULL) {
+            record.type = EVENT_TYPE_OVERLOAD_CORRECTED;
+            event_records_add(&event_records, &record);
+        }
+        cursor->overload_corrected = block->overload_corrected;
+    }
+}
+
 static void output_gain_changes() {
     pthread_mutex_lock(gain_changes_resource.lock);
     unsigned int nready = gain_changes_resource.nready;
@@ -0,0 +1,537 @@
+/* record to file the I/Q stream(s) from a SDRplay RSP
+ * TCP server output (rtl_tcp compatible)
+ *
+ * Copyright 2025 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifdef __linux__
+#define _GNU_SOURCE     /* accept4() */
+#endif /* __linux__ */
+
+#include "config.h"
+#include "sample-format.h"
+#include "tcp-server.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#ifdef __linux__
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#endif /* __linux__ */
+
+/* the TCP server sends the samples of tuner A like rtl_tcp does: when a
+ * client connects it gets a 12 byte header ('RTL0', tuner type, and number
+ * of gains, as big endian 32 bit integers), followed by the I/Q samples as
+ * unsigned 8 bit (u8, same as rtl_tcp), signed 8 bit (cs8), or signed 16 bit
+ * little endian (cs16) values. The 5 byte commands sent by the clients
+ * (frequency, sample rate, gain, etc) are read and ignored, since the
+ * RSP settings are those of the recording.
+ *
+ * The writer converts the samples once, and appends them to a bounded queue
+ * for each client; if a client queue is full, the samples are dropped for
+ * that client only, and the writer never waits. A separate thread runs the
+ * epoll loop with non-blocking sockets: it accepts the clients, reads their
+ * commands, and sends out their queues.
+ */
+#define TCP_SERVER_MAGIC "RTL0"
+#define TCP_SERVER_TUNER_TYPE 0         /* unknown */
+#define TCP_SERVER_COMMAND_SIZE 5
+#define TCP_SERVER_CHUNK_SAMPLES 16384
+#define TCP_SERVER_MAX_EVENTS 16
+#define TCP_SERVER_FINISH_TIMEOUT 1     /* seconds to send out the queues at the end */
+
+/* global variables */
+TcpServerStats tcp_server_stats = {
+    .clients = 0,
+    .bytes_sent = 0,
+    .dropped_samples = 0,
+    .commands = 0,
+};
+
+#ifdef __linux__
+/* typedefs */
+typedef struct {
+    int fd;                             /* -1 if this slot is free */
+    char address[INET6_ADDRSTRLEN + 8];
+    uint8_t *queue;
+    unsigned long long queue_read;      /* bytes sent */
+    unsigned long long queue_write;     /* bytes queued */
+    bool is_polling_out;
+    uint8_t command[TCP_SERVER_COMMAND_SIZE];
+    unsigned int command_size;
+    struct timespec connect_ts;
+    unsigned long long bytes_sent;
+    unsigned long long dropped_samples;
+    unsigned long long commands;
+} TcpClient;
+
+static pthread_mutex_t tcp_server_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t tcp_server_thread;
+static bool is_tcp_server_running = false;
+static bool is_tcp_server_stopping = false;
+static int listen_fd = -1;
+static int epoll_fd = -1;
+static int wake_fd = -1;
+static TcpClient *clients = NULL;
+static int num_clients = 0;
+static size_t bytes_per_sample = 0;
+static size_t queue_capacity = 0;       /* bytes */
+static uint8_t *converted = NULL;
+
+/* internal functions */
+static void *tcp_server_loop(void *arg);
+static void tcp_server_accept();
+static void tcp_client_read(TcpClient *client);
+static int tcp_client_flush(TcpClient *client);
+static void tcp_client_close(TcpClient *client);
+static void tcp_client_enqueue(TcpClient *client, const uint8_t *data, size_t size);
+static size_t tcp_server_convert(const short *xi, const short *xq, size_t num_samples);
+#endif /* __linux__ */
+
+
+int tcp_server_open() {
+    if (tcp_server_address == NULL) {
+        return 0;
+    }
+#ifdef __linux__
+    char host[INET6_ADDRSTRLEN];
+    unsigned int port;
+    const char *port_string = tcp_server_address;
+    const char *sep = strrchr(tcp_server_address, ':');
+    if (sep == NULL) {
+        snprintf(host, sizeof(host), "127.0.0.1");
+    } else {
+        size_t len = sep - tcp_server_address;
+        if (len >= sizeof(host)) {
+            fprintf(stderr, "invalid TCP server address: %s\n", tcp_server_address);
+            return -1;
+        }
+        memcpy(host, tcp_server_address, len);
+        host[len] = '\0';
+        port_string = sep + 1;
+    }
+    if (sscanf(port_string, "%u", &port) != 1 || port == 0 || port > 65535) {
+        fprintf(stderr, "invalid TCP server port: %s\n", tcp_server_address);
+        return -1;
+    }
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(port),
+    };
+    if (inet_pton(AF_INET, host, &addr.sin_addr) != 1) {
+        fprintf(stderr, "invalid TCP server address: %s\n", tcp_server_address);
+        return -1;
+    }
+
+    switch (tcp_server_format) {
+        case TCP_SERVER_FORMAT_CS16:
+            bytes_per_sample = 2 * sizeof(int16_t);
+            break;
+        default:
+            bytes_per_sample = 2 * sizeof(uint8_t);
+            break;
+    }
+    queue_capacity = (size_t)tcp_server_queue_capacity * bytes_per_sample;
+    converted = (uint8_t *)malloc(TCP_SERVER_CHUNK_SAMPLES * bytes_per_sample);
+    clients = (TcpClient *)calloc(tcp_server_max_clients, sizeof(TcpClient));
+    if (converted == NULL || clients == NULL) {
+        fprintf(stderr, "malloc(TCP server buffers) failed\n");
+        return -1;
+    }
+    for (int i = 0; i < tcp_server_max_clients; i++) {
+        clients[i].fd = -1;
+    }
+
+    listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listen_fd == -1) {
+        fprintf(stderr, "socket() failed: %s\n", strerror(errno));
+        return -1;
+    }
+    int reuse = 1;
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    if (bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+        fprintf(stderr, "bind(%s) failed: %s\n", tcp_server_address, strerror(errno));
+        return -1;
+    }
+    if (listen(listen_fd, tcp_server_max_clients) == -1) {
+        fprintf(stderr, "listen(%s) failed: %s\n", tcp_server_address, strerror(errno));
+        return -1;
+    }
+    wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (wake_fd == -1 || epoll_fd == -1) {
+        fprintf(stderr, "eventfd()/epoll_create1() failed: %s\n", strerror(errno));
+        return -1;
+    }
+    struct epoll_event ev = {
+        .events = EPOLLIN,
+        .data.fd = listen_fd,
+    };
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &ev);
+    ev.data.fd = wake_fd;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_fd, &ev);
+
+    is_tcp_server_stopping = false;
+    int errcode = pthread_create(&tcp_server_thread, NULL, tcp_server_loop, NULL);
+    if (errcode != 0) {
+        fprintf(stderr, "pthread_create(TCP server) failed: %s\n", strerror(errcode));
+        return -1;
+    }
+    is_tcp_server_running = true;
+    if (verbose) {
+        fprintf(stderr, "TCP server listening on %s:%u\n", host, port);
+    }
+    return 0;
+#else
+    fprintf(stderr, "TCP server output is only supported on Linux\n");
+    return -1;
+#endif /* __linux__ */
+}
+
+/* called by the writer for each segment; only tuner A is sent */
+void tcp_server_write(const short *const *xi, const short *const *xq, unsigned int nrx, size_t num_samples) {
+#ifdef __linux__
+    (void)nrx;
+    if (!is_tcp_server_running || __atomic_load_n(&num_clients, __ATOMIC_RELAXED) == 0) {
+        return;
+    }
+    for (size_t offset = 0; offset < num_samples; ) {
+        size_t n = num_samples - offset < TCP_SERVER_CHUNK_SAMPLES ? num_samples - offset : TCP_SERVER_CHUNK_SAMPLES;
+        size_t size = tcp_server_convert(xi[0] != NULL ? xi[0] + offset : NULL, xq[0] != NULL ? xq[0] + offset : NULL, n);
+        pthread_mutex_lock(&tcp_server_lock);
+        for (int i = 0; i < tcp_server_max_clients; i++) {
+            TcpClient *client = &clients[i];
+            if (client->fd == -1) {
+                continue;
+            }
+            if (client->queue_write - client->queue_read + size > queue_capacity) {
+                client->dropped_samples += n;
+                tcp_server_stats.dropped_samples += n;
+                continue;
+            }
+            tcp_client_enqueue(client, converted, size);
+        }
+        pthread_mutex_unlock(&tcp_server_lock);
+        offset += n;
+    }
+    uint64_t one = 1;
+    if (write(wake_fd, &one, sizeof(one)) == -1) {
+        /* the counter is already non zero - nothing to do */
+    }
+#else
+    (void)xi;
+    (void)xq;
+    (void)nrx;
+    (void)num_samples;
+#endif /* __linux__ */
+}
+
+/* end of streaming: give the clients a little time to get their queues */
+void tcp_server_finish() {
+#ifdef __linux__
+    if (!is_tcp_server_running) {
+        return;
+    }
+    pthread_mutex_lock(&tcp_server_lock);
+    is_tcp_server_stopping = true;
+    pthread_mutex_unlock(&tcp_server_lock);
+    uint64_t one = 1;
+    if (write(wake_fd, &one, sizeof(one)) == -1) {
+        /* the counter is already non zero - nothing to do */
+    }
+    pthread_join(tcp_server_thread, NULL);
+    is_tcp_server_running = false;
+#endif /* __linux__ */
+}
+
+void tcp_server_close() {
+#ifdef __linux__
+    tcp_server_finish();
+    if (listen_fd != -1) {
+        close(listen_fd);
+        listen_fd = -1;
+    }
+    if (epoll_fd != -1) {
+        close(epoll_fd);
+        epoll_fd = -1;
+    }
+    if (wake_fd != -1) {
+        close(wake_fd);
+        wake_fd = -1;
+    }
+    free(clients);
+    clients = NULL;
+    free(converted);
+    converted = NULL;
+#endif /* __linux__ */
+}
+
+/* internal functions */
+#ifdef __linux__
+static void *tcp_server_loop(void *arg) {
+    (void)arg;
+    struct timespec stop_ts = {0, 0};
+    for (;;) {
+        struct epoll_event events[TCP_SERVER_MAX_EVENTS];
+        int nevents = epoll_wait(epoll_fd, events, TCP_SERVER_MAX_EVENTS, 100);
+        if (nevents == -1 && errno != EINTR) {
+            fprintf(stderr, "epoll_wait() failed: %s\n", strerror(errno));
+            break;
+        }
+        for (int i = 0; i < nevents; i++) {
+            if (events[i].data.fd == listen_fd) {
+                tcp_server_accept();
+            } else if (events[i].data.fd == wake_fd) {
+                uint64_t value;
+                if (read(wake_fd, &value, sizeof(value)) == -1) {
+                    /* spurious wake up - nothing to do */
+                }
+            } else {
+                TcpClient *client = (TcpClient *)events[i].data.ptr;
+                if (client->fd != -1 && (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))) {
+                    tcp_client_read(client);
+                }
+            }
+        }
+
+        /* send out the queues; poll for writable sockets only when a
+         * queue could not be sent completely
+         */
+        bool is_queue_empty = true;
+        for (int i = 0; i < tcp_server_max_clients; i++) {
+            TcpClient *client = &clients[i];
+            if (client->fd == -1) {
+                continue;
+            }
+            if (tcp_client_flush(client) == -1) {
+                tcp_client_close(client);
+                continue;
+            }
+            pthread_mutex_lock(&tcp_server_lock);
+            bool is_pending = client->queue_write > client->queue_read;
+            pthread_mutex_unlock(&tcp_server_lock);
+            if (is_pending) {
+                is_queue_empty = false;
+            }
+            if (is_pending != client->is_polling_out) {
+                struct epoll_event ev = {
+                    .events = EPOLLIN | (is_pending ? EPOLLOUT : 0),
+                    .data.ptr = client,
+                };
+                epoll_ctl(epoll_fd, EPOLL_CTL_MOD, client->fd, &ev);
+                client->is_polling_out = is_pending;
+            }
+        }
+
+        pthread_mutex_lock(&tcp_server_lock);
+        bool is_stopping = is_tcp_server_stopping;
+        pthread_mutex_unlock(&tcp_server_lock);
+        if (is_stopping) {
+            struct timespec now;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            if (stop_ts.tv_sec == 0) {
+                stop_ts = now;
+            }
+            if (is_queue_empty || now.tv_sec - stop_ts.tv_sec >= TCP_SERVER_FINISH_TIMEOUT) {
+                break;
+            }
+        }
+    }
+
+    for (int i = 0; i < tcp_server_max_clients; i++) {
+        if (clients[i].fd != -1) {
+            tcp_client_close(&clients[i]);
+        }
+    }
+    return NULL;
+}
+
+static void tcp_server_accept() {
+    for (;;) {
+        struct sockaddr_in addr;
+        socklen_t addrlen = sizeof(addr);
+        int fd = accept4(listen_fd, (struct sockaddr *)&addr, &addrlen, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd == -1) {
+            if (!(errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+                fprintf(stderr, "accept() failed: %s\n", strerror(errno));
+            }
+            return;
+        }
+        char address[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &addr.sin_addr, address, sizeof(address));
+
+        TcpClient *client = NULL;
+        for (int i = 0; i < tcp_server_max_clients; i++) {
+            if (clients[i].fd == -1) {
+                client = &clients[i];
+                break;
+            }
+        }
+        uint8_t *queue = client != NULL ? (uint8_t *)malloc(queue_capacity) : NULL;
+        if (queue == NULL) {
+            fprintf(stderr, "TCP client %s:%u rejected - too many clients\n", address, ntohs(addr.sin_port));
+            close(fd);
+            continue;
+        }
+        int nodelay = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+
+        pthread_mutex_lock(&tcp_server_lock);
+        *client = (TcpClient) {
+            .fd = fd,
+            .queue = queue,
+            .queue_read = 0,
+            .queue_write = 0,
+            .is_polling_out = false,
+            .command_size = 0,
+            .bytes_sent = 0,
+            .dropped_samples = 0,
+            .commands = 0,
+        };
+        snprintf(client->address, sizeof(client->address), "%s:%u", address, ntohs(addr.sin_port));
+        clock_gettime(CLOCK_MONOTONIC, &client->connect_ts);
+
+        /* rtl_tcp dongle info */
+        uint8_t header[12];
+        memcpy(header, TCP_SERVER_MAGIC, 4);
+        uint32_t tuner_type = htonl(TCP_SERVER_TUNER_TYPE);
+        uint32_t gain_count = htonl(0);
+        memcpy(header + 4, &tuner_type, sizeof(tuner_type));
+        memcpy(header + 8, &gain_count, sizeof(gain_count));
+        tcp_client_enqueue(client, header, sizeof(header));
+        __atomic_add_fetch(&num_clients, 1, __ATOMIC_RELAXED);
+        tcp_server_stats.clients++;
+        pthread_mutex_unlock(&tcp_server_lock);
+
+        struct epoll_event ev = {
+            .events = EPOLLIN,
+            .data.ptr = client,
+        };
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+        if (verbose) {
+            fprintf(stderr, "TCP client %s connected\n", client->address);
+        }
+    }
+}
+
+/* the client commands are counted, but not applied */
+static void tcp_client_read(TcpClient *client) {
+    for (;;) {
+        uint8_t buffer[256];
+        ssize_t nread = recv(client->fd, buffer, sizeof(buffer), 0);
+        if (nread == 0) {
+            tcp_client_close(client);
+            return;
+        }
+        if (nread == -1) {
+            if (!(errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+                tcp_client_close(client);
+            }
+            return;
+        }
+        for (ssize_t i = 0; i < nread; i++) {
+            client->command[client->command_size++] = buffer[i];
+            if (client->command_size == TCP_SERVER_COMMAND_SIZE) {
+                client->commands++;
+                tcp_server_stats.commands++;
+                client->command_size = 0;
+            }
+        }
+    }
+}
+
+static int tcp_client_flush(TcpClient *client) {
+    for (;;) {
+        pthread_mutex_lock(&tcp_server_lock);
+        unsigned long long queue_read = client->queue_read;
+        unsigned long long queue_write = client->queue_write;
+        pthread_mutex_unlock(&tcp_server_lock);
+        if (queue_read == queue_write) {
+            return 0;
+        }
+        /* the writer never touches the queued bytes, so they are sent
+         * without holding the lock
+         */
+        size_t index = queue_read % queue_capacity;
+        size_t size = queue_write - queue_read;
+        if (size > queue_capacity - index) {
+            size = queue_capacity - index;
+        }
+        ssize_t nsent = send(client->fd, client->queue + index, size, MSG_NOSIGNAL);
+        if (nsent == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+                return 0;
+            }
+            return -1;
+        }
+        pthread_mutex_lock(&tcp_server_lock);
+        client->queue_read += nsent;
+        client->bytes_sent += nsent;
+        tcp_server_stats.bytes_sent += nsent;
+        pthread_mutex_unlock(&tcp_server_lock);
+    }
+}
+
+static void tcp_client_close(TcpClient *client) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double elapsed = (now.tv_sec - client->connect_ts.tv_sec) + 1e-9 * (now.tv_nsec - client->connect_ts.tv_nsec);
+    fprintf(stderr, "TCP client %s disconnected - bytes sent = %llu (%.1lf MB/s), dropped samples = %llu, commands = %llu\n",
+            client->address, client->bytes_sent, elapsed > 0.0 ? client->bytes_sent / elapsed / 1e6 : 0.0,
+            client->dropped_samples, client->commands);
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, client->fd, NULL);
+    close(client->fd);
+    pthread_mutex_lock(&tcp_server_lock);
+    client->fd = -1;
+    free(client->queue);
+    client->queue = NULL;
+    __atomic_sub_fetch(&num_clients, 1, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&tcp_server_lock);
+}
+
+/* must be called with the lock held, and with enough room in the queue */
+static void tcp_client_enqueue(TcpClient *client, const uint8_t *data, size_t size) {
+    size_t index = client->queue_write % queue_capacity;
+    size_t n = size < queue_capacity - index ? size : queue_capacity - index;
+    memcpy(client->queue + index, data, n);
+    memcpy(client->queue, data + n, size - n);
+    client->queue_write += size;
+}
+
+static size_t tcp_server_convert(const short *xi, const short *xq, size_t num_samples) {
+    switch (tcp_server_format) {
+        case TCP_SERVER_FORMAT_CS16: {
+            int16_t *out = (int16_t *)converted;
+            for (size_t i = 0; i < num_samples; i++) {
+                out[2*i] = xi != NULL ? xi[i] : 0;
+                out[2*i+1] = xq != NULL ? xq[i] : 0;
+            }
+            break;
+        }
+        case TCP_SERVER_FORMAT_CS8:
+            interleave_cs8(xi, xq, 1, num_samples, (int8_t *)converted, 2);
+            break;
+        default:
+            /* u8 is cs8 with an offset of 128 */
+            interleave_cs8(xi, xq, 1, num_samples, (int8_t *)converted, 2);
+            for (size_t i = 0; i < 2 * num_samples; i++) {
+                converted[i] ^= 0x80;
+            }
+            break;
+    }
+    return num_samples * bytes_per_sample;
+}
+#endif /* __linux__ */
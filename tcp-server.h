@@ -0,0 +1,31 @@
+/* record to file the I/Q stream(s) from a SDRplay RSP
+ * TCP server output (rtl_tcp compatible)
+ *
+ * Copyright 2025 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef _TCP_SERVER_H
+#define _TCP_SERVER_H
+
+#include <stddef.h>
+
+/* typedefs */
+typedef struct {
+    unsigned long long clients;
+    unsigned long long bytes_sent;
+    unsigned long long dropped_samples;
+    unsigned long long commands;
+} TcpServerStats;
+
+/* global variables */
+extern TcpServerStats tcp_server_stats;
+
+/* public functions */
+int tcp_server_open();
+void tcp_server_write(const short *const *xi, const short *const *xq, unsigned int nrx, size_t num_samples);
+void tcp_server_finish();
+void tcp_server_close();
+
+#endif /* _TCP_SERVER_H */
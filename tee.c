@@ -0,0 +1,381 @@
+/* record to file the I/Q stream(s) from a SDRplay RSP
+ * tee outputs
+ *
+ * Copyright 2025 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "config.h"
+#include "output.h"
+#include "sample-format.h"
+#include "stats.h"
+#include "tee.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef WIN32
+// _setmode
+#include <io.h>
+#endif /* WIN32 */
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+/* samples copied out of the ring (and written) at a time by each sink */
+#define TEE_CHUNK_SAMPLES 65536
+
+/* the writer copies the interleaved samples into a ring shared by all the
+ * tee outputs, and each tee output has its own thread and its own read
+ * position in the ring; the writer never waits for the tee outputs: if a
+ * tee output falls more than the ring size behind, its read position is
+ * moved forward and the samples it missed are counted as dropped.
+ * The lock is only held to copy samples in and out of the ring, never
+ * while writing to a tee output.
+ */
+static pthread_mutex_t tee_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t tee_data_ready = PTHREAD_COND_INITIALIZER;
+static short *ring = NULL;
+static unsigned long long ring_samples = 0;
+static unsigned long long write_sample = 0;     /* next sample to write to the ring */
+static int num_channels = 0;
+static bool is_tee_stopping = false;
+
+/* global variables */
+TeeSink tee_sinks[MAX_TEE_OUTPUTS];
+int num_tee_sinks = 0;
+
+/* internal functions */
+static int tee_sink_init(TeeSink *sink, const char *tee_output);
+static void *tee_sink_loop(void *arg);
+static int tee_sink_open(TeeSink *sink);
+static int tee_sink_write(TeeSink *sink, size_t num_samples);
+
+
+int tee_open() {
+    if (num_tee_outputs == 0) {
+        return 0;
+    }
+    if (num_output_files != 1) {
+        fprintf(stderr, "tee outputs are not supported with one file per tuner\n");
+        return -1;
+    }
+    num_channels = output_files[0].num_channels;
+    ring_samples = tee_buffer_capacity;
+    ring = (short *)malloc(ring_samples * num_channels * sizeof(short));
+    if (ring == NULL) {
+        fprintf(stderr, "malloc(tee buffer) failed\n");
+        return -1;
+    }
+    write_sample = 0;
+    is_tee_stopping = false;
+
+#ifndef WIN32
+    /* a tee output whose reader goes away must not terminate the recording */
+    signal(SIGPIPE, SIG_IGN);
+#endif /* WIN32 */
+
+    for (int i = 0; i < num_tee_outputs; i++) {
+        TeeSink *sink = &tee_sinks[i];
+        if (tee_sink_init(sink, tee_outputs[i]) == -1) {
+            return -1;
+        }
+        num_tee_sinks++;
+        int errcode = pthread_create(&sink->thread, NULL, tee_sink_loop, sink);
+        if (errcode != 0) {
+            fprintf(stderr, "pthread_create(tee output) failed: %s\n", strerror(errcode));
+            num_tee_sinks--;
+            return -1;
+        }
+        if (verbose) {
+            fprintf(stderr, "tee output %d: %s (%s)\n", i + 1, sink->output.filename, sample_format_name(sink->sample_format));
+        }
+    }
+    return 0;
+}
+
+/* called by the writer for each segment; a NULL tuner is filled with zeros */
+void tee_write(const short *const *xi, const short *const *xq, unsigned int nrx, size_t num_samples) {
+    if (num_tee_sinks == 0) {
+        return;
+    }
+    pthread_mutex_lock(&tee_lock);
+    for (size_t offset = 0; offset < num_samples; ) {
+        unsigned long long ring_index = (write_sample + offset) % ring_samples;
+        size_t n = num_samples - offset;
+        if (n > ring_samples - ring_index) {
+            n = ring_samples - ring_index;
+        }
+        for (unsigned int tuner = 0; tuner < nrx; tuner++) {
+            short *out = ring + ring_index * num_channels + 2 * tuner;
+            if (xi[tuner] != NULL) {
+                const short *txi = xi[tuner] + offset;
+                const short *txq = xq[tuner] + offset;
+                for (size_t i = 0; i < n; i++, out += num_channels) {
+                    out[0] = txi[i];
+                    out[1] = txq[i];
+                }
+            } else {
+                for (size_t i = 0; i < n; i++, out += num_channels) {
+                    out[0] = 0;
+                    out[1] = 0;
+                }
+            }
+        }
+        offset += n;
+    }
+    write_sample += num_samples;
+
+    for (int i = 0; i < num_tee_sinks; i++) {
+        TeeSink *sink = &tee_sinks[i];
+        if (write_sample - sink->read_sample > ring_samples) {
+            unsigned long long first_sample = write_sample - ring_samples;
+            sink->dropped_samples += first_sample - sink->read_sample;
+            sink->read_sample = first_sample;
+            if (!sink->is_overrun) {
+                sink->overruns++;
+                sink->is_overrun = true;
+            }
+        }
+    }
+    pthread_cond_broadcast(&tee_data_ready);
+    pthread_mutex_unlock(&tee_lock);
+}
+
+/* end of streaming: the tee outputs write out what is left in the ring */
+void tee_finish() {
+    if (num_tee_sinks == 0) {
+        return;
+    }
+    pthread_mutex_lock(&tee_lock);
+    is_tee_stopping = true;
+    pthread_cond_broadcast(&tee_data_ready);
+    for (int i = 0; i < num_tee_sinks; i++) {
+        /* nobody ever opened the other end of the named pipe */
+        if (tee_sinks[i].state == TEE_SINK_OPENING) {
+            pthread_cancel(tee_sinks[i].thread);
+        }
+    }
+    pthread_mutex_unlock(&tee_lock);
+
+    for (int i = 0; i < num_tee_sinks; i++) {
+        TeeSink *sink = &tee_sinks[i];
+        pthread_join(sink->thread, NULL);
+        /* samples never read by a tee output that failed or never opened */
+        sink->dropped_samples += write_sample - sink->read_sample;
+        sink->read_sample = write_sample;
+    }
+}
+
+void tee_close() {
+    for (int i = 0; i < num_tee_sinks; i++) {
+        TeeSink *sink = &tee_sinks[i];
+        if (sink->output.is_open) {
+            close(sink->output.fd);
+            sink->output.fd = -1;
+            sink->output.is_open = false;
+        }
+        free(sink->samples);
+        sink->samples = NULL;
+        free(sink->converted);
+        sink->converted = NULL;
+    }
+    num_tee_sinks = 0;
+    free(ring);
+    ring = NULL;
+}
+
+/* internal functions */
+static int tee_sink_init(TeeSink *sink, const char *tee_output) {
+    *sink = (TeeSink) {
+        .sample_format = SAMPLE_FORMAT_S16,
+        .state = TEE_SINK_OPENING,
+        .read_sample = 0,
+        .dropped_samples = 0,
+        .overruns = 0,
+        .is_overrun = false,
+        .samples = NULL,
+        .converted = NULL,
+    };
+    sink->output = (OutputFile) {
+        .fd = -1,
+        .tuner = -1,
+        .num_channels = num_channels,
+        .stats = &sink->stats,
+        .is_open = false,
+        .index_fd = -1,
+    };
+
+    /* optional sample format prefix */
+    const char *filename = tee_output;
+    const char *sep = strchr(tee_output, ':');
+    if (sep != NULL) {
+        char format[16];
+        size_t len = sep - tee_output;
+        if (len < sizeof(format)) {
+            memcpy(format, tee_output, len);
+            format[len] = '\0';
+            if (strcasecmp(format, "s16") == 0) {
+                sink->sample_format = SAMPLE_FORMAT_S16;
+                filename = sep + 1;
+            } else if (strcasecmp(format, "cf32") == 0) {
+                sink->sample_format = SAMPLE_FORMAT_CF32;
+                filename = sep + 1;
+            } else if (strcasecmp(format, "cs8") == 0) {
+                sink->sample_format = SAMPLE_FORMAT_CS8;
+                filename = sep + 1;
+            }
+        }
+    }
+    if (strlen(filename) == 0) {
+        fprintf(stderr, "empty tee output filename: %s\n", tee_output);
+        return -1;
+    }
+    if (strcmp(filename, "-") == 0) {
+        if (strcmp(output_files[0].filename, "-") == 0) {
+            fprintf(stderr, "stdout cannot be used for both the output file and a tee output\n");
+            return -1;
+        }
+        for (int i = 0; i < num_tee_sinks; i++) {
+            if (strcmp(tee_sinks[i].output.filename, "-") == 0) {
+                fprintf(stderr, "stdout cannot be used for more than one tee output\n");
+                return -1;
+            }
+        }
+    }
+    snprintf(sink->output.filename, sizeof(sink->output.filename), "%s", filename);
+
+    size_t value_size = sink->sample_format == SAMPLE_FORMAT_CF32 ? sizeof(float) : sizeof(int8_t);
+    sink->samples = (short *)malloc(TEE_CHUNK_SAMPLES * num_channels * sizeof(short));
+    if (sink->sample_format != SAMPLE_FORMAT_S16) {
+        sink->converted = (uint8_t *)malloc(TEE_CHUNK_SAMPLES * num_channels * value_size);
+    }
+    if (sink->samples == NULL || (sink->sample_format != SAMPLE_FORMAT_S16 && sink->converted == NULL)) {
+        fprintf(stderr, "malloc(tee output buffers) failed\n");
+        return -1;
+    }
+    return 0;
+}
+
+static void *tee_sink_loop(void *arg) {
+    TeeSink *sink = (TeeSink *)arg;
+
+    /* the open of a named pipe blocks until there is a reader, so it is
+     * done here, and it is the only place where this thread can be cancelled
+     */
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+    int open_status = tee_sink_open(sink);
+    pthread_mutex_lock(&tee_lock);
+    sink->state = open_status == 0 ? TEE_SINK_OPEN : TEE_SINK_FAILED;
+    /* the samples before the tee output was opened are dropped */
+    if (sink->state == TEE_SINK_OPEN && write_sample - sink->read_sample > 0) {
+        sink->dropped_samples += write_sample - sink->read_sample;
+        sink->read_sample = write_sample;
+    }
+
+    while (sink->state == TEE_SINK_OPEN) {
+        while (sink->read_sample == write_sample && !is_tee_stopping) {
+            pthread_cond_wait(&tee_data_ready, &tee_lock);
+        }
+        if (sink->read_sample == write_sample) {
+            sink->state = TEE_SINK_DONE;
+            break;
+        }
+        unsigned long long ring_index = sink->read_sample % ring_samples;
+        size_t n = write_sample - sink->read_sample;
+        if (n > TEE_CHUNK_SAMPLES) {
+            n = TEE_CHUNK_SAMPLES;
+        }
+        if (n > ring_samples - ring_index) {
+            n = ring_samples - ring_index;
+        }
+        memcpy(sink->samples, ring + ring_index * num_channels, n * num_channels * sizeof(short));
+        sink->read_sample += n;
+        sink->is_overrun = false;
+        pthread_mutex_unlock(&tee_lock);
+
+        int write_status = tee_sink_write(sink, n);
+
+        pthread_mutex_lock(&tee_lock);
+        if (write_status == -1) {
+            fprintf(stderr, "tee output %s failed - no more samples will be written to it\n", sink->output.filename);
+            sink->state = TEE_SINK_FAILED;
+        }
+    }
+    pthread_mutex_unlock(&tee_lock);
+    return NULL;
+}
+
+static int tee_sink_open(TeeSink *sink) {
+    OutputFile *output = &sink->output;
+    const char *filename = output->filename;
+    if (strcmp(filename, "-") == 0) {
+        output->fd = fileno(stdout);
+#ifdef WIN32
+        _setmode(output->fd, _O_BINARY);
+#endif
+    } else if (filename[0] == '|') {
+        const char *pipename = filename + 1;
+        while (isspace(*pipename))
+            pipename++;
+        if (strlen(pipename) == 0) {
+            fprintf(stderr, "empty named pipe name\n");
+            return -1;
+        }
+        pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+        output->fd = open(pipename, O_WRONLY | O_BINARY);
+        pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+    } else {
+        output->fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, 0644);
+    }
+    if (output->fd == -1) {
+        fprintf(stderr, "open(%s) for writing failed: %s\n", filename, strerror(errno));
+        return -1;
+    }
+    output->is_open = true;
+    return 0;
+}
+
+static int tee_sink_write(TeeSink *sink, size_t num_samples) {
+    Stats *stats = &sink->stats;
+    if (sink->sample_format == SAMPLE_FORMAT_S16) {
+        if (output_write(&sink->output, (const uint8_t *)sink->samples, num_samples * num_channels * sizeof(short)) == -1) {
+            return -1;
+        }
+        stats->output_samples += num_samples;
+        return 0;
+    }
+
+    /* cf32 values are always full scale for the tee outputs */
+    size_t value_size = sink->sample_format == SAMPLE_FORMAT_CF32 ? sizeof(float) : sizeof(int8_t);
+    struct timespec before_convert_ts;
+    struct timespec after_convert_ts;
+    clock_gettime(CLOCK_MONOTONIC, &before_convert_ts);
+    for (int tuner = 0; tuner < num_channels / 2; tuner++) {
+        const short *xi = sink->samples + 2 * tuner;
+        const short *xq = sink->samples + 2 * tuner + 1;
+        if (sink->sample_format == SAMPLE_FORMAT_CF32) {
+            interleave_cf32(xi, xq, num_channels, num_samples, 1.0f / FULL_SCALE_14BIT, (float *)sink->converted + 2 * tuner, num_channels);
+        } else {
+            stats->conversion_clipped_values += interleave_cs8(xi, xq, num_channels, num_samples, (int8_t *)sink->converted + 2 * tuner, num_channels);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &after_convert_ts);
+    stats->conversion_input_bytes += num_samples * num_channels * sizeof(short);
+    stats->conversion_elapsed += (after_convert_ts.tv_sec - before_convert_ts.tv_sec) * 1000000000ULL + after_convert_ts.tv_nsec - before_convert_ts.tv_nsec;
+    if (output_write(&sink->output, sink->converted, num_samples * num_channels * value_size) == -1) {
+        return -1;
+    }
+    stats->output_samples += num_samples;
+    return 0;
+}
@@ -0,0 +1,53 @@
+/* record to file the I/Q stream(s) from a SDRplay RSP
+ * tee outputs
+ *
+ * Copyright 2025 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef _TEE_H
+#define _TEE_H
+
+#include "config.h"
+#include "output.h"
+#include "stats.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* typedefs */
+typedef enum {
+    TEE_SINK_OPENING,
+    TEE_SINK_OPEN,
+    TEE_SINK_FAILED,
+    TEE_SINK_DONE,
+} TeeSinkState;
+
+typedef struct {
+    OutputFile output;          /* fd, filename, and write stats */
+    SampleFormat sample_format;
+    Stats stats;
+    TeeSinkState state;
+    unsigned long long read_sample;     /* next sample to read from the ring */
+    unsigned long long dropped_samples; /* overwritten before they were read */
+    unsigned long long overruns;
+    bool is_overrun;
+    short *samples;             /* samples copied out of the ring */
+    uint8_t *converted;         /* samples in the output sample format */
+    pthread_t thread;
+} TeeSink;
+
+/* global variables */
+extern TeeSink tee_sinks[MAX_TEE_OUTPUTS];
+extern int num_tee_sinks;
+
+/* public functions */
+int tee_open();
+void tee_write(const short *const *xi, const short *const *xq, unsigned int nrx, size_t num_samples);
+void tee_finish();
+void tee_close();
+
+#endif /* _TEE_H */
@@ -0,0 +1,525 @@
+/* record to file the I/Q stream(s) from a SDRplay RSP
+ * triggered recordings
+ *
+ * Copyright 2025 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "buffers.h"
+#include "config.h"
+#include "output.h"
+#include "sdrplay-rsp.h"
+#include "stats.h"
+#include "trigger.h"
+#include "wav.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#ifndef WIN32
+#include <poll.h>
+#include <pthread.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#endif /* WIN32 */
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+/* in trigger mode nothing is written to the main output file: the writer
+ * keeps the last samples in a ring ('trigger pre time' seconds, plus one
+ * second of slack for the latency of the writer), and when a trigger fires
+ * the samples from 'trigger pre time' before the trigger to 'trigger post
+ * time' after it are written to a new file. A trigger that fires while a
+ * triggered recording is still being written extends it instead.
+ * The triggers come from SIGUSR1, from the control socket, or from
+ * trigger_fire() (built-in detectors); the asynchronous ones are converted
+ * to a sample number from their wall clock time.
+ */
+#define TRIGGER_RING_SLACK 1.0          /* seconds */
+#define TRIGGER_CONTROL_POLL_MS 200
+#define TRIGGER_MAX_GAPS 1024
+
+/* typedefs */
+typedef struct {
+    unsigned long long sample_num;      /* first sample after the gap */
+    unsigned long long skipped_samples; /* samples skipped up to here */
+} SkippedGap;
+
+/* global variables */
+TriggerStats trigger_stats = {
+    .triggers = 0,
+    .merged_triggers = 0,
+    .recordings = 0,
+    .samples = 0,
+};
+
+static short *ring = NULL;
+static unsigned long long ring_samples = 0;
+static unsigned int num_channels = 0;
+static unsigned long long written_samples = 0;  /* samples added to the ring */
+static unsigned long long skipped_samples = 0;  /* gaps not in the ring */
+/* the recent gaps, so the samples before a gap keep their timestamp */
+static SkippedGap gaps[TRIGGER_MAX_GAPS];
+static unsigned int num_gaps = 0;
+static unsigned long long gaps_base = 0;        /* samples skipped before gaps[0] */
+static unsigned long long pre_samples = 0;
+static unsigned long long post_samples = 0;
+
+static bool is_recording = false;
+static OutputFile recording;
+static Stats recording_stats;
+static unsigned long long recording_next_sample = 0;
+static unsigned long long recording_end_sample = 0;
+
+static FILE *events_fp = NULL;
+
+/* pending asynchronous triggers (wall clock time in ns, 0 if none) */
+static long long pending_signal_ns = 0;
+static long long pending_socket_ns = 0;
+#ifndef WIN32
+static int control_fd = -1;
+static pthread_t control_thread;
+static bool is_control_running = false;
+static bool is_control_stopping = false;
+#endif /* WIN32 */
+
+/* internal functions */
+static void check_pending_triggers();
+static unsigned long long timestamp_to_sample(long long ns);
+static void sample_timestamp(unsigned long long sample_num, struct timespec *ts);
+static unsigned long long skipped_before(unsigned long long sample_num);
+static int recording_open(unsigned long long trigger_sample, unsigned long long first_sample);
+static void recording_flush();
+static void recording_close();
+#ifndef WIN32
+static void trigger_signal_handler(int signum);
+static int control_socket_open();
+static void *control_socket_loop(void *arg);
+#endif /* WIN32 */
+
+
+int trigger_open() {
+    if (!trigger_mode) {
+        return 0;
+    }
+    num_channels = output_files[0].num_channels;
+    pre_samples = (unsigned long long)(trigger_pre_time * output_sample_rate + 0.5);
+    post_samples = (unsigned long long)(trigger_post_time * output_sample_rate + 0.5);
+    ring_samples = pre_samples + (unsigned long long)(TRIGGER_RING_SLACK * output_sample_rate + 0.5);
+    ring = (short *)malloc(ring_samples * num_channels * sizeof(short));
+    if (ring == NULL) {
+        fprintf(stderr, "malloc(trigger ring) failed\n");
+        return -1;
+    }
+    written_samples = 0;
+    skipped_samples = 0;
+    num_gaps = 0;
+    gaps_base = 0;
+    is_recording = false;
+
+    /* the events file is named after the main output file */
+    char events_filename[PATH_MAX];
+    snprintf(events_filename, sizeof(events_filename), "%s", output_files[0].filename);
+    char *p = strrchr(events_filename, '.');
+    char *sep = strrchr(events_filename, '/');
+    if (p == NULL || (sep != NULL && p < sep)) {
+        p = events_filename + strlen(events_filename);
+    }
+    snprintf(p, sizeof(events_filename) - (p - events_filename), ".events.csv");
+    events_fp = fopen(events_filename, "w");
+    if (events_fp == NULL) {
+        fprintf(stderr, "fopen(%s) failed: %s\n", events_filename, strerror(errno));
+        return -1;
+    }
+    fprintf(events_fp, "sample,timestamp,event,detail\n");
+    fflush(events_fp);
+
+#ifndef WIN32
+    __atomic_store_n(&pending_signal_ns, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&pending_socket_ns, 0, __ATOMIC_RELAXED);
+    signal(SIGUSR1, trigger_signal_handler);
+    if (trigger_control_socket != NULL) {
+        if (control_socket_open() == -1) {
+            return -1;
+        }
+    }
+#endif /* WIN32 */
+
+    if (verbose) {
+        fprintf(stderr, "trigger mode: %.1lfs before and %.1lfs after each trigger - events in %s\n", trigger_pre_time, trigger_post_time, events_filename);
+    }
+    return 0;
+}
+
+/* called by the writer for each segment; a NULL tuner is filled with zeros */
+void trigger_write(const short *const *xi, const short *const *xq, unsigned int nrx, size_t num_samples) {
+    if (ring == NULL) {
+        return;
+    }
+    check_pending_triggers();
+
+    for (size_t offset = 0; offset < num_samples; ) {
+        unsigned long long ring_index = written_samples % ring_samples;
+        size_t n = num_samples - offset;
+        if (n > ring_samples - ring_index) {
+            n = ring_samples - ring_index;
+        }
+        for (unsigned int tuner = 0; tuner < nrx; tuner++) {
+            short *out = ring + ring_index * num_channels + 2 * tuner;
+            const short *txi = xi[tuner];
+            const short *txq = xq[tuner];
+            if (txi != NULL) {
+                for (size_t i = 0; i < n; i++, out += num_channels) {
+                    out[0] = txi[offset + i];
+                    out[1] = txq[offset + i];
+                }
+            } else {
+                for (size_t i = 0; i < n; i++, out += num_channels) {
+                    out[0] = 0;
+                    out[1] = 0;
+                }
+            }
+        }
+        written_samples += n;
+        offset += n;
+        if (is_recording) {
+            recording_flush();
+        }
+    }
+}
+
+/* gaps that are not filled with zeros still count for the timestamps */
+void trigger_skip(unsigned long long num_samples) {
+    skipped_samples += num_samples;
+    if (ring == NULL) {
+        return;
+    }
+    /* the gaps before the oldest sample in the ring are no longer needed */
+    unsigned long long oldest_sample = written_samples > ring_samples ? written_samples - ring_samples : 0;
+    unsigned int num_old = 0;
+    while (num_old + 1 < num_gaps && gaps[num_old + 1].sample_num <= oldest_sample) {
+        num_old++;
+    }
+    if (num_old == 0 && num_gaps == TRIGGER_MAX_GAPS) {
+        num_old = 1;
+    }
+    if (num_old > 0) {
+        gaps_base = gaps[num_old - 1].skipped_samples;
+        num_gaps -= num_old;
+        memmove(gaps, gaps + num_old, num_gaps * sizeof(SkippedGap));
+    }
+    if (num_gaps > 0 && gaps[num_gaps - 1].sample_num == written_samples) {
+        gaps[num_gaps - 1].skipped_samples = skipped_samples;
+    } else {
+        gaps[num_gaps++] = (SkippedGap) {
+            .sample_num = written_samples,
+            .skipped_samples = skipped_samples,
+        };
+    }
+}
+
+/* must be called from the writer thread */
+void trigger_fire(unsigned long long sample_num, const char *source) {
+    if (ring == NULL) {
+        return;
+    }
+    trigger_stats.triggers++;
+    if (is_recording) {
+        if (sample_num + post_samples > recording_end_sample) {
+            recording_end_sample = sample_num + post_samples;
+        }
+        trigger_stats.merged_triggers++;
+        trigger_log_event(sample_num, "trigger merged", source);
+        return;
+    }
+    trigger_log_event(sample_num, "trigger", source);
+
+    unsigned long long first_sample = sample_num > pre_samples ? sample_num - pre_samples : 0;
+    unsigned long long oldest_sample = written_samples > ring_samples ? written_samples - ring_samples : 0;
+    if (first_sample < oldest_sample) {
+        first_sample = oldest_sample;
+    }
+    if (recording_open(sample_num, first_sample) == -1) {
+        return;
+    }
+    recording_flush();
+}
+
+/* keep the recording in progress going until 'trigger post time' after
+ * sample_num (for instance while a detector is active)
+ */
+void trigger_extend(unsigned long long sample_num) {
+    if (ring == NULL || !is_recording) {
+        return;
+    }
+    if (sample_num + post_samples > recording_end_sample) {
+        recording_end_sample = sample_num + post_samples;
+    }
+}
+
+/* one line in the events file */
+void trigger_log_event(unsigned long long sample_num, const char *event, const char *detail) {
+    if (events_fp == NULL) {
+        return;
+    }
+    struct timespec ts;
+    sample_timestamp(sample_num, &ts);
+    struct tm tm;
+#ifdef WIN32
+    gmtime_s(&tm, &ts.tv_sec);
+#else
+    gmtime_r(&ts.tv_sec, &tm);
+#endif /* WIN32 */
+    char datetime[32];
+    strftime(datetime, sizeof(datetime), "%Y-%m-%dT%H:%M:%S", &tm);
+    fprintf(events_fp, "%llu,%s.%06ldZ,%s,%s\n", sample_num, datetime, ts.tv_nsec / 1000, event, detail);
+    fflush(events_fp);
+}
+
+void trigger_close() {
+    if (ring == NULL) {
+        return;
+    }
+#ifndef WIN32
+    signal(SIGUSR1, SIG_DFL);
+    if (is_control_running) {
+        __atomic_store_n(&is_control_stopping, true, __ATOMIC_RELAXED);
+        pthread_join(control_thread, NULL);
+        is_control_running = false;
+    }
+    if (control_fd != -1) {
+        close(control_fd);
+        control_fd = -1;
+        unlink(trigger_control_socket);
+    }
+#endif /* WIN32 */
+    /* the recording in progress ends with the last sample received */
+    if (is_recording) {
+        recording_end_sample = written_samples;
+        recording_flush();
+    }
+    if (events_fp != NULL) {
+        fclose(events_fp);
+        events_fp = NULL;
+    }
+    free(ring);
+    ring = NULL;
+}
+
+/* internal functions */
+static void check_pending_triggers() {
+    long long ns = __atomic_exchange_n(&pending_signal_ns, 0, __ATOMIC_RELAXED);
+    if (ns != 0) {
+        trigger_fire(timestamp_to_sample(ns), "signal");
+    }
+    ns = __atomic_exchange_n(&pending_socket_ns, 0, __ATOMIC_RELAXED);
+    if (ns != 0) {
+        trigger_fire(timestamp_to_sample(ns), "control socket");
+    }
+}
+
+/* the samples are received (and written) a little after they were
+ * sampled, so the sample at the time of the trigger can still be in the
+ * future for the writer; it is limited to one second ahead
+ */
+static unsigned long long timestamp_to_sample(long long ns) {
+    long long start_ns = timeinfo.start_ts.tv_sec * 1000000000LL + timeinfo.start_ts.tv_nsec;
+    if (timeinfo.start_ts.tv_sec == 0 || ns <= start_ns) {
+        return written_samples;
+    }
+    double elapsed = (ns - start_ns) * 1e-9;
+    long long sample_num = (long long)(elapsed * output_sample_rate + 0.5) - (long long)skipped_samples;
+    unsigned long long max_sample_num = written_samples + (unsigned long long)(output_sample_rate + 0.5);
+    if (sample_num < 0) {
+        return 0;
+    }
+    return (unsigned long long)sample_num < max_sample_num ? (unsigned long long)sample_num : max_sample_num;
+}
+
+static void sample_timestamp(unsigned long long sample_num, struct timespec *ts) {
+    long long start_ns = timeinfo.start_ts.tv_sec * 1000000000LL + timeinfo.start_ts.tv_nsec;
+    double elapsed = (double)(sample_num + skipped_before(sample_num)) / output_sample_rate;
+    long long ns = start_ns + (long long)(elapsed * 1e9 + 0.5);
+    ts->tv_sec = ns / 1000000000LL;
+    ts->tv_nsec = ns % 1000000000LL;
+}
+
+/* samples skipped in the gaps before sample_num */
+static unsigned long long skipped_before(unsigned long long sample_num) {
+    for (unsigned int i = num_gaps; i > 0; i--) {
+        if (gaps[i - 1].sample_num <= sample_num) {
+            return gaps[i - 1].skipped_samples;
+        }
+    }
+    return gaps_base;
+}
+
+static int recording_open(unsigned long long trigger_sample, unsigned long long first_sample) {
+    struct timespec trigger_ts;
+    sample_timestamp(trigger_sample, &trigger_ts);
+    char filename[PATH_MAX];
+    if (output_trigger_filename(filename, PATH_MAX, &trigger_ts, trigger_sample) != 0) {
+        fprintf(stderr, "output_trigger_filename(%s) failed\n", outfile_template);
+        return -1;
+    }
+
+    recording_stats = (Stats) {
+        .data_size = 0,
+        .output_samples = 0,
+    };
+    recording = (OutputFile) {
+        .fd = -1,
+        .tuner = -1,
+        .num_channels = num_channels,
+        .frequency = frequency_A,
+        .wav_type = WAV_TYPE_UNKNOWN,
+        .stats = &recording_stats,
+        .is_open = false,
+        .index_fd = -1,
+    };
+    snprintf(recording.filename, sizeof(recording.filename), "%s", filename);
+    recording.fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, 0644);
+    if (recording.fd == -1) {
+        fprintf(stderr, "open(%s) for writing failed: %s\n", filename, strerror(errno));
+        return -1;
+    }
+    recording.is_open = true;
+    if (output_type != OUTPUT_TYPE_WAVVIEWDX_RAW) {
+        if (write_plain_wav_header(&recording) == -1) {
+            fprintf(stderr, "write() WAV header failed: %s\n", strerror(errno));
+            close(recording.fd);
+            return -1;
+        }
+    }
+    is_recording = true;
+    recording_next_sample = first_sample;
+    recording_end_sample = trigger_sample + post_samples;
+    trigger_stats.recordings++;
+    trigger_log_event(first_sample, "recording start", filename);
+    if (verbose) {
+        fprintf(stderr, "triggered recording %s\n", filename);
+    }
+    return 0;
+}
+
+/* write the samples in the ring up to the end of the recording */
+static void recording_flush() {
+    unsigned long long end_sample = written_samples < recording_end_sample ? written_samples : recording_end_sample;
+    while (recording_next_sample < end_sample) {
+        unsigned long long ring_index = recording_next_sample % ring_samples;
+        unsigned long long n = end_sample - recording_next_sample;
+        if (n > ring_samples - ring_index) {
+            n = ring_samples - ring_index;
+        }
+        if (output_write(&recording, (const uint8_t *)(ring + ring_index * num_channels), n * num_channels * sizeof(short)) == -1) {
+            recording_close();
+            return;
+        }
+        recording_next_sample += n;
+        recording_stats.output_samples += n;
+        trigger_stats.samples += n;
+    }
+    if (recording_next_sample >= recording_end_sample) {
+        recording_close();
+    }
+}
+
+static void recording_close() {
+    if (output_type != OUTPUT_TYPE_WAVVIEWDX_RAW) {
+        if (finalize_plain_wav_file(&recording) == -1) {
+            fprintf(stderr, "finalize() WAV file failed: %s\n", strerror(errno));
+        }
+    }
+    close(recording.fd);
+    recording.fd = -1;
+    recording.is_open = false;
+    is_recording = false;
+    trigger_log_event(recording_next_sample, "recording end", recording.filename);
+}
+
+#ifndef WIN32
+static void trigger_signal_handler(int signum) {
+    (void)signum;
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    __atomic_store_n(&pending_signal_ns, ts.tv_sec * 1000000000LL + ts.tv_nsec, __ATOMIC_RELAXED);
+}
+
+/* Unix datagram socket; each 'trigger' datagram fires a trigger */
+static int control_socket_open() {
+    struct sockaddr_un addr = {
+        .sun_family = AF_UNIX,
+    };
+    if (strlen(trigger_control_socket) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "trigger control socket path is too long: %s\n", trigger_control_socket);
+        return -1;
+    }
+    strcpy(addr.sun_path, trigger_control_socket);
+    struct stat st;
+    if (stat(trigger_control_socket, &st) == 0 && S_ISSOCK(st.st_mode)) {
+        /* left over from a previous recording */
+        unlink(trigger_control_socket);
+    }
+    control_fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+    if (control_fd == -1) {
+        fprintf(stderr, "socket() failed: %s\n", strerror(errno));
+        return -1;
+    }
+    if (bind(control_fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+        fprintf(stderr, "bind(%s) failed: %s\n", trigger_control_socket, strerror(errno));
+        close(control_fd);
+        control_fd = -1;
+        return -1;
+    }
+    is_control_stopping = false;
+    int errcode = pthread_create(&control_thread, NULL, control_socket_loop, NULL);
+    if (errcode != 0) {
+        fprintf(stderr, "pthread_create(trigger control socket) failed: %s\n", strerror(errcode));
+        return -1;
+    }
+    is_control_running = true;
+    return 0;
+}
+
+static void *control_socket_loop(void *arg) {
+    (void)arg;
+    while (!__atomic_load_n(&is_control_stopping, __ATOMIC_RELAXED)) {
+        struct pollfd pfd = {
+            .fd = control_fd,
+            .events = POLLIN,
+        };
+        if (poll(&pfd, 1, TRIGGER_CONTROL_POLL_MS) <= 0) {
+            continue;
+        }
+        char command[64];
+        ssize_t n = recv(control_fd, command, sizeof(command) - 1, 0);
+        if (n <= 0) {
+            continue;
+        }
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        while (n > 0 && (command[n-1] == '\n' || command[n-1] == '\r' || command[n-1] == ' ')) {
+            n--;
+        }
+        command[n] = '\0';
+        if (strcasecmp(command, "trigger") == 0) {
+            __atomic_store_n(&pending_socket_ns, ts.tv_sec * 1000000000LL + ts.tv_nsec, __ATOMIC_RELAXED);
+        } else {
+            fprintf(stderr, "trigger control socket: unknown command: %s\n", command);
+        }
+    }
+    return NULL;
+}
+#endif /* WIN32 */
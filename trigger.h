@@ -0,0 +1,34 @@
+/* record to file the I/Q stream(s) from a SDRplay RSP
+ * triggered recordings
+ *
+ * Copyright 2025 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef _TRIGGER_H
+#define _TRIGGER_H
+
+#include <stddef.h>
+
+/* typedefs */
+typedef struct {
+    unsigned long long triggers;
+    unsigned long long merged_triggers;
+    unsigned long long recordings;
+    unsigned long long samples;         /* written to the triggered recordings */
+} TriggerStats;
+
+/* global variables */
+extern TriggerStats trigger_stats;
+
+/* public functions */
+int trigger_open();
+void trigger_write(const short *const *xi, const short *const *xq, unsigned int nrx, size_t num_samples);
+void trigger_skip(unsigned long long num_samples);
+void trigger_fire(unsigned long long sample_num, const char *source);
+void trigger_extend(unsigned long long sample_num);
+void trigger_log_event(unsigned long long sample_num, const char *event, const char *detail);
+void trigger_close();
+
+#endif /* _TRIGGER_H */
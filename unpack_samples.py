@@ -0,0 +1,88 @@
+#!/usr/bin/env python3
+# convert a raw recording in one of the output sample formats back to
+# 16 bit I/Q samples
+#
+# Copyright 2025 Franco Venturi
+#
+# SPDX-License-Identifier: GPL-3.0-or-later
+
+import struct
+import sys
+
+BFP8_HEADER = struct.Struct('<8sHHId')
+
+def read_bfp8_header(fin):
+    # magic, header size, channels, frames per block, sample rate
+    data = fin.read(BFP8_HEADER.size)
+    if len(data) < BFP8_HEADER.size:
+        return None
+    magic, header_size, num_channels, block_size, sample_rate = BFP8_HEADER.unpack(data)
+    if magic != b'RSPBFP01':
+        return None
+    fin.read(header_size - BFP8_HEADER.size)
+    return num_channels, block_size, sample_rate
+
+def unpack_bfp8(fin, fout, num_channels, block_size):
+    # one exponent byte followed by the 8 bit mantissas for each block
+    block_values = block_size * num_channels
+    num_values = 0
+    while True:
+        block = fin.read(1 + block_values)
+        if len(block) < 2:
+            break
+        exponent = block[0]
+        mantissas = struct.unpack_from(f'{len(block) - 1}b', block, 1)
+        fout.write(struct.pack(f'<{len(mantissas)}h', *(m << exponent for m in mantissas)))
+        num_values += len(mantissas)
+    return num_values
+
+def unpack_packed(fin, fout, group_values, group_bytes, bits):
+    # groups of 'group_values' values packed little endian in 'group_bytes'
+    # bytes; packed12 values are scaled back to the 14 bit range
+    shift = 14 - bits
+    mask = (1 << bits) - 1
+    sign = 1 << (bits - 1)
+    num_values = 0
+    while True:
+        data = fin.read(group_bytes * 65536)
+        if len(data) < group_bytes:
+            break
+        values = []
+        for offset in range(0, len(data) - group_bytes + 1, group_bytes):
+            w = int.from_bytes(data[offset:offset+group_bytes], 'little')
+            for j in range(group_values):
+                v = (w >> (bits * j)) & mask
+                values.append(((v ^ sign) - sign) << shift)
+        fout.write(struct.pack(f'<{len(values)}h', *values))
+        num_values += len(values)
+    return num_values
+
+def main():
+    if len(sys.argv) < 4:
+        print(f'usage: {sys.argv[0]} <sample format> <input file> <output file> [<channels>]', file=sys.stderr)
+        sys.exit(1)
+    sample_format = sys.argv[1].lower()
+    input_filename = sys.argv[2]
+    output_filename = sys.argv[3]
+    num_channels = int(sys.argv[4]) if len(sys.argv) > 4 else 2
+
+    if sample_format not in ('bfp8', 'packed12', 'packed14'):
+        print(f'unsupported sample format: {sample_format}', file=sys.stderr)
+        sys.exit(1)
+    with open(input_filename, 'rb') as fin, open(output_filename, 'wb') as fout:
+        if sample_format == 'bfp8':
+            # the bfp8 header has the number of channels and the block size
+            header = read_bfp8_header(fin)
+            if header is None:
+                print(f'invalid bfp8 header in {input_filename}', file=sys.stderr)
+                sys.exit(1)
+            num_channels, block_size, _ = header
+            num_values = unpack_bfp8(fin, fout, num_channels, block_size)
+        elif sample_format == 'packed12':
+            num_values = unpack_packed(fin, fout, 2, 3, 12)
+        else:
+            num_values = unpack_packed(fin, fout, 4, 7, 14)
+    print(f'samples={num_values // num_channels}', file=sys.stderr)
+
+if __name__ == '__main__':
+    main()
@@ -18,9 +18,12 @@
 
 #include <errno.h>
 #include <limits.h>
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 #define WAVE_FORMAT_PCM 1
@@ -66,6 +69,13 @@ struct DataSize64Chunk {
     uint32_t tableLength;
 };
 
+/* ds64 table entry, for the size of a chunk other than 'data' */
+struct ChunkSize64 {
+    char chunkId[4];
+    uint32_t chunkSizeLow;
+    uint32_t chunkSizeHigh;
+};
+
 struct SystemTime {
     uint16_t year;
     uint16_t month;
@@ -124,138 +134,195 @@ struct MarkerChunk {
     uint32_t chunkSize;
 };
 
-typedef enum {
-    WAV_TYPE_UNKNOWN,
-    WAV_TYPE_RIFF,      /* 32 bit */
-    WAV_TYPE_RF64,      /* 62 bit */
-} WavType;
-
-static WavType wav_type = WAV_TYPE_UNKNOWN;
+/* gain and power overload events ('rspe' chunk); it is written right
+ * after the data chunk, so it can be found with one seek using the data
+ * size in the ds64 chunk, and its size is also in the ds64 table
+ */
+struct EventsChunk {
+    char chunkId[4];
+    uint32_t chunkSize;
+};
 
 /* internal functions */
-static int write_riff_header(uint16_t block_alignment);
-static int write_rf64_header(uint16_t block_alignment);
-static int write_data_header();
-static int finalize_riff_file(off_t data_chunk_offset, uint32_t riff_size);
-static int finalize_rf64_file(unsigned long long riff_size);
-
-
-int write_sdruno_header() {
-    wav_type = estimate_data_size() < MAX_RIFF_SIZE ? WAV_TYPE_RIFF : WAV_TYPE_RF64;
+static int write_riff_header(OutputFile *output, uint16_t block_alignment);
+static int write_rf64_header(OutputFile *output, uint16_t block_alignment);
+static int write_data_header(OutputFile *output);
+static int write_auxi_chunk(OutputFile *output);
+static int update_sdruno_header(OutputFile *output, const struct timespec *stop_ts, bool is_final);
+static int update_sdrconnect_header(OutputFile *output, bool is_final);
+static int update_experimental_header(OutputFile *output, bool is_final);
+static int write_markers_chunk(OutputFile *output, off_t offset, unsigned long long num_markers);
+static unsigned long long events_chunk_num_records(const OutputFile *output, bool is_final);
+static int write_events_chunk(OutputFile *output, off_t offset, unsigned long long num_records);
+static off_t ds64_chunk_size();
+static int finalize_riff_file(OutputFile *output, off_t data_chunk_offset, uint32_t riff_size);
+static int finalize_rf64_file(OutputFile *output, unsigned long long riff_size, unsigned long long events_size);
+static int write_at(OutputFile *output, const void *buf, size_t count, off_t offset);
+
+
+int write_sdruno_header(OutputFile *output) {
+    output->wav_type = estimate_data_size(output->num_channels / 2) < MAX_RIFF_SIZE ? WAV_TYPE_RIFF : WAV_TYPE_RF64;
+    if (events_chunk_enable) {
+        output->wav_type = WAV_TYPE_RF64;
+    }
 
-    if (is_dual_tuner && frequency_A != frequency_B) {
+    if (output->num_channels > 2 && frequency_A != frequency_B) {
         fprintf(stderr, "warning: SRuno auxi chunk can store only one center frequency\n");
     }
 
     uint16_t block_alignment = 2 * sizeof(short);
-    if (wav_type == WAV_TYPE_RIFF) {
-        if (write_riff_header(block_alignment) == -1) {
+    if (output->wav_type == WAV_TYPE_RIFF) {
+        if (write_riff_header(output, block_alignment) == -1) {
             return -1;
         }
-    } else if (wav_type == WAV_TYPE_RF64) {
-        if (write_rf64_header(block_alignment) == -1) {
+    } else if (output->wav_type == WAV_TYPE_RF64) {
+        if (write_rf64_header(output, block_alignment) == -1) {
             return -1;
         }
     }
 
-    uint32_t gain_A = sdrplay_get_current_gain(0) * 1000 + 0.5;
-    uint32_t gain_B = is_dual_tuner ? sdrplay_get_current_gain(1) * 1000 + 0.5 : 0;
-
-    struct AuxiChunk auxi_chunk = {
-        .chunkId = {'a', 'u', 'x',  'i'},
-        .chunkSize = sizeof(struct AuxiChunk) - sizeof(char[4]) - sizeof(uint32_t),
-        .startTime = {0, 0, 0, 0, 0, 0, 0, 0},   /* to be filled at the end */
-        .stopTime = {0, 0, 0, 0, 0, 0, 0, 0},    /* to be filled at the end */
-        .centerFreq = (uint32_t) frequency_A,
-        .adFrequency = 0,
-        .ifFrequency = 0,
-        .bandwidth = 0,
-        .iqOffset = 0,
-        .dbOffset = 0xe49b72a9,    /* same value as in SDRuno */
-        .maxVal = 0,
-        .unused4 = gain_A,
-        .unused5 = gain_B
-    };
-
-    if (write(outputfd, &auxi_chunk, sizeof(auxi_chunk)) == -1) {
+    if (write_auxi_chunk(output) == -1) {
         return -1;
     }
 
-    if (write_data_header() == -1) {
+    if (write_data_header(output) == -1) {
         return -1;
     }
 
     return 0;
 }
 
-int write_sdrconnect_header() {
-    wav_type = estimate_data_size() < MAX_RIFF_SIZE ? WAV_TYPE_RIFF : WAV_TYPE_RF64;
+int write_sdrconnect_header(OutputFile *output) {
+    output->wav_type = estimate_data_size(output->num_channels / 2) < MAX_RIFF_SIZE ? WAV_TYPE_RIFF : WAV_TYPE_RF64;
+    if (events_chunk_enable) {
+        output->wav_type = WAV_TYPE_RF64;
+    }
 
     uint16_t block_alignment = 2 * sizeof(short);
-    if (wav_type == WAV_TYPE_RIFF) {
-        if (write_riff_header(block_alignment) == -1) {
+    if (output->wav_type == WAV_TYPE_RIFF) {
+        if (write_riff_header(output, block_alignment) == -1) {
             return -1;
         }
-    } else if (wav_type == WAV_TYPE_RF64) {
-        if (write_rf64_header(block_alignment) == -1) {
+    } else if (output->wav_type == WAV_TYPE_RF64) {
+        if (write_rf64_header(output, block_alignment) == -1) {
             return -1;
         }
     }
 
-    if (write_data_header() == -1) {
+    if (write_data_header(output) == -1) {
         return -1;
     }
 
     return 0;
 }
 
-int write_experimental_header() {
-    wav_type = estimate_data_size() < MAX_RIFF_SIZE ? WAV_TYPE_RIFF : WAV_TYPE_RF64;
-    int max_num_markers = timeinfo.markers_max_idx;
-    if (max_num_markers > 0) {
-        wav_type = WAV_TYPE_RF64;
+int write_experimental_header(OutputFile *output) {
+    output->wav_type = estimate_data_size(output->num_channels / 2) < MAX_RIFF_SIZE ? WAV_TYPE_RIFF : WAV_TYPE_RF64;
+    if (timeinfo.markers_first != NULL || events_chunk_enable) {
+        output->wav_type = WAV_TYPE_RF64;
     }
 
     uint16_t block_alignment = 2 * 2 * sizeof(short);
-    if (wav_type == WAV_TYPE_RIFF) {
-        if (write_riff_header(block_alignment) == -1) {
+    if (output->wav_type == WAV_TYPE_RIFF) {
+        if (write_riff_header(output, block_alignment) == -1) {
             return -1;
         }
-    } else if (wav_type == WAV_TYPE_RF64) {
-        if (write_rf64_header(block_alignment) == -1) {
+    } else if (output->wav_type == WAV_TYPE_RF64) {
+        if (write_rf64_header(output, block_alignment) == -1) {
             return -1;
         }
     }
 
-    if (max_num_markers > 0) {
-        int chunk_size = max_num_markers * sizeof(struct MarkerEntry);
-        struct MarkerChunk marker_chunk = {
-            .chunkId = {'r', '6', '4', 'm'},
-            .chunkSize = chunk_size
-        };
-        struct MarkerEntry empty_marker;
-        memset(&empty_marker, 0, sizeof(empty_marker));
+    /* the events and the time markers are written in the 'rspe' and
+     * 'r64m' chunks after the data chunk when the file is finalized
+     */
+    if (write_data_header(output) == -1) {
+        return -1;
+    }
 
-        if (write(outputfd, &marker_chunk, sizeof(marker_chunk)) == -1) {
-            return -1;
-        }
-        for (int i = 0; i < max_num_markers; i++) {
-            if (write(outputfd, &empty_marker, sizeof(empty_marker)) == -1) {
-                return -1;
-            }
-        }
+    return 0;
+}
+
+int finalize_sdruno_file(OutputFile *output) {
+    return update_sdruno_header(output, &timeinfo.stop_ts, true);
+}
+
+int finalize_sdrconnect_file(OutputFile *output) {
+    return update_sdrconnect_header(output, true);
+}
+
+int finalize_experimental_file(OutputFile *output) {
+    return update_experimental_header(output, true);
+}
+
+/* rewrite the sizes (and the stop time) in the header of a file that is
+ * still being written, so it can be read as is in case of a crash
+ */
+int checkpoint_wav_file(OutputFile *output) {
+    int status = 0;
+    if (output_type == OUTPUT_TYPE_SDRUNO) {
+        struct timespec now;
+        clock_gettime(CLOCK_REALTIME, &now);
+        status = update_sdruno_header(output, &now, false);
+    } else if (output_type == OUTPUT_TYPE_SDRCONNECT) {
+        status = update_sdrconnect_header(output, false);
+    } else if (output_type == OUTPUT_TYPE_EXPERIMENTAL) {
+        status = update_experimental_header(output, false);
     }
+    return status;
+}
 
-    if (write_data_header() == -1) {
+/* plain 16 bit PCM WAV file, without any metadata chunk (triggered
+ * recordings)
+ */
+int write_plain_wav_header(OutputFile *output) {
+    output->wav_type = WAV_TYPE_RIFF;
+    if (write_riff_header(output, output->num_channels * sizeof(short)) == -1) {
+        return -1;
+    }
+    if (write_data_header(output) == -1) {
         return -1;
     }
+    return 0;
+}
 
+/* RIFF file with just the SDRuno auxi chunk (center frequency, start and
+ * stop time) as metadata; used for the DDC and channelizer outputs
+ */
+int write_auxi_wav_header(OutputFile *output) {
+    output->wav_type = WAV_TYPE_RIFF;
+    if (write_riff_header(output, output->num_channels * sizeof(short)) == -1) {
+        return -1;
+    }
+    if (write_auxi_chunk(output) == -1) {
+        return -1;
+    }
+    if (write_data_header(output) == -1) {
+        return -1;
+    }
     return 0;
 }
 
-int finalize_sdruno_file() {
+int finalize_auxi_wav_file(OutputFile *output) {
+    if (output->stats->data_size > MAX_RIFF_SIZE) {
+        fprintf(stderr, "warning: %s is too large for a RIFF file - the sizes in the header are not valid\n", output->filename);
+    }
+    return update_sdruno_header(output, &timeinfo.stop_ts, true);
+}
+
+int finalize_plain_wav_file(OutputFile *output) {
+    if (output->stats->data_size > MAX_RIFF_SIZE) {
+        fprintf(stderr, "warning: %s is too large for a RIFF file - the sizes in the header are not valid\n", output->filename);
+    }
+    off_t data_chunk_offset = sizeof(struct RIFFChunk) + sizeof(struct FormatChunk);
+    uint32_t riff_size = data_chunk_offset + sizeof(struct DataChunk) + output->stats->data_size - sizeof(char[4]) - sizeof(uint32_t);
+    return finalize_riff_file(output, data_chunk_offset, riff_size);
+}
+
+/* internal functions */
+static int update_sdruno_header(OutputFile *output, const struct timespec *stop_ts, bool is_final) {
     off_t data_chunk_offset = 0;
-    if (wav_type == WAV_TYPE_RIFF) {
+    if (output->wav_type == WAV_TYPE_RIFF) {
         data_chunk_offset = sizeof(struct RIFFChunk) +
                             sizeof(struct FormatChunk) +
                             sizeof(struct AuxiChunk);
@@ -263,32 +330,39 @@ int finalize_sdruno_file() {
                                         sizeof(struct FormatChunk) +
                                         sizeof(struct AuxiChunk) +
                                         sizeof(struct DataChunk) +
-                                        stats.data_size);
-        if (finalize_riff_file(data_chunk_offset, riff_size) == -1) {
+                                        output->stats->data_size);
+        if (finalize_riff_file(output, data_chunk_offset, riff_size) == -1) {
             return -1;
         }
-    } else if (wav_type == WAV_TYPE_RF64) {
+    } else if (output->wav_type == WAV_TYPE_RF64) {
         data_chunk_offset = sizeof(struct RF64Chunk) +
-                            sizeof(struct DataSize64Chunk) +
+                            ds64_chunk_size() +
                             sizeof(struct FormatChunk) +
                             sizeof(struct AuxiChunk);
+        unsigned long long num_records = events_chunk_num_records(output, is_final);
+        unsigned long long events_size = 0;
+        if (num_records > 0) {
+            events_size = sizeof(struct EventsChunk) + num_records * sizeof(EventRecord);
+            off_t offset = data_chunk_offset + sizeof(struct DataChunk) + output->stats->data_size;
+            if (write_events_chunk(output, offset, num_records) == -1) {
+                return -1;
+            }
+        }
         unsigned long long riff_size = sizeof(char[4]) +
-                                       sizeof(struct DataSize64Chunk) +
+                                       ds64_chunk_size() +
                                        sizeof(struct FormatChunk) +
                                        sizeof(struct AuxiChunk) +
                                        sizeof(struct DataChunk) +
-                                       stats.data_size;
-        if (finalize_rf64_file(riff_size) == -1) {
+                                       output->stats->data_size +
+                                       events_size;
+        if (finalize_rf64_file(output, riff_size, events_size) == -1) {
             return -1;
         }
     }
 
     // set startTime and stopTime in auxi chunk
     off_t auxi_chunk_offset = data_chunk_offset - sizeof(struct AuxiChunk);
-    if (lseek(outputfd, auxi_chunk_offset + sizeof(char[4]) + sizeof(uint32_t), SEEK_SET) == -1) {
-        fprintf(stderr, "lseek(auxi chunk startTime) failed: %s\n", strerror(errno));
-        return -1;
-    }
+    off_t offset = auxi_chunk_offset + sizeof(char[4]) + sizeof(uint32_t);
     struct tm *startTime_tm = gmtime(&timeinfo.start_ts.tv_sec);
     struct SystemTime startTime = {
         .year = 1900 + startTime_tm->tm_year,
@@ -300,10 +374,11 @@ int finalize_sdruno_file() {
         .second = startTime_tm->tm_sec,
         .milliseconds = timeinfo.start_ts.tv_nsec * 1e-6 + 0.5
     };
-    if (write(outputfd, &startTime, sizeof(startTime)) == -1) {
+    if (write_at(output, &startTime, sizeof(startTime), offset) == -1) {
         return -1;
     }
-    struct tm *stopTime_tm = gmtime(&timeinfo.stop_ts.tv_sec);
+    offset += sizeof(startTime);
+    struct tm *stopTime_tm = gmtime(&stop_ts->tv_sec);
     struct SystemTime stopTime = {
         .year = 1900 + stopTime_tm->tm_year,
         .month = stopTime_tm->tm_mon + 1,
@@ -312,29 +387,45 @@ int finalize_sdruno_file() {
         .hour = stopTime_tm->tm_hour,
         .minute = stopTime_tm->tm_min,
         .second = stopTime_tm->tm_sec,
-        .milliseconds = timeinfo.stop_ts.tv_nsec * 1e-6 + 0.5
+        .milliseconds = stop_ts->tv_nsec * 1e-6 + 0.5
     };
-    if (write(outputfd, &stopTime, sizeof(stopTime)) == -1) {
+    if (write_at(output, &stopTime, sizeof(stopTime), offset) == -1) {
         return -1;
     }
 
     return 0;
 }
 
-int finalize_sdrconnect_file() {
+static int update_sdrconnect_header(OutputFile *output, bool is_final) {
     off_t data_chunk_offset = 0;
-    if (wav_type == WAV_TYPE_RIFF) {
+    if (output->wav_type == WAV_TYPE_RIFF) {
         data_chunk_offset = sizeof(struct RIFFChunk) +
                             sizeof(struct FormatChunk);
         // it's magic - SDRconnect RIFF is always 36 bytes less than data size
-        uint32_t riff_size = (uint32_t)(stats.data_size - 36);
-        if (finalize_riff_file(data_chunk_offset, riff_size) == -1) {
+        uint32_t riff_size = (uint32_t)(output->stats->data_size - 36);
+        if (finalize_riff_file(output, data_chunk_offset, riff_size) == -1) {
             return -1;
         }
-    } else if (wav_type == WAV_TYPE_RF64) {
+    } else if (output->wav_type == WAV_TYPE_RF64) {
         // it's magic - SDRconnect RIFF is always 36 bytes more than data size
-        unsigned long long riff_size = stats.data_size + 36;
-        if (finalize_rf64_file(riff_size) == -1) {
+        // (plus the ds64 table and the events chunk, if enabled)
+        unsigned long long num_records = events_chunk_num_records(output, is_final);
+        unsigned long long events_size = 0;
+        if (num_records > 0) {
+            events_size = sizeof(struct EventsChunk) + num_records * sizeof(EventRecord);
+            off_t offset = sizeof(struct RF64Chunk) +
+                           ds64_chunk_size() +
+                           sizeof(struct FormatChunk) +
+                           sizeof(struct DataChunk) +
+                           output->stats->data_size;
+            if (write_events_chunk(output, offset, num_records) == -1) {
+                return -1;
+            }
+        }
+        unsigned long long riff_size = output->stats->data_size + 36 +
+                                       (ds64_chunk_size() - sizeof(struct DataSize64Chunk)) +
+                                       events_size;
+        if (finalize_rf64_file(output, riff_size, events_size) == -1) {
             return -1;
         }
     }
@@ -342,54 +433,103 @@ int finalize_sdrconnect_file() {
     return 0;
 }
 
-int finalize_experimental_file() {
-    int max_num_markers = timeinfo.markers_max_idx;
+static int update_experimental_header(OutputFile *output, bool is_final) {
+    /* the 'r64m' chunk size is only 32 bit */
+    unsigned long long num_markers = is_final ? timeinfo.num_markers : 0;
+    unsigned long long max_num_markers = (0xffffffffULL - sizeof(struct MarkerChunk)) / sizeof(struct MarkerEntry);
+    if (num_markers > max_num_markers) {
+        fprintf(stderr, "warning: too many time markers - only the first %llu markers will be saved\n", max_num_markers);
+        num_markers = max_num_markers;
+    }
     off_t markers_size = 0;
-    if (max_num_markers > 0) {
+    if (num_markers > 0) {
         markers_size = sizeof(struct MarkerChunk) +
-                       max_num_markers * sizeof(struct MarkerEntry);
+                       num_markers * sizeof(struct MarkerEntry);
+    }
+    unsigned long long num_records = events_chunk_num_records(output, is_final);
+    off_t events_size = 0;
+    if (num_records > 0) {
+        events_size = sizeof(struct EventsChunk) + num_records * sizeof(EventRecord);
     }
 
     off_t data_chunk_offset = 0;
-    if (wav_type == WAV_TYPE_RIFF) {
+    if (output->wav_type == WAV_TYPE_RIFF) {
         data_chunk_offset = sizeof(struct RIFFChunk) +
-                            sizeof(struct FormatChunk) +
-                            markers_size;
+                            sizeof(struct FormatChunk);
+    } else if (output->wav_type == WAV_TYPE_RF64) {
+        data_chunk_offset = sizeof(struct RF64Chunk) +
+                            ds64_chunk_size() +
+                            sizeof(struct FormatChunk);
+    }
+
+    // write events and time markers after the data chunk
+    off_t offset = data_chunk_offset + sizeof(struct DataChunk) + output->stats->data_size;
+    if (num_records > 0) {
+        if (write_events_chunk(output, offset, num_records) == -1) {
+            return -1;
+        }
+        offset += events_size;
+    }
+    if (num_markers > 0) {
+        if (write_markers_chunk(output, offset, num_markers) == -1) {
+            return -1;
+        }
+    }
+
+    if (output->wav_type == WAV_TYPE_RIFF) {
         uint32_t riff_size = (uint32_t)(sizeof(char[4]) +
                                         sizeof(struct FormatChunk) +
                                         sizeof(struct DataChunk) +
-                                        stats.data_size);
-        if (finalize_riff_file(data_chunk_offset, riff_size) == -1) {
+                                        output->stats->data_size +
+                                        markers_size);
+        if (finalize_riff_file(output, data_chunk_offset, riff_size) == -1) {
             return -1;
         }
-    } else if (wav_type == WAV_TYPE_RF64) {
+    } else if (output->wav_type == WAV_TYPE_RF64) {
         unsigned long long riff_size = sizeof(char[4]) +
-                                       sizeof(struct DataSize64Chunk) +
+                                       ds64_chunk_size() +
                                        sizeof(struct FormatChunk) +
-                                       markers_size +
                                        sizeof(struct DataChunk) +
-                                       stats.data_size;
-        if (finalize_rf64_file(riff_size) == -1) {
+                                       output->stats->data_size +
+                                       events_size +
+                                       markers_size;
+        if (finalize_rf64_file(output, riff_size, events_size) == -1) {
             return -1;
         }
     }
 
-    // write time markers
-    if (max_num_markers > 0) {
-        off_t offset = data_chunk_offset - markers_size + sizeof(struct MarkerChunk);
-        if (lseek(outputfd, offset, SEEK_SET) == -1) {
-            fprintf(stderr, "lseek(marker chunk entries) failed: %s\n", strerror(errno));
-            return -1;
-        }
-        int num_markers = timeinfo.markers_curr_idx;
-        for (int i = 0; i < num_markers; i++) {
-            TimeMarker *marker = &timeinfo.markers[i];
-            struct MarkerEntry marker_entry = {
+    return 0;
+}
+
+/* write the 'r64m' chunk, one arena chunk of time markers at a time */
+static int write_markers_chunk(OutputFile *output, off_t offset, unsigned long long num_markers) {
+    struct MarkerChunk marker_chunk = {
+        .chunkId = {'r', '6', '4', 'm'},
+        .chunkSize = num_markers * sizeof(struct MarkerEntry)
+    };
+    if (write_at(output, &marker_chunk, sizeof(marker_chunk), offset) == -1) {
+        return -1;
+    }
+    offset += sizeof(marker_chunk);
+
+    struct MarkerEntry *marker_entries = (struct MarkerEntry *)malloc(TIME_MARKERS_CHUNK_SIZE * sizeof(struct MarkerEntry));
+    if (marker_entries == NULL) {
+        fprintf(stderr, "malloc(marker entries) failed\n");
+        return -1;
+    }
+    unsigned int frame_size = output->num_channels * sizeof(short);
+    unsigned long long markers_left = num_markers;
+    for (TimeMarkersChunk *markers_chunk = timeinfo.markers_first; markers_chunk != NULL && markers_left > 0; markers_chunk = markers_chunk->next) {
+        unsigned int n = markers_chunk->num_markers < markers_left ? markers_chunk->num_markers : markers_left;
+        for (unsigned int i = 0; i < n; i++) {
+            TimeMarker *marker = &markers_chunk->markers[i];
+            unsigned long long byte_offset = marker->sample_num * frame_size;
+            marker_entries[i] = (struct MarkerEntry) {
                 .flags = 0x1,
                 .sampleOffsetLow = marker->sample_num & 0xffffffff,
                 .sampleOffsetHigh = marker->sample_num >> 32,
-                .byteOffsetLow = 0,
-                .byteOffsetHigh = 0,
+                .byteOffsetLow = byte_offset & 0xffffffff,
+                .byteOffsetHigh = byte_offset >> 32,
                 .intraSmplOffsetHigh = 0,
                 .intraSmplOffsetLow = 0,
                 .labelText = {0},
@@ -403,50 +543,122 @@ int finalize_experimental_file() {
             struct tm *tm = gmtime(&marker->ts.tv_sec);
             char buffer[20];
             /* build ISO8601/RFC3339 timestamp */
-            strftime(buffer, sizeof(buffer), "%Y-%m-%dT%H%M:%S", tm);
-            snprintf(marker_entry.labelText, 256, "%s.%09luZ", buffer, marker->ts.tv_nsec);
-            if (write(outputfd, &marker_entry, sizeof(marker_entry)) == -1) {
-                return -1;
+            strftime(buffer, sizeof(buffer), "%Y-%m-%dT%H:%M:%S", tm);
+            snprintf(marker_entries[i].labelText, 256, "%s.%09luZ", buffer, marker->ts.tv_nsec);
+        }
+        if (write_at(output, marker_entries, n * sizeof(struct MarkerEntry), offset) == -1) {
+            free(marker_entries);
+            return -1;
+        }
+        offset += n * sizeof(struct MarkerEntry);
+        markers_left -= n;
+    }
+    free(marker_entries);
+
+    return 0;
+}
+
+/* number of event records to write in the 'rspe' chunk (only when the
+ * file is finalized; with one file per tuner, only the events of its tuner)
+ */
+static unsigned long long events_chunk_num_records(const OutputFile *output, bool is_final) {
+    if (!is_final || event_records.first == NULL || output->wav_type != WAV_TYPE_RF64) {
+        return 0;
+    }
+    unsigned long long num_records = 0;
+    for (EventRecordsChunk *records_chunk = event_records.first; records_chunk != NULL; records_chunk = records_chunk->next) {
+        for (unsigned int i = 0; i < records_chunk->num_records; i++) {
+            if (output->tuner == -1 || records_chunk->records[i].tuner == output->tuner) {
+                num_records++;
+            }
+        }
+    }
+    if (event_records.records_lost > 0) {
+        fprintf(stderr, "warning: %llu events lost (out of memory)\n", event_records.records_lost);
+    }
+    /* the 'rspe' chunk size is only 32 bit */
+    unsigned long long max_num_records = (0xffffffffULL - sizeof(struct EventsChunk)) / sizeof(EventRecord);
+    if (num_records > max_num_records) {
+        fprintf(stderr, "warning: too many events - only the first %llu events will be saved\n", max_num_records);
+        num_records = max_num_records;
+    }
+    return num_records;
+}
+
+/* write the 'rspe' chunk, one arena chunk of events at a time */
+static int write_events_chunk(OutputFile *output, off_t offset, unsigned long long num_records) {
+    struct EventsChunk events_chunk = {
+        .chunkId = {'r', 's', 'p', 'e'},
+        .chunkSize = num_records * sizeof(EventRecord)
+    };
+    if (write_at(output, &events_chunk, sizeof(events_chunk), offset) == -1) {
+        return -1;
+    }
+    offset += sizeof(events_chunk);
+
+    EventRecord *records = (EventRecord *)malloc(EVENT_RECORDS_CHUNK_SIZE * sizeof(EventRecord));
+    if (records == NULL) {
+        fprintf(stderr, "malloc(event records) failed\n");
+        return -1;
+    }
+    unsigned long long records_left = num_records;
+    for (EventRecordsChunk *records_chunk = event_records.first; records_chunk != NULL && records_left > 0; records_chunk = records_chunk->next) {
+        unsigned int n = 0;
+        for (unsigned int i = 0; i < records_chunk->num_records && n < records_left; i++) {
+            if (output->tuner == -1 || records_chunk->records[i].tuner == output->tuner) {
+                records[n++] = records_chunk->records[i];
             }
         }
+        if (write_at(output, records, n * sizeof(EventRecord), offset) == -1) {
+            free(records);
+            return -1;
+        }
+        offset += n * sizeof(EventRecord);
+        records_left -= n;
     }
+    free(records);
 
     return 0;
 }
 
-/* internal functions */
-static int write_riff_header(uint16_t block_alignment) {
+/* with the events chunk, the ds64 chunk has a table with one entry */
+static off_t ds64_chunk_size() {
+    return sizeof(struct DataSize64Chunk) + (events_chunk_enable ? sizeof(struct ChunkSize64) : 0);
+}
+
+static int write_riff_header(OutputFile *output, uint16_t block_alignment) {
     struct RIFFChunk riff_chunk = {
         .chunkId = {'R', 'I', 'F', 'F'},
         .chunkSize = 0,
         .riffType = {'W', 'A', 'V', 'E'}
     };
 
-    uint16_t channelCount = is_dual_tuner ? 4 : 2;
-    uint32_t bytesPerSecond = output_sample_rate * channelCount * sizeof(short);
+    uint16_t channelCount = output->num_channels;
+    double sample_rate = output->sample_rate > 0.0 ? output->sample_rate : output_sample_rate;
+    uint32_t bytesPerSecond = sample_rate * channelCount * sizeof(short);
 
     struct FormatChunk fmt_chunk = {
         .chunkId = {'f', 'm', 't', ' '},
         .chunkSize = sizeof(struct FormatChunk) - sizeof(char[4]) - sizeof(uint32_t),
         .formatType = WAVE_FORMAT_PCM,
         .channelCount = channelCount,
-        .sampleRate = output_sample_rate,
+        .sampleRate = sample_rate,
         .bytesPerSecond = bytesPerSecond,
         .blockAlignment = block_alignment,
         .bitsPerSample = 16
     };
 
-    if (write(outputfd, &riff_chunk, sizeof(riff_chunk)) == -1) {
+    if (write(output->fd, &riff_chunk, sizeof(riff_chunk)) == -1) {
         return -1;
     }
-    if (write(outputfd, &fmt_chunk, sizeof(fmt_chunk)) == -1) {
+    if (write(output->fd, &fmt_chunk, sizeof(fmt_chunk)) == -1) {
         return -1;
     }
 
     return 0;
 }
 
-static int write_rf64_header(uint16_t block_alignment) {
+static int write_rf64_header(OutputFile *output, uint16_t block_alignment) {
     struct RF64Chunk rf64_chunk = {
         .chunkId = {'R', 'F', '6', '4'},
         .chunkSize = 0xffffffff,
@@ -455,41 +667,53 @@ static int write_rf64_header(uint16_t block_alignment) {
 
     struct DataSize64Chunk ds64_chunk = {
         .chunkId = {'d', 's', '6', '4'},
-        .chunkSize = sizeof(struct DataSize64Chunk) - sizeof(char[4]) - sizeof(uint32_t),
+        .chunkSize = ds64_chunk_size() - sizeof(char[4]) - sizeof(uint32_t),
+        .tableLength = events_chunk_enable ? 1 : 0
+    };
+    struct ChunkSize64 events_chunk_size = {
+        .chunkId = {'r', 's', 'p', 'e'},
+        .chunkSizeLow = 0,      /* to be filled at the end */
+        .chunkSizeHigh = 0
     };
 
-    uint16_t channelCount = is_dual_tuner ? 4 : 2;
-    uint32_t bytesPerSecond = output_sample_rate * channelCount * sizeof(short);
+    uint16_t channelCount = output->num_channels;
+    double sample_rate = output->sample_rate > 0.0 ? output->sample_rate : output_sample_rate;
+    uint32_t bytesPerSecond = sample_rate * channelCount * sizeof(short);
 
     struct FormatChunk fmt_chunk = {
         .chunkId = {'f', 'm', 't', ' '},
         .chunkSize = sizeof(struct FormatChunk) - sizeof(char[4]) - sizeof(uint32_t),
         .formatType = WAVE_FORMAT_PCM,
         .channelCount = channelCount,
-        .sampleRate = output_sample_rate,
+        .sampleRate = sample_rate,
         .bytesPerSecond = bytesPerSecond,
         .blockAlignment = block_alignment,
         .bitsPerSample = 16
     };
 
-    if (write(outputfd, &rf64_chunk, sizeof(rf64_chunk)) == -1) {
+    if (write(output->fd, &rf64_chunk, sizeof(rf64_chunk)) == -1) {
         return -1;
     }
-    if (write(outputfd, &ds64_chunk, sizeof(ds64_chunk)) == -1) {
+    if (write(output->fd, &ds64_chunk, sizeof(ds64_chunk)) == -1) {
         return -1;
     }
-    if (write(outputfd, &fmt_chunk, sizeof(fmt_chunk)) == -1) {
+    if (events_chunk_enable) {
+        if (write(output->fd, &events_chunk_size, sizeof(events_chunk_size)) == -1) {
+            return -1;
+        }
+    }
+    if (write(output->fd, &fmt_chunk, sizeof(fmt_chunk)) == -1) {
         return -1;
     }
 
     return 0;
 }
 
-static int write_data_header() {
+static int write_data_header(OutputFile *output) {
     uint32_t chunk_size = 0;
-    if (wav_type == WAV_TYPE_RIFF) {
+    if (output->wav_type == WAV_TYPE_RIFF) {
         chunk_size = 0;
-    } else if (wav_type == WAV_TYPE_RF64) {
+    } else if (output->wav_type == WAV_TYPE_RF64) {
         chunk_size = 0xffffffff;
     }
 
@@ -498,58 +722,117 @@ static int write_data_header() {
         .chunkSize = chunk_size
     };
 
-    if (write(outputfd, &data_chunk, sizeof(data_chunk)) == -1) {
+    if (write(output->fd, &data_chunk, sizeof(data_chunk)) == -1) {
         return -1;
     }
 
     return 0;
 }
 
-static int finalize_riff_file(off_t data_chunk_offset, uint32_t riff_size) {
-    // fix data chunk size
-    if (lseek(outputfd, data_chunk_offset + sizeof(char[4]), SEEK_SET) == -1) {
-        fprintf(stderr, "lseek(data chunk size) failed: %s\n", strerror(errno));
+static int write_auxi_chunk(OutputFile *output) {
+    /* with one file per tuner, each file stores the gain of its own tuner */
+    uint32_t gain_A = sdrplay_get_current_gain(output->tuner == 1 ? 1 : 0) * 1000 + 0.5;
+    uint32_t gain_B = output->num_channels > 2 ? sdrplay_get_current_gain(1) * 1000 + 0.5 : 0;
+
+    struct AuxiChunk auxi_chunk = {
+        .chunkId = {'a', 'u', 'x',  'i'},
+        .chunkSize = sizeof(struct AuxiChunk) - sizeof(char[4]) - sizeof(uint32_t),
+        .startTime = {0, 0, 0, 0, 0, 0, 0, 0},   /* to be filled at the end */
+        .stopTime = {0, 0, 0, 0, 0, 0, 0, 0},    /* to be filled at the end */
+        .centerFreq = (uint32_t) output->frequency,
+        .adFrequency = 0,
+        .ifFrequency = 0,
+        .bandwidth = 0,
+        .iqOffset = 0,
+        .dbOffset = 0xe49b72a9,    /* same value as in SDRuno */
+        .maxVal = 0,
+        .unused4 = gain_A,
+        .unused5 = gain_B
+    };
+
+    if (write(output->fd, &auxi_chunk, sizeof(auxi_chunk)) == -1) {
         return -1;
     }
-    uint32_t data_size_int = (uint32_t)stats.data_size;
-    if (write(outputfd, &data_size_int, sizeof(data_size_int)) == -1) {
+    return 0;
+}
+
+static int finalize_riff_file(OutputFile *output, off_t data_chunk_offset, uint32_t riff_size) {
+    // fix data chunk size
+    uint32_t data_size_int = (uint32_t)output->stats->data_size;
+    if (write_at(output, &data_size_int, sizeof(data_size_int), data_chunk_offset + sizeof(char[4])) == -1) {
         return -1;
     }
 
     // fix RIFF chunk size
-    if (lseek(outputfd, sizeof(char[4]), SEEK_SET) == -1) {
-        fprintf(stderr, "lseek(RIFF chunk size) failed: %s\n", strerror(errno));
-        return -1;
-    }
-    if (write(outputfd, &riff_size, sizeof(riff_size)) == -1) {
+    if (write_at(output, &riff_size, sizeof(riff_size), sizeof(char[4])) == -1) {
         return -1;
     }
 
     return 0;
 }
 
-static int finalize_rf64_file(unsigned long long riff_size) {
+static int finalize_rf64_file(OutputFile *output, unsigned long long riff_size, unsigned long long events_size) {
     // insert the RIFF size, 'data' chunk size and sample count in the 'ds64' chunk
     struct DataSize64Chunk ds64_chunk = {
         .chunkId = {'d', 's', '6', '4'},
-        .chunkSize = sizeof(struct DataSize64Chunk) - sizeof(char[4]) - sizeof(uint32_t),
+        .chunkSize = ds64_chunk_size() - sizeof(char[4]) - sizeof(uint32_t),
         .riffSizeLow = riff_size & 0xffffffff,
         .riffSizeHigh = riff_size >> 32,
-        .dataSizeLow = stats.data_size & 0xffffffff,
-        .dataSizeHigh = stats.data_size >> 32,
-        .sampleCountLow = stats.output_samples & 0xffffffff,
-        .sampleCountHigh = stats.output_samples >> 32,
-        .tableLength = 0
+        .dataSizeLow = output->stats->data_size & 0xffffffff,
+        .dataSizeHigh = output->stats->data_size >> 32,
+        .sampleCountLow = output->stats->output_samples & 0xffffffff,
+        .sampleCountHigh = output->stats->output_samples >> 32,
+        .tableLength = events_chunk_enable ? 1 : 0
     };
 
     off_t offset = sizeof(struct RF64Chunk);
-    if (lseek(outputfd, offset, SEEK_SET) == -1) {
-        fprintf(stderr, "lseek(ds64 chunk) failed: %s\n", strerror(errno));
+    if (write_at(output, &ds64_chunk, sizeof(ds64_chunk), offset) == -1) {
         return -1;
     }
-    if (write(outputfd, &ds64_chunk, sizeof(ds64_chunk)) == -1) {
-        return -1;
+
+    // the size of the events chunk (without its header) in the ds64 table
+    if (events_chunk_enable) {
+        unsigned long long events_chunk_data_size = events_size > 0 ? events_size - sizeof(struct EventsChunk) : 0;
+        struct ChunkSize64 events_chunk_size = {
+            .chunkId = {'r', 's', 'p', 'e'},
+            .chunkSizeLow = events_chunk_data_size & 0xffffffff,
+            .chunkSizeHigh = events_chunk_data_size >> 32
+        };
+        offset += sizeof(ds64_chunk);
+        if (write_at(output, &events_chunk_size, sizeof(events_chunk_size), offset) == -1) {
+            return -1;
+        }
     }
 
     return 0;
 }
+
+/* write at the given offset without moving the file position,
+ * since the header is also updated while the samples are being written
+ */
+static int write_at(OutputFile *output, const void *buf, size_t count, off_t offset) {
+#ifndef WIN32
+    if (pwrite(output->fd, buf, count, offset) == -1) {
+        return -1;
+    }
+#else
+    /* no pwrite() on Windows - save and restore the file position */
+    off_t position = lseek(output->fd, 0, SEEK_CUR);
+    if (position == -1) {
+        fprintf(stderr, "lseek(current position) failed: %s\n", strerror(errno));
+        return -1;
+    }
+    if (lseek(output->fd, offset, SEEK_SET) == -1) {
+        fprintf(stderr, "lseek(header) failed: %s\n", strerror(errno));
+        return -1;
+    }
+    if (write(output->fd, buf, count) == -1) {
+        return -1;
+    }
+    if (lseek(output->fd, position, SEEK_SET) == -1) {
+        fprintf(stderr, "lseek(restore position) failed: %s\n", strerror(errno));
+        return -1;
+    }
+#endif /* WIN32 */
+    return 0;
+}
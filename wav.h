@@ -9,12 +9,19 @@
 #ifndef _WAV_H
 #define _WAV_H
 
+#include "output.h"
+
 /* public functions */
-int write_sdruno_header();
-int write_sdrconnect_header();
-int write_experimental_header();
-int finalize_sdruno_file();
-int finalize_sdrconnect_file();
-int finalize_experimental_file();
+int write_sdruno_header(OutputFile *output);
+int write_sdrconnect_header(OutputFile *output);
+int write_experimental_header(OutputFile *output);
+int finalize_sdruno_file(OutputFile *output);
+int finalize_sdrconnect_file(OutputFile *output);
+int finalize_experimental_file(OutputFile *output);
+int checkpoint_wav_file(OutputFile *output);
+int write_plain_wav_header(OutputFile *output);
+int finalize_plain_wav_file(OutputFile *output);
+int write_auxi_wav_header(OutputFile *output);
+int finalize_auxi_wav_file(OutputFile *output);
 
 #endif /* _WAV_H */
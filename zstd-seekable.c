@@ -0,0 +1,115 @@
+/* record to file the I/Q stream(s) from a SDRplay RSP
+ * zstd seekable format output
+ *
+ * Copyright 2025 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "zstd-seekable.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <zstd.h>
+
+/* zstd seekable file layout:
+ *   - independent zstd frames, each one with a fixed number of I/Q frames
+ *     (except the last one)
+ *   - seek table in a skippable frame:
+ *       - skippable frame magic (0x184D2A5E) and size (4 bytes each)
+ *       - one entry for each frame: compressed size and decompressed size
+ *         (4 bytes each; no checksums)
+ *       - footer: number of frames (4 bytes), descriptor (1 byte), and
+ *         seekable magic (0x8F92EAB1, 4 bytes)
+ * All the integers are little endian. Since the seek table is a skippable
+ * frame, the whole file can also be decompressed by the regular zstd tools.
+ */
+
+/* internal functions */
+static void write_le32(uint8_t *p, uint32_t value);
+
+
+ZSTD_CCtx *zstd_context_new(int level) {
+    ZSTD_CCtx *cctx = ZSTD_createCCtx();
+    if (cctx == NULL) {
+        fprintf(stderr, "ZSTD_createCCtx() failed\n");
+        return NULL;
+    }
+    size_t ret = ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, level);
+    if (!ZSTD_isError(ret)) {
+        /* each frame carries its own content checksum */
+        ret = ZSTD_CCtx_setParameter(cctx, ZSTD_c_checksumFlag, 1);
+    }
+    if (ZSTD_isError(ret)) {
+        fprintf(stderr, "ZSTD_CCtx_setParameter() failed: %s\n", ZSTD_getErrorName(ret));
+        ZSTD_freeCCtx(cctx);
+        return NULL;
+    }
+    return cctx;
+}
+
+void zstd_context_free(ZSTD_CCtx *cctx) {
+    ZSTD_freeCCtx(cctx);
+}
+
+size_t zstd_max_frame_size(size_t raw_size) {
+    return ZSTD_compressBound(raw_size);
+}
+
+/* returns the size of the compressed frame, or 0 on error */
+size_t zstd_encode_frame(ZSTD_CCtx *cctx, const short *samples, size_t raw_size, uint8_t *out, size_t out_capacity) {
+    size_t ret = ZSTD_compress2(cctx, out, out_capacity, samples, raw_size);
+    if (ZSTD_isError(ret)) {
+        fprintf(stderr, "ZSTD_compress2() failed: %s\n", ZSTD_getErrorName(ret));
+        return 0;
+    }
+    return ret;
+}
+
+int zstd_verify_frame(const uint8_t *frame, size_t frame_size, const short *samples, size_t raw_size, short *verify_samples) {
+    size_t ret = ZSTD_decompress(verify_samples, raw_size, frame, frame_size);
+    if (ZSTD_isError(ret) || ret != raw_size || memcmp(verify_samples, samples, raw_size) != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+int zstd_write_seek_table(OutputFile *output, const CompressedBlockInfo *blocks, size_t num_blocks, int num_channels) {
+    if (num_blocks > UINT32_MAX / 8 - 2) {
+        fprintf(stderr, "too many frames for the zstd seek table\n");
+        return -1;
+    }
+    uint8_t buf[8];
+    uint32_t seek_table_size = num_blocks * 8 + 9;
+    write_le32(buf, ZSTD_SEEKABLE_SKIPPABLE_MAGIC);
+    write_le32(buf + 4, seek_table_size);
+    if (output_write(output, buf, 8) == -1) {
+        fprintf(stderr, "write() zstd seek table failed\n");
+        return -1;
+    }
+    for (size_t i = 0; i < num_blocks; i++) {
+        write_le32(buf, blocks[i].compressed_size);
+        write_le32(buf + 4, blocks[i].num_frames * num_channels * sizeof(short));
+        if (output_write(output, buf, 8) == -1) {
+            fprintf(stderr, "write() zstd seek table failed\n");
+            return -1;
+        }
+    }
+    uint8_t footer[9];
+    write_le32(footer, num_blocks);
+    footer[4] = 0;      /* descriptor: no checksums */
+    write_le32(footer + 5, ZSTD_SEEKABLE_MAGIC);
+    if (output_write(output, footer, sizeof(footer)) == -1) {
+        fprintf(stderr, "write() zstd seek table failed\n");
+        return -1;
+    }
+    return 0;
+}
+
+/* internal functions */
+static void write_le32(uint8_t *p, uint32_t value) {
+    p[0] = value;
+    p[1] = value >> 8;
+    p[2] = value >> 16;
+    p[3] = value >> 24;
+}
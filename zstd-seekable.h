@@ -0,0 +1,33 @@
+/* record to file the I/Q stream(s) from a SDRplay RSP
+ * zstd seekable format output
+ *
+ * Copyright 2025 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef _ZSTD_SEEKABLE_H
+#define _ZSTD_SEEKABLE_H
+
+#include "compressor.h"
+#include "output.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* zstd seekable format (contrib/seekable_format in the zstd sources) */
+#define ZSTD_SEEKABLE_SKIPPABLE_MAGIC 0x184D2A5E
+#define ZSTD_SEEKABLE_MAGIC 0x8F92EAB1
+#define ZSTD_SEEKABLE_MAX_FRAME_SIZE 0x40000000U    /* 1GB */
+
+/* public functions */
+#ifdef HAVE_ZSTD
+struct ZSTD_CCtx_s *zstd_context_new(int level);
+void zstd_context_free(struct ZSTD_CCtx_s *cctx);
+size_t zstd_max_frame_size(size_t raw_size);
+size_t zstd_encode_frame(struct ZSTD_CCtx_s *cctx, const short *samples, size_t raw_size, uint8_t *out, size_t out_capacity);
+int zstd_verify_frame(const uint8_t *frame, size_t frame_size, const short *samples, size_t raw_size, short *verify_samples);
+int zstd_write_seek_table(OutputFile *output, const CompressedBlockInfo *blocks, size_t num_blocks, int num_channels);
+#endif /* HAVE_ZSTD */
+
+#endif /* _ZSTD_SEEKABLE_H */